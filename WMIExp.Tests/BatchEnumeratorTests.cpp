@@ -0,0 +1,129 @@
+#include "FakeWmi.h"
+#include "TestRunner.h"
+#include "../WMIExp/BatchEnumerator.h"
+#include <thread>
+
+namespace {
+	ULONG Drain(BatchEnumerator& enumerator) {
+		ULONG count = 0;
+		enumerator.ForEach([&](auto) { count++; });
+		return count;
+	}
+}
+
+TEST(BatchEnumeratorFixed) {
+	FakeEnum* fake;
+	auto spEnum = FakeEnum::Create({ 1000, 0, 0 }, &fake);
+	{
+		BatchEnumerator enumerator(spEnum, 64);
+		CHECK(Drain(enumerator) == 1000);
+		CHECK(enumerator.IsDone());
+		CHECK(enumerator.GetStats().Objects == 1000);
+		CHECK(SUCCEEDED(enumerator.GetStats().Status));
+		// 15 full batches, then 40 with WBEM_S_FALSE
+		CHECK(fake->GetCalls() == 16);
+		CHECK(enumerator.GetStats().Calls == 16);
+	}
+	CHECK(FakeObject::Live == 0);
+
+	std::vector<CComPtr<IWbemClassObject>> objects;
+	{
+		BatchEnumerator enumerator(FakeEnum::Create({ 100, 0, 0 }), 30);
+		while (enumerator.Next(objects) > 0)
+			;
+	}
+	CHECK(objects.size() == 100);
+	CHECK(FakeObject::Live == 100);
+	objects.clear();
+	CHECK(FakeObject::Live == 0);
+}
+
+TEST(BatchEnumeratorAdaptive) {
+	//
+	// quick calls: the batch doubles up to the maximum
+	//
+	{
+		BatchEnumerator enumerator(FakeEnum::Create({ 20000, 0, 0 }));
+		CHECK(enumerator.IsAdaptive() && enumerator.GetBatchSize() == BatchEnumerator::InitialAdaptiveBatchSize);
+		CHECK(Drain(enumerator) == 20000);
+		CHECK(enumerator.GetBatchSize() == BatchEnumerator::MaxBatchSize);
+	}
+	//
+	// 4 msec an object against a 50 msec target: 16 take too long, 8 do not
+	//
+	{
+		BatchEnumerator enumerator(FakeEnum::Create({ 48, 0, 4000 }));
+		CHECK(Drain(enumerator) == 48);
+		CHECK(enumerator.GetBatchSize() == 8);
+	}
+	CHECK(FakeObject::Live == 0);
+}
+
+TEST(BatchEnumeratorErrors) {
+	{
+		BatchEnumerator enumerator(FakeEnum::Create({ 1000, 0, 0, 100, WBEM_E_ACCESS_DENIED }), 64);
+		CHECK(Drain(enumerator) == 100);
+		CHECK(enumerator.IsDone());
+		CHECK(enumerator.GetLastStatus() == WBEM_E_ACCESS_DENIED);
+		CHECK(enumerator.GetStats().Status == WBEM_E_ACCESS_DENIED);
+	}
+	//
+	// cancelled before the first call, and while waiting on a provider that takes longer than a slice
+	//
+	std::atomic<bool> cancelled{ true };
+	{
+		BatchEnumerator enumerator(FakeEnum::Create({ 10, 0, 0 }), 64);
+		enumerator.SetCancelFlag(&cancelled);
+		CHECK(Drain(enumerator) == 0);
+		CHECK(enumerator.GetStats().Status == WBEM_E_CALL_CANCELLED);
+	}
+	cancelled = false;
+	{
+		FakeEnum* fake;
+		BatchEnumerator enumerator(FakeEnum::Create({ 10, 0, 1000000 }, &fake), 64);
+		enumerator.SetCancelFlag(&cancelled);
+		// the first slice returns nothing, the second finds the flag set
+		std::thread canceller([&] {
+			std::this_thread::sleep_for(std::chrono::milliseconds(BatchEnumerator::SliceMsec / 2));
+			cancelled = true;
+			});
+		CHECK(Drain(enumerator) == 0);
+		canceller.join();
+		CHECK(enumerator.GetStats().Status == WBEM_E_CALL_CANCELLED);
+		CHECK(fake->GetLongestCallUsec() <= BatchEnumerator::SliceMsec * 1000ULL);
+	}
+	CHECK(FakeObject::Live == 0);
+}
+
+//
+// a remote provider: every Next() is a round trip, every object costs a little more. Small fixed
+// batches pay the round trip per handful of objects, large ones hold the caller up for long;
+// the adaptive size should come close to the best fixed one without long calls
+//
+BENCHMARK(BatchSizeFixedVsAdaptive) {
+	struct Provider {
+		char const* Name;
+		FakeEnumOptions Options;
+	};
+	Provider providers[] = {
+		{ "remote, cheap objects", { 5000, 1000, 5 } },
+		{ "local, costly objects", { 2000, 50, 400 } },
+	};
+	for (auto& provider : providers) {
+		printf("  %s: %lu objects, %lu usec a call, %lu usec an object\n", provider.Name,
+			provider.Options.Objects, provider.Options.CallUsec, provider.Options.ObjectUsec);
+		for (ULONG size : { 1u, 16u, 64u, 256u, 1024u, 0u }) {
+			FakeEnum* fake;
+			BatchEnumerator enumerator(FakeEnum::Create(provider.Options, &fake), size);
+			Stopwatch watch;
+			auto first = enumerator.Next().size();
+			auto firstMsec = watch.Elapsed() * 1000;
+			auto count = first + Drain(enumerator);
+			auto elapsed = watch.Elapsed();
+			CHECK(count == provider.Options.Objects);
+			printf("    %-8s %8.1f msec %6lu calls %9.0f objects/sec, first batch %7.2f msec, longest call %7.2f msec\n",
+				size ? std::to_string(size).c_str() : "adaptive", elapsed * 1000, fake->GetCalls(), count / elapsed,
+				firstMsec, fake->GetLongestCallUsec() / 1000.0);
+		}
+	}
+}
@@ -0,0 +1,240 @@
+#include "../WMIExp/pch.h"
+#include "TestRunner.h"
+#include "../WMIExp/CellCache.h"
+
+namespace {
+	enum Column { NameColumn, TypeColumn, ValueColumn, ColumnCount };
+
+	//
+	// a property row of the class list, as the main frame keeps it
+	//
+	struct PropertyRow {
+		std::wstring Name;
+		CComVariant Value;
+		CIMTYPE Type;
+	};
+
+	std::vector<PropertyRow> MakeRows(int count) {
+		std::vector<PropertyRow> rows;
+		for (int i = 0; i < count; i++) {
+			PropertyRow row;
+			row.Name = L"Property" + std::to_wstring(i);
+			switch (i % 6) {
+				case 0: row.Type = CIM_STRING; row.Value = (L"some value " + std::to_wstring(i)).c_str(); break;
+				case 1: row.Type = CIM_UINT32; row.Value.vt = VT_I4; row.Value.lVal = i * 1000; break;
+				case 2: row.Type = CIM_UINT64; row.Value = std::to_wstring(1ULL << 40 | i).c_str(); break;
+				case 3: row.Type = CIM_BOOLEAN; row.Value.vt = VT_BOOL; row.Value.boolVal = i % 4 ? VARIANT_TRUE : VARIANT_FALSE; break;
+				case 4: row.Type = CIM_REAL64; row.Value.vt = VT_R8; row.Value.dblVal = i / 3.0; break;
+				case 5: row.Type = CIM_DATETIME; row.Value.vt = VT_NULL; break;
+			}
+			rows.push_back(std::move(row));
+		}
+		return rows;
+	}
+
+	//
+	// LVN_GETDISPINFO as the main frame answers it now: names are owned by the row,
+	// type names are constants and values are formatted once into the cache
+	//
+	PCWSTR CachedText(CellCache& cells, std::vector<PropertyRow> const& rows, int row, int col) {
+		auto& item = rows[row];
+		switch (col) {
+			case NameColumn: return item.Name.c_str();
+			case TypeColumn: return CellText::CimTypeToText(item.Type);
+		}
+		if (auto text = cells.Find(row, col))
+			return text;
+		auto& text = cells.GetBuffer();
+		CellText::AppendValue(text, item.Value, item.Type);
+		return cells.Add(row, col, text);
+	}
+
+	//
+	// hands CString buffers out from new, so the allocation counter sees them
+	//
+	class CountedStringMgr : public IAtlStringMgr {
+	public:
+		CountedStringMgr() {
+			m_Nil.SetManager(this);
+		}
+
+		CStringData* Allocate(int chars, int charSize) noexcept override {
+			auto data = static_cast<CStringData*>(::operator new(sizeof(CStringData) + (chars + 1) * charSize, std::nothrow));
+			if (data == nullptr)
+				return nullptr;
+			data->pStringMgr = this;
+			data->nRefs = 1;
+			data->nAllocLength = chars;
+			data->nDataLength = 0;
+			return data;
+		}
+		void Free(CStringData* data) noexcept override {
+			::operator delete(data);
+		}
+		CStringData* Reallocate(CStringData* data, int chars, int charSize) noexcept override {
+			auto copy = Allocate(chars, charSize);
+			if (copy == nullptr)
+				return nullptr;
+			memcpy(copy->data(), data->data(), (std::min(data->nAllocLength, chars) + 1) * charSize);
+			copy->nDataLength = data->nDataLength;
+			Free(data);
+			return copy;
+		}
+		CStringData* GetNilString() noexcept override {
+			m_Nil.AddRef();
+			return &m_Nil;
+		}
+		IAtlStringMgr* Clone() noexcept override {
+			return this;
+		}
+
+	private:
+		CNilStringData m_Nil;
+	};
+
+	//
+	// LVN_GETDISPINFO as it was answered before the cache: a CString for every cell and, for values,
+	// a copy of the VARIANT converted to a BSTR. BSTRs come from the OLE allocator, which new does not see,
+	// so they are counted here
+	//
+	CString UncachedText(IAtlStringMgr* mgr, std::vector<PropertyRow> const& rows, int row, int col) {
+		auto& item = rows[row];
+		CString text(mgr);
+		switch (col) {
+			case NameColumn: text = item.Name.c_str(); return text;
+			case TypeColumn: text = CellText::CimTypeToText(item.Type); return text;
+		}
+		CComVariant value(item.Value);
+		if (value.vt == VT_BSTR)
+			TestRunner::Allocations++;
+		if (value.vt == VT_NULL)
+			return text;
+		if (value.vt == VT_BOOL) {
+			text = value.boolVal ? L"True" : L"False";
+			return text;
+		}
+		if (SUCCEEDED(value.ChangeType(VT_BSTR))) {
+			if (item.Value.vt != VT_BSTR)
+				TestRunner::Allocations++;
+			text = value.bstrVal;
+		}
+		return text;
+	}
+}
+
+TEST(CellCacheTexts) {
+	CellCache cells;
+	cells.Reset(3);
+	CHECK(cells.Find(0, 0) == nullptr);
+	CHECK(wcscmp(cells.Add(2, 1, L"two one"), L"two one") == 0);
+	CHECK(cells.Find(2, 0) == nullptr);
+	CHECK(cells.Find(5, 1) == nullptr);
+	cells.Add(0, 0, L"zero zero");
+	cells.Add(0, 1, L"");
+	CHECK(cells.Find(0, 1) && *cells.Find(0, 1) == 0);
+
+	cells.Invalidate(1);
+	CHECK(cells.Find(2, 1) == nullptr && cells.Find(0, 1) == nullptr);
+	CHECK(wcscmp(cells.Find(0, 0), L"zero zero") == 0);
+
+	//
+	// rewriting cells leaves their old text behind until compacted; live text survives
+	//
+	std::wstring big(1000, L'x');
+	for (int i = 0; i < 20; i++)
+		cells.Add(1, 2, big + std::to_wstring(i));
+	CHECK(cells.Find(1, 2) && big + L"19" == cells.Find(1, 2));
+	CHECK(wcscmp(cells.Find(0, 0), L"zero zero") == 0);
+	CHECK(cells.GetMemorySize() < 20 * big.size() * sizeof(WCHAR));
+
+	cells.Reset(2);
+	CHECK(cells.Find(0, 0) == nullptr);
+}
+
+TEST(CellTextFormatting) {
+	CHECK(wcscmp(CellText::CimTypeToText(CIM_UINT32), L"Int (32 bit)") == 0);
+	CHECK(wcscmp(CellText::CimTypeToText(CIM_STRING | CIM_FLAG_ARRAY), L"String [Array]") == 0);
+	CHECK(wcscmp(CellText::CimTypeToText(CIM_REFERENCE), L"Reference") == 0);
+
+	auto format = [](VARIANT const& value, CIMTYPE type) {
+		std::wstring text;
+		CellText::AppendValue(text, value, type);
+		return text;
+	};
+	CComVariant value;
+	value.vt = VT_I4;
+	value.lVal = -42;
+	CHECK(format(value, CIM_SINT32) == L"-42");
+	value.vt = VT_BOOL;
+	value.boolVal = VARIANT_TRUE;
+	CHECK(format(value, CIM_BOOLEAN) == L"True");
+	value.vt = VT_NULL;
+	CHECK(format(value, CIM_STRING).empty());
+	value = L"18446744073709551615";
+	CHECK(format(value, CIM_UINT64) == L"18446744073709551615");
+}
+
+//
+// once a page has been painted, painting it again only finds cached text
+//
+TEST(CellRepaintAllocatesNothing) {
+	auto rows = MakeRows(60);
+	CellCache cells;
+	cells.Reset(ColumnCount);
+	for (int row = 0; row < 40; row++)
+		for (int col = 0; col < ColumnCount; col++)
+			CachedText(cells, rows, row, col);
+
+	size_t chars = 0;
+	auto allocations = TestRunner::Allocations.load();
+	for (int row = 0; row < 40; row++)
+		for (int col = 0; col < ColumnCount; col++)
+			chars += wcslen(CachedText(cells, rows, row, col));
+	CHECK(TestRunner::Allocations == allocations);
+	CHECK(chars > 0);
+}
+
+BENCHMARK(CellAllocations) {
+	const int pageRows = 40, repaints = 1000;
+	auto rows = MakeRows(200);
+	const auto calls = pageRows * ColumnCount;
+	WCHAR buffer[260];
+
+	CountedStringMgr mgr;
+	auto allocations = TestRunner::Allocations.load();
+	Stopwatch before;
+	for (int paint = 0; paint < repaints; paint++) {
+		for (int row = 0; row < pageRows; row++) {
+			for (int col = 0; col < ColumnCount; col++) {
+				auto text = UncachedText(&mgr, rows, row, col);
+				::StringCchCopy(buffer, _countof(buffer), text);
+			}
+		}
+	}
+	auto beforeSec = before.Elapsed();
+	printf("  before: %.2f allocations per LVN_GETDISPINFO, %.3f usec\n",
+		double(TestRunner::Allocations - allocations) / (repaints * calls), beforeSec * 1e6 / (repaints * calls));
+
+	CellCache cells;
+	cells.Reset(ColumnCount);
+	allocations = TestRunner::Allocations.load();
+	Stopwatch first;
+	for (int row = 0; row < pageRows; row++)
+		for (int col = 0; col < ColumnCount; col++)
+			CachedText(cells, rows, row, col);
+	printf("  after, first paint: %.2f allocations per LVN_GETDISPINFO, %.3f usec\n",
+		double(TestRunner::Allocations - allocations) / calls, first.Elapsed() * 1e6 / calls);
+
+	allocations = TestRunner::Allocations.load();
+	Stopwatch after;
+	size_t chars = 0;
+	for (int paint = 0; paint < repaints; paint++)
+		for (int row = 0; row < pageRows; row++)
+			for (int col = 0; col < ColumnCount; col++)
+				chars += *CachedText(cells, rows, row, col) != 0;
+	auto afterSec = after.Elapsed();
+	printf("  after, repaint: %.2f allocations per LVN_GETDISPINFO, %.3f usec (%.0fx faster), cache %zu bytes\n",
+		double(TestRunner::Allocations - allocations) / (repaints * calls), afterSec * 1e6 / (repaints * calls), beforeSec / afterSec,
+		cells.GetMemorySize());
+	CHECK(chars > 0);
+}
@@ -0,0 +1,117 @@
+#include "TestRunner.h"
+#include "../WMIExp/CounterFormula.h"
+#include <cmath>
+#include <vector>
+
+namespace {
+	//
+	// one instance; companions not given stay zero
+	//
+	struct Sample {
+		uint64_t N1, N0, D1{ 0 }, D0{ 0 }, B1{ 0 }, B0{ 0 }, F{ 0 };
+	};
+
+	double Cook(uint32_t type, Sample const& s) {
+		CookInput input{ &s.N1, &s.N0, &s.D1, &s.D0, &s.B1, &s.B0, &s.F };
+		double value = -1;
+		CounterFormula::Cook(CounterFormula::FromType(type), input, &value, 1);
+		return value;
+	}
+
+	bool Near(double value, double expected) {
+		return std::fabs(value - expected) <= 1e-9 * std::fmax(1, std::fabs(expected));
+	}
+}
+
+TEST(FormulaFromType) {
+	CHECK(CounterFormula::FromType(CounterFormula::PerfCounterCounter) == CookFormula::Rate);
+	CHECK(CounterFormula::FromType(CounterFormula::PerfCounterBulkCount) == CookFormula::Rate);
+	CHECK(CounterFormula::FromType(CounterFormula::Perf100NsecTimer) == CookFormula::Timer);
+	CHECK(CounterFormula::FromType(CounterFormula::Perf100NsecTimerInv) == CookFormula::TimerInverse);
+	CHECK(CounterFormula::FromType(CounterFormula::PerfCounterLargeQueueLen) == CookFormula::QueueLength);
+	CHECK(CounterFormula::FromType(CounterFormula::PerfRawFraction) == CookFormula::RawFraction);
+	CHECK(CounterFormula::FromType(CounterFormula::PerfElapsedTime) == CookFormula::Elapsed);
+	CHECK(CounterFormula::FromType(CounterFormula::PerfCounterRawcount) == CookFormula::Raw);
+	CHECK(CounterFormula::FromType(CounterFormula::PerfCounterLargeRawcount) == CookFormula::Raw);
+	CHECK(CounterFormula::FromType(CounterFormula::PerfRawBase) == CookFormula::Hidden);
+	CHECK(CounterFormula::FromType(CounterFormula::PerfCounterText) == CookFormula::Hidden);
+
+	CHECK(CounterFormula::IsPercent(CounterFormula::Perf100NsecTimer));
+	CHECK(CounterFormula::IsPercent(CounterFormula::PerfRawFraction));
+	CHECK(!CounterFormula::IsPercent(CounterFormula::PerfCounterCounter));
+	CHECK(CounterFormula::GetTimeBase(CounterFormula::Perf100NsecTimer) == CookTimeBase::Sys100Ns);
+	CHECK(CounterFormula::GetTimeBase(CounterFormula::PerfCounterObjTimeQueueLen) == CookTimeBase::Object);
+	CHECK(CounterFormula::GetTimeBase(CounterFormula::PerfCounterCounter) == CookTimeBase::PerfTime);
+
+	CHECK(CounterFormula::UsesTime(CookFormula::Rate) && CounterFormula::UsesFrequency(CookFormula::Rate));
+	CHECK(CounterFormula::UsesBase(CookFormula::AverageTimer) && CounterFormula::UsesFrequency(CookFormula::AverageTimer));
+	CHECK(!CounterFormula::UsesTime(CookFormula::RawFraction) && !CounterFormula::UsesBase(CookFormula::Raw));
+}
+
+//
+// raw sample pairs with the values PerfMon shows for them
+//
+TEST(CookKnownPairs) {
+	// 1000 events in half a second of a 10 MHz clock
+	CHECK(Near(Cook(CounterFormula::PerfCounterCounter, { 2000, 1000, 15000000, 10000000, 0, 0, 10000000 }), 2000));
+	// 250 msec busy out of one second
+	CHECK(Near(Cook(CounterFormula::Perf100NsecTimer, { 12500000, 10000000, 30000000, 20000000 }), 25));
+	// 750 msec idle out of one second
+	CHECK(Near(Cook(CounterFormula::Perf100NsecTimerInv, { 17500000, 10000000, 30000000, 20000000 }), 25));
+	// 3 seconds of busy time on 4 processors in one second
+	CHECK(Near(Cook(CounterFormula::Perf100NsecMultiTimer, { 30000000, 0, 10000000, 0, 4 }), 75));
+	// 1 second idle on 4 processors in one second
+	CHECK(Near(Cook(CounterFormula::Perf100NsecMultiTimerInv, { 10000000, 0, 10000000, 0, 4 }), 300));
+	// a queue length sum of 50 over 10 ticks
+	CHECK(Near(Cook(CounterFormula::PerfCounterLargeQueueLen, { 150, 100, 30, 20 }), 5));
+	CHECK(Near(Cook(CounterFormula::PerfRawFraction, { 25, 0, 0, 0, 200 }), 12.5));
+	CHECK(Near(Cook(CounterFormula::PerfSampleFraction, { 13, 10, 0, 0, 24, 20 }), 75));
+	CHECK(Near(Cook(CounterFormula::PerfPrecision100NsTimer, { 105, 100, 0, 0, 220, 200 }), 25));
+	// 2 seconds for 4 operations
+	CHECK(Near(Cook(CounterFormula::PerfAverageTimer, { 20000000, 0, 0, 0, 4, 0, 10000000 }), 0.5));
+	CHECK(Near(Cook(CounterFormula::PerfAverageBulk, { 8192, 4096, 0, 0, 16, 8 }), 512));
+	CHECK(Near(Cook(CounterFormula::PerfCounterDelta, { 150, 100 }), 50));
+	// started at 100 seconds, now 160 seconds
+	CHECK(Near(Cook(CounterFormula::PerfElapsedTime, { 1000000000, 0, 1600000000, 0, 0, 0, 10000000 }), 60));
+	CHECK(Near(Cook(CounterFormula::PerfCounterLargeRawcount, { 42, 7 }), 42));
+}
+
+TEST(CookEdgeCases) {
+	// the counter was reset between the samples
+	CHECK(Cook(CounterFormula::PerfCounterCounter, { 10, 1000, 20, 10, 0, 0, 10 }) == 0);
+	CHECK(Cook(CounterFormula::PerfCounterDelta, { 10, 1000 }) == 0);
+	// no time passed, a zero base or a zero frequency
+	CHECK(Cook(CounterFormula::PerfCounterCounter, { 2000, 1000, 10, 10, 0, 0, 10 }) == 0);
+	CHECK(Cook(CounterFormula::Perf100NsecTimer, { 2000, 1000, 10, 10 }) == 0);
+	CHECK(Cook(CounterFormula::PerfRawFraction, { 5, 0 }) == 0);
+	CHECK(Cook(CounterFormula::PerfAverageTimer, { 10, 0, 0, 0, 4, 0, 0 }) == 0);
+	CHECK(Cook(CounterFormula::PerfElapsedTime, { 100, 0, 200, 0, 0, 0, 0 }) == 0);
+	// more idle than elapsed time
+	CHECK(Cook(CounterFormula::Perf100NsecTimerInv, { 300, 0, 200, 0 }) == 0);
+	// a 64 bit counter that wrapped a little forward still counts
+	CHECK(Near(Cook(CounterFormula::PerfCounterDelta, { 5, UINT64_MAX - 4 }), 10));
+}
+
+BENCHMARK(CookMillionPairs) {
+	const size_t Count = 1000000;
+	std::vector<uint64_t> n1(Count), n0(Count), d1(Count), d0(Count), b1(Count), b0(Count), f(Count, 10000000);
+	for (size_t i = 0; i < Count; i++) {
+		n0[i] = i * 7;
+		n1[i] = n0[i] + i % 1000;
+		d0[i] = i * 11;
+		d1[i] = d0[i] + 10000000;
+		b0[i] = i;
+		b1[i] = i + 1 + i % 8;
+	}
+	CookInput input{ n1.data(), n0.data(), d1.data(), d0.data(), b1.data(), b0.data(), f.data() };
+	std::vector<double> values(Count);
+
+	for (auto type : { CounterFormula::PerfCounterCounter, CounterFormula::Perf100NsecTimer, CounterFormula::Perf100NsecTimerInv,
+		CounterFormula::PerfSampleFraction, CounterFormula::PerfAverageTimer, CounterFormula::PerfCounterLargeRawcount }) {
+		auto formula = CounterFormula::FromType(type);
+		Stopwatch watch;
+		CounterFormula::Cook(formula, input, values.data(), Count);
+		auto elapsed = watch.Elapsed();
+		printf("  formula %2d: %8.2f msec, %7.1f M pairs/sec\n", (int)formula, elapsed * 1000, Count / elapsed / 1e6);
+	}
+}
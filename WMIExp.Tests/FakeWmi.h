@@ -0,0 +1,438 @@
+#pragma once
+
+//
+// in-process stand-ins for WMI objects, for testing the units that talk to WMI
+// without a provider (or a machine) behind them
+//
+#include "../WMIExp/pch.h"
+#include <chrono>
+#include <memory>
+
+//
+// a class object that only counts references; the test checks nothing is leaked.
+// IWbemObjectAccess is there for derived fakes to implement, and is only handed out when they do
+//
+class FakeObject : public IWbemObjectAccess {
+public:
+	static inline std::atomic<int> Live{ 0 };
+
+	static IWbemClassObject* Create() {
+		return new FakeObject;
+	}
+
+	STDMETHOD(QueryInterface)(REFIID riid, void** ppv) override {
+		if (riid == __uuidof(IUnknown) || riid == __uuidof(IWbemClassObject) || (riid == __uuidof(IWbemObjectAccess) && HasAccess())) {
+			AddRef();
+			*ppv = static_cast<IWbemObjectAccess*>(this);
+			return S_OK;
+		}
+		*ppv = nullptr;
+		return E_NOINTERFACE;
+	}
+	STDMETHOD_(ULONG, AddRef)() override {
+		return ++m_Refs;
+	}
+	STDMETHOD_(ULONG, Release)() override {
+		auto refs = --m_Refs;
+		if (refs == 0)
+			delete this;
+		return refs;
+	}
+
+	STDMETHOD(GetQualifierSet)(IWbemQualifierSet**) override { return E_NOTIMPL; }
+	STDMETHOD(Get)(LPCWSTR, long, VARIANT*, CIMTYPE*, long*) override { return WBEM_E_NOT_FOUND; }
+	STDMETHOD(Put)(LPCWSTR, long, VARIANT*, CIMTYPE) override { return E_NOTIMPL; }
+	STDMETHOD(Delete)(LPCWSTR) override { return E_NOTIMPL; }
+	STDMETHOD(GetNames)(LPCWSTR, long, VARIANT*, SAFEARRAY**) override { return E_NOTIMPL; }
+	STDMETHOD(BeginEnumeration)(long) override { return E_NOTIMPL; }
+	STDMETHOD(Next)(long, BSTR*, VARIANT*, CIMTYPE*, long*) override { return E_NOTIMPL; }
+	STDMETHOD(EndEnumeration)() override { return E_NOTIMPL; }
+	STDMETHOD(GetPropertyQualifierSet)(LPCWSTR, IWbemQualifierSet**) override { return E_NOTIMPL; }
+	STDMETHOD(Clone)(IWbemClassObject**) override { return E_NOTIMPL; }
+	STDMETHOD(GetObjectText)(long, BSTR*) override { return E_NOTIMPL; }
+	STDMETHOD(SpawnDerivedClass)(long, IWbemClassObject**) override { return E_NOTIMPL; }
+	STDMETHOD(SpawnInstance)(long, IWbemClassObject**) override { return E_NOTIMPL; }
+	STDMETHOD(CompareTo)(long, IWbemClassObject*) override { return E_NOTIMPL; }
+	STDMETHOD(GetPropertyOrigin)(LPCWSTR, BSTR*) override { return E_NOTIMPL; }
+	STDMETHOD(InheritsFrom)(LPCWSTR) override { return E_NOTIMPL; }
+	STDMETHOD(GetMethod)(LPCWSTR, long, IWbemClassObject**, IWbemClassObject**) override { return E_NOTIMPL; }
+	STDMETHOD(PutMethod)(LPCWSTR, long, IWbemClassObject*, IWbemClassObject*) override { return E_NOTIMPL; }
+	STDMETHOD(DeleteMethod)(LPCWSTR) override { return E_NOTIMPL; }
+	STDMETHOD(BeginMethodEnumeration)(long) override { return E_NOTIMPL; }
+	STDMETHOD(NextMethod)(long, BSTR*, IWbemClassObject**, IWbemClassObject**) override { return E_NOTIMPL; }
+	STDMETHOD(EndMethodEnumeration)() override { return E_NOTIMPL; }
+	STDMETHOD(GetMethodQualifierSet)(LPCWSTR, IWbemQualifierSet**) override { return E_NOTIMPL; }
+	STDMETHOD(GetMethodOrigin)(LPCWSTR, BSTR*) override { return E_NOTIMPL; }
+
+	STDMETHOD(GetPropertyHandle)(LPCWSTR, CIMTYPE*, long*) override { return E_NOTIMPL; }
+	STDMETHOD(WritePropertyValue)(long, long, const byte*) override { return E_NOTIMPL; }
+	STDMETHOD(ReadPropertyValue)(long, long, long*, byte*) override { return E_NOTIMPL; }
+	STDMETHOD(ReadDWORD)(long, DWORD*) override { return E_NOTIMPL; }
+	STDMETHOD(WriteDWORD)(long, DWORD) override { return E_NOTIMPL; }
+	STDMETHOD(ReadQWORD)(long, unsigned __int64*) override { return E_NOTIMPL; }
+	STDMETHOD(WriteQWORD)(long, unsigned __int64) override { return E_NOTIMPL; }
+	STDMETHOD(GetPropertyInfoByHandle)(long, BSTR*, CIMTYPE*) override { return E_NOTIMPL; }
+	STDMETHOD(Lock)(long) override { return E_NOTIMPL; }
+	STDMETHOD(Unlock)(long) override { return E_NOTIMPL; }
+
+protected:
+	FakeObject() {
+		Live++;
+	}
+	virtual ~FakeObject() {
+		Live--;
+	}
+
+	virtual bool HasAccess() const {
+		return false;
+	}
+
+private:
+	std::atomic<ULONG> m_Refs{ 1 };
+};
+
+struct FakeProperty {
+	std::wstring Name;
+	CIMTYPE Type;
+	bool IsKey;
+};
+
+struct FakeClass {
+	std::wstring Name;
+	std::vector<FakeProperty> Properties;
+};
+
+//
+// a property value as WMI keeps it: integers and reals natively, strings (and datetimes) as text
+//
+struct FakeValue {
+	LONGLONG Int;
+	double Real;
+	std::wstring Text;
+	bool Null;
+};
+
+//
+// an instance with properties of scalar types (values not given are NULL), read through Get (VARIANTs, the way WMI converts them),
+// Next, GetObjectText (MOF) or, unless access is off, IWbemObjectAccess handles (the property index)
+//
+class FakeInstance : public FakeObject {
+public:
+	//
+	// BSTRs handed out (values, names and text); they come from the OLE allocator, which new does not see
+	//
+	static inline std::atomic<size_t> Strings{ 0 };
+
+	static CComPtr<IWbemClassObject> Create(std::shared_ptr<FakeClass const> cls, std::vector<FakeValue> values, bool access = true) {
+		CComPtr<IWbemClassObject> spObj;
+		spObj.Attach(new FakeInstance(std::move(cls), std::move(values), access));
+		return spObj;
+	}
+
+	STDMETHOD(Get)(LPCWSTR name, long, VARIANT* pValue, CIMTYPE* pType, long* pFlavor) override {
+		if (::_wcsicmp(name, L"__CLASS") == 0) {
+			if (pValue) {
+				pValue->vt = VT_BSTR;
+				pValue->bstrVal = AllocString(m_Class->Name.c_str());
+			}
+			if (pType)
+				*pType = CIM_STRING;
+			if (pFlavor)
+				*pFlavor = WBEM_FLAVOR_ORIGIN_SYSTEM;
+			return S_OK;
+		}
+		auto index = Find(name);
+		if (index < 0)
+			return WBEM_E_NOT_FOUND;
+		if (pValue)
+			ToVariant(index, pValue);
+		if (pType)
+			*pType = m_Class->Properties[index].Type;
+		if (pFlavor)
+			*pFlavor = WBEM_FLAVOR_ORIGIN_LOCAL;
+		return S_OK;
+	}
+
+	STDMETHOD(BeginEnumeration)(long) override {
+		m_Next = 0;
+		return S_OK;
+	}
+	STDMETHOD(Next)(long, BSTR* pName, VARIANT* pValue, CIMTYPE* pType, long* pFlavor) override {
+		if (m_Next >= (int)m_Values.size())
+			return WBEM_S_NO_MORE_DATA;
+		auto index = m_Next++;
+		if (pName)
+			*pName = AllocString(m_Class->Properties[index].Name.c_str());
+		if (pValue)
+			ToVariant(index, pValue);
+		if (pType)
+			*pType = m_Class->Properties[index].Type;
+		if (pFlavor)
+			*pFlavor = WBEM_FLAVOR_ORIGIN_LOCAL;
+		return S_OK;
+	}
+	STDMETHOD(EndEnumeration)() override {
+		m_Next = 0;
+		return S_OK;
+	}
+
+	STDMETHOD(GetObjectText)(long, BSTR* pText) override {
+		std::wstring text = L"\ninstance of " + m_Class->Name + L"\n{\n";
+		for (size_t i = 0; i < m_Values.size(); i++) {
+			auto& value = m_Values[i];
+			if (value.Null)
+				continue;
+			text += L'\t' + m_Class->Properties[i].Name + L" = ";
+			switch (m_Class->Properties[i].Type) {
+				case CIM_STRING:
+				case CIM_DATETIME:
+				case CIM_REFERENCE:
+					text += L'"' + value.Text + L'"';
+					break;
+				case CIM_BOOLEAN: text += value.Int ? L"TRUE" : L"FALSE"; break;
+				case CIM_REAL32:
+				case CIM_REAL64:
+					text += std::to_wstring(value.Real);
+					break;
+				default: text += std::to_wstring(value.Int); break;
+			}
+			text += L";\n";
+		}
+		text += L"};\n";
+		*pText = AllocString(text.c_str(), text.size());
+		return S_OK;
+	}
+
+	STDMETHOD(GetPropertyHandle)(LPCWSTR name, CIMTYPE* pType, long* pHandle) override {
+		auto index = Find(name);
+		if (index < 0)
+			return WBEM_E_NOT_FOUND;
+		*pType = m_Class->Properties[index].Type;
+		*pHandle = index;
+		return S_OK;
+	}
+
+	STDMETHOD(ReadPropertyValue)(long handle, long size, long* pSize, byte* data) override {
+		if (handle < 0 || handle >= (long)m_Values.size())
+			return WBEM_E_INVALID_PARAMETER;
+		auto& value = m_Values[handle];
+		if (value.Null) {
+			*pSize = 0;
+			return WBEM_S_FALSE;
+		}
+		auto type = m_Class->Properties[handle].Type;
+		WORD word = type == CIM_BOOLEAN ? (value.Int ? 0xffff : 0) : (WORD)value.Int;
+		float real32 = (float)value.Real;
+		void const* source = &value.Int;
+		switch (type) {
+			case CIM_SINT8:
+			case CIM_UINT8:
+				*pSize = 1;
+				break;
+			case CIM_SINT16:
+			case CIM_UINT16:
+			case CIM_CHAR16:
+			case CIM_BOOLEAN:
+				*pSize = 2;
+				source = &word;
+				break;
+			case CIM_SINT32:
+			case CIM_UINT32:
+				*pSize = 4;
+				break;
+			case CIM_REAL32:
+				*pSize = 4;
+				source = &real32;
+				break;
+			case CIM_REAL64:
+				*pSize = 8;
+				source = &value.Real;
+				break;
+			case CIM_STRING:
+			case CIM_DATETIME:
+			case CIM_REFERENCE:
+				*pSize = long(value.Text.size() + 1) * sizeof(WCHAR);
+				source = value.Text.c_str();
+				break;
+			default:
+				*pSize = 8;
+				break;
+		}
+		if (size < *pSize)
+			return WBEM_E_BUFFER_TOO_SMALL;
+		memcpy(data, source, *pSize);
+		return S_OK;
+	}
+
+private:
+	FakeInstance(std::shared_ptr<FakeClass const> cls, std::vector<FakeValue> values, bool access)
+		: m_Class(std::move(cls)), m_Values(std::move(values)), m_Access(access) {
+		m_Values.resize(m_Class->Properties.size(), FakeValue{ 0, 0, {}, true });
+	}
+
+	bool HasAccess() const override {
+		return m_Access;
+	}
+
+	static BSTR AllocString(PCWSTR text, size_t length) {
+		Strings++;
+		return ::SysAllocStringLen(text, (UINT)length);
+	}
+	static BSTR AllocString(PCWSTR text) {
+		return AllocString(text, wcslen(text));
+	}
+
+	int Find(LPCWSTR name) const {
+		for (size_t i = 0; i < m_Class->Properties.size(); i++)
+			if (::_wcsicmp(m_Class->Properties[i].Name.c_str(), name) == 0)
+				return (int)i;
+		return -1;
+	}
+
+	//
+	// 64 bit integers and datetimes arrive as strings, smaller integers widened, as from WMI
+	//
+	void ToVariant(int index, VARIANT* pValue) const {
+		auto& value = m_Values[index];
+		::VariantInit(pValue);
+		if (value.Null) {
+			pValue->vt = VT_NULL;
+			return;
+		}
+		switch (m_Class->Properties[index].Type) {
+			case CIM_UINT8: pValue->vt = VT_UI1; pValue->bVal = (BYTE)value.Int; break;
+			case CIM_SINT8:
+			case CIM_SINT16:
+			case CIM_CHAR16:
+				pValue->vt = VT_I2;
+				pValue->iVal = (SHORT)value.Int;
+				break;
+			case CIM_UINT16:
+			case CIM_SINT32:
+			case CIM_UINT32:
+				pValue->vt = VT_I4;
+				pValue->lVal = (LONG)value.Int;
+				break;
+			case CIM_REAL32: pValue->vt = VT_R4; pValue->fltVal = (float)value.Real; break;
+			case CIM_REAL64: pValue->vt = VT_R8; pValue->dblVal = value.Real; break;
+			case CIM_BOOLEAN: pValue->vt = VT_BOOL; pValue->boolVal = value.Int ? VARIANT_TRUE : VARIANT_FALSE; break;
+			case CIM_SINT64:
+			case CIM_UINT64:
+			{
+				WCHAR text[24];
+				std::swprintf(text, _countof(text), m_Class->Properties[index].Type == CIM_SINT64 ? L"%lld" : L"%llu", value.Int);
+				pValue->vt = VT_BSTR;
+				pValue->bstrVal = AllocString(text);
+				break;
+			}
+			default:
+				pValue->vt = VT_BSTR;
+				pValue->bstrVal = AllocString(value.Text.c_str(), value.Text.size());
+				break;
+		}
+	}
+
+	std::shared_ptr<FakeClass const> m_Class;
+	std::vector<FakeValue> m_Values;
+	int m_Next{ 0 };
+	bool m_Access;
+};
+
+struct FakeEnumOptions {
+	ULONG Objects;
+	ULONG CallUsec;			// each Next() costs this much (a round trip) ...
+	ULONG ObjectUsec;		// ... plus this much for every object it returns
+	ULONG FailAt{ ULONG_MAX };	// the object at which Next() fails with Error
+	HRESULT Error{ WBEM_E_FAILED };
+};
+
+//
+// a forward-only enumeration served at a set pace. Time is spent spinning, so short
+// latencies are kept to the microsecond; a Next() that would outlast its timeout returns
+// what was ready by then with WBEM_S_TIMEDOUT, the way WMI does
+//
+class FakeEnum : public IEnumWbemClassObject {
+public:
+	static CComPtr<IEnumWbemClassObject> Create(FakeEnumOptions const& options, FakeEnum** ppFake = nullptr) {
+		CComPtr<IEnumWbemClassObject> spEnum;
+		auto fake = new FakeEnum(options);
+		spEnum.Attach(fake);
+		if (ppFake)
+			*ppFake = fake;
+		return spEnum;
+	}
+
+	STDMETHOD(QueryInterface)(REFIID riid, void** ppv) override {
+		if (riid == __uuidof(IUnknown) || riid == __uuidof(IEnumWbemClassObject)) {
+			AddRef();
+			*ppv = static_cast<IEnumWbemClassObject*>(this);
+			return S_OK;
+		}
+		*ppv = nullptr;
+		return E_NOINTERFACE;
+	}
+	STDMETHOD_(ULONG, AddRef)() override {
+		return ++m_Refs;
+	}
+	STDMETHOD_(ULONG, Release)() override {
+		auto refs = --m_Refs;
+		if (refs == 0)
+			delete this;
+		return refs;
+	}
+
+	STDMETHOD(Reset)() override { return WBEM_E_INVALID_OPERATION; }
+	STDMETHOD(NextAsync)(ULONG, IWbemObjectSink*) override { return E_NOTIMPL; }
+	STDMETHOD(Clone)(IEnumWbemClassObject**) override { return E_NOTIMPL; }
+	STDMETHOD(Skip)(long, ULONG) override { return E_NOTIMPL; }
+
+	STDMETHOD(Next)(long lTimeout, ULONG uCount, IWbemClassObject** apObjects, ULONG* puReturned) override {
+		*puReturned = 0;
+		m_Calls++;
+		auto end = std::min(m_Options.FailAt, m_Options.Objects);
+		auto count = std::min<ULONGLONG>(uCount, end - m_Next);
+		auto usec = m_Options.CallUsec + count * m_Options.ObjectUsec;
+		auto timedOut = lTimeout >= 0 && usec > lTimeout * 1000ULL;
+		if (timedOut) {
+			usec = lTimeout * 1000ULL;
+			count = usec > m_Options.CallUsec && m_Options.ObjectUsec ? std::min(count, (usec - m_Options.CallUsec) / m_Options.ObjectUsec) : 0;
+		}
+		Spin(usec);
+		m_LongestUsec = std::max(m_LongestUsec, usec);
+
+		for (ULONG i = 0; i < count; i++)
+			apObjects[i] = FakeObject::Create();
+		m_Next += (ULONG)count;
+		*puReturned = (ULONG)count;
+		if (timedOut)
+			return WBEM_S_TIMEDOUT;
+		if (m_Next == m_Options.FailAt && count < uCount)
+			return m_Options.Error;
+		return count == uCount ? S_OK : WBEM_S_FALSE;
+	}
+
+	ULONG GetCalls() const {
+		return m_Calls;
+	}
+
+	ULONGLONG GetLongestCallUsec() const {
+		return m_LongestUsec;
+	}
+
+private:
+	explicit FakeEnum(FakeEnumOptions const& options) : m_Options(options) {
+	}
+	virtual ~FakeEnum() = default;
+
+	static void Spin(ULONGLONG usec) {
+		auto end = std::chrono::steady_clock::now() + std::chrono::microseconds(usec);
+		while (std::chrono::steady_clock::now() < end)
+			;
+	}
+
+	FakeEnumOptions m_Options;
+	std::atomic<ULONG> m_Refs{ 1 };
+	ULONG m_Next{ 0 };
+	ULONG m_Calls{ 0 };
+	ULONGLONG m_LongestUsec{ 0 };
+};
@@ -0,0 +1,146 @@
+#include "../WMIExp/pch.h"
+#include "TestRunner.h"
+#include "../WMIExp/FanOutQuery.h"
+
+namespace {
+	//
+	// passes calls on, keeping count of how many run at the same time
+	//
+	class CountingSource : public IFanOutSource {
+	public:
+		explicit CountingSource(std::shared_ptr<IFanOutSource> next) : m_Next(std::move(next)) {
+		}
+
+		HRESULT Run(FanOutCall& call) override {
+			auto active = ++m_Active;
+			for (auto peak = m_Peak.load(); active > peak && !m_Peak.compare_exchange_weak(peak, active);)
+				;
+			auto hr = m_Next->Run(call);
+			m_Active--;
+			return hr;
+		}
+
+		int GetPeak() const {
+			return m_Peak;
+		}
+
+	private:
+		std::shared_ptr<IFanOutSource> m_Next;
+		std::atomic<int> m_Active{ 0 };
+		std::atomic<int> m_Peak{ 0 };
+	};
+
+	struct FanOutResult {
+		std::vector<FanOutPage> Pages;
+		std::vector<FanOutHostStats> Hosts;
+		DWORD ElapsedMsec;
+	};
+
+	//
+	// runs the query to the end, taking pages as the dialog does: whenever the message comes in
+	//
+	FanOutResult Run(std::shared_ptr<IFanOutSource> source, FanOutOptions const& options, std::vector<std::wstring> hosts) {
+		const UINT WM_FANOUT = WM_APP + 1;
+		auto hWnd = ::CreateWindowEx(0, L"Message", nullptr, 0, 0, 0, 0, 0, HWND_MESSAGE, nullptr, nullptr, nullptr);
+		auto query = FanOutQuery::Create(std::move(source), options, hWnd, WM_FANOUT, 1);
+		query->Start(std::move(hosts), L"SELECT * FROM Win32_Process");
+
+		FanOutResult result;
+		for (;;) {
+			MSG msg;
+			if (::GetMessage(&msg, hWnd, WM_FANOUT, WM_FANOUT) <= 0)
+				break;
+			FanOutPage page;
+			while (query->TakePage(page))
+				result.Pages.push_back(std::move(page));
+			if (query->IsDone())
+				break;
+		}
+		result.Hosts = query->GetHosts();
+		result.ElapsedMsec = query->GetElapsedMsec();
+		::DestroyWindow(hWnd);
+		return result;
+	}
+}
+
+//
+// pages from several hosts come in interleaved; each is tagged with its host, carries the
+// columns the first time only, and rows add up per host
+//
+TEST(FanOutHostTagging) {
+	std::vector<std::wstring> hosts{ L"sim:10:300", L"sim:40:130", L"sim:20:64", L"sim:0:0" };
+	FanOutOptions options;
+	options.Concurrency = 4;
+	auto result = Run(std::make_shared<SimulatedFanOutSource>(), options, hosts);
+
+	std::vector<ULONG> rows(hosts.size());
+	std::vector<int> columnPages(hosts.size());
+	for (auto& page : result.Pages) {
+		CHECK(page.Host >= 0 && page.Host < (int)hosts.size());
+		if (!page.Columns.empty())
+			columnPages[page.Host]++;
+		CHECK(rows[page.Host] > 0 || !page.Columns.empty());
+		//
+		// the third column is the latency the host was named with
+		//
+		auto latency = hosts[page.Host].substr(4, hosts[page.Host].find(L':', 4) - 4);
+		CHECK(page.Cells.size() % 3 == 0);
+		for (size_t i = 0; i < page.Cells.size(); i += 3) {
+			CHECK(page.Cells[i + 1] == std::to_wstring(rows[page.Host]));
+			CHECK(page.Cells[i + 2] == latency);
+			rows[page.Host]++;
+		}
+	}
+	ULONG expected[] = { 300, 130, 64, 0 };
+	for (size_t i = 0; i < hosts.size(); i++) {
+		CHECK(rows[i] == expected[i]);
+		CHECK(columnPages[i] == (expected[i] ? 1 : 0));
+		auto& stats = result.Hosts[i];
+		CHECK(stats.Host == hosts[i]);
+		CHECK(stats.Done && stats.Started && !stats.TimedOut);
+		CHECK(stats.Status == S_OK);
+		CHECK(stats.Rows == expected[i]);
+	}
+}
+
+//
+// a host that does not answer in time is reported as timed out without holding up the others;
+// the time counts from the host's turn, not from the start of the fan-out
+//
+TEST(FanOutTimeout) {
+	FanOutOptions options;
+	options.Concurrency = 2;
+	options.TimeoutMsec = 300;
+	auto result = Run(std::make_shared<SimulatedFanOutSource>(), options,
+		{ L"sim:5000:10", L"sim:150:10", L"sim:150:10", L"sim:150:10" });
+
+	CHECK(result.ElapsedMsec < 2000);
+	auto& slow = result.Hosts[0];
+	CHECK(slow.Done && slow.TimedOut);
+	CHECK(slow.Status == WBEM_E_TIMED_OUT);
+	CHECK(slow.Rows == 0);
+	//
+	// the later hosts wait for a thread; their time starts when they get one
+	//
+	for (int i = 1; i < 4; i++) {
+		CHECK(result.Hosts[i].Status == S_OK && !result.Hosts[i].TimedOut);
+		CHECK(result.Hosts[i].Rows == 10);
+	}
+}
+
+//
+// no more hosts are queried at once than the concurrency allows
+//
+TEST(FanOutConcurrencyCap) {
+	std::vector<std::wstring> hosts(9, L"sim:100:10");
+	FanOutOptions options;
+	options.Concurrency = 3;
+	auto source = std::make_shared<CountingSource>(std::make_shared<SimulatedFanOutSource>());
+	auto result = Run(source, options, hosts);
+
+	CHECK(source->GetPeak() == 3);
+	// three rounds of 100 msec, less the granularity of the tick count
+	CHECK(result.ElapsedMsec >= 250);
+	for (auto& host : result.Hosts)
+		CHECK(host.Status == S_OK && host.Rows == 10);
+}
@@ -0,0 +1,234 @@
+#include "../WMIExp/pch.h"
+#include "TestRunner.h"
+#include "FakeWmi.h"
+#include "../WMIExp/InstanceStore.h"
+#include "../WMIExp/SchemaCache.h"
+#include "../WMIExp/WMIHelper.h"
+
+namespace {
+	std::shared_ptr<FakeClass const> MakeServiceClass() {
+		auto cls = std::make_shared<FakeClass>();
+		cls->Name = L"Fake_Service";
+		cls->Properties = {
+			{ L"Name", CIM_STRING, true },
+			{ L"DisplayName", CIM_STRING, false },
+			{ L"ProcessId", CIM_UINT32, false },
+			{ L"State", CIM_STRING, false },
+			{ L"StartMode", CIM_STRING, false },
+			{ L"Started", CIM_BOOLEAN, false },
+			{ L"ExitCode", CIM_UINT32, false },
+			{ L"InstallDate", CIM_DATETIME, false },
+			{ L"PagedMemory", CIM_UINT64, false },
+			{ L"Priority", CIM_SINT16, false },
+			{ L"Load", CIM_REAL64, false },
+			{ L"Tag", CIM_CHAR16, false },
+		};
+		return cls;
+	}
+
+	//
+	// the schema as the class would be parsed: __CLASS first, then the properties
+	//
+	ClassSchema MakeSchema(FakeClass const& cls) {
+		ClassSchema schema;
+		schema.Name = cls.Name;
+		schema.Properties.push_back({ L"__CLASS", L"___SYSTEM", {}, CIM_STRING, WBEM_FLAVOR_ORIGIN_SYSTEM, 0, false });
+		for (auto& prop : cls.Properties)
+			schema.Properties.push_back({ prop.Name, cls.Name, {}, prop.Type, WBEM_FLAVOR_ORIGIN_LOCAL, 0, prop.IsKey });
+		schema.Parsed = true;
+		return schema;
+	}
+
+	CComPtr<IWbemClassObject> MakeService(std::shared_ptr<FakeClass const> const& cls, int i, bool access = true) {
+		auto day = std::to_wstring(10 + i % 18);
+		return FakeInstance::Create(cls, {
+			{ 0, 0, L"Service" + std::to_wstring(i), false },
+			{ 0, 0, L"Fake service number " + std::to_wstring(i), false },
+			{ 1000 + i, 0, {}, i % 3 == 0 },
+			{ 0, 0, i % 3 == 0 ? L"Stopped" : L"Running", false },
+			{ 0, 0, i % 2 ? L"Auto" : L"Manual", false },
+			{ i % 3 != 0, 0, {}, false },
+			{ i % 7, 0, {}, false },
+			{ 0, 0, L"202401" + day + L"093000.000000+060", false },
+			{ (LONGLONG)i << 20, 0, {}, false },
+			{ i % 32 - 16, 0, {}, false },
+			{ 0, i / 7.0, {}, i % 5 == 0 },
+			{ L'A' + i % 26, 0, {}, false },
+			}, access);
+	}
+}
+
+TEST(InstanceRelPath) {
+	auto cls = MakeServiceClass();
+	InstanceStore store;
+	store.Reset(MakeSchema(*cls));
+	store.Append(MakeService(cls, 1));
+	CHECK(store.GetRelPath(0) == L"Fake_Service.Name=\"Service1\"");
+
+	store.Append(FakeInstance::Create(cls, { { 0, 0, L"a \"b\" c:\\d", false } }));
+	CHECK(store.GetRelPath(1) == L"Fake_Service.Name=\"a \\\"b\\\" c:\\\\d\"");
+
+	store.Append(FakeInstance::Create(cls, { { 0, 0, {}, true } }));
+	CHECK(store.GetRelPath(2) == L"Fake_Service.Name=\"\"");
+
+	//
+	// keys in alphabetical order, numbers and booleans unquoted
+	//
+	auto pair = std::make_shared<FakeClass>();
+	pair->Name = L"Fake_Pair";
+	pair->Properties = { { L"Zeta", CIM_UINT32, true }, { L"Value", CIM_STRING, false }, { L"alpha", CIM_STRING, true }, { L"Beta", CIM_BOOLEAN, true } };
+	store.Reset(MakeSchema(*pair));
+	store.Append(FakeInstance::Create(pair, { { 5, 0, {}, false }, { 0, 0, L"x", false }, { 0, 0, L"a", false }, { 1, 0, {}, false } }));
+	CHECK(store.GetRelPath(0) == L"Fake_Pair.alpha=\"a\",Beta=True,Zeta=5");
+
+	auto singleton = std::make_shared<FakeClass>();
+	singleton->Name = L"Fake_Singleton";
+	singleton->Properties = { { L"Value", CIM_UINT32, false } };
+	store.Reset(MakeSchema(*singleton));
+	store.Append(FakeInstance::Create(singleton, { { 1, 0, {}, false } }));
+	CHECK(store.GetRelPath(0) == L"Fake_Singleton=@");
+
+	store.Clear();
+	CHECK(FakeObject::Live == 0);
+}
+
+//
+// values read through property handles and through VARIANTs end up the same in the store
+//
+TEST(InstanceHandleReads) {
+	auto cls = MakeServiceClass();
+	InstanceStore handles, variants;
+	handles.Reset(MakeSchema(*cls));
+	variants.Reset(MakeSchema(*cls));
+	auto append = [&](auto make) {
+		handles.Append(make(true));
+		variants.Append(make(false));
+	};
+	for (int i = 0; i < 100; i++)
+		append([&](bool access) { return MakeService(cls, i, access); });
+	//
+	// the ends of each range: WMI hands uint32 to a VARIANT as VT_I4
+	//
+	append([&](bool access) {
+		return FakeInstance::Create(cls, {
+			{ 0, 0, L"Extremes", false }, { 0, 0, L"", false }, { 0xffffffff, 0, {}, false }, { 0, 0, {}, true }, {}, { 0, 0, {}, false },
+			{ 0x80000000, 0, {}, false }, { 0, 0, L"2024****093000.000000+060", false }, { -1, 0, {}, false }, { -32768, 0, {}, false },
+			{ 0, -1e300, {}, false }, { 0xffff, 0, {}, false } }, access);
+		});
+
+	CHECK(handles.GetRowCount() == 101 && variants.GetRowCount() == 101);
+	for (size_t row = 0; row < handles.GetRowCount(); row++) {
+		for (int col = 0; col < handles.GetColumnCount(); col++) {
+			CHECK(handles.IsNull(row, col) == variants.IsNull(row, col));
+			CHECK(handles.GetText(row, col) == variants.GetText(row, col));
+		}
+	}
+	auto last = handles.GetRowCount() - 1;
+	CHECK(handles.GetText(last, handles.FindColumn(L"ProcessId")) == L"4294967295");
+	CHECK(handles.GetText(last, handles.FindColumn(L"PagedMemory")) == L"18446744073709551615");
+	CHECK(handles.GetText(last, handles.FindColumn(L"Priority")) == L"-32768");
+	CHECK(handles.GetText(last, handles.FindColumn(L"InstallDate")) == L"2024****093000.000000+060");
+	CHECK(handles.IsNull(last, handles.FindColumn(L"State")));
+	CHECK(handles.GetText(0, handles.FindColumn(L"__CLASS")) == L"Fake_Service");
+
+	handles.Clear();
+	variants.Clear();
+	CHECK(FakeObject::Live == 0);
+}
+
+//
+// naming an instance: the MOF text the list used to show against the key based name it shows now.
+// The fake serializes a dozen properties, far less work than WMI's GetObjectText, so the gap is understated
+//
+BENCHMARK(InstanceNaming) {
+	const int count = 100000;
+	auto cls = MakeServiceClass();
+	std::vector<CComPtr<IWbemClassObject>> objects;
+	objects.reserve(count);
+	for (int i = 0; i < count; i++)
+		objects.push_back(MakeService(cls, i));
+
+	size_t chars = 0;
+	Stopwatch mof;
+	for (auto& obj : objects) {
+		CComBSTR text;
+		obj->GetObjectText(0, &text);
+		chars += text.Length();
+	}
+	auto mofSec = mof.Elapsed();
+	printf("  GetObjectText: %.3f usec per instance, %zu characters on average\n", mofSec * 1e6 / count, chars / count);
+
+	InstanceStore store;
+	store.Reset(MakeSchema(*cls));
+	for (auto& obj : objects)
+		store.Append(obj);
+	objects.clear();
+
+	chars = 0;
+	std::wstring name;
+	Stopwatch keys;
+	for (size_t row = 0; row < store.GetRowCount(); row++) {
+		name.clear();
+		store.AppendRelPath(row, name);
+		chars += name.size();
+	}
+	auto keysSec = keys.Elapsed();
+	printf("  key names: %.3f usec per instance, %zu characters on average (%.0fx faster)\n",
+		keysSec * 1e6 / count, chars / count, mofSec / keysSec);
+
+	//
+	// names are only built for the rows being painted
+	//
+	Stopwatch page;
+	for (size_t row = count / 2; row < count / 2 + 40; row++) {
+		name.clear();
+		store.AppendRelPath(row, name);
+	}
+	printf("  a page of 40 rows: %.1f usec\n", page.Elapsed() * 1e6);
+}
+
+//
+// decoding instances into the store through property handles and through VARIANTs (Get);
+// WMIHelper::EnumProperties, which only reads every property into a VARIANT, for reference
+//
+BENCHMARK(PropertyReads) {
+	const int count = 20000;
+	auto cls = MakeServiceClass();
+	auto schema = MakeSchema(*cls);
+	std::vector<CComPtr<IWbemClassObject>> objects[2];
+	for (int access = 0; access < 2; access++) {
+		objects[access].reserve(count);
+		for (int i = 0; i < count; i++)
+			objects[access].push_back(MakeService(cls, i, access != 0));
+	}
+
+	auto report = [&](char const* name, auto read) {
+		InstanceStore store;
+		store.Reset(schema);
+		auto allocations = TestRunner::Allocations.load();
+		auto strings = FakeInstance::Strings.load();
+		Stopwatch sw;
+		read(store);
+		auto sec = sw.Elapsed();
+		printf("  %s: %.3f usec, %.1f allocations and %.1f BSTRs per instance\n", name, sec * 1e6 / count,
+			double(TestRunner::Allocations - allocations) / count, double(FakeInstance::Strings - strings) / count);
+		return sec;
+	};
+
+	auto handles = report("handles", [&](InstanceStore& store) {
+		for (auto& obj : objects[1])
+			store.Append(obj);
+		});
+	auto variants = report("VARIANTs", [&](InstanceStore& store) {
+		for (auto& obj : objects[0])
+			store.Append(obj);
+		});
+	printf("  handles are %.1fx faster\n", variants / handles);
+
+	size_t properties = 0;
+	report("EnumProperties, reading only", [&](InstanceStore&) {
+		for (auto& obj : objects[0])
+			properties += WMIHelper::EnumProperties(obj).size();
+		});
+	CHECK(properties == count * cls->Properties.size());
+}
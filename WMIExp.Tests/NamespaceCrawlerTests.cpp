@@ -0,0 +1,166 @@
+#include "../WMIExp/pch.h"
+#include "TestRunner.h"
+#include "../WMIExp/NamespaceCrawler.h"
+#include <thread>
+
+namespace {
+	//
+	// a namespace tree held in memory. Reads are logged in the order they start;
+	// a namespace can be made slow or made to fail
+	//
+	class MemoryCrawlerSource : public ICrawlerSource {
+	public:
+		void Add(std::wstring path, std::vector<std::wstring> children, size_t classes, HRESULT status = S_OK) {
+			m_Namespaces[Key(path)] = { std::move(children), classes, status };
+		}
+
+		void SetDelay(DWORD msec) {
+			m_DelayMsec = msec;
+		}
+
+		HRESULT ReadNamespace(CatalogNamespace& ns) override {
+			{
+				std::lock_guard lock(m_Lock);
+				m_Reads.push_back(ns.Path);
+			}
+			if (m_DelayMsec)
+				std::this_thread::sleep_for(std::chrono::milliseconds(m_DelayMsec));
+
+			auto it = m_Namespaces.find(Key(ns.Path));
+			if (it == m_Namespaces.end())
+				return WBEM_E_INVALID_NAMESPACE;
+			auto& node = it->second;
+			if (FAILED(node.Status))
+				return node.Status;
+
+			for (size_t i = 0; i < node.Classes; i++)
+				ns.Classes.push_back({ L"Class" + std::to_wstring(i), {}, {}, {}, {}, false });
+			ns.Namespaces = node.Children;
+			return S_OK;
+		}
+
+		std::vector<std::wstring> GetReads() {
+			std::lock_guard lock(m_Lock);
+			return m_Reads;
+		}
+
+	private:
+		struct Node {
+			std::vector<std::wstring> Children;
+			size_t Classes;
+			HRESULT Status;
+		};
+
+		static std::wstring Key(std::wstring const& path) {
+			std::wstring key(path);
+			for (auto& ch : key)
+				ch = (wchar_t)towlower(ch);
+			return key;
+		}
+
+		std::map<std::wstring, Node> m_Namespaces;
+		std::mutex m_Lock;
+		std::vector<std::wstring> m_Reads;
+		DWORD m_DelayMsec{ 0 };
+	};
+
+	//
+	// root with three levels under it: root\N<i> and root\N<i>\M<j>
+	//
+	std::shared_ptr<MemoryCrawlerSource> MakeTree(int width) {
+		auto source = std::make_shared<MemoryCrawlerSource>();
+		std::vector<std::wstring> top;
+		for (int i = 0; i < width; i++) {
+			auto name = L"N" + std::to_wstring(i);
+			top.push_back(name);
+			std::vector<std::wstring> children;
+			for (int j = 0; j < width; j++) {
+				children.push_back(L"M" + std::to_wstring(j));
+				source->Add(L"root\\" + name + L"\\M" + std::to_wstring(j), {}, 2);
+			}
+			source->Add(L"root\\" + name, children, 5);
+		}
+		source->Add(L"root", top, 10);
+		return source;
+	}
+
+	ptrdiff_t IndexOf(std::vector<std::wstring> const& paths, std::wstring const& path) {
+		auto it = std::find(paths.begin(), paths.end(), path);
+		return it == paths.end() ? -1 : it - paths.begin();
+	}
+}
+
+TEST(CrawlerOrdering) {
+	auto source = MakeTree(4);
+	std::mutex lock;
+	std::vector<std::wstring> reported;
+	CrawlOptions options;
+	options.Concurrency = 3;
+	options.OnNamespace = [&](CatalogNamespace const& ns) {
+		std::lock_guard guard(lock);
+		reported.push_back(ns.Path);
+	};
+	auto catalog = NamespaceCrawler::Create(source, options)->Crawl(L"root");
+
+	CHECK(catalog.Namespaces.size() == 1 + 4 + 16);
+	CHECK(catalog.GetClassCount() == 10 + 4 * 5 + 16 * 2);
+	CHECK(reported.size() == catalog.Namespaces.size());
+	//
+	// the catalog comes out sorted by path whatever order the threads finished in;
+	// a namespace is read before its children and only once
+	//
+	for (size_t i = 1; i < catalog.Namespaces.size(); i++)
+		CHECK(::_wcsicmp(catalog.Namespaces[i - 1].Path.c_str(), catalog.Namespaces[i].Path.c_str()) < 0);
+	auto reads = source->GetReads();
+	CHECK(reads.size() == catalog.Namespaces.size());
+	for (auto& ns : catalog.Namespaces) {
+		CHECK(SUCCEEDED(ns.Status));
+		auto pos = ns.Path.rfind(L'\\');
+		if (pos != std::wstring::npos)
+			CHECK(IndexOf(reads, ns.Path.substr(0, pos)) < IndexOf(reads, ns.Path));
+	}
+	CHECK(catalog.Find(L"ROOT\\n2\\m3") != nullptr);
+	CHECK(catalog.Find(L"root\\N9") == nullptr);
+}
+
+TEST(CrawlerErrors) {
+	auto source = MakeTree(3);
+	source->Add(L"root\\N1", { L"M0", L"M1", L"M2" }, 5, WBEM_E_ACCESS_DENIED);
+	source->Add(L"root\\N2", { L"M0", L"Missing" }, 5);
+	auto catalog = NamespaceCrawler::Create(source)->Crawl(L"root");
+
+	//
+	// a namespace that fails is listed with its status and nothing under it is read;
+	// the rest of the tree is crawled as usual
+	//
+	auto denied = catalog.Find(L"root\\N1");
+	CHECK(denied && denied->Status == WBEM_E_ACCESS_DENIED && denied->Classes.empty());
+	CHECK(catalog.Find(L"root\\N1\\M0") == nullptr);
+	auto missing = catalog.Find(L"root\\N2\\Missing");
+	CHECK(missing && missing->Status == WBEM_E_INVALID_NAMESPACE);
+	CHECK(catalog.Find(L"root\\N0\\M2") && SUCCEEDED(catalog.Find(L"root\\N0\\M2")->Status));
+	CHECK(catalog.Namespaces.size() == 1 + 3 + 3 + 2);
+}
+
+TEST(CrawlerCancel) {
+	auto source = MakeTree(8);
+	source->SetDelay(20);
+	std::shared_ptr<NamespaceCrawler> crawler;
+	CrawlOptions options;
+	options.Concurrency = 2;
+	options.OnNamespace = [&](CatalogNamespace const& ns) {
+		if (ns.Path != L"root")
+			crawler->Cancel();
+	};
+	crawler = NamespaceCrawler::Create(source, options);
+
+	//
+	// the walk still completes: namespaces already being read finish, queued ones are skipped
+	//
+	auto catalog = crawler->Crawl(L"root");
+	CHECK(crawler->IsCancelled());
+	CHECK(catalog.Find(L"root") != nullptr);
+	CHECK(catalog.Namespaces.size() <= size_t(1 + options.Concurrency));
+	CHECK(source->GetReads().size() == catalog.Namespaces.size());
+	crawler.reset();
+}
@@ -0,0 +1,242 @@
+#include "../WMIExp/pch.h"
+#include "TestRunner.h"
+#include "../WMIExp/SchemaSnapshot.h"
+#include "../WMIExp/WMIHelper.h"
+#include <filesystem>
+#include <fstream>
+#include <random>
+
+namespace {
+	//
+	// namespaces of classes deriving from one another, each with the system classes every
+	// namespace has, and child namespaces
+	//
+	std::vector<NamespaceContents> MakeTree(int namespaces, int classes) {
+		static PCWSTR const system[] = { L"__SystemClass", L"__NAMESPACE", L"__Provider", L"__Win32Provider", L"__EventFilter" };
+		std::vector<NamespaceContents> tree(namespaces);
+		for (int n = 0; n < namespaces; n++) {
+			auto& ns = tree[n];
+			ns.Path = n == 0 ? L"ROOT" : L"ROOT\\Namespace" + std::to_wstring(n);
+			for (auto name : system)
+				ns.Classes.push_back({ name, true, name == system[0] ? L"" : system[0] });
+			for (int c = 0; c < classes; c++) {
+				auto name = L"Test_Class" + std::to_wstring(c);
+				ns.Classes.push_back({ name, false, c < 10 ? L"" : L"Test_Class" + std::to_wstring(c / 10) });
+			}
+			if (n == 0)
+				for (int child = 1; child < namespaces; child++)
+					ns.Namespaces.push_back({ L"Namespace" + std::to_wstring(child), child % 2 == 0, L"" });
+		}
+		return tree;
+	}
+
+	std::wstring TempPath(PCWSTR name) {
+		return (std::filesystem::temp_directory_path() / name).wstring();
+	}
+
+	std::string ReadBytes(std::wstring const& path) {
+		std::ifstream file(std::filesystem::path(path), std::ios::binary);
+		return std::string(std::istreambuf_iterator<char>(file), {});
+	}
+
+	void WriteBytes(std::wstring const& path, std::string const& bytes) {
+		std::ofstream file(std::filesystem::path(path), std::ios::binary | std::ios::trunc);
+		file.write(bytes.data(), bytes.size());
+	}
+
+	//
+	// the size the file would have with every string stored at every use
+	//
+	size_t UninternedSize(std::vector<NamespaceContents> const& tree) {
+		size_t size = 24, chars = 0;
+		for (auto& ns : tree) {
+			size += 16;
+			chars += ns.Path.size() + 1;
+			for (auto const* entries : { &ns.Classes, &ns.Namespaces }) {
+				for (auto& e : *entries) {
+					size += 12;
+					chars += e.Name.size() + 1 + e.SuperClass.size() + 1;
+				}
+			}
+		}
+		return size + chars * sizeof(WCHAR);
+	}
+
+	//
+	// a damaged snapshot may open or not, but what it decodes to must be readable
+	//
+	size_t Touch(SchemaSnapshot const& snapshot) {
+		size_t chars = 0;
+		for (auto& ns : snapshot.GetAll()) {
+			chars += ns.Path.size();
+			for (auto& e : ns.Classes)
+				chars += e.Name.size() + e.SuperClass.size();
+			for (auto& e : ns.Namespaces)
+				chars += e.Name.size();
+		}
+		return chars;
+	}
+}
+
+TEST(SnapshotRoundTrip) {
+	auto path = TempPath(L"WMIExp.Tests.snapshot");
+	auto tree = MakeTree(8, 150);
+	CHECK(SchemaSnapshot::Save(path.c_str(), tree));
+
+	SchemaSnapshot snapshot;
+	CHECK(snapshot.Open(path.c_str()));
+	CHECK(snapshot.GetAll() == tree);
+	auto ns = snapshot.Find(L"root\\NAMESPACE3");
+	CHECK(ns && *ns == tree[3]);
+	CHECK(!snapshot.Find(L"ROOT\\Namespace99"));
+	//
+	// repeated names (superclasses, system classes) are stored once
+	//
+	auto size = ReadBytes(path).size();
+	CHECK(size < UninternedSize(tree) / 2);
+	snapshot.Close();
+	CHECK(!snapshot.IsOpen());
+
+	CHECK(SchemaSnapshot::Save(path.c_str(), {}));
+	CHECK(snapshot.Open(path.c_str()));
+	CHECK(snapshot.GetAll().empty());
+	snapshot.Close();
+
+	std::vector<NamespaceContents> empty(1);
+	empty[0].Path = L"ROOT\\Empty";
+	CHECK(SchemaSnapshot::Save(path.c_str(), empty));
+	CHECK(snapshot.Open(path.c_str()));
+	CHECK(snapshot.GetAll() == empty);
+	snapshot.Close();
+	std::filesystem::remove(path);
+}
+
+TEST(SnapshotRejectsDamage) {
+	auto path = TempPath(L"WMIExp.Tests.snapshot");
+	auto damaged = TempPath(L"WMIExp.Tests.damaged.snapshot");
+	auto tree = MakeTree(3, 40);
+	CHECK(SchemaSnapshot::Save(path.c_str(), tree));
+	auto bytes = ReadBytes(path);
+	SchemaSnapshot snapshot;
+
+	CHECK(!snapshot.Open(TempPath(L"WMIExp.Tests.missing.snapshot").c_str()));
+
+	//
+	// any truncation breaks the size the header promises
+	//
+	for (size_t size = 0; size < bytes.size(); size += size < 64 ? 1 : 37) {
+		WriteBytes(damaged, bytes.substr(0, size));
+		CHECK(!snapshot.Open(damaged.c_str()));
+	}
+
+	auto patched = [&](size_t offset, char value) {
+		auto copy = bytes;
+		copy[offset] = value;
+		WriteBytes(damaged, copy);
+		return snapshot.Open(damaged.c_str());
+	};
+	CHECK(!patched(0, 'X'));						// magic
+	CHECK(!patched(4, 7));							// version
+	CHECK(!patched(8, bytes[8] + 1));				// namespace count
+	CHECK(!patched(bytes.size() - 1, 'A'));			// the last string loses its terminator
+	CHECK(!patched(bytes.size() - 2, 'A'));
+
+	//
+	// records pointing anywhere: offsets out of range read as empty strings and entry ranges
+	// out of range as no entries
+	//
+	std::mt19937 random(42);
+	size_t records = 24 + 16 * tree.size() + 12 * (3 * (5 + 40) + 2);
+	for (int i = 0; i < 2000; i++) {
+		auto copy = bytes;
+		for (int flips = 0; flips < 4; flips++)
+			copy[24 + random() % (records - 24)] = (char)random();
+		WriteBytes(damaged, copy);
+		if (snapshot.Open(damaged.c_str())) {
+			Touch(snapshot);
+			snapshot.Find(L"ROOT\\Namespace2");
+			snapshot.Close();
+		}
+	}
+	std::filesystem::remove(path);
+	std::filesystem::remove(damaged);
+}
+
+BENCHMARK(SnapshotLoad) {
+	auto path = TempPath(L"WMIExp.Tests.snapshot");
+	auto damaged = TempPath(L"WMIExp.Tests.damaged.snapshot");
+	auto tree = MakeTree(60, 1000);
+
+	Stopwatch save;
+	CHECK(SchemaSnapshot::Save(path.c_str(), tree));
+	auto saveMsec = save.Elapsed() * 1000;
+	auto bytes = ReadBytes(path);
+	printf("  saved %zu namespaces in %.2f msec: %zu KB (%zu KB with every string stored at every use)\n",
+		tree.size(), saveMsec, bytes.size() >> 10, UninternedSize(tree) >> 10);
+
+	SchemaSnapshot snapshot;
+	Stopwatch open;
+	CHECK(snapshot.Open(path.c_str()));
+	auto ns = snapshot.Find(L"ROOT\\Namespace59");
+	auto openMsec = open.Elapsed() * 1000;
+	CHECK(ns && ns->Classes.size() == 1005);
+	Stopwatch all;
+	auto count = snapshot.GetAll().size();
+	printf("  open and find the last namespace %.3f msec, decode all %zu %.2f msec\n", openMsec, count, all.Elapsed() * 1000);
+	snapshot.Close();
+
+	//
+	// damaged files must be turned away (or read) as quickly as good ones
+	//
+	WriteBytes(damaged, bytes.substr(0, bytes.size() / 2));
+	Stopwatch truncated;
+	CHECK(!snapshot.Open(damaged.c_str()));
+	printf("  truncated: rejected in %.3f msec\n", truncated.Elapsed() * 1000);
+
+	std::mt19937 random(7);
+	auto copy = bytes;
+	for (int i = 0; i < 1000; i++)
+		copy[24 + random() % (bytes.size() / 2)] = (char)random();
+	WriteBytes(damaged, copy);
+	Stopwatch corrupt;
+	auto opened = snapshot.Open(damaged.c_str());
+	auto chars = opened ? Touch(snapshot) : 0;
+	printf("  corrupt: %s, %zu characters decoded in %.2f msec\n", opened ? "opened" : "rejected", chars, corrupt.Elapsed() * 1000);
+	snapshot.Close();
+	std::filesystem::remove(path);
+	std::filesystem::remove(damaged);
+}
+
+//
+// what stands between launch and a usable tree: without a snapshot the root is enumerated
+// and its children probed (cold), with one the root is read from the file (warm)
+//
+BENCHMARK(TreeFirstPaint) {
+	//
+	// COM stays initialized: the connection pool holds on to the services until the process exits
+	//
+	::CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+	CComPtr<IWbemServices> spSvc;
+	if (FAILED(WMIHelper::Init(nullptr, L"root", &spSvc))) {
+		printf("  WMI is not available, skipped\n");
+		return;
+	}
+
+	Stopwatch cold;
+	auto root = NamespaceContents::Collect(spSvc, L"root");
+	auto coldMsec = cold.Elapsed() * 1000;
+
+	auto path = TempPath(L"WMIExp.Tests.snapshot");
+	CHECK(SchemaSnapshot::Save(path.c_str(), { root }));
+	SchemaSnapshot snapshot;
+	Stopwatch warm;
+	CHECK(snapshot.Open(path.c_str()));
+	auto cached = snapshot.Find(L"root");
+	auto warmMsec = warm.Elapsed() * 1000;
+	CHECK(cached && *cached == root);
+	printf("  root: %zu classes, %zu namespaces; cold %.1f msec, warm %.3f msec\n",
+		root.Classes.size(), root.Namespaces.size(), coldMsec, warmMsec);
+
+	snapshot.Close();
+	std::filesystem::remove(path);
+}
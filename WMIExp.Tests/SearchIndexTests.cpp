@@ -0,0 +1,156 @@
+#include "../WMIExp/pch.h"
+#include "TestRunner.h"
+#include "../WMIExp/NamespaceCrawler.h"
+#include "../WMIExp/SearchIndex.h"
+#include <random>
+#include <set>
+#include <tuple>
+
+namespace {
+	//
+	// a repository's worth of names made of the words WMI names are made of
+	//
+	std::vector<CatalogNamespace> MakeCatalog(int namespaces, int classes, int properties) {
+		static PCWSTR const words[] = {
+			L"Process", L"Service", L"Network", L"Adapter", L"Disk", L"Drive", L"Logical", L"Physical",
+			L"Memory", L"Thread", L"Handle", L"Name", L"Id", L"Status", L"Size", L"Free", L"Total",
+			L"Caption", L"Install", L"Date", L"Time", L"Security", L"Setting", L"Account", L"User",
+			L"Group", L"Share", L"Printer", L"Port", L"Volume", L"Partition", L"Boot", L"Config",
+			L"Provider", L"Event", L"Filter", L"Consumer", L"Counter", L"Raw", L"Formatted", L"Queue",
+			L"Bytes", L"Persec", L"Cache", L"Page", L"File", L"Path", L"Version", L"Vendor", L"Serial",
+		};
+		static PCWSTR const prefixes[] = { L"Win32_", L"CIM_", L"MSFT_", L"__", L"Msvm_" };
+		static PCWSTR const verbs[] = { L"Get", L"Set", L"Create", L"Delete", L"Start", L"Stop", L"Reset" };
+
+		std::mt19937 random(1234);
+		auto pick = [&](auto& list) { return list[random() % std::size(list)]; };
+		auto name = [&](int count) {
+			std::wstring text;
+			for (int i = 0; i < count; i++)
+				text += pick(words);
+			return text;
+		};
+
+		std::vector<CatalogNamespace> catalog(namespaces);
+		for (int n = 0; n < namespaces; n++) {
+			auto& ns = catalog[n];
+			ns.Path = L"root\\ns" + std::to_wstring(n);
+			for (int c = 0; c < classes; c++) {
+				CatalogClass cls;
+				cls.Name = pick(prefixes) + name(2 + random() % 2) + std::to_wstring(c % 7);
+				for (int p = 0; p < properties; p++)
+					cls.Properties.push_back(name(1 + random() % 3));
+				cls.Methods.push_back(pick(verbs) + name(1));
+				if (c % 4 == 0)
+					cls.Description = L"The " + name(1) + L" of a " + name(2) + L" on this system.";
+				cls.IsSystem = false;
+				ns.Classes.push_back(std::move(cls));
+			}
+		}
+		return catalog;
+	}
+
+	std::wstring Lower(std::wstring text) {
+		for (auto& ch : text)
+			ch = (wchar_t)towlower(ch);
+		return text;
+	}
+
+	using HitKey = std::tuple<SearchKind, std::wstring, std::wstring, std::wstring>;
+
+	//
+	// what the index should find, the slow way. Names differing only in case share a term, which
+	// reports the casing seen first, so everything is compared in lower case
+	//
+	std::multiset<HitKey> LinearSearch(std::vector<CatalogNamespace> const& catalog, std::wstring const& text) {
+		std::multiset<HitKey> hits;
+		auto key = Lower(text);
+		auto match = [&](std::wstring const& name) { return Lower(name).find(key) != std::wstring::npos; };
+		for (auto& ns : catalog) {
+			for (auto& cls : ns.Classes) {
+				auto add = [&](SearchKind kind, std::wstring const& name) {
+					if (match(name))
+						hits.insert({ kind, ns.Path, Lower(cls.Name), Lower(name) });
+				};
+				add(SearchKind::Class, cls.Name);
+				for (auto& name : cls.Properties)
+					add(SearchKind::Property, name);
+				for (auto& name : cls.Methods)
+					add(SearchKind::Method, name);
+				if (!cls.Description.empty())
+					add(SearchKind::Description, cls.Description);
+			}
+		}
+		return hits;
+	}
+
+	std::multiset<HitKey> ToKeys(std::vector<SearchHit> const& hits) {
+		std::multiset<HitKey> keys;
+		for (auto& hit : hits)
+			keys.insert({ hit.Kind, hit.Namespace, Lower(hit.Class), Lower(hit.Name) });
+		return keys;
+	}
+
+	//
+	// 1 and 2 characters go through the term scan and the bigrams; 3 and more through the trigrams,
+	// including ones whose trigrams are all there but not in sequence
+	//
+	PCWSTR const Queries[] = {
+		L"x", L"Q", L"_", L"id", L"ID", L"sv", L"win", L"proc", L"PROCESS", L"handlecount", L"win32_process",
+		L"namename", L"essser", L"dateti", L"persecbytes", L"the memory", L"system.", L"msvm_", L"__",
+		L"zzz", L"processprocessprocessprocess", L"rocessServ",
+	};
+}
+
+TEST(SearchMatchesLinearScan) {
+	auto catalog = MakeCatalog(6, 120, 8);
+	SearchIndex index;
+	for (auto& ns : catalog)
+		index.Add(ns);
+	CHECK(index.GetNamespaceCount() == catalog.size());
+	CHECK(index.GetEntryCount() == 6 * 120 * (1 + 8 + 1) + 6 * 30);
+
+	for (auto query : Queries) {
+		auto hits = index.Search(query, SIZE_MAX);
+		CHECK(ToKeys(hits) == LinearSearch(catalog, query));
+
+		//
+		// exact matches first, then prefixes, then the rest
+		//
+		auto key = Lower(query);
+		auto rank = [&](SearchHit const& hit) {
+			auto name = Lower(hit.Name);
+			return name == key ? 0 : name.starts_with(key) ? 1 : 2;
+		};
+		for (size_t i = 1; i < hits.size(); i++)
+			CHECK(rank(hits[i - 1]) <= rank(hits[i]));
+	}
+
+	auto limited = index.Search(L"e", 10);
+	CHECK(limited.size() == 10);
+	CHECK(index.Search(L"", SIZE_MAX).empty());
+}
+
+BENCHMARK(SearchIndexQueries) {
+	auto catalog = MakeCatalog(80, 400, 12);
+	SearchIndex index;
+	Stopwatch build;
+	for (auto& ns : catalog)
+		index.Add(ns);
+	printf("  indexed %zu entries, %zu terms in %.1f msec\n", index.GetEntryCount(), index.GetTermCount(), build.Elapsed() * 1000);
+
+	for (auto query : Queries) {
+		const int Rounds = 20;
+		size_t count = 0;
+		Stopwatch watch;
+		for (int i = 0; i < Rounds; i++)
+			count = index.Search(query, SIZE_MAX).size();
+		auto indexed = watch.Elapsed() / Rounds;
+
+		Stopwatch linear;
+		auto expected = LinearSearch(catalog, query).size();
+		auto scanned = linear.Elapsed();
+		CHECK(count == expected);
+		printf("  %-30ls %7zu hits %9.3f msec, linear scan %9.3f msec (%6.0fx)\n", query, count, indexed * 1000, scanned * 1000, scanned / indexed);
+	}
+}
@@ -0,0 +1,66 @@
+#include "TestRunner.h"
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+int TestRunner::Failures;
+std::atomic<size_t> TestRunner::Allocations;
+
+void* operator new(size_t size) {
+	TestRunner::Allocations++;
+	if (auto p = malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void* operator new(size_t size, std::nothrow_t const&) noexcept {
+	TestRunner::Allocations++;
+	return malloc(size ? size : 1);
+}
+
+void operator delete(void* p) noexcept {
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+	free(p);
+}
+
+void operator delete(void* p, std::nothrow_t const&) noexcept {
+	free(p);
+}
+
+std::vector<TestCase>& TestRunner::GetTests() {
+	static std::vector<TestCase> tests;
+	return tests;
+}
+
+bool TestRunner::Register(char const* name, void (*run)(), bool benchmark) {
+	GetTests().push_back({ name, run, benchmark });
+	return true;
+}
+
+void TestRunner::Fail(char const* file, int line, char const* expression) {
+	printf("  %s(%d): CHECK(%s) failed\n", file, line, expression);
+	Failures++;
+}
+
+int TestRunner::Run(bool benchmarks) {
+	int count = 0, failed = 0;
+	for (auto& test : GetTests()) {
+		if (test.Benchmark != benchmarks)
+			continue;
+		printf("%s\n", test.Name);
+		auto failures = Failures;
+		test.Run();
+		count++;
+		if (Failures != failures)
+			failed++;
+	}
+	printf("%d run, %d failed\n", count, failed);
+	return failed ? 1 : 0;
+}
+
+int main(int argc, char* argv[]) {
+	return TestRunner::Run(argc > 1 && strcmp(argv[1], "bench") == 0);
+}
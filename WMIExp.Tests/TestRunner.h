@@ -0,0 +1,50 @@
+#pragma once
+
+//
+// a minimal test runner: TEST bodies run by default, BENCHMARK bodies only with "bench" on the command line.
+// CHECK reports a failure and carries on with the test. Allocations counts every operator new, for benchmarks
+// that measure allocations
+//
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+struct TestCase {
+	char const* Name;
+	void (*Run)();
+	bool Benchmark;
+};
+
+struct TestRunner {
+	static std::vector<TestCase>& GetTests();
+	static bool Register(char const* name, void (*run)(), bool benchmark);
+	static void Fail(char const* file, int line, char const* expression);
+	static int Run(bool benchmarks);
+
+	static int Failures;
+	static std::atomic<size_t> Allocations;
+};
+
+#define TEST_CASE(name, benchmark) \
+	static void name(); \
+	static bool name##_registered = TestRunner::Register(#name, name, benchmark); \
+	static void name()
+
+#define TEST(name) TEST_CASE(name, false)
+#define BENCHMARK(name) TEST_CASE(name, true)
+
+#define CHECK(expression) ((expression) ? (void)0 : TestRunner::Fail(__FILE__, __LINE__, #expression))
+
+//
+// seconds elapsed since construction
+//
+class Stopwatch {
+public:
+	double Elapsed() const {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_Start).count();
+	}
+
+private:
+	std::chrono::steady_clock::time_point m_Start{ std::chrono::steady_clock::now() };
+};
@@ -0,0 +1,158 @@
+#include "TestRunner.h"
+#include "../WMIExp/Utf8Text.h"
+#include <string>
+
+namespace {
+	std::string Plain(std::wstring_view text) {
+		Utf8Buffer out;
+		Utf8Text::Append(out, text);
+		return std::string(out.GetView());
+	}
+
+	std::string Csv(std::wstring_view text) {
+		Utf8Buffer out;
+		Utf8Text::AppendCsv(out, text);
+		return std::string(out.GetView());
+	}
+
+	std::string Json(std::wstring_view text) {
+		Utf8Buffer out;
+		Utf8Text::AppendJson(out, text);
+		return std::string(out.GetView());
+	}
+
+	//
+	// surrogates spelled out, so the text is UTF-16 whatever the size of wchar_t
+	//
+	std::wstring Units(std::initializer_list<unsigned> units) {
+		std::wstring text;
+		for (auto unit : units)
+			text += (wchar_t)unit;
+		return text;
+	}
+}
+
+TEST(Utf8Encoding) {
+	CHECK(Plain(L"") == "");
+	CHECK(Plain(L"abc") == "abc");
+	CHECK(Plain(Units({ 0xe9 })) == "\xc3\xa9");
+	CHECK(Plain(Units({ 0x7ff, 0x800 })) == "\xdf\xbf\xe0\xa0\x80");
+	CHECK(Plain(Units({ 0x20ac })) == "\xe2\x82\xac");
+	CHECK(Plain(Units({ 0xffff })) == "\xef\xbf\xbf");
+}
+
+TEST(Utf8Surrogates) {
+	// U+1F600 as a pair
+	CHECK(Plain(Units({ 0xd83d, 0xde00 })) == "\xf0\x9f\x98\x80");
+	CHECK(Json(Units({ 'a', 0xd83d, 0xde00, 'b' })) == "\"a\xf0\x9f\x98\x80" "b\"");
+	// unpaired halves become U+FFFD
+	CHECK(Plain(Units({ 0xd83d })) == "\xef\xbf\xbd");
+	CHECK(Plain(Units({ 0xde00 })) == "\xef\xbf\xbd");
+	CHECK(Plain(Units({ 0xd83d, 'x' })) == "\xef\xbf\xbdx");
+	CHECK(Plain(Units({ 0xde00, 0xd83d })) == "\xef\xbf\xbd\xef\xbf\xbd");
+	CHECK(Json(Units({ 0xd83d, '"' })) == "\"\xef\xbf\xbd\\\"\"");
+}
+
+TEST(CsvQuoting) {
+	CHECK(Csv(L"plain text") == "plain text");
+	CHECK(Csv(L"") == "");
+	CHECK(Csv(L"a,b") == "\"a,b\"");
+	CHECK(Csv(L"say \"hi\"") == "\"say \"\"hi\"\"\"");
+	CHECK(Csv(L"line\nbreak") == "\"line\nbreak\"");
+	CHECK(Csv(L"line\rbreak") == "\"line\rbreak\"");
+	CHECK(Csv(L"tab\tand;semicolon") == "tab\tand;semicolon");
+	// found past the first 8 characters, and in the tail after the last full 8
+	CHECK(Csv(L"0123456789,") == "\"0123456789,\"");
+	CHECK(Csv(L"0123456789abcdef\"") == "\"0123456789abcdef\"\"\"");
+	CHECK(Csv(Units({ 0xe9, ',', 0xe9 })) == "\"\xc3\xa9,\xc3\xa9\"");
+}
+
+TEST(JsonEscaping) {
+	CHECK(Json(L"") == "\"\"");
+	CHECK(Json(L"C:\\Windows") == "\"C:\\\\Windows\"");
+	CHECK(Json(L"say \"hi\"") == "\"say \\\"hi\\\"\"");
+	CHECK(Json(L"\b\f\n\r\t") == "\"\\b\\f\\n\\r\\t\"");
+	CHECK(Json(Units({ 0, 1, 0x1b, 0x1f, 0x20, 0x7f })) == "\"\\u0000\\u0001\\u001b\\u001f \x7f\"");
+	// a comma needs nothing in JSON
+	CHECK(Json(L"a,b") == "\"a,b\"");
+}
+
+//
+// one special character at every position of 24 characters of ASCII: the 8-character
+// blocks hand over to the character by character path wherever it falls, then pick up again
+//
+TEST(Utf8BlockBoundaries) {
+	struct Special {
+		std::wstring Text;
+		char const* Plain;
+		char const* Csv;
+		char const* Json;
+	};
+	Special specials[] = {
+		{ Units({ 0xe9 }), "\xc3\xa9", "\xc3\xa9", "\xc3\xa9" },
+		{ Units({ 0x4e2d }), "\xe4\xb8\xad", "\xe4\xb8\xad", "\xe4\xb8\xad" },
+		{ Units({ 0xd83d, 0xde00 }), "\xf0\x9f\x98\x80", "\xf0\x9f\x98\x80", "\xf0\x9f\x98\x80" },
+		{ Units({ 0xdc00 }), "\xef\xbf\xbd", "\xef\xbf\xbd", "\xef\xbf\xbd" },
+		{ L"\"", "\"", "\"\"", "\\\"" },
+		{ L"\\", "\\", "\\", "\\\\" },
+		{ L"\n", "\n", "\n", "\\n" },
+		{ Units({ 0x1f }), "\x1f", "\x1f", "\\u001f" },
+	};
+	const size_t Length = 24;
+	for (auto& special : specials) {
+		for (size_t pos = 0; pos + special.Text.size() <= Length; pos++) {
+			auto before = std::string(pos, 'a');
+			auto after = std::string(Length - pos - special.Text.size(), 'b');
+			auto text = std::wstring(pos, L'a') + special.Text + std::wstring(after.size(), L'b');
+			CHECK(Plain(text) == before + special.Plain + after);
+			CHECK(Json(text) == "\"" + before + special.Json + after + "\"");
+			auto csv = before + special.Csv + after;
+			if (special.Text == L"\"" || special.Text == L"\n")
+				csv = "\"" + csv + "\"";
+			CHECK(Csv(text) == csv);
+		}
+	}
+}
+
+//
+// property text as it comes from WMI: mostly ASCII names and paths, some accented or CJK text
+// and the odd quote or backslash
+//
+BENCHMARK(Utf8Throughput) {
+	const size_t Values = 1 << 20;
+	std::vector<std::wstring> corpus;
+	corpus.reserve(Values);
+	size_t units = 0;
+	for (size_t i = 0; i < Values; i++) {
+		std::wstring text;
+		switch (i % 8) {
+			case 0: text = L"C:\\Windows\\System32\\svchost.exe -k netsvcs -p -s Schedule"; break;
+			case 1: text = L"Win32_Process.Handle=\"" + std::to_wstring(i) + L"\""; break;
+			case 2: text = L"Caf" + Units({ 0xe9 }) + L" M" + Units({ 0xfc }) + L"ller Netzwerkadapter #" + std::to_wstring(i % 16); break;
+			case 3: text = Units({ 0x65e5, 0x672c, 0x8a9e }) + L" Display Adapter"; break;
+			default: text = L"Microsoft Windows Service Instance Number " + std::to_wstring(i); break;
+		}
+		units += text.size();
+		corpus.push_back(std::move(text));
+	}
+	//
+	// measured against UTF-16 input, 2 bytes a character
+	//
+	auto mb = units * 2 / 1e6;
+	Utf8Buffer out;
+	out.Reserve(units * 6 + 8);
+	for (int kind = 0; kind < 3; kind++) {
+		out.Clear();
+		Stopwatch watch;
+		for (auto& text : corpus) {
+			if (kind == 0)
+				Utf8Text::Append(out, text);
+			else if (kind == 1)
+				Utf8Text::AppendCsv(out, text);
+			else
+				Utf8Text::AppendJson(out, text);
+		}
+		auto elapsed = watch.Elapsed();
+		printf("  %-5s %8.2f MB in %8.2f msec, %8.1f MB/sec\n", kind == 0 ? "plain" : kind == 1 ? "csv" : "json", mb, elapsed * 1000, mb / elapsed);
+	}
+}
@@ -0,0 +1,396 @@
+#include "TestRunner.h"
+#include "../WMIExp/WqlQuery.h"
+#include "../WMIExp/CimDateTime.h"
+#include <cwctype>
+#include <map>
+
+namespace {
+	//
+	// columns in plain vectors, the way InstanceStore lays them out
+	//
+	class VectorTable : public WqlTable {
+	public:
+		struct Column {
+			std::wstring Name;
+			WqlColumnKind Kind;
+			std::vector<int64_t> Ints;
+			std::vector<double> Reals;
+			std::vector<uint32_t> Strings;
+			std::vector<bool> Nulls;
+			std::vector<bool> Raw;		// DateTime kept as text
+		};
+
+		int AddColumn(std::wstring name, WqlColumnKind kind) {
+			m_Columns.push_back({ std::move(name), kind, {}, {}, {}, {}, {} });
+			return (int)m_Columns.size() - 1;
+		}
+
+		//
+		// appends a value to a column; columns are filled to the same length
+		//
+		void AddInt(int col, int64_t value, bool null = false) {
+			m_Columns[col].Ints.push_back(value);
+			m_Columns[col].Nulls.push_back(null);
+		}
+
+		void AddDouble(int col, double value) {
+			m_Columns[col].Reals.push_back(value);
+			m_Columns[col].Nulls.push_back(false);
+		}
+
+		void AddString(int col, std::wstring const& value, bool null = false) {
+			auto it = m_Index.try_emplace(value, (uint32_t)m_Strings.size()).first;
+			if (it->second == m_Strings.size())
+				m_Strings.push_back(value);
+			m_Columns[col].Strings.push_back(it->second);
+			m_Columns[col].Nulls.push_back(null);
+		}
+
+		void AddDateTime(int col, std::wstring_view text) {
+			int64_t ticks = 0;
+			int16_t offset;
+			auto& raw = m_Columns[col].Raw;
+			raw.resize(m_Columns[col].Nulls.size());
+			raw.push_back(!CimDateTime::Parse(text, ticks, offset));
+			AddInt(col, ticks);
+		}
+
+		size_t GetRowCount() const override {
+			return m_Columns.empty() ? 0 : m_Columns[0].Nulls.size();
+		}
+
+		int FindColumn(std::wstring_view name) const override {
+			for (int i = 0; i < (int)m_Columns.size(); i++) {
+				auto& column = m_Columns[i].Name;
+				if (column.length() == name.length() && std::equal(column.begin(), column.end(), name.begin(),
+					[](auto c1, auto c2) { return std::towlower(c1) == std::towlower(c2); }))
+					return i;
+			}
+			return -1;
+		}
+
+		WqlColumnKind GetColumnKind(int col) const override {
+			return m_Columns[col].Kind;
+		}
+
+		bool IsNull(size_t row, int col) const override {
+			return m_Columns[col].Nulls[row];
+		}
+
+		int64_t GetInt64(size_t row, int col) const override {
+			return m_Columns[col].Ints[row];
+		}
+
+		bool HasTicks(size_t row, int col) const override {
+			auto& raw = m_Columns[col].Raw;
+			return row >= raw.size() || !raw[row];
+		}
+
+		double GetDouble(size_t row, int col) const override {
+			return m_Columns[col].Reals[row];
+		}
+
+		bool GetBool(size_t row, int col) const override {
+			return m_Columns[col].Ints[row] != 0;
+		}
+
+		uint32_t GetStringId(size_t row, int col) const override {
+			return m_Columns[col].Strings[row];
+		}
+
+		size_t GetStringCount() const override {
+			return m_Strings.size();
+		}
+
+		std::wstring const& GetPooledString(uint32_t id) const override {
+			return m_Strings[id];
+		}
+
+	private:
+		std::vector<Column> m_Columns;
+		std::vector<std::wstring> m_Strings;
+		std::map<std::wstring, uint32_t> m_Index;
+	};
+
+	WqlNumber Number(std::wstring_view text) {
+		WqlNumber number;
+		CHECK(WqlNumber::Parse(text, number));
+		return number;
+	}
+
+	std::vector<size_t> Select(WqlTable const& table, std::wstring_view text) {
+		WqlQuery query;
+		std::wstring error;
+		CHECK(WqlQuery::Parse(text, query, &error));
+		WqlFilter filter;
+		CHECK(filter.Bind(query, table, &error));
+		return filter.Run();
+	}
+
+	//
+	// Id (Int64), Size (UInt64), Name (String), Ratio (Double), Enabled (Bool), Started (DateTime)
+	//
+	VectorTable MakeTable() {
+		VectorTable table;
+		auto id = table.AddColumn(L"Id", WqlColumnKind::Int64);
+		auto size = table.AddColumn(L"Size", WqlColumnKind::UInt64);
+		auto name = table.AddColumn(L"Name", WqlColumnKind::String);
+		auto ratio = table.AddColumn(L"Ratio", WqlColumnKind::Double);
+		auto enabled = table.AddColumn(L"Enabled", WqlColumnKind::Bool);
+		auto started = table.AddColumn(L"Started", WqlColumnKind::DateTime);
+
+		table.AddInt(id, 9007199254740993LL);
+		table.AddInt(size, (int64_t)UINT64_MAX);
+		table.AddString(name, L"svchost.exe");
+		table.AddDouble(ratio, 0.5);
+		table.AddInt(enabled, 1);
+		table.AddDateTime(started, L"20240229123456.789012+120");
+
+		table.AddInt(id, 9007199254740992LL);
+		table.AddInt(size, (int64_t)18446744073709551614ULL);
+		table.AddString(name, L"System");
+		table.AddDouble(ratio, 1.5);
+		table.AddInt(enabled, 0);
+		table.AddDateTime(started, L"20231231120000.000000-300");
+
+		table.AddInt(id, INT64_MIN);
+		table.AddInt(size, 0);
+		table.AddString(name, L"", true);
+		table.AddDouble(ratio, -2);
+		table.AddInt(enabled, 0, true);
+		table.AddDateTime(started, L"**************.******+***");
+		return table;
+	}
+}
+
+TEST(ParseSelect) {
+	WqlQuery query;
+	CHECK(WqlQuery::Parse(L"select Name, ProcessId from Win32_Process where ProcessId > 4 and not Name like 'svc%'", query));
+	CHECK(query.Properties.size() == 2);
+	CHECK(query.ClassName == L"Win32_Process");
+	CHECK(query.Where >= 0);
+	CHECK(query.Nodes[query.Where].Op == WqlOp::And);
+
+	CHECK(WqlQuery::Parse(L"SELECT * FROM Win32_Service", query));
+	CHECK(query.Properties.empty());
+	CHECK(query.Where < 0);
+
+	std::wstring error;
+	CHECK(!WqlQuery::Parse(L"SELECT * Win32_Service", query, &error));
+	CHECK(!error.empty());
+	CHECK(!WqlQuery::Parse(L"SELECT * FROM A WHERE X = 'open", query, &error));
+	CHECK(!WqlQuery::Parse(L"SELECT * FROM A WHERE X =", query, &error));
+}
+
+TEST(ParseRoundTrip) {
+	for (auto text : {
+		L"SELECT * FROM Win32_Process WHERE ProcessId >= 4 AND (Name LIKE 'svc%' OR Name = 'System')",
+		L"SELECT Name FROM Win32_Service WHERE NOT State = 'Running' AND StartName IS NOT NULL",
+		L"SELECT * FROM A WHERE X = -9223372036854775808 OR Y = 18446744073709551615 OR Z < 1.5",
+	}) {
+		WqlQuery query, again;
+		CHECK(WqlQuery::Parse(text, query));
+		auto printed = query.ToString();
+		CHECK(WqlQuery::Parse(printed, again));
+		CHECK(again.ToString() == printed);
+	}
+}
+
+TEST(LexNumbers) {
+	WqlQuery query;
+	std::wstring error;
+	CHECK(!WqlQuery::Parse(L"SELECT * FROM A WHERE X = 12ab", query, &error));
+	CHECK(error.find(L"12ab") != std::wstring::npos);
+	CHECK(!WqlQuery::Parse(L"SELECT * FROM A WHERE X = 1.2.3", query));
+	CHECK(!WqlQuery::Parse(L"SELECT * FROM A WHERE X = 0x", query));
+	CHECK(WqlQuery::Parse(L"SELECT * FROM A WHERE X = 99999999999999999999", query));
+	CHECK(!query.Nodes[query.Where].Value.Number.Integral);
+
+	CHECK(WqlQuery::Parse(L"SELECT * FROM A WHERE X = 0x1F", query));
+	auto& hex = query.Nodes[query.Where].Value.Number;
+	CHECK(hex.Integral && hex.Magnitude == 31 && !hex.Negative);
+
+	CHECK(WqlQuery::Parse(L"SELECT * FROM A WHERE X = -42", query));
+	auto& negative = query.Nodes[query.Where].Value.Number;
+	CHECK(negative.Integral && negative.Negative && negative.Magnitude == 42 && negative.Value == -42);
+}
+
+TEST(NumberParse) {
+	auto n = Number(L"18446744073709551615");
+	CHECK(n.Integral && n.Magnitude == UINT64_MAX);
+	n = Number(L"18446744073709551616");
+	CHECK(!n.Integral && n.Value == 18446744073709551616.0);
+	n = Number(L"-0");
+	CHECK(n.Integral && !n.Negative);
+	n = Number(L".25");
+	CHECK(!n.Integral && n.Value == 0.25);
+	CHECK(Number(L"-9223372036854775808").ToString() == L"-9223372036854775808");
+	CHECK(Number(L"2.5").ToString() == L"2.5");
+
+	WqlNumber bad;
+	CHECK(!WqlNumber::Parse(L"", bad));
+	CHECK(!WqlNumber::Parse(L"-", bad));
+	CHECK(!WqlNumber::Parse(L"1e5", bad));
+	CHECK(!WqlNumber::Parse(L"0x10000000000000000", bad));
+}
+
+TEST(CompareIntegers) {
+	//
+	// 2^53 + 1 and 2^53 are the same double
+	//
+	CHECK(WqlFilter::Compare(int64_t(9007199254740993), Number(L"9007199254740992")) == 1);
+	CHECK(WqlFilter::Compare(int64_t(9007199254740992), Number(L"9007199254740993")) == -1);
+	CHECK(WqlFilter::Compare(int64_t(9007199254740993), Number(L"9007199254740993")) == 0);
+	CHECK(WqlFilter::Compare(UINT64_MAX, Number(L"18446744073709551614")) == 1);
+	CHECK(WqlFilter::Compare(UINT64_MAX, Number(L"18446744073709551615")) == 0);
+	CHECK(WqlFilter::Compare(UINT64_MAX, Number(L"18446744073709551616")) == -1);
+	CHECK(WqlFilter::Compare(uint64_t(0), Number(L"-1")) == 1);
+
+	CHECK(WqlFilter::Compare(INT64_MIN, Number(L"-9223372036854775808")) == 0);
+	CHECK(WqlFilter::Compare(INT64_MIN, Number(L"-9223372036854775807")) == -1);
+	CHECK(WqlFilter::Compare(INT64_MIN + 1, Number(L"-9223372036854775808")) == 1);
+	CHECK(WqlFilter::Compare(INT64_MAX, Number(L"9223372036854775808")) == -1);
+	CHECK(WqlFilter::Compare(int64_t(-1), Number(L"0")) == -1);
+
+	CHECK(WqlFilter::Compare(int64_t(5), Number(L"5.5")) == -1);
+	CHECK(WqlFilter::Compare(int64_t(6), Number(L"5.5")) == 1);
+	CHECK(WqlFilter::Compare(int64_t(5), Number(L"5.0")) == 0);
+	CHECK(WqlFilter::Compare(int64_t(-6), Number(L"-5.5")) == -1);
+	CHECK(WqlFilter::Compare(int64_t(-5), Number(L"-5.5")) == 1);
+	CHECK(WqlFilter::Compare(INT64_MIN, Number(L"-10000000000000000000.5")) == 1);
+	CHECK(WqlFilter::Compare(1.5, Number(L"1.5")) == 0);
+}
+
+TEST(Like) {
+	CHECK(WqlFilter::Like(L"svchost.exe", L"svc%"));
+	CHECK(WqlFilter::Like(L"SVCHOST.EXE", L"%.exe"));
+	CHECK(WqlFilter::Like(L"svchost.exe", L"%host%"));
+	CHECK(WqlFilter::Like(L"abc", L"a_c"));
+	CHECK(!WqlFilter::Like(L"abbc", L"a_c"));
+	CHECK(WqlFilter::Like(L"b1", L"[abc]_"));
+	CHECK(WqlFilter::Like(L"m", L"[a-z]"));
+	CHECK(!WqlFilter::Like(L"a", L"[^abc]"));
+	CHECK(WqlFilter::Like(L"", L"%"));
+	CHECK(!WqlFilter::Like(L"abc", L"ab"));
+}
+
+TEST(FilterRows) {
+	auto table = MakeTable();
+	CHECK(Select(table, L"SELECT * FROM A WHERE Id = 9007199254740993") == std::vector<size_t>{ 0 });
+	CHECK(Select(table, L"SELECT * FROM A WHERE Id > 9007199254740992") == std::vector<size_t>{ 0 });
+	CHECK(Select(table, L"SELECT * FROM A WHERE Id = -9223372036854775808") == std::vector<size_t>{ 2 });
+	CHECK(Select(table, L"SELECT * FROM A WHERE Size = 18446744073709551614") == std::vector<size_t>{ 1 });
+	CHECK(Select(table, L"SELECT * FROM A WHERE Size >= 18446744073709551614").size() == 2);
+	CHECK(Select(table, L"SELECT * FROM A WHERE Size > -1").size() == 3);
+	CHECK(Select(table, L"SELECT * FROM A WHERE Size = '18446744073709551615'") == std::vector<size_t>{ 0 });
+	CHECK(Select(table, L"SELECT * FROM A WHERE Ratio < 1").size() == 2);
+	CHECK(Select(table, L"SELECT * FROM A WHERE Enabled = TRUE") == std::vector<size_t>{ 0 });
+	CHECK(Select(table, L"SELECT * FROM A WHERE Enabled <> TRUE") == std::vector<size_t>{ 1 });
+	CHECK(Select(table, L"SELECT * FROM A WHERE name = 'SYSTEM'") == std::vector<size_t>{ 1 });
+	CHECK(Select(table, L"SELECT * FROM A WHERE Name LIKE 'svc%' OR Ratio = -2").size() == 2);
+	CHECK(Select(table, L"SELECT * FROM A WHERE Name IS NOT NULL AND NOT Name LIKE 'svc%'") == std::vector<size_t>{ 1 });
+}
+
+TEST(FilterNulls) {
+	auto table = MakeTable();
+	CHECK(Select(table, L"SELECT * FROM A WHERE Name IS NULL") == std::vector<size_t>{ 2 });
+	CHECK(Select(table, L"SELECT * FROM A WHERE Name = NULL") == std::vector<size_t>{ 2 });
+	CHECK(Select(table, L"SELECT * FROM A WHERE Name IS NOT NULL").size() == 2);
+	CHECK(Select(table, L"SELECT * FROM A WHERE Name <> 'System'") == std::vector<size_t>{ 0 });
+	CHECK(Select(table, L"SELECT * FROM A WHERE Enabled = FALSE") == std::vector<size_t>{ 1 });
+	//
+	// a wildcard datetime is kept as text: not NULL, and never equal to or ordered against a literal
+	//
+	CHECK(Select(table, L"SELECT * FROM A WHERE Started IS NULL").empty());
+	CHECK(Select(table, L"SELECT * FROM A WHERE Started IS NOT NULL").size() == 3);
+	CHECK(Select(table, L"SELECT * FROM A WHERE Started <> '20240101000000.000000+000'") == std::vector<size_t>({ 0, 1 }));
+}
+
+TEST(FilterDateTime) {
+	auto table = MakeTable();
+	//
+	// 2024-02-29 12:34:56 +02:00 is 10:34:56 UTC
+	//
+	CHECK(Select(table, L"SELECT * FROM A WHERE Started = '20240229103456.789012+000'") == std::vector<size_t>{ 0 });
+	CHECK(Select(table, L"SELECT * FROM A WHERE Started > '20240101000000.000000+000'") == std::vector<size_t>{ 0 });
+	CHECK(Select(table, L"SELECT * FROM A WHERE Started < '20240101000000.000000+000'") == std::vector<size_t>{ 1 });
+}
+
+TEST(BindErrors) {
+	auto table = MakeTable();
+	WqlQuery query;
+	WqlFilter filter;
+	std::wstring error;
+	for (auto text : {
+		L"SELECT * FROM A WHERE Missing = 1",
+		L"SELECT * FROM A WHERE Id LIKE '1%'",
+		L"SELECT * FROM A WHERE Id = 'one'",
+		L"SELECT * FROM A WHERE Started = 'yesterday'",
+	}) {
+		CHECK(WqlQuery::Parse(text, query));
+		error.clear();
+		CHECK(!filter.Bind(query, table, &error));
+		CHECK(!error.empty());
+	}
+}
+
+TEST(DateTimeRoundTrip) {
+	for (auto text : { L"20240229123456.789012-300", L"19700101000000.000000+000", L"16010101000000.000000+000",
+		L"99991231235959.999999+840", L"00000001020304.000005:000", L"10675198235959.999999:000",
+		L"15000101120000.000000+000", L"16001231235959.999999-060", L"00000101000000.000000+000" }) {
+		int64_t ticks;
+		int16_t offset;
+		CHECK(CimDateTime::Parse(text, ticks, offset));
+		CHECK(CimDateTime::Format(ticks, offset) == text);
+	}
+
+	int64_t ticks;
+	int16_t offset;
+	CHECK(CimDateTime::Parse(L"16010101000000.000000+000", ticks, offset) && ticks == 0 && offset == 0);
+	CHECK(CimDateTime::Parse(L"16001231235959.999999+000", ticks, offset) && ticks == -10);
+	CHECK(CimDateTime::Parse(L"00000001000000.000000:000", ticks, offset) && offset == CimDateTime::IntervalOffset);
+	CHECK(!CimDateTime::Parse(L"20241301000000.000000+000", ticks, offset));
+	CHECK(!CimDateTime::Parse(L"2024010100000.000000+000", ticks, offset));
+	CHECK(!CimDateTime::Parse(L"2024****000000.000000+000", ticks, offset));
+	CHECK(!CimDateTime::Parse(L"99999999000000.000000:000", ticks, offset));
+}
+
+BENCHMARK(FilterMillionRows) {
+	const size_t Rows = 1000000;
+	VectorTable table;
+	auto id = table.AddColumn(L"Id", WqlColumnKind::Int64);
+	auto size = table.AddColumn(L"Size", WqlColumnKind::UInt64);
+	auto name = table.AddColumn(L"Name", WqlColumnKind::String);
+	for (size_t i = 0; i < Rows; i++) {
+		table.AddInt(id, (int64_t)i);
+		table.AddInt(size, (int64_t)(i * 4096));
+		table.AddString(name, L"process" + std::to_wstring(i % 1000) + L".exe");
+	}
+
+	for (auto text : {
+		L"SELECT * FROM A WHERE Id > 500000",
+		L"SELECT * FROM A WHERE Size >= 2048000000 AND Size < 3072000000",
+		L"SELECT * FROM A WHERE Name LIKE 'process1%'",
+		L"SELECT * FROM A WHERE Id < 100000 OR Name = 'PROCESS7.EXE'",
+	}) {
+		WqlQuery query;
+		WqlFilter filter;
+		CHECK(WqlQuery::Parse(text, query));
+		CHECK(filter.Bind(query, table));
+		Stopwatch watch;
+		auto rows = filter.Run();
+		auto elapsed = watch.Elapsed();
+		printf("  %-70ls %7zu rows %8.2f msec %7.1f M rows/sec\n", text, rows.size(), elapsed * 1000, Rows / elapsed / 1e6);
+	}
+}
+
+BENCHMARK(ParseQueries) {
+	const int Count = 100000;
+	Stopwatch watch;
+	for (int i = 0; i < Count; i++) {
+		WqlQuery query;
+		CHECK(WqlQuery::Parse(L"SELECT Name, ProcessId FROM Win32_Process WHERE ProcessId > 4 AND (Name LIKE 'svc%' OR HandleCount >= 1000)", query));
+	}
+	auto elapsed = watch.Elapsed();
+	printf("  %d queries %.2f msec, %.2f usec each\n", Count, elapsed * 1000, elapsed * 1e6 / Count);
+}
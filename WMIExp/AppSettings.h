@@ -10,6 +10,19 @@ struct AppSettings : Settings {
 		SETTING(ViewSystemClasses, 0, SettingType::Bool);
 		SETTING(ViewSystemProperties, 0, SettingType::Bool);
 		SETTING(ShowNamespacesInList, 0, SettingType::Bool);
+		SETTING(ClassHierarchy, 0, SettingType::Bool);
+		SETTING(CrawlerConcurrency, 8, SettingType::Int32);
+		SETTING(IndexDescriptions, 0, SettingType::Bool);
+		SETTING(QueryMaxRows, 100000, SettingType::Int32);
+		SETTING(PerfRefreshMsec, 1000, SettingType::Int32);
+		SETTING(PerfHistoryLength, 60, SettingType::Int32);
+		SETTING(EventRingCapacity, 65536, SettingType::Int32);
+		SETTING(EventMaxRows, 100000, SettingType::Int32);
+		SETTING(EventCoalesceRate, 1000, SettingType::Int32);
+		SETTING(ConnectionPoolSize, 32, SettingType::Int32);
+		SETTING(FanOutConcurrency, 8, SettingType::Int32);
+		SETTING(FanOutTimeoutMsec, 30000, SettingType::Int32);
+		SETTING(EnumBatchSize, 0, SettingType::Int32);
 	END_SETTINGS
 
 	DEF_SETTING(AlwaysOnTop, int)
@@ -18,4 +31,17 @@ struct AppSettings : Settings {
 	DEF_SETTING(ViewSystemClasses, int)
 	DEF_SETTING(ViewSystemProperties, int)
 	DEF_SETTING(ShowNamespacesInList, int)
+	DEF_SETTING(ClassHierarchy, int)
+	DEF_SETTING(CrawlerConcurrency, int)
+	DEF_SETTING(IndexDescriptions, int)
+	DEF_SETTING(QueryMaxRows, int)
+	DEF_SETTING(PerfRefreshMsec, int)
+	DEF_SETTING(PerfHistoryLength, int)
+	DEF_SETTING(EventRingCapacity, int)
+	DEF_SETTING(EventMaxRows, int)
+	DEF_SETTING(EventCoalesceRate, int)
+	DEF_SETTING(ConnectionPoolSize, int)
+	DEF_SETTING(FanOutConcurrency, int)
+	DEF_SETTING(FanOutTimeoutMsec, int)
+	DEF_SETTING(EnumBatchSize, int)
 };
@@ -0,0 +1,131 @@
+#include "pch.h"
+#include "BatchEnumerator.h"
+
+namespace {
+	ULONGLONG QueryMicroseconds() {
+		static LARGE_INTEGER freq = [] {
+			LARGE_INTEGER f;
+			::QueryPerformanceFrequency(&f);
+			return f;
+			}();
+		LARGE_INTEGER now;
+		::QueryPerformanceCounter(&now);
+		//
+		// split so the multiplication does not overflow after a long uptime
+		//
+		auto q = now.QuadPart, f = freq.QuadPart;
+		return (q / f) * 1000000 + (q % f) * 1000000 / f;
+	}
+}
+
+double EnumStats::ObjectsPerSecond() const {
+	return ElapsedUsec ? Objects * 1000000.0 / ElapsedUsec : 0.0;
+}
+
+BatchEnumerator::BatchEnumerator(IEnumWbemClassObject* pEnum, ULONG batchSize, ULONG targetLatencyMsec) :
+	m_spEnum(pEnum), m_TargetUsec(targetLatencyMsec * 1000ULL), m_Adaptive(batchSize == 0) {
+	m_BatchSize = m_Adaptive ? InitialAdaptiveBatchSize : std::clamp(batchSize, MinBatchSize, MaxBatchSize);
+	m_Batch.resize(m_Adaptive ? MaxBatchSize : m_BatchSize);
+	m_Done = pEnum == nullptr;
+}
+
+BatchEnumerator::~BatchEnumerator() {
+	ReleaseBatch();
+}
+
+std::span<IWbemClassObject* const> BatchEnumerator::Next() {
+	ReleaseBatch();
+	m_Count = Fetch();
+	return { m_Batch.data(), m_Count };
+}
+
+ULONG BatchEnumerator::Next(std::vector<CComPtr<IWbemClassObject>>& objects) {
+	ReleaseBatch();
+	auto count = Fetch();
+	objects.reserve(objects.size() + count);
+	for (ULONG i = 0; i < count; i++) {
+		objects.emplace_back().Attach(m_Batch[i]);
+		m_Batch[i] = nullptr;
+	}
+	return count;
+}
+
+void BatchEnumerator::SetCancelFlag(std::atomic<bool> const* cancelled) {
+	m_Cancelled = cancelled;
+}
+
+ULONG BatchEnumerator::GetBatchSize() const {
+	return m_BatchSize;
+}
+
+bool BatchEnumerator::IsAdaptive() const {
+	return m_Adaptive;
+}
+
+bool BatchEnumerator::IsDone() const {
+	return m_Done;
+}
+
+HRESULT BatchEnumerator::GetLastStatus() const {
+	return m_LastStatus;
+}
+
+EnumStats const& BatchEnumerator::GetStats() const {
+	return m_Stats;
+}
+
+ULONG BatchEnumerator::Fetch() {
+	if (m_Done)
+		return 0;
+
+	ULONG returned = 0;
+	auto start = QueryMicroseconds();
+	for (;;) {
+		if (m_Cancelled && m_Cancelled->load()) {
+			m_LastStatus = WBEM_E_CALL_CANCELLED;
+			break;
+		}
+		m_LastStatus = m_spEnum->Next(SliceMsec, m_BatchSize, m_Batch.data(), &returned);
+		m_Stats.Calls++;
+		//
+		// a slice that timed out with some objects is a short batch; with none, wait again
+		//
+		if (m_LastStatus != WBEM_S_TIMEDOUT || returned > 0)
+			break;
+	}
+	auto elapsed = QueryMicroseconds() - start;
+
+	m_Stats.Objects += returned;
+	m_Stats.ElapsedUsec += elapsed;
+
+	//
+	// WBEM_S_FALSE means fewer objects than requested remain, anything else but S_OK is an error
+	//
+	if (m_LastStatus == WBEM_S_TIMEDOUT)
+		m_LastStatus = S_OK;
+	if (FAILED(m_LastStatus) && SUCCEEDED(m_Stats.Status))
+		m_Stats.Status = m_LastStatus;
+	if (m_LastStatus != S_OK || returned == 0)
+		m_Done = true;
+	else if (m_Adaptive)
+		AdjustBatchSize(returned, elapsed);
+
+	return returned;
+}
+
+void BatchEnumerator::ReleaseBatch() {
+	for (ULONG i = 0; i < m_Count; i++) {
+		if (m_Batch[i]) {
+			m_Batch[i]->Release();
+			m_Batch[i] = nullptr;
+		}
+	}
+	m_Count = 0;
+}
+
+void BatchEnumerator::AdjustBatchSize(ULONG returned, ULONGLONG usec) {
+	if (usec > m_TargetUsec)
+		m_BatchSize = std::max(MinBatchSize, m_BatchSize / 2);
+	else if (returned == m_BatchSize && usec < m_TargetUsec / 2)
+		m_BatchSize = std::min(MaxBatchSize, m_BatchSize * 2);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <span>
+
+struct EnumStats {
+	ULONG Objects{ 0 };
+	ULONG Calls{ 0 };
+	ULONGLONG ElapsedUsec{ 0 };
+	HRESULT Status{ S_OK };		// the first failure, if any
+
+	double ObjectsPerSecond() const;
+};
+
+//
+// pulls objects from IEnumWbemClassObject in batches instead of one per round trip.
+// batch size 0 means adaptive: the batch grows while Next() calls return quickly
+// and shrinks when a single call takes longer than the target latency
+//
+class BatchEnumerator {
+public:
+	static constexpr ULONG MinBatchSize = 1;
+	static constexpr ULONG MaxBatchSize = 1024;
+	static constexpr ULONG InitialAdaptiveBatchSize = 16;
+	//
+	// Next() waits in slices of this length so a cancellation is noticed while a provider is slow
+	//
+	static constexpr LONG SliceMsec = 250;
+
+	explicit BatchEnumerator(IEnumWbemClassObject* pEnum, ULONG batchSize = 0, ULONG targetLatencyMsec = 50);
+	~BatchEnumerator();
+
+	BatchEnumerator(BatchEnumerator const&) = delete;
+	BatchEnumerator& operator=(BatchEnumerator const&) = delete;
+
+	//
+	// returns the next batch as a contiguous array; objects are owned by the enumerator
+	// and are valid until the next call. An empty span means the enumeration is done
+	//
+	std::span<IWbemClassObject* const> Next();
+
+	//
+	// appends the next batch to the vector, transferring ownership. Returns the number of objects added
+	//
+	ULONG Next(std::vector<CComPtr<IWbemClassObject>>& objects);
+
+	template<typename F>
+	void ForEach(F&& f) {
+		for (auto batch = Next(); !batch.empty(); batch = Next())
+			for (auto pObj : batch)
+				f(pObj);
+	}
+
+	//
+	// once the flag is set, the enumeration stops with WBEM_E_CALL_CANCELLED at the next slice.
+	// The flag must outlive the enumerator
+	//
+	void SetCancelFlag(std::atomic<bool> const* cancelled);
+
+	ULONG GetBatchSize() const;
+	bool IsAdaptive() const;
+	bool IsDone() const;
+	HRESULT GetLastStatus() const;
+	EnumStats const& GetStats() const;
+
+private:
+	ULONG Fetch();
+	void ReleaseBatch();
+	void AdjustBatchSize(ULONG returned, ULONGLONG usec);
+
+	CComPtr<IEnumWbemClassObject> m_spEnum;
+	std::atomic<bool> const* m_Cancelled{ nullptr };
+	std::vector<IWbemClassObject*> m_Batch;
+	ULONG m_Count{ 0 };
+	ULONG m_BatchSize;
+	ULONGLONG m_TargetUsec;
+	EnumStats m_Stats;
+	HRESULT m_LastStatus{ S_OK };
+	bool m_Adaptive;
+	bool m_Done{ false };
+};
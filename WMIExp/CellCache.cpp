@@ -0,0 +1,165 @@
+#include "pch.h"
+#include "CellCache.h"
+
+void CellCache::Reset(int columns) {
+	m_Columns = columns;
+	m_Text.clear();
+	m_Offsets.clear();
+	m_Dead = 0;
+}
+
+void CellCache::Invalidate(int col) {
+	for (size_t i = col; i < m_Offsets.size(); i += m_Columns) {
+		if (m_Offsets[i] != NoText) {
+			m_Dead += ::wcslen(m_Text.data() + m_Offsets[i]) + 1;
+			m_Offsets[i] = NoText;
+		}
+	}
+}
+
+PCWSTR CellCache::Find(size_t row, int col) const {
+	auto index = row * m_Columns + col;
+	if (index >= m_Offsets.size() || m_Offsets[index] == NoText)
+		return nullptr;
+	return m_Text.data() + m_Offsets[index];
+}
+
+PCWSTR CellCache::Add(size_t row, int col, std::wstring_view text) {
+	auto index = row * m_Columns + col;
+	if (index >= m_Offsets.size())
+		m_Offsets.resize((row + 1) * m_Columns, NoText);
+	else if (m_Offsets[index] != NoText)
+		m_Dead += ::wcslen(m_Text.data() + m_Offsets[index]) + 1;
+
+	//
+	// text of invalidated cells is left behind; reclaim it once it dominates
+	//
+	if (m_Dead > 4096 && m_Dead > m_Text.size() / 2)
+		Compact();
+
+	auto offset = (DWORD)m_Text.size();
+	m_Text.insert(m_Text.end(), text.begin(), text.end());
+	m_Text.push_back(0);
+	m_Offsets[index] = offset;
+	return m_Text.data() + offset;
+}
+
+std::wstring& CellCache::GetBuffer() {
+	m_Buffer.clear();
+	return m_Buffer;
+}
+
+size_t CellCache::GetMemorySize() const {
+	return m_Text.capacity() * sizeof(WCHAR) + m_Offsets.capacity() * sizeof(DWORD) + m_Buffer.capacity() * sizeof(WCHAR);
+}
+
+void CellCache::Compact() {
+	std::vector<WCHAR> text;
+	text.reserve(m_Text.size() - m_Dead);
+	for (auto& offset : m_Offsets) {
+		if (offset == NoText)
+			continue;
+		auto p = m_Text.data() + offset;
+		offset = (DWORD)text.size();
+		text.insert(text.end(), p, p + ::wcslen(p) + 1);
+	}
+	m_Text = std::move(text);
+	m_Dead = 0;
+}
+
+PCWSTR CellText::CimTypeToText(CIMTYPE type) {
+	static const struct {
+		CIMTYPE Type;
+		PCWSTR Scalar, Array;
+	} names[] = {
+		{ CIM_EMPTY, L"Empty", L"Empty [Array]" },
+		{ CIM_SINT8, L"Signed Byte (8 bit)", L"Signed Byte (8 bit) [Array]" },
+		{ CIM_UINT8, L"Byte (8 bit)", L"Byte (8 bit) [Array]" },
+		{ CIM_SINT16, L"Signed Word (16 bit)", L"Signed Word (16 bit) [Array]" },
+		{ CIM_UINT16, L"Word (16 bit)", L"Word (16 bit) [Array]" },
+		{ CIM_SINT32, L"Signed Int (32 bit)", L"Signed Int (32 bit) [Array]" },
+		{ CIM_UINT32, L"Int (32 bit)", L"Int (32 bit) [Array]" },
+		{ CIM_SINT64, L"Signed QWord (64 bit)", L"Signed QWord (64 bit) [Array]" },
+		{ CIM_UINT64, L"QWord (64 bit)", L"QWord (64 bit) [Array]" },
+		{ CIM_REAL32, L"Real (32 bit)", L"Real (32 bit) [Array]" },
+		{ CIM_REAL64, L"Real (64 bit)", L"Real (64 bit) [Array]" },
+		{ CIM_BOOLEAN, L"Boolean", L"Boolean [Array]" },
+		{ CIM_STRING, L"String", L"String [Array]" },
+		{ CIM_DATETIME, L"Date Time", L"Date Time [Array]" },
+		{ CIM_REFERENCE, L"Reference", L"Reference [Array]" },
+		{ CIM_CHAR16, L"Character", L"Character [Array]" },
+		{ CIM_OBJECT, L"Object", L"Object [Array]" },
+	};
+
+	auto array = (type & CIM_FLAG_ARRAY) != 0;
+	for (auto& name : names)
+		if (name.Type == (type & 0xff))
+			return array ? name.Array : name.Scalar;
+	return array ? L" [Array]" : L"";
+}
+
+void CellText::AppendValue(std::wstring& text, VARIANT const& value, CIMTYPE type) {
+	if (value.vt == VT_NULL || value.vt == VT_EMPTY)
+		return;
+
+	if (type & CIM_FLAG_ARRAY) {
+		if ((value.vt & VT_ARRAY) == 0 || value.parray == nullptr)
+			return;
+
+		auto count = value.parray->rgsabound[0].cElements;
+		void* data;
+		if (FAILED(::SafeArrayAccessData(value.parray, &data)))
+			return;
+
+		switch (type & 0xff) {
+			case CIM_STRING:
+			{
+				auto strings = static_cast<BSTR*>(data);
+				for (ULONG i = 0; i < count; i++) {
+					if (i > 0)
+						text += L", ";
+					if (strings[i])
+						text += strings[i];
+				}
+				break;
+			}
+
+			case CIM_SINT8:
+			case CIM_UINT8:
+			{
+				auto bytes = static_cast<BYTE*>(data);
+				for (ULONG i = 0; i < std::min(count, (ULONG)64); i++)
+					std::format_to(std::back_inserter(text), L"{:02X} ", bytes[i]);
+				break;
+			}
+		}
+		::SafeArrayUnaccessData(value.parray);
+		return;
+	}
+
+	switch (value.vt) {
+		case VT_BOOL: text += value.boolVal ? L"True" : L"False"; return;
+		case VT_BSTR:
+			if (value.bstrVal)
+				text += value.bstrVal;
+			return;
+
+		case VT_I1: std::format_to(std::back_inserter(text), L"{}", (int)value.cVal); return;
+		case VT_UI1: std::format_to(std::back_inserter(text), L"{}", (int)value.bVal); return;
+		case VT_I2: std::format_to(std::back_inserter(text), L"{}", value.iVal); return;
+		case VT_UI2: std::format_to(std::back_inserter(text), L"{}", value.uiVal); return;
+		case VT_I4: std::format_to(std::back_inserter(text), L"{}", value.lVal); return;
+		case VT_UI4: std::format_to(std::back_inserter(text), L"{}", value.ulVal); return;
+		case VT_I8: std::format_to(std::back_inserter(text), L"{}", value.llVal); return;
+		case VT_UI8: std::format_to(std::back_inserter(text), L"{}", value.ullVal); return;
+		case VT_R4: std::format_to(std::back_inserter(text), L"{}", value.fltVal); return;
+		case VT_R8: std::format_to(std::back_inserter(text), L"{}", value.dblVal); return;
+	}
+
+	//
+	// anything else is rare enough to go through a conversion
+	//
+	CComVariant converted;
+	if (SUCCEEDED(converted.ChangeType(VT_BSTR, &value)) && converted.bstrVal)
+		text += converted.bstrVal;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+//
+// formatted text of list view cells, kept in one growing buffer so a repaint of a
+// cell already seen returns a pointer instead of building a string again.
+// Returned pointers are valid until the next Add or Reset
+//
+class CellCache {
+public:
+	void Reset(int columns);
+	void Invalidate(int col);
+
+	PCWSTR Find(size_t row, int col) const;
+	PCWSTR Add(size_t row, int col, std::wstring_view text);
+
+	//
+	// empty scratch buffer to format into before Add; keeps its capacity between cells
+	//
+	std::wstring& GetBuffer();
+
+	size_t GetMemorySize() const;
+
+private:
+	static constexpr DWORD NoText = 0xffffffff;
+
+	void Compact();
+
+	std::vector<WCHAR> m_Text;
+	std::vector<DWORD> m_Offsets;	// row * columns + column
+	std::wstring m_Buffer;
+	size_t m_Dead{ 0 };		// characters of invalidated cells
+	int m_Columns{ 0 };
+};
+
+//
+// cell text that does not depend on a particular value
+//
+struct CellText abstract final {
+	static PCWSTR CimTypeToText(CIMTYPE type);
+	//
+	// property value as shown in the list; arrays show strings and bytes only
+	//
+	static void AppendValue(std::wstring& text, VARIANT const& value, CIMTYPE type);
+};
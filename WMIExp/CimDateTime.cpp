@@ -0,0 +1,129 @@
+#include "CimDateTime.h"
+
+namespace {
+	const int64_t TicksPerMinute = 600000000LL;
+	const int64_t TicksPerDay = 1440 * TicksPerMinute;
+	const int64_t DaysFrom1601To1970 = 134774;
+
+	//
+	// proleptic Gregorian calendar <-> days since 1970-01-01
+	//
+	int64_t DaysFromCivil(int y, int m, int d) {
+		y -= m <= 2;
+		int64_t era = (y >= 0 ? y : y - 399) / 400;
+		int yoe = int(y - era * 400);
+		int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+		int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+		return era * 146097 + doe - 719468;
+	}
+
+	void CivilFromDays(int64_t days, int& y, int& m, int& d) {
+		days += 719468;
+		int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+		int doe = int(days - era * 146097);
+		int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+		int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+		int mp = (5 * doy + 2) / 153;
+		d = doy - (153 * mp + 2) / 5 + 1;
+		m = mp < 10 ? mp + 3 : mp - 9;
+		y = int(yoe + era * 400) + (m <= 2);
+	}
+
+	void AppendDigits(std::wstring& text, int64_t value, int width) {
+		wchar_t digits[20];
+		int count = 0;
+		do {
+			digits[count++] = wchar_t(L'0' + value % 10);
+			value /= 10;
+		} while (value && count < 20);
+		while (count < width && count < 20)
+			digits[count++] = L'0';
+		while (count)
+			text += digits[--count];
+	}
+}
+
+bool CimDateTime::Parse(std::wstring_view text, int64_t& ticks, int16_t& offset) {
+	if (text.length() != 25 || text[14] != L'.')
+		return false;
+
+	auto number = [&](size_t pos, size_t len, int& value) {
+		value = 0;
+		for (auto i = pos; i < pos + len; i++) {
+			if (text[i] < L'0' || text[i] > L'9')
+				return false;
+			value = value * 10 + (text[i] - L'0');
+		}
+		return true;
+	};
+	int hour, minute, second, micro, utc;
+	if (!number(8, 2, hour) || !number(10, 2, minute) || !number(12, 2, second) || !number(15, 6, micro) || !number(22, 3, utc))
+		return false;
+
+	auto time = ((hour * 60LL + minute) * 60 + second) * 10000000LL + micro * 10LL;
+	if (text[21] == L':') {
+		//
+		// the longest intervals (up to 99999999 days) do not fit in 64 bit ticks
+		//
+		int days;
+		if (!number(0, 8, days) || days >= INT64_MAX / TicksPerDay)
+			return false;
+		ticks = days * TicksPerDay + time;
+		offset = IntervalOffset;
+		return true;
+	}
+
+	int year, month, day;
+	if ((text[21] != L'+' && text[21] != L'-') || !number(0, 4, year) || !number(4, 2, month) || !number(6, 2, day)
+		|| month < 1 || month > 12 || day < 1 || day > 31)
+		return false;
+
+	offset = int16_t(text[21] == L'-' ? -utc : utc);
+	ticks = (DaysFromCivil(year, month, day) + DaysFrom1601To1970) * TicksPerDay + time - offset * TicksPerMinute;
+	return true;
+}
+
+std::wstring CimDateTime::Format(int64_t ticks, int16_t offset) {
+	std::wstring text;
+	Append(text, ticks, offset);
+	return text;
+}
+
+void CimDateTime::Append(std::wstring& text, int64_t ticks, int16_t offset) {
+	auto interval = offset == IntervalOffset;
+	if (!interval)
+		ticks += offset * TicksPerMinute;
+
+	//
+	// floor division: dates before 1601 have negative ticks
+	//
+	auto days = ticks / TicksPerDay;
+	auto time = ticks % TicksPerDay;
+	if (time < 0) {
+		time += TicksPerDay;
+		days--;
+	}
+	auto micro = int(time / 10 % 1000000);
+	auto seconds = int(time / 10000000);
+	if (interval) {
+		AppendDigits(text, days, 8);
+	}
+	else {
+		int year, month, day;
+		CivilFromDays(days - DaysFrom1601To1970, year, month, day);
+		AppendDigits(text, year, 4);
+		AppendDigits(text, month, 2);
+		AppendDigits(text, day, 2);
+	}
+	AppendDigits(text, seconds / 3600, 2);
+	AppendDigits(text, seconds / 60 % 60, 2);
+	AppendDigits(text, seconds % 60, 2);
+	text += L'.';
+	AppendDigits(text, micro, 6);
+	if (interval) {
+		text += L":000";
+		return;
+	}
+	text += offset < 0 ? L'-' : L'+';
+	AppendDigits(text, offset < 0 ? -offset : offset, 3);
+}
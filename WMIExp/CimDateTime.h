@@ -0,0 +1,22 @@
+#pragma once
+
+//
+// CIM DATETIME text (yyyymmddHHMMSS.mmmmmmsUUU, or ddddddddHHMMSS.mmmmmm:000 for an interval)
+// to and from ticks. Plain C++ with no Windows or WMI dependency, so it builds on its own (see WMIExp.Tests)
+//
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+struct CimDateTime {
+	static const int16_t IntervalOffset = INT16_MIN;
+
+	//
+	// UTC ticks (100 nsec since 1601, negative before it) and the UTC offset in minutes, or IntervalOffset with the
+	// length of the interval in ticks. Wildcard (asterisk) fields, and intervals too long for 64 bit ticks
+	// (over 10675198 days), are not supported
+	//
+	static bool Parse(std::wstring_view text, int64_t& ticks, int16_t& offset);
+	static std::wstring Format(int64_t ticks, int16_t offset);
+	static void Append(std::wstring& text, int64_t ticks, int16_t offset);
+};
@@ -0,0 +1,121 @@
+#include "pch.h"
+#include "ClassGraph.h"
+
+void ClassGraph::Add(std::wstring name, std::wstring superClass) {
+	m_Index.try_emplace(MakeKey(name), (int)m_Names.size());
+	m_Names.push_back(std::move(name));
+	m_SuperNames.push_back(std::move(superClass));
+}
+
+void ClassGraph::Build() {
+	auto count = (int)m_Names.size();
+	m_Parents.assign(count, None);
+	m_ChildStart.assign(count + 1, 0);
+	m_Roots.clear();
+
+	//
+	// resolve parents and count children, a superclass that is not part of the graph makes a root
+	//
+	for (int i = 0; i < count; i++) {
+		auto parent = m_SuperNames[i].empty() ? None : Find(m_SuperNames[i].c_str());
+		if (parent == i)
+			parent = None;
+		m_Parents[i] = parent;
+		if (parent == None)
+			m_Roots.push_back(i);
+		else
+			m_ChildStart[parent + 1]++;
+	}
+	for (int i = 0; i < count; i++)
+		m_ChildStart[i + 1] += m_ChildStart[i];
+
+	m_Children.resize(m_ChildStart[count]);
+	std::vector<int> next(m_ChildStart.begin(), m_ChildStart.end() - 1);
+	for (int i = 0; i < count; i++)
+		if (m_Parents[i] != None)
+			m_Children[next[m_Parents[i]]++] = i;
+
+	auto byName = [&](int i1, int i2) {
+		return ::_wcsicmp(m_Names[i1].c_str(), m_Names[i2].c_str()) < 0;
+	};
+	for (int i = 0; i < count; i++)
+		std::sort(m_Children.begin() + m_ChildStart[i], m_Children.begin() + m_ChildStart[i + 1], byName);
+	std::sort(m_Roots.begin(), m_Roots.end(), byName);
+
+	m_SuperNames.clear();
+	m_SuperNames.shrink_to_fit();
+}
+
+void ClassGraph::Clear() {
+	m_Names.clear();
+	m_SuperNames.clear();
+	m_Index.clear();
+	m_Parents.clear();
+	m_ChildStart.clear();
+	m_Children.clear();
+	m_Roots.clear();
+}
+
+bool ClassGraph::IsEmpty() const {
+	return m_Names.empty();
+}
+
+int ClassGraph::GetCount() const {
+	return (int)m_Names.size();
+}
+
+int ClassGraph::Find(PCWSTR name) const {
+	auto it = m_Index.find(MakeKey(name));
+	return it == m_Index.end() ? None : it->second;
+}
+
+std::wstring const& ClassGraph::GetName(int index) const {
+	return m_Names[index];
+}
+
+int ClassGraph::GetParent(int index) const {
+	return index >= 0 && index < (int)m_Parents.size() ? m_Parents[index] : None;
+}
+
+std::span<int const> ClassGraph::GetChildren(int index) const {
+	if (index < 0 || index + 1 >= (int)m_ChildStart.size())
+		return {};
+	return { m_Children.data() + m_ChildStart[index], m_Children.data() + m_ChildStart[index + 1] };
+}
+
+std::span<int const> ClassGraph::GetRoots() const {
+	return m_Roots;
+}
+
+std::vector<int> ClassGraph::GetDerived(int index) const {
+	std::vector<int> derived;
+	std::vector<int> stack;
+	auto push = [&](int i) {
+		auto children = GetChildren(i);
+		stack.insert(stack.end(), children.rbegin(), children.rend());
+	};
+	push(index);
+	while (!stack.empty() && derived.size() < m_Names.size()) {
+		auto i = stack.back();
+		stack.pop_back();
+		derived.push_back(i);
+		push(i);
+	}
+	return derived;
+}
+
+std::vector<int> ClassGraph::GetAncestors(int index) const {
+	std::vector<int> ancestors;
+	//
+	// the count bounds the walk in case of a (malformed) cycle
+	//
+	for (auto i = GetParent(index); i != None && ancestors.size() < m_Names.size(); i = GetParent(i))
+		ancestors.push_back(i);
+	return ancestors;
+}
+
+std::wstring ClassGraph::MakeKey(std::wstring_view name) {
+	std::wstring key(name);
+	::CharLowerBuff(key.data(), (DWORD)key.length());
+	return key;
+}
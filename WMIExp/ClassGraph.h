@@ -0,0 +1,50 @@
+#pragma once
+
+#include <unordered_map>
+#include <span>
+
+//
+// inheritance graph of the classes of a namespace, built from __SUPERCLASS.
+// Classes are numbered densely; the children of each class are stored contiguously
+// (CSR layout), so parent and child lookups are O(1) and need no further WMI calls
+//
+class ClassGraph {
+public:
+	static constexpr int None = -1;
+
+	//
+	// collect classes in any order, then call Build once
+	//
+	void Add(std::wstring name, std::wstring superClass);
+	void Build();
+	void Clear();
+
+	bool IsEmpty() const;
+	int GetCount() const;
+	int Find(PCWSTR name) const;
+	std::wstring const& GetName(int index) const;
+
+	int GetParent(int index) const;
+	std::span<int const> GetChildren(int index) const;
+	std::span<int const> GetRoots() const;
+
+	//
+	// all classes derived from the class, directly or not, in depth first order
+	//
+	std::vector<int> GetDerived(int index) const;
+	//
+	// the superclass chain of the class, nearest first
+	//
+	std::vector<int> GetAncestors(int index) const;
+
+private:
+	static std::wstring MakeKey(std::wstring_view name);
+
+	std::vector<std::wstring> m_Names;
+	std::vector<std::wstring> m_SuperNames;		// only needed until Build
+	std::unordered_map<std::wstring, int> m_Index;
+	std::vector<int> m_Parents;
+	std::vector<int> m_ChildStart;		// m_Children range of class i is [m_ChildStart[i], m_ChildStart[i + 1])
+	std::vector<int> m_Children;
+	std::vector<int> m_Roots;
+};
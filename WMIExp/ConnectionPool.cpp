@@ -0,0 +1,207 @@
+#include "pch.h"
+#include "ConnectionPool.h"
+#include "WMIHelper.h"
+
+ConnectionPool& ConnectionPool::Get() {
+	static ConnectionPool pool;
+	return pool;
+}
+
+HRESULT ConnectionPool::GetService(PCWSTR nsPath, IWbemServices** ppSvc) {
+	auto key = MakeKey(nsPath);
+	auto table = GetTable();
+	if (table == nullptr)
+		return WMIHelper::Init(nullptr, nsPath, ppSvc);
+
+	DWORD cookie = 0;
+	{
+		std::lock_guard lock(m_Lock);
+		if (auto it = m_Index.find(key); it != m_Index.end())
+			cookie = it->second->Cookie;
+	}
+	//
+	// unmarshaling gives a proxy for the calling apartment. Only a connection that unmarshals
+	// counts as reused; one that does not (e.g. its server went away) is dropped and opened again
+	//
+	if (cookie) {
+		if (SUCCEEDED(table->GetInterfaceFromGlobal(cookie, __uuidof(IWbemServices), reinterpret_cast<void**>(ppSvc)))) {
+			std::lock_guard lock(m_Lock);
+			if (auto it = m_Index.find(key); it != m_Index.end() && it->second->Cookie == cookie) {
+				auto& entry = *it->second;
+				entry.Info.Uses++;
+				entry.Info.LastUsed = ::GetTickCount64();
+				m_Entries.splice(m_Entries.begin(), m_Entries, it->second);
+				m_Hits++;
+				m_SavedUsec += entry.Info.OpenUsec;
+			}
+			return S_OK;
+		}
+		std::vector<DWORD> revoked;
+		{
+			std::lock_guard lock(m_Lock);
+			if (auto removed = Remove(key, cookie)) {
+				revoked.push_back(removed);
+				m_Evictions++;
+			}
+		}
+		Revoke(table, revoked);
+	}
+
+	LARGE_INTEGER start, end, freq;
+	::QueryPerformanceCounter(&start);
+	CComPtr<IWbemServices> spSvc;
+	auto hr = WMIHelper::Init(nullptr, nsPath, &spSvc);
+	::QueryPerformanceCounter(&end);
+	::QueryPerformanceFrequency(&freq);
+	auto usec = DWORD((end.QuadPart - start.QuadPart) * 1000000 / freq.QuadPart);
+	if (FAILED(hr)) {
+		std::lock_guard lock(m_Lock);
+		m_Failures++;
+		return hr;
+	}
+	if (FAILED(table->RegisterInterfaceInGlobal(spSvc, __uuidof(IWbemServices), &cookie)))
+		cookie = 0;
+
+	std::vector<DWORD> revoked;
+	{
+		std::lock_guard lock(m_Lock);
+		m_Misses++;
+		m_OpenUsec += usec;
+		if (cookie) {
+			//
+			// another thread may have opened the same namespace meanwhile; the newer connection wins
+			//
+			if (auto removed = Remove(key))
+				revoked.push_back(removed);
+			m_Entries.push_front({ key, { nsPath, 1, usec, ::GetTickCount64() }, cookie });
+			m_Index[key] = m_Entries.begin();
+			while (m_Entries.size() > m_Capacity) {
+				auto& last = m_Entries.back();
+				revoked.push_back(last.Cookie);
+				m_Index.erase(last.Key);
+				m_Entries.pop_back();
+				m_Evictions++;
+			}
+		}
+	}
+	Revoke(table, revoked);
+	*ppSvc = spSvc.Detach();
+	return S_OK;
+}
+
+void ConnectionPool::Discard(PCWSTR nsPath) {
+	std::vector<DWORD> revoked;
+	CComPtr<IGlobalInterfaceTable> table;
+	{
+		std::lock_guard lock(m_Lock);
+		table = m_spTable;
+		if (auto removed = Remove(MakeKey(nsPath)))
+			revoked.push_back(removed);
+	}
+	Revoke(table, revoked);
+}
+
+HRESULT ConnectionPool::CheckCall(PCWSTR nsPath, HRESULT hr) {
+	if (IsBroken(hr))
+		Discard(nsPath);
+	return hr;
+}
+
+bool ConnectionPool::IsBroken(HRESULT hr) {
+	return hr == RPC_E_DISCONNECTED || hr == HRESULT_FROM_WIN32(RPC_S_SERVER_UNAVAILABLE) || hr == WBEM_E_TRANSPORT_FAILURE;
+}
+
+void ConnectionPool::Clear() {
+	//
+	// the table goes too, so nothing COM is left for the static destructor
+	//
+	std::vector<DWORD> revoked;
+	CComPtr<IGlobalInterfaceTable> table;
+	{
+		std::lock_guard lock(m_Lock);
+		for (auto& entry : m_Entries)
+			revoked.push_back(entry.Cookie);
+		m_Entries.clear();
+		m_Index.clear();
+		table.Attach(m_spTable.Detach());
+	}
+	Revoke(table, revoked);
+}
+
+void ConnectionPool::SetCapacity(size_t capacity) {
+	std::vector<DWORD> revoked;
+	CComPtr<IGlobalInterfaceTable> table;
+	{
+		std::lock_guard lock(m_Lock);
+		table = m_spTable;
+		m_Capacity = std::max<size_t>(1, capacity);
+		while (m_Entries.size() > m_Capacity) {
+			auto& last = m_Entries.back();
+			revoked.push_back(last.Cookie);
+			m_Index.erase(last.Key);
+			m_Entries.pop_back();
+			m_Evictions++;
+		}
+	}
+	Revoke(table, revoked);
+}
+
+ConnectionPoolStats ConnectionPool::GetStats() const {
+	std::lock_guard lock(m_Lock);
+	ConnectionPoolStats stats{};
+	stats.Connections = m_Entries.size();
+	stats.Capacity = m_Capacity;
+	stats.Hits = m_Hits;
+	stats.Misses = m_Misses;
+	stats.Evictions = m_Evictions;
+	stats.Failures = m_Failures;
+	stats.OpenUsec = m_OpenUsec;
+	stats.SavedUsec = m_SavedUsec;
+	return stats;
+}
+
+std::vector<PooledConnection> ConnectionPool::GetConnections() const {
+	std::lock_guard lock(m_Lock);
+	std::vector<PooledConnection> connections;
+	connections.reserve(m_Entries.size());
+	for (auto& entry : m_Entries)
+		connections.push_back(entry.Info);
+	return connections;
+}
+
+std::wstring ConnectionPool::MakeKey(PCWSTR path) {
+	std::wstring key(path);
+	::CharLowerBuff(key.data(), (DWORD)key.length());
+	return key;
+}
+
+CComPtr<IGlobalInterfaceTable> ConnectionPool::GetTable() {
+	//
+	// the table is free threaded, one instance serves all apartments
+	//
+	std::lock_guard lock(m_Lock);
+	if (m_spTable == nullptr)
+		m_spTable.CoCreateInstance(CLSID_StdGlobalInterfaceTable);
+	return m_spTable;
+}
+
+DWORD ConnectionPool::Remove(std::wstring const& key, DWORD cookie) {
+	//
+	// with the lock held; a cookie, if given, must match, so a newer connection is left alone.
+	// Returns the cookie to revoke, 0 if nothing was removed
+	//
+	auto it = m_Index.find(key);
+	if (it == m_Index.end() || (cookie && it->second->Cookie != cookie))
+		return 0;
+
+	auto removed = it->second->Cookie;
+	m_Entries.erase(it->second);
+	m_Index.erase(it);
+	return removed;
+}
+
+void ConnectionPool::Revoke(IGlobalInterfaceTable* table, std::vector<DWORD> const& cookies) {
+	if (table)
+		for (auto cookie : cookies)
+			table->RevokeInterfaceFromGlobal(cookie);
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+struct PooledConnection {
+	std::wstring Path;
+	ULONG Uses;				// times handed out, the opening included
+	DWORD OpenUsec;			// what opening the namespace took
+	ULONGLONG LastUsed;		// tick count
+};
+
+struct ConnectionPoolStats {
+	size_t Connections;
+	size_t Capacity;
+	ULONG Hits;
+	ULONG Misses;
+	ULONG Evictions;
+	ULONG Failures;
+	ULONGLONG OpenUsec;		// spent opening namespaces
+	ULONGLONG SavedUsec;	// opening time avoided by reuse, by the cost of each namespace's opening
+};
+
+//
+// opened IWbemServices by namespace path, shared by the UI and the workers. Connections are
+// registered in the global interface table, so a connection opened on a worker (MTA) is usable
+// on the UI thread (STA) and the other way around. Once the pool is full the least recently
+// used connection goes
+//
+class ConnectionPool {
+public:
+	static const size_t DefaultCapacity = 32;
+
+	static ConnectionPool& Get();
+
+	//
+	// an open connection to the namespace, from the pool if there is one
+	//
+	HRESULT GetService(PCWSTR nsPath, IWbemServices** ppSvc);
+
+	//
+	// forgets the namespace's connection, e.g. after it broke
+	//
+	void Discard(PCWSTR nsPath);
+	//
+	// discards the namespace's connection if a call on it failed because the connection
+	// itself is gone (see IsBroken); returns hr
+	//
+	HRESULT CheckCall(PCWSTR nsPath, HRESULT hr);
+	static bool IsBroken(HRESULT hr);
+	void Clear();
+
+	void SetCapacity(size_t capacity);
+
+	ConnectionPoolStats GetStats() const;
+	//
+	// most recently used first
+	//
+	std::vector<PooledConnection> GetConnections() const;
+
+private:
+	struct Entry {
+		std::wstring Key;
+		PooledConnection Info;
+		DWORD Cookie;			// in the global interface table
+	};
+
+	ConnectionPool() = default;
+
+	static std::wstring MakeKey(PCWSTR path);
+	CComPtr<IGlobalInterfaceTable> GetTable();
+	static void Revoke(IGlobalInterfaceTable* table, std::vector<DWORD> const& cookies);
+	DWORD Remove(std::wstring const& key, DWORD cookie = 0);
+
+	mutable std::mutex m_Lock;
+	CComPtr<IGlobalInterfaceTable> m_spTable;
+	std::list<Entry> m_Entries;			// most recently used first
+	std::unordered_map<std::wstring, std::list<Entry>::iterator> m_Index;
+	size_t m_Capacity{ DefaultCapacity };
+	ULONG m_Hits{ 0 }, m_Misses{ 0 }, m_Evictions{ 0 }, m_Failures{ 0 };
+	ULONGLONG m_OpenUsec{ 0 }, m_SavedUsec{ 0 };
+};
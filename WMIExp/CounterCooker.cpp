@@ -0,0 +1,125 @@
+#include "pch.h"
+#include "CounterCooker.h"
+#include "PerfMonitor.h"
+#include "SchemaCache.h"
+
+void CounterCooker::Bind(PerfMonitor const& monitor, ClassSchema const& schema) {
+	m_Plans.clear();
+	m_Values.clear();
+	m_Rows = 0;
+	for (int c = 0; c < monitor.GetCounterCount(); c++) {
+		auto& name = monitor.GetCounter(c).Name;
+		auto prop = std::find_if(schema.Properties.begin(), schema.Properties.end(), [&](auto& p) { return p.Name == name; });
+		auto type = prop == schema.Properties.end() ? 0 : prop->CounterType;
+
+		CounterPlan plan;
+		plan.Formula = CounterFormula::FromType(type);
+		plan.Percent = CounterFormula::IsPercent(type);
+		switch (CounterFormula::GetTimeBase(type)) {
+			case CookTimeBase::Sys100Ns:
+				plan.Time = monitor.FindCounter(L"Timestamp_Sys100NS");
+				plan.Frequency = monitor.FindCounter(L"Frequency_Sys100NS");
+				break;
+			case CookTimeBase::Object:
+				plan.Time = monitor.FindCounter(L"Timestamp_Object");
+				plan.Frequency = monitor.FindCounter(L"Frequency_Object");
+				break;
+			default:
+				plan.Time = monitor.FindCounter(L"Timestamp_PerfTime");
+				plan.Frequency = monitor.FindCounter(L"Frequency_PerfTime");
+				break;
+		}
+		plan.Base = monitor.FindCounter((name + L"_Base").c_str());
+
+		//
+		// a counter whose companions are missing is shown raw rather than cooked wrong
+		//
+		auto formula = plan.Formula;
+		if ((CounterFormula::UsesTime(formula) && plan.Time < 0) || (CounterFormula::UsesFrequency(formula) && plan.Frequency < 0)
+			|| (CounterFormula::UsesBase(formula) && plan.Base < 0))
+			plan.Formula = CookFormula::Raw;
+		m_Plans.push_back(plan);
+	}
+}
+
+void CounterCooker::Cook(PerfMonitor const& monitor) {
+	m_Rows = monitor.GetInstances().size();
+	m_Values.resize(m_Plans.size() * m_Rows);
+
+	//
+	// time stamps and frequencies are shared by most counters; they are gathered once
+	//
+	int time = -1, frequency = -1, base = -1;
+	for (int c = 0; c < (int)m_Plans.size(); c++) {
+		auto& plan = m_Plans[c];
+		Gather(monitor, c, 0, m_N1);
+		Gather(monitor, c, 1, m_N0);
+		CookInput input{ m_N1.data(), m_N0.data() };
+		if (plan.Time >= 0) {
+			if (plan.Time != time) {
+				Gather(monitor, plan.Time, 0, m_D1);
+				Gather(monitor, plan.Time, 1, m_D0);
+				time = plan.Time;
+			}
+			input.D1 = m_D1.data();
+			input.D0 = m_D0.data();
+		}
+		if (plan.Frequency >= 0) {
+			if (plan.Frequency != frequency) {
+				Gather(monitor, plan.Frequency, 0, m_F);
+				frequency = plan.Frequency;
+			}
+			input.F = m_F.data();
+		}
+		if (plan.Base >= 0) {
+			if (plan.Base != base) {
+				Gather(monitor, plan.Base, 0, m_B1);
+				Gather(monitor, plan.Base, 1, m_B0);
+				base = plan.Base;
+			}
+			input.B1 = m_B1.data();
+			input.B0 = m_B0.data();
+		}
+		CounterFormula::Cook(plan.Formula, input, m_Values.data() + c * m_Rows, m_Rows);
+	}
+}
+
+bool CounterCooker::IsBound() const {
+	return !m_Plans.empty();
+}
+
+CookFormula CounterCooker::GetFormula(int counter) const {
+	return m_Plans[counter].Formula;
+}
+
+double CounterCooker::GetValue(int row, int counter) const {
+	return (size_t)row < m_Rows ? m_Values[counter * m_Rows + row] : 0.0;
+}
+
+void CounterCooker::AppendValue(int row, int counter, std::wstring& text) const {
+	auto& plan = m_Plans[counter];
+	auto value = GetValue(row, counter);
+	switch (plan.Formula) {
+		case CookFormula::Raw:
+		case CookFormula::Hidden:
+		case CookFormula::Delta:
+			std::format_to(std::back_inserter(text), L"{}", (LONGLONG)value);
+			break;
+
+		default:
+			std::format_to(std::back_inserter(text), plan.Percent ? L"{:.2f}%" : L"{:.3f}", value);
+			break;
+	}
+}
+
+void CounterCooker::Gather(PerfMonitor const& monitor, int counter, UINT back, std::vector<ULONGLONG>& values) {
+	//
+	// an instance seen once has no previous sample; using the current one cooks it to 0
+	//
+	auto& instances = monitor.GetInstances();
+	values.resize(instances.size());
+	for (size_t i = 0; i < instances.size(); i++) {
+		auto instance = instances[i];
+		values[i] = monitor.GetValue(instance, counter, monitor.GetSampleCount(instance) > back ? back : 0);
+	}
+}
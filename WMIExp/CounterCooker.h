@@ -0,0 +1,45 @@
+#pragma once
+
+#include "CounterFormula.h"
+
+class PerfMonitor;
+struct ClassSchema;
+
+//
+// cooks the counters of a PerfMonitor for all instances of a class at once (see CounterFormula)
+//
+class CounterCooker {
+public:
+	//
+	// matches the monitor's counters with their CounterType, base and time stamp counters
+	//
+	void Bind(PerfMonitor const& monitor, ClassSchema const& schema);
+	//
+	// cooks the latest two samples of every live instance
+	//
+	void Cook(PerfMonitor const& monitor);
+
+	bool IsBound() const;
+	CookFormula GetFormula(int counter) const;
+	double GetValue(int row, int counter) const;
+	void AppendValue(int row, int counter, std::wstring& text) const;
+
+private:
+	struct CounterPlan {
+		CookFormula Formula{ CookFormula::Raw };
+		int Base{ -1 };
+		int Time{ -1 };
+		int Frequency{ -1 };
+		bool Percent{ false };
+	};
+
+	void Gather(PerfMonitor const& monitor, int counter, UINT back, std::vector<ULONGLONG>& values);
+
+	std::vector<CounterPlan> m_Plans;
+	//
+	// cooked values by counter, then row
+	//
+	std::vector<double> m_Values;
+	size_t m_Rows{ 0 };
+	std::vector<ULONGLONG> m_N1, m_N0, m_D1, m_D0, m_B1, m_B0, m_F;
+};
@@ -0,0 +1,197 @@
+#include "CounterFormula.h"
+
+namespace {
+	//
+	// CounterType bits, as in winperf.h
+	//
+	enum : uint32_t {
+		PerfCounterTypeMask = 0x00070000,
+		PerfCounterBase = 0x00030000,
+		PerfTimerMask = 0x00300000,
+		PerfTimer100Ns = 0x00100000,
+		PerfObjectTimer = 0x00200000,
+		PerfSizeMask = 0x00000300,
+		PerfSizeZero = 0x00000200,
+		PerfTypeMask = 0x00000C00,
+		PerfTypeText = 0x00000800,
+		PerfDisplayMask = 0xF0000000,
+		PerfDisplayPercent = 0x20000000,
+	};
+
+	//
+	// counters are cumulative, so a negative difference means the counter was reset
+	// (or wrapped) between the samples; it counts as no progress
+	//
+	inline double Diff(uint64_t v1, uint64_t v0) {
+		auto d = (double)(int64_t)(v1 - v0);
+		return d > 0 ? d : 0.0;
+	}
+
+	inline double Ratio(double n, double d) {
+		return d != 0 ? n / d : 0.0;
+	}
+
+	inline double Clamp(double v) {
+		return v > 0 ? v : 0.0;
+	}
+}
+
+CookFormula CounterFormula::FromType(uint32_t type) {
+	switch (type) {
+		case PerfCounterCounter:
+		case PerfCounterBulkCount:
+		case PerfSampleCounter:
+			return CookFormula::Rate;
+		case PerfCounterTimer:
+		case Perf100NsecTimer:
+			return CookFormula::Timer;
+		case PerfCounterTimerInv:
+		case Perf100NsecTimerInv:
+			return CookFormula::TimerInverse;
+		case PerfCounterMultiTimer:
+		case Perf100NsecMultiTimer:
+			return CookFormula::MultiTimer;
+		case PerfCounterMultiTimerInv:
+		case Perf100NsecMultiTimerInv:
+			return CookFormula::MultiTimerInverse;
+		case PerfCounterQueueLen:
+		case PerfCounterLargeQueueLen:
+		case PerfCounter100NsQueueLen:
+		case PerfCounterObjTimeQueueLen:
+			return CookFormula::QueueLength;
+		case PerfRawFraction:
+		case PerfLargeRawFraction:
+			return CookFormula::RawFraction;
+		case PerfSampleFraction:
+			return CookFormula::SampleFraction;
+		case PerfPrecisionSystemTimer:
+		case PerfPrecision100NsTimer:
+		case PerfPrecisionObjectTimer:
+			return CookFormula::PrecisionTimer;
+		case PerfAverageTimer: return CookFormula::AverageTimer;
+		case PerfAverageBulk: return CookFormula::AverageBulk;
+		case PerfCounterDelta:
+		case PerfCounterLargeDelta:
+			return CookFormula::Delta;
+		case PerfElapsedTime: return CookFormula::Elapsed;
+	}
+	if ((type & PerfCounterTypeMask) == PerfCounterBase || (type & PerfSizeMask) == PerfSizeZero || (type & PerfTypeMask) == PerfTypeText)
+		return CookFormula::Hidden;
+	return CookFormula::Raw;
+}
+
+CookTimeBase CounterFormula::GetTimeBase(uint32_t type) {
+	switch (type & PerfTimerMask) {
+		case PerfTimer100Ns: return CookTimeBase::Sys100Ns;
+		case PerfObjectTimer: return CookTimeBase::Object;
+	}
+	return CookTimeBase::PerfTime;
+}
+
+bool CounterFormula::IsPercent(uint32_t type) {
+	return (type & PerfDisplayMask) == PerfDisplayPercent;
+}
+
+bool CounterFormula::UsesTime(CookFormula formula) {
+	switch (formula) {
+		case CookFormula::Rate:
+		case CookFormula::Elapsed:
+		case CookFormula::Timer:
+		case CookFormula::TimerInverse:
+		case CookFormula::QueueLength:
+		case CookFormula::MultiTimer:
+		case CookFormula::MultiTimerInverse:
+			return true;
+		default: break;
+	}
+	return false;
+}
+
+bool CounterFormula::UsesFrequency(CookFormula formula) {
+	return formula == CookFormula::Rate || formula == CookFormula::Elapsed || formula == CookFormula::AverageTimer;
+}
+
+bool CounterFormula::UsesBase(CookFormula formula) {
+	switch (formula) {
+		case CookFormula::MultiTimer:
+		case CookFormula::MultiTimerInverse:
+		case CookFormula::RawFraction:
+		case CookFormula::SampleFraction:
+		case CookFormula::PrecisionTimer:
+		case CookFormula::AverageBulk:
+		case CookFormula::AverageTimer:
+			return true;
+		default: break;
+	}
+	return false;
+}
+
+void CounterFormula::Cook(CookFormula formula, CookInput const& in, double* values, size_t count) {
+	switch (formula) {
+		case CookFormula::Rate:
+			for (size_t i = 0; i < count; i++)
+				values[i] = Ratio(Diff(in.N1[i], in.N0[i]) * (double)in.F[i], Diff(in.D1[i], in.D0[i]));
+			break;
+
+		case CookFormula::Timer:
+			for (size_t i = 0; i < count; i++)
+				values[i] = 100 * Ratio(Diff(in.N1[i], in.N0[i]), Diff(in.D1[i], in.D0[i]));
+			break;
+
+		case CookFormula::TimerInverse:
+			for (size_t i = 0; i < count; i++)
+				values[i] = Clamp(100 * (1 - Ratio(Diff(in.N1[i], in.N0[i]), Diff(in.D1[i], in.D0[i]))));
+			break;
+
+		case CookFormula::MultiTimer:
+			for (size_t i = 0; i < count; i++)
+				values[i] = Ratio(100 * Ratio(Diff(in.N1[i], in.N0[i]), Diff(in.D1[i], in.D0[i])), (double)in.B1[i]);
+			break;
+
+		case CookFormula::MultiTimerInverse:
+			for (size_t i = 0; i < count; i++)
+				values[i] = Clamp(100 * ((double)in.B1[i] - Ratio(Diff(in.N1[i], in.N0[i]), Diff(in.D1[i], in.D0[i]))));
+			break;
+
+		case CookFormula::QueueLength:
+			for (size_t i = 0; i < count; i++)
+				values[i] = Ratio(Diff(in.N1[i], in.N0[i]), Diff(in.D1[i], in.D0[i]));
+			break;
+
+		case CookFormula::RawFraction:
+			for (size_t i = 0; i < count; i++)
+				values[i] = 100 * Ratio((double)in.N1[i], (double)in.B1[i]);
+			break;
+
+		case CookFormula::SampleFraction:
+		case CookFormula::PrecisionTimer:
+			for (size_t i = 0; i < count; i++)
+				values[i] = 100 * Ratio(Diff(in.N1[i], in.N0[i]), Diff(in.B1[i], in.B0[i]));
+			break;
+
+		case CookFormula::AverageTimer:
+			for (size_t i = 0; i < count; i++)
+				values[i] = Ratio(Ratio(Diff(in.N1[i], in.N0[i]), (double)in.F[i]), Diff(in.B1[i], in.B0[i]));
+			break;
+
+		case CookFormula::AverageBulk:
+			for (size_t i = 0; i < count; i++)
+				values[i] = Ratio(Diff(in.N1[i], in.N0[i]), Diff(in.B1[i], in.B0[i]));
+			break;
+
+		case CookFormula::Delta:
+			for (size_t i = 0; i < count; i++)
+				values[i] = Diff(in.N1[i], in.N0[i]);
+			break;
+
+		case CookFormula::Elapsed:
+			for (size_t i = 0; i < count; i++)
+				values[i] = Ratio(Diff(in.D1[i], in.N1[i]), (double)in.F[i]);
+			break;
+
+		default:
+			for (size_t i = 0; i < count; i++)
+				values[i] = (double)in.N1[i];
+			break;
+	}
+}
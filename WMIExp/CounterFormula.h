@@ -0,0 +1,107 @@
+#pragma once
+
+//
+// the arithmetic of performance counter cooking, by CounterType (see winperf.h).
+// Plain C++ with no Windows or WMI dependency, so it builds on its own (see WMIExp.Tests)
+//
+#include <cstddef>
+#include <cstdint>
+
+//
+// how a raw counter becomes a displayable value; one per CounterType
+//
+enum class CookFormula : uint8_t {
+	Raw,				// N1
+	Rate,				// (N1 - N0) / ((D1 - D0) / F)
+	Timer,				// 100 * (N1 - N0) / (D1 - D0)
+	TimerInverse,		// 100 * (1 - (N1 - N0) / (D1 - D0))
+	MultiTimer,			// 100 * (N1 - N0) / (D1 - D0) / B1
+	MultiTimerInverse,	// 100 * (B1 - (N1 - N0) / (D1 - D0))
+	QueueLength,		// (N1 - N0) / (D1 - D0)
+	RawFraction,		// 100 * N1 / B1
+	SampleFraction,		// 100 * (N1 - N0) / (B1 - B0)
+	PrecisionTimer,		// 100 * (N1 - N0) / (B1 - B0)
+	AverageTimer,		// ((N1 - N0) / F) / (B1 - B0)
+	AverageBulk,		// (N1 - N0) / (B1 - B0)
+	Delta,				// N1 - N0
+	Elapsed,			// (D1 - N1) / F
+	Hidden,				// bases and counters that carry no data
+};
+
+//
+// the time stamp (D) and frequency (F) a counter is measured against
+//
+enum class CookTimeBase : uint8_t {
+	PerfTime,			// Timestamp_PerfTime, Frequency_PerfTime
+	Sys100Ns,			// Timestamp_Sys100NS, Frequency_Sys100NS
+	Object,				// Timestamp_Object, Frequency_Object
+};
+
+//
+// the samples of one counter across all instances, by instance.
+// D, B and F are null when the formula does not use them
+//
+struct CookInput {
+	uint64_t const* N1;
+	uint64_t const* N0;
+	uint64_t const* D1;
+	uint64_t const* D0;
+	uint64_t const* B1;
+	uint64_t const* B0;
+	uint64_t const* F;
+};
+
+//
+// computes formatted values from two raw samples, the way PerfMon and the
+// Win32_PerfFormattedData classes do. The inner loops are branch free per element so
+// the compiler can vectorize them; a zero denominator cooks to 0 rather than faulting or producing NaN
+//
+struct CounterFormula {
+	//
+	// CounterType values, as in winperf.h
+	//
+	enum : uint32_t {
+		PerfCounterCounter = 0x10410400,
+		PerfCounterBulkCount = 0x10410500,
+		PerfSampleCounter = 0x00410400,
+		PerfCounterTimer = 0x20410500,
+		PerfCounterTimerInv = 0x21410500,
+		Perf100NsecTimer = 0x20510500,
+		Perf100NsecTimerInv = 0x21510500,
+		PerfCounterMultiTimer = 0x22410500,
+		PerfCounterMultiTimerInv = 0x23410500,
+		Perf100NsecMultiTimer = 0x22510500,
+		Perf100NsecMultiTimerInv = 0x23510500,
+		PerfCounterQueueLen = 0x00450400,
+		PerfCounterLargeQueueLen = 0x00450500,
+		PerfCounter100NsQueueLen = 0x00550500,
+		PerfCounterObjTimeQueueLen = 0x00650500,
+		PerfRawFraction = 0x20020400,
+		PerfLargeRawFraction = 0x20020500,
+		PerfSampleFraction = 0x20C20400,
+		PerfPrecisionSystemTimer = 0x20470500,
+		PerfPrecision100NsTimer = 0x20570500,
+		PerfPrecisionObjectTimer = 0x20670500,
+		PerfAverageTimer = 0x30020400,
+		PerfAverageBulk = 0x40020500,
+		PerfCounterDelta = 0x00400400,
+		PerfCounterLargeDelta = 0x00400500,
+		PerfElapsedTime = 0x30240500,
+		PerfCounterRawcount = 0x00010000,
+		PerfCounterLargeRawcount = 0x00010100,
+		PerfRawBase = 0x40030403,
+		PerfCounterText = 0x00000B00,
+	};
+
+	static CookFormula FromType(uint32_t counterType);
+	static CookTimeBase GetTimeBase(uint32_t counterType);
+	static bool IsPercent(uint32_t counterType);
+	//
+	// the companion samples a formula reads besides N
+	//
+	static bool UsesTime(CookFormula formula);
+	static bool UsesFrequency(CookFormula formula);
+	static bool UsesBase(CookFormula formula);
+
+	static void Cook(CookFormula formula, CookInput const& input, double* values, size_t count);
+};
@@ -0,0 +1,98 @@
+#include "pch.h"
+#include "DiagnosticsDlg.h"
+#include "SchemaCache.h"
+
+void CDiagnosticsDlg::Refresh() {
+	m_Connections = ConnectionPool::Get().GetConnections();
+	m_Now = ::GetTickCount64();
+	m_List.SetItemCountEx((int)m_Connections.size(), LVSICF_NOSCROLL);
+	m_List.Invalidate(FALSE);
+
+	auto pool = ConnectionPool::Get().GetStats();
+	auto schema = SchemaCache::Get().GetStats();
+	auto opens = pool.Hits + pool.Misses;
+	SetDlgItemText(IDC_STATUS, std::format(
+		L"{} of {} connections; {} of {} opens reused ({:.0f}%), {} evicted, {} failed; opening took {} msec, reuse avoided about {} msec. "
+		L"Schema cache: {} classes, {} hits, {} misses",
+		pool.Connections, pool.Capacity, pool.Hits, opens, opens ? pool.Hits * 100.0 / opens : 0.0, pool.Evictions, pool.Failures,
+		pool.OpenUsec / 1000, pool.SavedUsec / 1000, schema.Classes, schema.Hits, schema.Misses).c_str());
+}
+
+CString CDiagnosticsDlg::GetColumnText(HWND h, int row, int col) const {
+	return GetExistingColumnText(h, row, col);
+}
+
+PCWSTR CDiagnosticsDlg::GetExistingColumnText(HWND, int row, int col) const {
+	auto& conn = m_Connections[row];
+	switch (GetColumnManager(m_List)->GetColumnTag<ColumnType>(col)) {
+		case ColumnType::Namespace: return conn.Path.c_str();
+		case ColumnType::Uses:
+			m_Text = std::to_wstring(conn.Uses);
+			return m_Text.c_str();
+		case ColumnType::OpenTime:
+			m_Text = std::format(L"{:.1f}", conn.OpenUsec / 1000.0);
+			return m_Text.c_str();
+		case ColumnType::Saved:
+			//
+			// each reuse saved what the opening cost
+			//
+			m_Text = std::format(L"{:.1f}", (conn.Uses - 1) * (conn.OpenUsec / 1000.0));
+			return m_Text.c_str();
+		case ColumnType::LastUsed:
+			m_Text = std::format(L"{} sec ago", (m_Now - conn.LastUsed) / 1000);
+			return m_Text.c_str();
+	}
+	return L"";
+}
+
+LRESULT CDiagnosticsDlg::OnInitDialog(UINT, WPARAM, LPARAM, BOOL&) {
+	SetDialogIcon(IDR_MAINFRAME);
+	DlgResize_Init(true, false);
+
+	m_List.Attach(GetDlgItem(IDC_RESULTS));
+	m_List.SetExtendedListViewStyle(LVS_EX_FULLROWSELECT | LVS_EX_DOUBLEBUFFER);
+	auto cm = GetColumnManager(m_List);
+	cm->AddColumn(L"Namespace", LVCFMT_LEFT, 220, ColumnType::Namespace);
+	cm->AddColumn(L"Uses", LVCFMT_RIGHT, 60, ColumnType::Uses);
+	cm->AddColumn(L"Open (msec)", LVCFMT_RIGHT, 90, ColumnType::OpenTime);
+	cm->AddColumn(L"Saved (msec)", LVCFMT_RIGHT, 90, ColumnType::Saved);
+	cm->AddColumn(L"Last Used", LVCFMT_RIGHT, 90, ColumnType::LastUsed);
+	return TRUE;
+}
+
+LRESULT CDiagnosticsDlg::OnTimer(UINT, WPARAM id, LPARAM, BOOL&) {
+	if (id == RefreshTimerId)
+		Refresh();
+	return 0;
+}
+
+LRESULT CDiagnosticsDlg::OnShowWindow(UINT, WPARAM show, LPARAM, BOOL& bHandled) {
+	if (show) {
+		Refresh();
+		SetTimer(RefreshTimerId, RefreshIntervalMsec, nullptr);
+	}
+	else {
+		KillTimer(RefreshTimerId);
+	}
+	bHandled = FALSE;
+	return 0;
+}
+
+LRESULT CDiagnosticsDlg::OnDestroy(UINT, WPARAM, LPARAM, BOOL&) {
+	KillTimer(RefreshTimerId);
+	return 0;
+}
+
+LRESULT CDiagnosticsDlg::OnClear(WORD, WORD, HWND, BOOL&) {
+	//
+	// connections in use stay alive with their users; the next request for each namespace opens it again
+	//
+	ConnectionPool::Get().Clear();
+	Refresh();
+	return 0;
+}
+
+LRESULT CDiagnosticsDlg::OnCloseCmd(WORD, WORD, HWND, BOOL&) {
+	ShowWindow(SW_HIDE);
+	return 0;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "resource.h"
+#include "DialogHelper.h"
+#include <VirtualListView.h>
+#include "ConnectionPool.h"
+
+class CDiagnosticsDlg :
+	public CDialogImpl<CDiagnosticsDlg>,
+	public CDialogResize<CDiagnosticsDlg>,
+	public CVirtualListView<CDiagnosticsDlg>,
+	public CDialogHelper<CDiagnosticsDlg> {
+public:
+	enum { IDD = IDD_DIAGNOSTICS };
+	enum { RefreshTimerId = 1 };
+	static const UINT RefreshIntervalMsec = 1000;
+
+	void Refresh();
+
+	CString GetColumnText(HWND, int row, int col) const;
+	PCWSTR GetExistingColumnText(HWND, int row, int col) const;
+
+	BEGIN_MSG_MAP(CDiagnosticsDlg)
+		MESSAGE_HANDLER(WM_INITDIALOG, OnInitDialog)
+		MESSAGE_HANDLER(WM_TIMER, OnTimer)
+		MESSAGE_HANDLER(WM_SHOWWINDOW, OnShowWindow)
+		MESSAGE_HANDLER(WM_DESTROY, OnDestroy)
+		COMMAND_ID_HANDLER(IDC_CLEAR, OnClear)
+		COMMAND_ID_HANDLER(IDCANCEL, OnCloseCmd)
+		CHAIN_MSG_MAP(CVirtualListView<CDiagnosticsDlg>)
+		CHAIN_MSG_MAP(CDialogResize<CDiagnosticsDlg>)
+	END_MSG_MAP()
+
+	BEGIN_DLGRESIZE_MAP(CDiagnosticsDlg)
+		DLGRESIZE_CONTROL(IDC_CLEAR, DLSZ_MOVE_X)
+		DLGRESIZE_CONTROL(IDC_RESULTS, DLSZ_SIZE_X | DLSZ_SIZE_Y)
+		DLGRESIZE_CONTROL(IDC_STATUS, DLSZ_SIZE_X | DLSZ_MOVE_Y)
+	END_DLGRESIZE_MAP()
+
+private:
+	enum class ColumnType {
+		Namespace, Uses, OpenTime, Saved, LastUsed
+	};
+
+	LRESULT OnInitDialog(UINT /*uMsg*/, WPARAM /*wParam*/, LPARAM /*lParam*/, BOOL& /*bHandled*/);
+	LRESULT OnTimer(UINT /*uMsg*/, WPARAM id, LPARAM /*lParam*/, BOOL& /*bHandled*/);
+	LRESULT OnShowWindow(UINT /*uMsg*/, WPARAM show, LPARAM /*lParam*/, BOOL& /*bHandled*/);
+	LRESULT OnDestroy(UINT /*uMsg*/, WPARAM /*wParam*/, LPARAM /*lParam*/, BOOL& /*bHandled*/);
+	LRESULT OnClear(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/);
+	LRESULT OnCloseCmd(WORD /*wNotifyCode*/, WORD wID, HWND /*hWndCtl*/, BOOL& /*bHandled*/);
+
+	CListViewCtrl m_List;
+	std::vector<PooledConnection> m_Connections;
+	ULONGLONG m_Now{ 0 };
+	mutable std::wstring m_Text;
+};
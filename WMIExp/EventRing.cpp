@@ -0,0 +1,74 @@
+#include "pch.h"
+#include "EventRing.h"
+
+EventRing::EventRing(size_t capacity) {
+	size_t size = 2;
+	while (size < capacity)
+		size <<= 1;
+	m_Slots = std::make_unique<Slot[]>(size);
+	m_Mask = size - 1;
+	for (size_t i = 0; i < size; i++)
+		m_Slots[i].Sequence.store(i, std::memory_order_relaxed);
+}
+
+EventRing::~EventRing() {
+	EventRecord record;
+	while (Pop(record))
+		record.Object->Release();
+}
+
+bool EventRing::Push(IWbemClassObject* pObj, ULONGLONG time) {
+	auto pos = m_Head.load(std::memory_order_relaxed);
+	for (;;) {
+		auto& slot = m_Slots[pos & m_Mask];
+		auto seq = slot.Sequence.load(std::memory_order_acquire);
+		auto diff = (intptr_t)seq - (intptr_t)pos;
+		if (diff == 0) {
+			//
+			// the slot is free for this position; claim it
+			//
+			if (m_Head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+				pObj->AddRef();
+				slot.Record = { pObj, time };
+				slot.Sequence.store(pos + 1, std::memory_order_release);
+				return true;
+			}
+		}
+		else if (diff < 0) {
+			//
+			// the consumer has not freed the slot yet: full
+			//
+			m_Dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		else {
+			pos = m_Head.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+bool EventRing::Pop(EventRecord& record) {
+	auto pos = m_Tail.load(std::memory_order_relaxed);
+	auto& slot = m_Slots[pos & m_Mask];
+	if ((intptr_t)slot.Sequence.load(std::memory_order_acquire) - (intptr_t)(pos + 1) < 0)
+		return false;
+
+	record = slot.Record;
+	slot.Sequence.store(pos + m_Mask + 1, std::memory_order_release);
+	m_Tail.store(pos + 1, std::memory_order_relaxed);
+	return true;
+}
+
+size_t EventRing::GetCapacity() const {
+	return m_Mask + 1;
+}
+
+size_t EventRing::GetCount() const {
+	auto head = m_Head.load(std::memory_order_relaxed);
+	auto tail = m_Tail.load(std::memory_order_relaxed);
+	return head > tail ? head - tail : 0;
+}
+
+ULONGLONG EventRing::GetDropped() const {
+	return m_Dropped.load(std::memory_order_relaxed);
+}
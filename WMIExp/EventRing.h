@@ -0,0 +1,49 @@
+#pragma once
+
+struct EventRecord {
+	IWbemClassObject* Object;	// owned by whoever holds the record
+	ULONGLONG Time;				// FILETIME of arrival
+};
+
+//
+// bounded multi producer, single consumer queue of events (sequence numbered slots,
+// no locks). WMI delivers on its own threads, possibly several at once; the UI drains.
+// When the consumer falls behind the ring fills and further events are counted and
+// dropped, so a burst costs at most the ring's capacity in memory
+//
+class EventRing {
+public:
+	//
+	// capacity is rounded up to a power of two
+	//
+	explicit EventRing(size_t capacity);
+	~EventRing();
+
+	EventRing(EventRing const&) = delete;
+	EventRing& operator=(EventRing const&) = delete;
+
+	//
+	// adds a reference to the object on success
+	//
+	bool Push(IWbemClassObject* pObj, ULONGLONG time);
+	//
+	// single consumer; the record's object reference passes to the caller
+	//
+	bool Pop(EventRecord& record);
+
+	size_t GetCapacity() const;
+	size_t GetCount() const;
+	ULONGLONG GetDropped() const;
+
+private:
+	struct Slot {
+		std::atomic<size_t> Sequence;
+		EventRecord Record;
+	};
+
+	std::unique_ptr<Slot[]> m_Slots;
+	size_t m_Mask;
+	alignas(64) std::atomic<size_t> m_Head{ 0 };
+	alignas(64) std::atomic<size_t> m_Tail{ 0 };
+	alignas(64) std::atomic<ULONGLONG> m_Dropped{ 0 };
+};
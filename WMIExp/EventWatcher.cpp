@@ -0,0 +1,124 @@
+#include "pch.h"
+#include "EventWatcher.h"
+#include "WMIHelper.h"
+#include "ConnectionPool.h"
+
+struct EventWatcher::State {
+	explicit State(size_t capacity) : Ring(capacity) {}
+
+	EventRing Ring;
+	wil::unique_event Started{ wil::EventOptions::ManualReset };
+	wil::unique_event Stop{ wil::EventOptions::ManualReset };
+	std::atomic<bool> Done{ false };
+	std::atomic<HRESULT> Status{ S_OK };
+};
+
+class CEventSink :
+	public CComObjectRoot,
+	public IWbemObjectSink {
+public:
+	BEGIN_COM_MAP(CEventSink)
+		COM_INTERFACE_ENTRY(IWbemObjectSink)
+	END_COM_MAP()
+
+	void Init(std::shared_ptr<EventWatcher::State> state) {
+		//
+		// the sink holds the state, so deliveries racing with cancellation have somewhere to go
+		//
+		m_State = std::move(state);
+	}
+
+	void Cancel() {
+		m_Cancelled = true;
+	}
+
+	// Inherited via IWbemObjectSink
+	HRESULT __stdcall Indicate(long lObjectCount, IWbemClassObject** apObjArray) override {
+		if (m_Cancelled)
+			return WBEM_E_CALL_CANCELLED;
+
+		FILETIME now;
+		::GetSystemTimeAsFileTime(&now);
+		for (long i = 0; i < lObjectCount; i++)
+			m_State->Ring.Push(apObjArray[i], *(ULONGLONG*)&now);
+		return WBEM_S_NO_ERROR;
+	}
+
+	HRESULT __stdcall SetStatus(long lFlags, HRESULT hr, BSTR, IWbemClassObject*) override {
+		if (lFlags == WBEM_STATUS_COMPLETE) {
+			m_State->Status = hr;
+			m_State->Done = true;
+		}
+		return WBEM_S_NO_ERROR;
+	}
+
+private:
+	std::shared_ptr<EventWatcher::State> m_State;
+	std::atomic<bool> m_Cancelled{ false };
+};
+
+EventWatcher::~EventWatcher() {
+	Stop();
+}
+
+HRESULT EventWatcher::Start(PCWSTR nsPath, PCWSTR query, size_t capacity) {
+	Stop();
+
+	m_State = std::make_shared<State>(capacity);
+	m_Thread = std::thread(Run, m_State, std::wstring(nsPath), std::wstring(query));
+	m_State->Started.wait();
+	auto hr = m_State->Status.load();
+	if (FAILED(hr))
+		Stop();
+	return hr;
+}
+
+void EventWatcher::Stop() {
+	if (m_Thread.joinable()) {
+		m_State->Stop.SetEvent();
+		m_Thread.join();
+	}
+}
+
+bool EventWatcher::IsRunning() const {
+	return m_Thread.joinable() && !m_State->Done;
+}
+
+HRESULT EventWatcher::GetStatus() const {
+	return m_State ? m_State->Status.load() : S_OK;
+}
+
+EventRing* EventWatcher::GetRing() const {
+	return m_State ? &m_State->Ring : nullptr;
+}
+
+void EventWatcher::Run(std::shared_ptr<State> state, std::wstring nsPath, std::wstring query) {
+	::CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+	{
+		CComPtr<IWbemServices> spSvc;
+		CComObject<CEventSink>* pSink = nullptr;
+		auto hr = ConnectionPool::Get().GetService(nsPath.c_str(), &spSvc);
+		if (SUCCEEDED(hr))
+			hr = CComObject<CEventSink>::CreateInstance(&pSink);
+		if (SUCCEEDED(hr)) {
+			pSink->AddRef();
+			pSink->Init(state);
+			hr = ConnectionPool::Get().CheckCall(nsPath.c_str(),
+				spSvc->ExecNotificationQueryAsync(CComBSTR(L"WQL"), CComBSTR(query.c_str()), 0, nullptr, pSink));
+		}
+		if (FAILED(hr)) {
+			state->Status = hr;
+			state->Done = true;
+		}
+		state->Started.SetEvent();
+
+		if (SUCCEEDED(hr)) {
+			state->Stop.wait();
+			pSink->Cancel();
+			spSvc->CancelAsyncCall(pSink);
+		}
+		if (pSink)
+			pSink->Release();
+	}
+	::CoUninitialize();
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "EventRing.h"
+#include <thread>
+
+//
+// an event query (ExecNotificationQueryAsync) feeding a ring. The subscription is made
+// from a thread of its own in the MTA, so WMI delivers on RPC threads straight into the
+// ring rather than through the UI thread's message loop; decoding is left to the consumer
+//
+class EventWatcher {
+public:
+	~EventWatcher();
+
+	//
+	// returns once the query was accepted or rejected
+	//
+	HRESULT Start(PCWSTR nsPath, PCWSTR query, size_t capacity);
+	void Stop();
+	bool IsRunning() const;
+	//
+	// the call's final status once WMI ended it, S_OK while running
+	//
+	HRESULT GetStatus() const;
+
+	//
+	// stays valid after Stop, until the next Start, so what is left can be drained
+	//
+	EventRing* GetRing() const;
+
+private:
+	friend class CEventSink;
+	struct State;
+	static void Run(std::shared_ptr<State> state, std::wstring nsPath, std::wstring query);
+
+	std::shared_ptr<State> m_State;
+	std::thread m_Thread;
+};
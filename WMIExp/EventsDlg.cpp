@@ -0,0 +1,288 @@
+#include "pch.h"
+#include "EventsDlg.h"
+#include "CellCache.h"
+#include "AppSettings.h"
+
+void CEventsDlg::SetNamespace(PCWSTR path) {
+	m_Namespace = path;
+	if (IsWindow() && !m_Watcher.IsRunning())
+		SetWindowText((L"Events - " + m_Namespace).c_str());
+}
+
+CString CEventsDlg::GetColumnText(HWND h, int row, int col) const {
+	return GetExistingColumnText(h, row, col);
+}
+
+PCWSTR CEventsDlg::GetExistingColumnText(HWND, int row, int col) const {
+	auto& item = m_Rows[row];
+	switch (GetColumnManager(m_List)->GetColumnTag<ColumnType>(col)) {
+		case ColumnType::Time:
+		{
+			FILETIME local;
+			SYSTEMTIME st;
+			::FileTimeToLocalFileTime((FILETIME const*)&item.Time, &local);
+			::FileTimeToSystemTime(&local, &st);
+			m_Text = std::format(L"{:02}:{:02}:{:02}.{:03}", st.wHour, st.wMinute, st.wSecond, st.wMilliseconds);
+			return m_Text.c_str();
+		}
+		case ColumnType::Event: return m_Names.Get(item.Event).c_str();
+		case ColumnType::Class: return m_Names.Get(item.Class).c_str();
+		case ColumnType::Instance: return item.Key.c_str();
+		case ColumnType::Count:
+			m_Text = std::to_wstring(item.Count);
+			return m_Text.c_str();
+	}
+	return L"";
+}
+
+void CEventsDlg::Drain() {
+	auto ring = m_Watcher.GetRing();
+	if (ring == nullptr)
+		return;
+
+	//
+	// when more is waiting than EventCoalesceRate allows for the time since the last
+	// drain, repeats of the same event for the same instance fold into one row
+	//
+	auto now = ::GetTickCount64();
+	auto elapsed = std::max<ULONGLONG>(1, now - m_LastDrain);
+	m_LastDrain = now;
+	m_Coalescing = ring->GetCount() * 1000 > AppSettings::Get().EventCoalesceRate() * elapsed;
+
+	auto maxRows = (size_t)std::max(1000, AppSettings::Get().EventMaxRows());
+	auto count = m_List.GetItemCount();
+	auto follow = count == 0 || m_List.GetTopIndex() + m_List.GetCountPerPage() >= count;
+	size_t drained = 0, trimmed = 0;
+	bool updated = false;
+
+	LARGE_INTEGER freq, start;
+	::QueryPerformanceFrequency(&freq);
+	::QueryPerformanceCounter(&start);
+	auto deadline = start.QuadPart + freq.QuadPart * DrainBudgetMsec / 1000;
+	auto expired = [&] {
+		LARGE_INTEGER now;
+		::QueryPerformanceCounter(&now);
+		return now.QuadPart >= deadline;
+		};
+
+	EventRecord record;
+	while (!expired() && ring->Pop(record)) {
+		wil::com_ptr<IWbemClassObject> spEvent;
+		spEvent.attach(record.Object);
+		drained++;
+
+		//
+		// a repeat only needs its key; the row is built for events that start one
+		//
+		ReadKey(spEvent.get(), m_Key);
+		if (m_Coalescing) {
+			if (auto it = m_Index.find(m_Key.Index); it != m_Index.end() && it->second >= m_FirstRow) {
+				auto& row = m_Rows[size_t(it->second - m_FirstRow)];
+				row.Count++;
+				row.Time = record.Time;
+				m_Coalesced++;
+				updated = true;
+				continue;
+			}
+		}
+
+		m_Scratch.Time = record.Time;
+		m_Scratch.Count = 1;
+		Decode(m_Key, m_Scratch);
+		m_Index[m_Key.Index] = m_FirstRow + m_Rows.size();
+		m_Rows.push_back(std::move(m_Scratch));
+		m_Scratch = EventRow();
+		if (m_Rows.size() > maxRows) {
+			if (auto it = m_Index.find(MakeIndexKey(m_Rows.front())); it != m_Index.end() && it->second == m_FirstRow)
+				m_Index.erase(it);
+			m_Rows.pop_front();
+			m_FirstRow++;
+			trimmed++;
+		}
+	}
+	m_Key.Target.Release();
+	m_Received += drained;
+
+	if (drained) {
+		if (trimmed) {
+			m_List.SetItemCountEx((int)m_Rows.size(), LVSICF_NOSCROLL);
+		}
+		else {
+			m_List.SetItemCountEx((int)m_Rows.size(), LVSICF_NOSCROLL | LVSICF_NOINVALIDATEALL);
+			if (updated) {
+				auto top = m_List.GetTopIndex();
+				m_List.RedrawItems(top, std::min(top + m_List.GetCountPerPage(), (int)m_Rows.size() - 1));
+			}
+		}
+		if (follow && !m_Rows.empty())
+			m_List.EnsureVisible((int)m_Rows.size() - 1, FALSE);
+	}
+	UpdateStatus();
+	if (!m_Watcher.IsRunning() && ring->GetCount() == 0) {
+		KillTimer(DrainTimerId);
+		GetDlgItem(IDC_STOP).EnableWindow(FALSE);
+	}
+}
+
+void CEventsDlg::ReadKey(IWbemClassObject* pObj, EventKey& key) {
+	key.Event.clear();
+	key.Target.Release();
+	key.Instance.clear();
+
+	CComVariant value;
+	if (SUCCEEDED(pObj->Get(L"__CLASS", 0, &value, nullptr, nullptr)) && value.vt == VT_BSTR)
+		key.Event = value.bstrVal;
+
+	//
+	// intrinsic events carry the instance; extrinsic ones are described by their own properties
+	//
+	CComVariant target;
+	if (SUCCEEDED(pObj->Get(L"TargetInstance", 0, &target, nullptr, nullptr)) && target.vt == VT_UNKNOWN && target.punkVal)
+		target.punkVal->QueryInterface(&key.Target);
+	if (key.Target) {
+		value.Clear();
+		if (SUCCEEDED(key.Target->Get(L"__RELPATH", 0, &value, nullptr, nullptr)) && value.vt == VT_BSTR)
+			key.Instance = value.bstrVal;
+	}
+	else if (SUCCEEDED(pObj->BeginEnumeration(WBEM_FLAG_NONSYSTEM_ONLY))) {
+		value.Clear();
+		CComBSTR name;
+		CIMTYPE type;
+		int count = 0;
+		while (count < 4 && pObj->Next(0, &name, &value, &type, nullptr) == WBEM_S_NO_ERROR) {
+			if ((type & CIM_FLAG_ARRAY) == 0 && type != CIM_OBJECT && value.vt != VT_NULL && value.vt != VT_EMPTY
+				&& ::_wcsicmp(name, L"TIME_CREATED") != 0 && ::_wcsicmp(name, L"SECURITY_DESCRIPTOR") != 0) {
+				if (count++)
+					key.Instance += L", ";
+				key.Instance += name;
+				key.Instance += L'=';
+				CellText::AppendValue(key.Instance, value, type);
+			}
+			name.Empty();
+			value.Clear();
+		}
+		pObj->EndEnumeration();
+	}
+
+	key.Index = key.Event;
+	key.Index += L'|';
+	key.Index += key.Instance;
+}
+
+void CEventsDlg::Decode(EventKey const& key, EventRow& row) {
+	row.Event = m_Names.Add(key.Event);
+	row.Class = row.Event;
+	row.Key = key.Instance;
+
+	CComVariant value;
+	if (key.Target && SUCCEEDED(key.Target->Get(L"__CLASS", 0, &value, nullptr, nullptr)) && value.vt == VT_BSTR)
+		row.Class = m_Names.Add(value.bstrVal);
+}
+
+std::wstring CEventsDlg::MakeIndexKey(EventRow const& row) const {
+	return m_Names.Get(row.Event) + L'|' + row.Key;
+}
+
+void CEventsDlg::Clear() {
+	m_List.SetItemCount(0);
+	m_Rows.clear();
+	m_Index.clear();
+	m_Names.Clear();
+	m_FirstRow = 0;
+	m_Received = m_Coalesced = 0;
+}
+
+void CEventsDlg::Stop() {
+	m_Watcher.Stop();
+	GetDlgItem(IDC_STOP).EnableWindow(FALSE);
+}
+
+void CEventsDlg::UpdateStatus() {
+	auto ring = m_Watcher.GetRing();
+	std::wstring text;
+	if (FAILED(m_Watcher.GetStatus()))
+		text = std::format(L"Error 0x{:08X}. ", (DWORD)m_Watcher.GetStatus());
+	text += std::format(L"{} events in {} rows, {} coalesced", m_Received, m_Rows.size(), m_Coalesced);
+	if (ring)
+		text += std::format(L", {} dropped; ring {} of {}", ring->GetDropped(), ring->GetCount(), ring->GetCapacity());
+	if (m_Coalescing)
+		text += L" (coalescing)";
+	SetDlgItemText(IDC_STATUS, text.c_str());
+}
+
+LRESULT CEventsDlg::OnInitDialog(UINT, WPARAM, LPARAM, BOOL&) {
+	SetDialogIcon(IDR_MAINFRAME);
+	DlgResize_Init(true, false);
+	SetNamespace(m_Namespace.c_str());
+
+	m_List.Attach(GetDlgItem(IDC_RESULTS));
+	m_List.SetExtendedListViewStyle(LVS_EX_FULLROWSELECT | LVS_EX_DOUBLEBUFFER);
+	auto cm = GetColumnManager(m_List);
+	cm->AddColumn(L"Time", LVCFMT_LEFT, 90, ColumnType::Time);
+	cm->AddColumn(L"Event", LVCFMT_LEFT, 170, ColumnType::Event);
+	cm->AddColumn(L"Class", LVCFMT_LEFT, 140, ColumnType::Class);
+	cm->AddColumn(L"Instance", LVCFMT_LEFT, 360, ColumnType::Instance);
+	cm->AddColumn(L"Count", LVCFMT_RIGHT, 60, ColumnType::Count);
+
+	SetDlgItemText(IDC_QUERY, L"SELECT * FROM __InstanceCreationEvent WITHIN 1 WHERE TargetInstance ISA 'Win32_Process'");
+	GetDlgItem(IDC_STOP).EnableWindow(FALSE);
+	return TRUE;
+}
+
+LRESULT CEventsDlg::OnTimer(UINT, WPARAM id, LPARAM, BOOL&) {
+	if (id == DrainTimerId)
+		Drain();
+	return 0;
+}
+
+LRESULT CEventsDlg::OnDestroy(UINT, WPARAM, LPARAM, BOOL&) {
+	KillTimer(DrainTimerId);
+	m_Watcher.Stop();
+	return 0;
+}
+
+LRESULT CEventsDlg::OnStart(WORD, WORD, HWND, BOOL&) {
+	CString query;
+	GetDlgItemText(IDC_QUERY, query);
+	query.Trim();
+	if (query.IsEmpty())
+		return 0;
+
+	KillTimer(DrainTimerId);
+	Stop();
+	Clear();
+	SetWindowText((L"Events - " + m_Namespace).c_str());
+	auto hr = m_Watcher.Start(m_Namespace.c_str(), query, AppSettings::Get().EventRingCapacity());
+	if (FAILED(hr)) {
+		SetDlgItemText(IDC_STATUS, std::format(L"Error 0x{:08X}: the query was not accepted", (DWORD)hr).c_str());
+		return 0;
+	}
+	m_LastDrain = ::GetTickCount64();
+	SetTimer(DrainTimerId, DrainIntervalMsec, nullptr);
+	GetDlgItem(IDC_STOP).EnableWindow();
+	UpdateStatus();
+	return 0;
+}
+
+LRESULT CEventsDlg::OnStop(WORD, WORD, HWND, BOOL&) {
+	//
+	// what is already in the ring is still shown; the timer stops once it is drained
+	//
+	Stop();
+	return 0;
+}
+
+LRESULT CEventsDlg::OnClear(WORD, WORD, HWND, BOOL&) {
+	Clear();
+	UpdateStatus();
+	return 0;
+}
+
+LRESULT CEventsDlg::OnCloseCmd(WORD, WORD, HWND, BOOL&) {
+	//
+	// modeless; hidden rather than destroyed so the events survive. The subscription
+	// keeps going, bounded by the ring, until stopped
+	//
+	ShowWindow(SW_HIDE);
+	return 0;
+}
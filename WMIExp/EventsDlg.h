@@ -0,0 +1,115 @@
+#pragma once
+
+#include "resource.h"
+#include "DialogHelper.h"
+#include <VirtualListView.h>
+#include <deque>
+#include <unordered_map>
+#include "EventWatcher.h"
+#include "InstanceStore.h"
+
+class CEventsDlg :
+	public CDialogImpl<CEventsDlg>,
+	public CDialogResize<CEventsDlg>,
+	public CVirtualListView<CEventsDlg>,
+	public CDialogHelper<CEventsDlg> {
+public:
+	enum { IDD = IDD_EVENTS };
+	enum { DrainTimerId = 1 };
+	static const UINT DrainIntervalMsec = 100;
+	//
+	// the longest a tick spends draining; anything beyond waits in the ring (or is dropped
+	// once the ring is full), so the UI thread never spends more than a slice on a burst
+	//
+	static const UINT DrainBudgetMsec = 30;
+
+	//
+	// namespace the next subscription is made in
+	//
+	void SetNamespace(PCWSTR path);
+
+	CString GetColumnText(HWND, int row, int col) const;
+	PCWSTR GetExistingColumnText(HWND, int row, int col) const;
+
+	BEGIN_MSG_MAP(CEventsDlg)
+		MESSAGE_HANDLER(WM_INITDIALOG, OnInitDialog)
+		MESSAGE_HANDLER(WM_TIMER, OnTimer)
+		MESSAGE_HANDLER(WM_DESTROY, OnDestroy)
+		COMMAND_ID_HANDLER(IDOK, OnStart)
+		COMMAND_ID_HANDLER(IDC_STOP, OnStop)
+		COMMAND_ID_HANDLER(IDC_CLEAR, OnClear)
+		COMMAND_ID_HANDLER(IDCANCEL, OnCloseCmd)
+		CHAIN_MSG_MAP(CVirtualListView<CEventsDlg>)
+		CHAIN_MSG_MAP(CDialogResize<CEventsDlg>)
+	END_MSG_MAP()
+
+	BEGIN_DLGRESIZE_MAP(CEventsDlg)
+		DLGRESIZE_CONTROL(IDC_QUERY, DLSZ_SIZE_X)
+		DLGRESIZE_CONTROL(IDOK, DLSZ_MOVE_X)
+		DLGRESIZE_CONTROL(IDC_STOP, DLSZ_MOVE_X)
+		DLGRESIZE_CONTROL(IDC_CLEAR, DLSZ_MOVE_X)
+		DLGRESIZE_CONTROL(IDC_RESULTS, DLSZ_SIZE_X | DLSZ_SIZE_Y)
+		DLGRESIZE_CONTROL(IDC_STATUS, DLSZ_SIZE_X | DLSZ_MOVE_Y)
+	END_DLGRESIZE_MAP()
+
+private:
+	enum class ColumnType {
+		Time, Event, Class, Instance, Count
+	};
+
+	//
+	// one event, or several of the same kind for the same instance when coalesced
+	//
+	struct EventRow {
+		ULONGLONG Time;		// latest occurrence
+		DWORD Event;		// event class, in m_Names
+		DWORD Class;		// class of the target instance, in m_Names
+		std::wstring Key;	// target instance path, or the event's own properties
+		ULONG Count;
+	};
+
+	//
+	// what identifies an event for coalescing, read before the rest of it is decoded
+	//
+	struct EventKey {
+		std::wstring Event;						// event class
+		CComPtr<IWbemClassObject> Target;		// intrinsic events only
+		std::wstring Instance;					// target instance path, or the event's own properties
+		std::wstring Index;						// Event|Instance
+	};
+
+	void Drain();
+	void ReadKey(IWbemClassObject* pObj, EventKey& key);
+	void Decode(EventKey const& key, EventRow& row);
+	std::wstring MakeIndexKey(EventRow const& row) const;
+	void Clear();
+	void Stop();
+	void UpdateStatus();
+
+	LRESULT OnInitDialog(UINT /*uMsg*/, WPARAM /*wParam*/, LPARAM /*lParam*/, BOOL& /*bHandled*/);
+	LRESULT OnTimer(UINT /*uMsg*/, WPARAM id, LPARAM /*lParam*/, BOOL& /*bHandled*/);
+	LRESULT OnDestroy(UINT /*uMsg*/, WPARAM /*wParam*/, LPARAM /*lParam*/, BOOL& /*bHandled*/);
+	LRESULT OnStart(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/);
+	LRESULT OnStop(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/);
+	LRESULT OnClear(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/);
+	LRESULT OnCloseCmd(WORD /*wNotifyCode*/, WORD wID, HWND /*hWndCtl*/, BOOL& /*bHandled*/);
+
+	EventWatcher m_Watcher;
+	CListViewCtrl m_List;
+	std::wstring m_Namespace{ L"ROOT\\CIMV2" };
+	//
+	// the newest rows, at most EventMaxRows; m_FirstRow numbers the oldest one kept,
+	// so rows can be found by a stable number while old ones fall off the front
+	//
+	std::deque<EventRow> m_Rows;
+	ULONGLONG m_FirstRow{ 0 };
+	std::unordered_map<std::wstring, ULONGLONG> m_Index;	// EventKey::Index -> latest row number
+	StringPool m_Names;
+	EventRow m_Scratch;
+	EventKey m_Key;
+	mutable std::wstring m_Text;
+	ULONGLONG m_Received{ 0 };
+	ULONGLONG m_Coalesced{ 0 };
+	ULONGLONG m_LastDrain{ 0 };
+	bool m_Coalescing{ false };
+};
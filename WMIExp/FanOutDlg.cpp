@@ -0,0 +1,197 @@
+#include "pch.h"
+#include "FanOutDlg.h"
+#include "AppSettings.h"
+
+void CFanOutDlg::SetNamespace(PCWSTR path) {
+	m_Namespace = path;
+	if (IsWindow())
+		SetWindowText((L"Multi-Host Query - " + m_Namespace).c_str());
+}
+
+CString CFanOutDlg::GetColumnText(HWND h, int row, int col) const {
+	return GetExistingColumnText(h, row, col);
+}
+
+PCWSTR CFanOutDlg::GetExistingColumnText(HWND, int row, int col) const {
+	auto& r = m_Rows[row];
+	if (col == 0)
+		return m_Hosts[r.Host].c_str();
+
+	auto& map = m_HostColumns[r.Host];
+	auto local = col - 1 < (int)map.size() ? map[col - 1] : -1;
+	return local < 0 ? L"" : m_Strings.Get(m_Cells[r.First + local]).c_str();
+}
+
+void CFanOutDlg::Stop() {
+	if (m_Query) {
+		m_Query->Cancel();
+		m_Query.reset();
+	}
+	KillTimer(StatusTimerId);
+	GetDlgItem(IDC_STOP).EnableWindow(FALSE);
+}
+
+void CFanOutDlg::Clear() {
+	m_List.SetItemCount(0);
+	auto cm = GetColumnManager(m_List);
+	cm->Clear();
+	cm->AddColumn(L"Host", LVCFMT_LEFT, 120);
+	m_Columns.clear();
+	m_HostColumns.assign(m_Hosts.size(), {});
+	m_HostWidth.assign(m_Hosts.size(), 0);
+	m_Rows.clear();
+	m_Cells.clear();
+	m_Strings.Clear();
+}
+
+void CFanOutDlg::AddPage(FanOutPage const& page) {
+	auto& map = m_HostColumns[page.Host];
+	if (!page.Columns.empty()) {
+		auto cm = GetColumnManager(m_List);
+		m_HostWidth[page.Host] = page.Columns.size();
+		for (int local = 0; local < (int)page.Columns.size(); local++) {
+			auto& name = page.Columns[local];
+			auto it = std::find_if(m_Columns.begin(), m_Columns.end(), [&](auto& c) { return ::_wcsicmp(c.c_str(), name.c_str()) == 0; });
+			auto merged = (int)(it - m_Columns.begin());
+			if (it == m_Columns.end()) {
+				m_Columns.push_back(name);
+				cm->AddColumn(name.c_str(), LVCFMT_LEFT, 140);
+			}
+			if ((int)map.size() <= merged)
+				map.resize(merged + 1, -1);
+			map[merged] = local;
+		}
+	}
+
+	auto width = m_HostWidth[page.Host];
+	if (width == 0)
+		return;
+	m_Cells.reserve(m_Cells.size() + page.Cells.size());
+	for (size_t i = 0; i < page.Cells.size(); i += width) {
+		m_Rows.push_back({ page.Host, m_Cells.size() });
+		for (size_t c = 0; c < width; c++)
+			m_Cells.push_back(m_Strings.Add(page.Cells[i + c]));
+	}
+}
+
+void CFanOutDlg::UpdateStatus() {
+	if (m_Query == nullptr)
+		return;
+
+	int done = 0, failed = 0, timedOut = 0, running = 0;
+	std::wstring failures;
+	for (auto& host : m_Query->GetHosts()) {
+		if (host.TimedOut)
+			timedOut++;
+		else if (host.Done && FAILED(host.Status)) {
+			failed++;
+			failures += std::format(L"{}{} (0x{:08X})", failures.empty() ? L"; failed: " : L", ", host.Host, (DWORD)host.Status);
+		}
+		if (host.Done)
+			done++;
+		else if (host.Started)
+			running++;
+	}
+	auto text = std::format(L"{} of {} hosts done, {} running ({} timed out, {} failed); {} rows in {} msec{}",
+		done, m_Hosts.size(), running, timedOut, failed, m_Rows.size(), m_Query->GetElapsedMsec(), failures);
+	SetDlgItemText(IDC_STATUS, text.c_str());
+}
+
+std::vector<std::wstring> CFanOutDlg::ParseHosts(PCWSTR text) {
+	std::vector<std::wstring> hosts;
+	CString list(text);
+	int start = 0;
+	for (auto host = list.Tokenize(L" ,;\t\r\n", start); start >= 0; host = list.Tokenize(L" ,;\t\r\n", start))
+		if (std::find_if(hosts.begin(), hosts.end(), [&](auto& h) { return host.CompareNoCase(h.c_str()) == 0; }) == hosts.end())
+			hosts.push_back((PCWSTR)host);
+	return hosts;
+}
+
+LRESULT CFanOutDlg::OnInitDialog(UINT, WPARAM, LPARAM, BOOL&) {
+	SetDialogIcon(IDR_MAINFRAME);
+	DlgResize_Init(true, false);
+	SetNamespace(m_Namespace.c_str());
+
+	m_List.Attach(GetDlgItem(IDC_RESULTS));
+	m_List.SetExtendedListViewStyle(LVS_EX_FULLROWSELECT | LVS_EX_DOUBLEBUFFER);
+	SetDlgItemText(IDC_HOSTS, L"localhost");
+	SetDlgItemText(IDC_QUERY, L"SELECT Caption, Version, LastBootUpTime FROM Win32_OperatingSystem");
+	GetDlgItem(IDC_STOP).EnableWindow(FALSE);
+	return TRUE;
+}
+
+LRESULT CFanOutDlg::OnTimer(UINT, WPARAM id, LPARAM, BOOL&) {
+	//
+	// hosts running out of time are only noticed by asking
+	//
+	if (id == StatusTimerId) {
+		UpdateStatus();
+		if (m_Query && m_Query->IsDone())
+			Stop();
+	}
+	return 0;
+}
+
+LRESULT CFanOutDlg::OnDestroy(UINT, WPARAM, LPARAM, BOOL&) {
+	Stop();
+	return 0;
+}
+
+LRESULT CFanOutDlg::OnResults(UINT, WPARAM cookie, LPARAM, BOOL&) {
+	if (cookie != m_Cookie || m_Query == nullptr)
+		return 0;
+
+	FanOutPage page;
+	while (m_Query->TakePage(page))
+		AddPage(page);
+	m_List.SetItemCountEx((int)m_Rows.size(), LVSICF_NOSCROLL | LVSICF_NOINVALIDATEALL);
+	UpdateStatus();
+	if (m_Query->IsDone()) {
+		m_Query.reset();
+		KillTimer(StatusTimerId);
+		GetDlgItem(IDC_STOP).EnableWindow(FALSE);
+	}
+	return 0;
+}
+
+LRESULT CFanOutDlg::OnRun(WORD, WORD, HWND, BOOL&) {
+	CString hosts, query;
+	GetDlgItemText(IDC_HOSTS, hosts);
+	GetDlgItemText(IDC_QUERY, query);
+	query.Trim();
+	m_Hosts = ParseHosts(hosts);
+	if (m_Hosts.empty() || query.IsEmpty())
+		return 0;
+
+	//
+	// a class name alone enumerates the class
+	//
+	if (query.Find(L' ') < 0)
+		query = L"SELECT * FROM " + query;
+
+	Stop();
+	Clear();
+	auto& settings = AppSettings::Get();
+	FanOutOptions options;
+	options.Concurrency = std::max(1, settings.FanOutConcurrency());
+	options.TimeoutMsec = std::max(1000, settings.FanOutTimeoutMsec());
+	options.MaxRowsPerHost = settings.QueryMaxRows();
+	m_Query = FanOutQuery::Create(std::make_shared<SimulatedFanOutSource>(std::make_shared<WmiFanOutSource>(m_Namespace.c_str())),
+		options, m_hWnd, WM_FANOUT_RESULTS, ++m_Cookie);
+	m_Query->Start(m_Hosts, query);
+	SetTimer(StatusTimerId, StatusIntervalMsec, nullptr);
+	GetDlgItem(IDC_STOP).EnableWindow();
+	UpdateStatus();
+	return 0;
+}
+
+LRESULT CFanOutDlg::OnStop(WORD, WORD, HWND, BOOL&) {
+	UpdateStatus();
+	Stop();
+	return 0;
+}
+
+LRESULT CFanOutDlg::OnCloseCmd(WORD, WORD, HWND, BOOL&) {
+	ShowWindow(SW_HIDE);
+	return 0;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "resource.h"
+#include "DialogHelper.h"
+#include <VirtualListView.h>
+#include "FanOutQuery.h"
+#include "InstanceStore.h"
+
+class CFanOutDlg :
+	public CDialogImpl<CFanOutDlg>,
+	public CDialogResize<CFanOutDlg>,
+	public CVirtualListView<CFanOutDlg>,
+	public CDialogHelper<CFanOutDlg> {
+public:
+	enum { IDD = IDD_FANOUT };
+	enum { StatusTimerId = 1 };
+	static const UINT StatusIntervalMsec = 500;
+
+	const UINT WM_FANOUT_RESULTS = WM_APP + 1;
+
+	//
+	// namespace queried on every host
+	//
+	void SetNamespace(PCWSTR path);
+
+	CString GetColumnText(HWND, int row, int col) const;
+	PCWSTR GetExistingColumnText(HWND, int row, int col) const;
+
+	BEGIN_MSG_MAP(CFanOutDlg)
+		MESSAGE_HANDLER(WM_INITDIALOG, OnInitDialog)
+		MESSAGE_HANDLER(WM_TIMER, OnTimer)
+		MESSAGE_HANDLER(WM_DESTROY, OnDestroy)
+		MESSAGE_HANDLER(WM_FANOUT_RESULTS, OnResults)
+		COMMAND_ID_HANDLER(IDOK, OnRun)
+		COMMAND_ID_HANDLER(IDC_STOP, OnStop)
+		COMMAND_ID_HANDLER(IDCANCEL, OnCloseCmd)
+		CHAIN_MSG_MAP(CVirtualListView<CFanOutDlg>)
+		CHAIN_MSG_MAP(CDialogResize<CFanOutDlg>)
+	END_MSG_MAP()
+
+	BEGIN_DLGRESIZE_MAP(CFanOutDlg)
+		DLGRESIZE_CONTROL(IDC_HOSTS, DLSZ_SIZE_X)
+		DLGRESIZE_CONTROL(IDC_QUERY, DLSZ_SIZE_X)
+		DLGRESIZE_CONTROL(IDOK, DLSZ_MOVE_X)
+		DLGRESIZE_CONTROL(IDC_STOP, DLSZ_MOVE_X)
+		DLGRESIZE_CONTROL(IDC_RESULTS, DLSZ_SIZE_X | DLSZ_SIZE_Y)
+		DLGRESIZE_CONTROL(IDC_STATUS, DLSZ_SIZE_X | DLSZ_MOVE_Y)
+	END_DLGRESIZE_MAP()
+
+private:
+	struct Row {
+		int Host;
+		size_t First;		// first cell in m_Cells
+	};
+
+	void Stop();
+	void Clear();
+	void AddPage(FanOutPage const& page);
+	void UpdateStatus();
+	static std::vector<std::wstring> ParseHosts(PCWSTR text);
+
+	LRESULT OnInitDialog(UINT /*uMsg*/, WPARAM /*wParam*/, LPARAM /*lParam*/, BOOL& /*bHandled*/);
+	LRESULT OnTimer(UINT /*uMsg*/, WPARAM id, LPARAM /*lParam*/, BOOL& /*bHandled*/);
+	LRESULT OnDestroy(UINT /*uMsg*/, WPARAM /*wParam*/, LPARAM /*lParam*/, BOOL& /*bHandled*/);
+	LRESULT OnResults(UINT /*uMsg*/, WPARAM cookie, LPARAM /*lParam*/, BOOL& /*bHandled*/);
+	LRESULT OnRun(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/);
+	LRESULT OnStop(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/);
+	LRESULT OnCloseCmd(WORD /*wNotifyCode*/, WORD wID, HWND /*hWndCtl*/, BOOL& /*bHandled*/);
+
+	CListViewCtrl m_List;
+	std::wstring m_Namespace{ L"ROOT\\CIMV2" };
+	std::shared_ptr<FanOutQuery> m_Query;
+	WPARAM m_Cookie{ 0 };
+	std::vector<std::wstring> m_Hosts;
+	//
+	// hosts may differ in the properties they return (e.g. OS versions), so the list shows
+	// the union; each host maps its own columns onto it
+	//
+	std::vector<std::wstring> m_Columns;
+	std::vector<std::vector<int>> m_HostColumns;	// by host: merged column -> host column, -1 if missing
+	std::vector<size_t> m_HostWidth;				// by host: cells per row
+	std::vector<Row> m_Rows;
+	std::vector<DWORD> m_Cells;
+	StringPool m_Strings;
+};
@@ -0,0 +1,273 @@
+#include "pch.h"
+#include "FanOutQuery.h"
+#include "WMIHelper.h"
+#include "CellCache.h"
+
+FanOutCall::FanOutCall(FanOutQuery& query, int host) : m_Query(query), m_Host(host) {
+	std::lock_guard lock(query.m_Lock);
+	m_Deadline = query.m_Hosts[host].Deadline;
+}
+
+std::wstring const& FanOutCall::GetHost() const {
+	return m_Query.m_Hosts[m_Host].Name;
+}
+
+std::wstring const& FanOutCall::GetQuery() const {
+	return m_Query.m_Query;
+}
+
+DWORD FanOutCall::GetRemainingMsec() const {
+	auto now = ::GetTickCount64();
+	return now < m_Deadline ? DWORD(m_Deadline - now) : 0;
+}
+
+bool FanOutCall::IsStopped() const {
+	std::lock_guard lock(m_Query.m_Lock);
+	return m_Query.m_Cancelled || GetRemainingMsec() == 0;
+}
+
+bool FanOutCall::Deliver(std::vector<std::wstring> const& columns, std::vector<std::wstring>& cells) {
+	return m_Query.Deliver(m_Host, columns, cells);
+}
+
+WmiFanOutSource::WmiFanOutSource(PCWSTR nsPath) : m_Namespace(nsPath) {
+}
+
+HRESULT WmiFanOutSource::Run(FanOutCall& call) {
+	CComPtr<IWbemServices> spSvc;
+	auto hr = WMIHelper::Init(call.GetHost().c_str(), m_Namespace.c_str(), &spSvc);
+	if (FAILED(hr))
+		return hr;
+
+	CComPtr<IEnumWbemClassObject> spEnum;
+	hr = spSvc->ExecQuery(CComBSTR(L"WQL"), CComBSTR(call.GetQuery().c_str()),
+		WBEM_FLAG_RETURN_IMMEDIATELY | WBEM_FLAG_FORWARD_ONLY, nullptr, &spEnum);
+	if (FAILED(hr))
+		return hr;
+
+	//
+	// each Next waits a slice at most (and no longer than the host has left), so a cancel
+	// or a timeout is noticed while a slow host is still producing a page
+	//
+	std::vector<std::wstring> columns, cells;
+	std::wstring text;
+	IWbemClassObject* objects[PageSize];
+	for (;;) {
+		if (call.IsStopped())
+			return call.GetRemainingMsec() ? WBEM_E_CALL_CANCELLED : WBEM_E_TIMED_OUT;
+
+		ULONG returned = 0;
+		hr = spEnum->Next((long)std::min(call.GetRemainingMsec(), SliceMsec), PageSize, objects, &returned);
+		for (ULONG i = 0; i < returned; i++) {
+			CComPtr<IWbemClassObject> spObj;
+			spObj.Attach(objects[i]);
+			if (columns.empty()) {
+				auto names = WMIHelper::GetNames(spObj, WBEM_FLAG_NONSYSTEM_ONLY);
+				for (auto& name : names)
+					columns.push_back(name.m_str);
+			}
+			for (auto& name : columns) {
+				CComVariant value;
+				CIMTYPE type;
+				text.clear();
+				if (SUCCEEDED(spObj->Get(name.c_str(), 0, &value, &type, nullptr)))
+					CellText::AppendValue(text, value, type);
+				cells.push_back(text);
+			}
+		}
+		if (returned && !call.Deliver(columns, cells))
+			return S_OK;
+		if (hr == WBEM_S_TIMEDOUT)
+			continue;
+		return hr == WBEM_S_FALSE ? S_OK : hr;
+	}
+}
+
+SimulatedFanOutSource::SimulatedFanOutSource(std::shared_ptr<IFanOutSource> next) : m_Next(std::move(next)) {
+}
+
+bool SimulatedFanOutSource::IsSimulated(std::wstring const& host) {
+	return ::_wcsnicmp(host.c_str(), L"sim:", 4) == 0;
+}
+
+HRESULT SimulatedFanOutSource::Run(FanOutCall& call) {
+	auto& host = call.GetHost();
+	if (!IsSimulated(host))
+		return m_Next ? m_Next->Run(call) : WBEM_E_INVALID_PARAMETER;
+
+	DWORD latency = 0;
+	ULONG rows = DefaultRows;
+	::swscanf_s(host.c_str() + 4, L"%u:%u", &latency, &rows);
+
+	//
+	// the latency stands for connecting; each page after that costs a tenth of it
+	//
+	auto hr = Wait(call, latency);
+	if (FAILED(hr))
+		return hr;
+
+	std::vector<std::wstring> columns{ L"Name", L"Index", L"Latency" };
+	std::vector<std::wstring> cells;
+	for (ULONG row = 0; row < rows; row += PageSize) {
+		if (row && FAILED(hr = Wait(call, latency / 10)))
+			return hr;
+		for (ULONG i = row; i < std::min(rows, row + PageSize); i++) {
+			cells.push_back(std::format(L"Item {}", i));
+			cells.push_back(std::to_wstring(i));
+			cells.push_back(std::to_wstring(latency));
+		}
+		if (!call.Deliver(columns, cells))
+			break;
+	}
+	return S_OK;
+}
+
+HRESULT SimulatedFanOutSource::Wait(FanOutCall const& call, DWORD msec) {
+	auto end = ::GetTickCount64() + msec;
+	for (auto now = ::GetTickCount64(); now < end; now = ::GetTickCount64()) {
+		if (call.IsStopped())
+			return call.GetRemainingMsec() ? WBEM_E_CALL_CANCELLED : WBEM_E_TIMED_OUT;
+		::Sleep((DWORD)std::min<ULONGLONG>(end - now, 20));
+	}
+	return S_OK;
+}
+
+std::shared_ptr<FanOutQuery> FanOutQuery::Create(std::shared_ptr<IFanOutSource> source, FanOutOptions const& options, HWND hWnd, UINT msg, WPARAM cookie) {
+	return std::shared_ptr<FanOutQuery>(new FanOutQuery(std::move(source), options, hWnd, msg, cookie));
+}
+
+FanOutQuery::FanOutQuery(std::shared_ptr<IFanOutSource> source, FanOutOptions const& options, HWND hWnd, UINT msg, WPARAM cookie) :
+	m_Source(std::move(source)), m_Options(options), m_Pool(std::max(1, options.Concurrency)),
+	m_MaxPending(4 * (size_t)std::max(1, options.Concurrency)), m_hWnd(hWnd), m_Msg(msg), m_Cookie(cookie) {
+}
+
+void FanOutQuery::Start(std::vector<std::wstring> hosts, PCWSTR query) {
+	m_Query = query;
+	m_Start = ::GetTickCount64();
+	m_Hosts.resize(hosts.size());
+	for (size_t i = 0; i < hosts.size(); i++)
+		m_Hosts[i].Name = std::move(hosts[i]);
+	for (int i = 0; i < (int)m_Hosts.size(); i++)
+		m_Pool.Submit([self = shared_from_this(), i] { self->Run(i); });
+}
+
+void FanOutQuery::Cancel() {
+	{
+		std::lock_guard lock(m_Lock);
+		m_Cancelled = true;
+		m_Pages.clear();
+	}
+	m_Pool.CancelPending();
+	m_PageTaken.notify_all();
+}
+
+bool FanOutQuery::TakePage(FanOutPage& page) {
+	{
+		std::lock_guard lock(m_Lock);
+		if (m_Pages.empty())
+			return false;
+
+		page = std::move(m_Pages.front());
+		m_Pages.pop_front();
+	}
+	m_PageTaken.notify_all();
+	return true;
+}
+
+bool FanOutQuery::IsDone() const {
+	std::lock_guard lock(m_Lock);
+	if (!m_Pages.empty())
+		return false;
+	if (m_Cancelled)
+		return true;
+
+	auto now = ::GetTickCount64();
+	return std::all_of(m_Hosts.begin(), m_Hosts.end(), [&](auto& h) { return h.Done || (h.Start && now >= h.Deadline); });
+}
+
+std::vector<FanOutHostStats> FanOutQuery::GetHosts() const {
+	std::lock_guard lock(m_Lock);
+	auto now = ::GetTickCount64();
+	std::vector<FanOutHostStats> hosts;
+	hosts.reserve(m_Hosts.size());
+	for (auto& h : m_Hosts) {
+		auto overdue = !h.Done && h.Start && now >= h.Deadline;
+		hosts.push_back({ h.Name, h.Rows, h.FirstRowMsec, h.Done ? h.ElapsedMsec : h.Start ? DWORD(now - h.Start) : 0,
+			overdue ? WBEM_E_TIMED_OUT : h.Status, h.Start != 0, h.Done || overdue, overdue || h.Status == WBEM_E_TIMED_OUT });
+	}
+	return hosts;
+}
+
+DWORD FanOutQuery::GetElapsedMsec() const {
+	return DWORD(::GetTickCount64() - m_Start);
+}
+
+void FanOutQuery::Run(int host) {
+	{
+		std::lock_guard lock(m_Lock);
+		auto& h = m_Hosts[host];
+		h.Start = ::GetTickCount64();
+		h.Deadline = h.Start + m_Options.TimeoutMsec;
+		if (m_Cancelled) {
+			h.Done = true;
+			h.Status = WBEM_E_CALL_CANCELLED;
+			return;
+		}
+	}
+
+	FanOutCall call(*this, host);
+	auto hr = m_Source->Run(call);
+	{
+		std::lock_guard lock(m_Lock);
+		auto& h = m_Hosts[host];
+		h.Done = true;
+		h.Status = SUCCEEDED(hr) && ::GetTickCount64() >= h.Deadline && h.Rows < m_Options.MaxRowsPerHost ? WBEM_E_TIMED_OUT : hr;
+		h.ElapsedMsec = DWORD(::GetTickCount64() - h.Start);
+	}
+	ATLTRACE(L"Fan-out host %s done: 0x%X\n", m_Hosts[host].Name.c_str(), hr);
+	Post();
+}
+
+bool FanOutQuery::Deliver(int host, std::vector<std::wstring> const& columns, std::vector<std::wstring>& cells) {
+	bool more;
+	{
+		std::unique_lock lock(m_Lock);
+		auto& h = m_Hosts[host];
+		auto now = ::GetTickCount64();
+		if (m_Cancelled || now >= h.Deadline || columns.empty())
+			return false;
+
+		//
+		// wait for the consumer, but not past the host's deadline
+		//
+		if (!m_PageTaken.wait_for(lock, std::chrono::milliseconds(h.Deadline - now), [&] { return m_Cancelled || m_Pages.size() < m_MaxPending; })
+			|| m_Cancelled)
+			return false;
+
+		auto rows = ULONG(cells.size() / columns.size());
+		more = h.Rows + rows < m_Options.MaxRowsPerHost;
+		if (!more) {
+			rows = m_Options.MaxRowsPerHost - h.Rows;
+			cells.resize(rows * columns.size());
+		}
+		if (h.Rows == 0 && rows)
+			h.FirstRowMsec = (DWORD)std::max(1ULL, ::GetTickCount64() - h.Start);
+		h.Rows += rows;
+
+		FanOutPage page{ host, {}, {} };
+		if (!h.ColumnsSent) {
+			page.Columns = columns;
+			h.ColumnsSent = true;
+		}
+		page.Cells = std::move(cells);
+		m_Pages.push_back(std::move(page));
+	}
+	cells.clear();
+	Post();
+	return more;
+}
+
+void FanOutQuery::Post() {
+	if (!::PostMessage(m_hWnd, m_Msg, m_Cookie, 0))
+		Cancel();
+}
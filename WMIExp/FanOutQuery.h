@@ -0,0 +1,157 @@
+#pragma once
+
+#include "WorkerPool.h"
+#include <deque>
+
+struct FanOutOptions {
+	int Concurrency{ 8 };				// hosts queried at the same time
+	DWORD TimeoutMsec{ 30000 };			// per host, from the moment its turn comes
+	ULONG MaxRowsPerHost{ 100000 };
+};
+
+struct FanOutPage {
+	int Host;							// index in the host list
+	std::vector<std::wstring> Columns;	// on the first page of each host only
+	std::vector<std::wstring> Cells;	// row by row, as many per row as the host has columns
+};
+
+struct FanOutHostStats {
+	std::wstring Host;
+	ULONG Rows;
+	DWORD FirstRowMsec;
+	DWORD ElapsedMsec;
+	HRESULT Status;
+	bool Started;
+	bool Done;
+	bool TimedOut;
+};
+
+class FanOutQuery;
+
+//
+// one host's share of a fan-out, handed to the source
+//
+class FanOutCall {
+public:
+	FanOutCall(FanOutQuery& query, int host);
+
+	std::wstring const& GetHost() const;
+	std::wstring const& GetQuery() const;
+	//
+	// time the host has left, 0 once it is up
+	//
+	DWORD GetRemainingMsec() const;
+	bool IsStopped() const;
+
+	//
+	// hands a page of rows over (cells are moved out); false means stop: cancelled,
+	// out of time or the row limit was reached
+	//
+	bool Deliver(std::vector<std::wstring> const& columns, std::vector<std::wstring>& cells);
+
+private:
+	FanOutQuery& m_Query;
+	int m_Host;
+	ULONGLONG m_Deadline;
+};
+
+//
+// where a host's rows come from; WMI for real machines, stand-ins otherwise
+//
+struct IFanOutSource {
+	virtual ~IFanOutSource() = default;
+	virtual HRESULT Run(FanOutCall& call) = 0;
+};
+
+//
+// each call opens a connection of its own and closes it when done. The hosts of a fan-out are
+// mostly one-offs, and going through the pool would evict the namespaces the UI works with.
+// Rows are waited for in short slices, so cancelling interrupts a slow host within a slice
+//
+class WmiFanOutSource : public IFanOutSource {
+public:
+	explicit WmiFanOutSource(PCWSTR nsPath);
+	HRESULT Run(FanOutCall& call) override;
+
+	static const ULONG PageSize = 64;
+	static const DWORD SliceMsec = 250;
+
+private:
+	std::wstring m_Namespace;
+};
+
+//
+// hosts named sim:<latency msec>[:<rows>] answer locally after the latency, then page by page
+// at a tenth of it, so fan-out behavior can be tried without remote machines. Other hosts go to
+// the next source, if any
+//
+class SimulatedFanOutSource : public IFanOutSource {
+public:
+	explicit SimulatedFanOutSource(std::shared_ptr<IFanOutSource> next = nullptr);
+	HRESULT Run(FanOutCall& call) override;
+
+	static bool IsSimulated(std::wstring const& host);
+
+	static const ULONG DefaultRows = 1000;
+	static const ULONG PageSize = 64;
+
+private:
+	static HRESULT Wait(FanOutCall const& call, DWORD msec);
+
+	std::shared_ptr<IFanOutSource> m_Next;
+};
+
+//
+// runs the same query against a list of hosts on a pool of Concurrency threads and merges the
+// results into one stream of pages tagged by host. Pages waiting for the consumer are bounded,
+// so a fast host blocks (within its time) rather than filling memory. The window is posted its
+// message (WPARAM = cookie) when a page is ready and when a host is done.
+// A host out of time is reported as timed out right away; a thread stuck in a call that cannot
+// be interrupted (e.g. connecting) keeps its slot until the call returns
+//
+class FanOutQuery : public std::enable_shared_from_this<FanOutQuery> {
+	friend class FanOutCall;
+public:
+	static std::shared_ptr<FanOutQuery> Create(std::shared_ptr<IFanOutSource> source, FanOutOptions const& options, HWND hWnd, UINT msg, WPARAM cookie);
+
+	void Start(std::vector<std::wstring> hosts, PCWSTR query);
+	void Cancel();
+
+	bool TakePage(FanOutPage& page);
+	bool IsDone() const;
+	std::vector<FanOutHostStats> GetHosts() const;
+	DWORD GetElapsedMsec() const;
+
+private:
+	struct HostState {
+		std::wstring Name;
+		ULONGLONG Start{ 0 };			// tick count, 0 while waiting for a thread
+		ULONGLONG Deadline{ 0 };
+		ULONG Rows{ 0 };
+		DWORD FirstRowMsec{ 0 };
+		DWORD ElapsedMsec{ 0 };
+		HRESULT Status{ S_OK };
+		bool Done{ false };
+		bool ColumnsSent{ false };
+	};
+
+	FanOutQuery(std::shared_ptr<IFanOutSource> source, FanOutOptions const& options, HWND hWnd, UINT msg, WPARAM cookie);
+	void Run(int host);
+	bool Deliver(int host, std::vector<std::wstring> const& columns, std::vector<std::wstring>& cells);
+	void Post();
+
+	std::shared_ptr<IFanOutSource> m_Source;
+	FanOutOptions m_Options;
+	WorkerPool m_Pool;
+	std::wstring m_Query;
+	mutable std::mutex m_Lock;
+	std::condition_variable m_PageTaken;
+	std::deque<FanOutPage> m_Pages;
+	std::vector<HostState> m_Hosts;
+	size_t m_MaxPending;
+	ULONGLONG m_Start{ 0 };
+	HWND m_hWnd;
+	UINT m_Msg;
+	WPARAM m_Cookie;
+	bool m_Cancelled{ false };
+};
@@ -0,0 +1,246 @@
+#include "pch.h"
+#include "InstanceExport.h"
+#include "InstanceStore.h"
+#include "WorkerPool.h"
+#include <charconv>
+#include <cmath>
+#include <thread>
+
+namespace {
+	template<typename T>
+	void AppendNumber(Utf8Buffer& out, T value) {
+		auto dst = out.Reserve(32);
+		out.Commit(std::to_chars(dst, dst + 32, value).ptr);
+	}
+
+	void AppendValue(Utf8Buffer& out, InstanceStore const& store, size_t row, int col, bool json, std::wstring& scratch) {
+		auto& column = store.GetColumn(col);
+		if (column.IsNull(row)) {
+			if (json)
+				out.Append("null");
+			return;
+		}
+
+		auto text = [&](std::wstring_view text) {
+			if (json)
+				Utf8Text::AppendJson(out, text);
+			else
+				Utf8Text::AppendCsv(out, text);
+		};
+		switch (column.Kind) {
+			case ColumnKind::Int64: AppendNumber(out, column.Ints[row]); break;
+			case ColumnKind::UInt64: AppendNumber(out, (ULONGLONG)column.Ints[row]); break;
+			case ColumnKind::Double:
+				if (json && !std::isfinite(column.Reals[row]))
+					out.Append("null");
+				else
+					AppendNumber(out, column.Reals[row]);
+				break;
+
+			case ColumnKind::Bool:
+				if (json)
+					out.Append(column.Bools[row] ? "true" : "false");
+				else
+					out.Append(column.Bools[row] ? "True" : "False");
+				break;
+
+			case ColumnKind::String:
+			case ColumnKind::Text:
+				text(store.GetStrings().Get(column.Strings[row]));
+				break;
+
+			default:
+				scratch.clear();
+				store.AppendText(row, col, scratch);
+				text(scratch);
+				break;
+		}
+	}
+}
+
+BufferedFileWriter::BufferedFileWriter(size_t bufferSize) : m_BufferSize(bufferSize) {
+}
+
+HRESULT BufferedFileWriter::Open(PCWSTR path) {
+	m_hFile.reset(::CreateFile(path, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, nullptr));
+	if (!m_hFile)
+		return HRESULT_FROM_WIN32(::GetLastError());
+
+	if (m_Buffer == nullptr)
+		m_Buffer = std::make_unique_for_overwrite<char[]>(m_BufferSize);
+	m_Used = 0;
+	m_Written = 0;
+	return S_OK;
+}
+
+HRESULT BufferedFileWriter::Write(std::string_view data) {
+	if (m_Used + data.size() > m_BufferSize) {
+		auto hr = Flush();
+		if (FAILED(hr))
+			return hr;
+		if (data.size() >= m_BufferSize)
+			return WriteThrough(data.data(), data.size());
+	}
+	memcpy(m_Buffer.get() + m_Used, data.data(), data.size());
+	m_Used += data.size();
+	return S_OK;
+}
+
+HRESULT BufferedFileWriter::Close() {
+	auto hr = Flush();
+	m_hFile.reset();
+	return hr;
+}
+
+ULONGLONG BufferedFileWriter::GetBytesWritten() const {
+	return m_Written + m_Used;
+}
+
+HRESULT BufferedFileWriter::Flush() {
+	if (m_Used == 0)
+		return S_OK;
+
+	auto hr = WriteThrough(m_Buffer.get(), m_Used);
+	m_Used = 0;
+	return hr;
+}
+
+HRESULT BufferedFileWriter::WriteThrough(char const* data, size_t size) {
+	while (size) {
+		DWORD written;
+		if (!::WriteFile(m_hFile.get(), data, (DWORD)std::min<size_t>(size, 1 << 30), &written, nullptr))
+			return HRESULT_FROM_WIN32(::GetLastError());
+		data += written;
+		size -= written;
+		m_Written += written;
+	}
+	return S_OK;
+}
+
+HRESULT InstanceExport::Save(PCWSTR path, InstanceStore const& store, std::vector<int> const& columns, ExportFormat format, ExportStats* stats) {
+	auto start = ::GetTickCount64();
+	BufferedFileWriter writer;
+	auto hr = writer.Open(path);
+	if (FAILED(hr))
+		return hr;
+
+	Utf8Buffer header;
+	AppendHeader(header, store, columns, format);
+	hr = writer.Write(header.GetView());
+
+	auto rows = store.GetRowCount();
+	auto chunks = (rows + ChunkRows - 1) / ChunkRows;
+	if (SUCCEEDED(hr) && chunks) {
+		//
+		// chunk i is formatted into slot i % slots; the slot is handed out again once written,
+		// so at most two chunks per thread are held at a time
+		//
+		struct Slot {
+			Utf8Buffer Text;
+			bool Ready{ false };
+		};
+		WorkerPool pool((int)std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), chunks));
+		std::vector<Slot> slots(2 * (size_t)pool.GetThreadCount());
+		std::mutex lock;
+		std::condition_variable ready;
+		auto submit = [&](size_t chunk) {
+			pool.Submit([&, chunk] {
+				auto& slot = slots[chunk % slots.size()];
+				auto first = chunk * ChunkRows;
+				slot.Text.Clear();
+				AppendRows(slot.Text, store, columns, format, first, std::min(ChunkRows, rows - first));
+				{
+					std::lock_guard locker(lock);
+					slot.Ready = true;
+				}
+				ready.notify_all();
+				});
+		};
+
+		size_t next = 0;
+		for (; next < std::min(chunks, slots.size()); next++)
+			submit(next);
+		for (size_t chunk = 0; chunk < chunks && SUCCEEDED(hr); chunk++) {
+			auto& slot = slots[chunk % slots.size()];
+			{
+				std::unique_lock locker(lock);
+				ready.wait(locker, [&] { return slot.Ready; });
+				slot.Ready = false;
+			}
+			hr = writer.Write(slot.Text.GetView());
+			if (next < chunks)
+				submit(next++);
+		}
+		//
+		// the tasks refer to the locals above
+		//
+		pool.CancelPending();
+		pool.Wait();
+	}
+
+	if (SUCCEEDED(hr))
+		hr = writer.Close();
+	if (FAILED(hr)) {
+		writer.Close();
+		::DeleteFile(path);
+		return hr;
+	}
+
+	if (stats) {
+		stats->Rows = rows;
+		stats->Bytes = writer.GetBytesWritten();
+		stats->ElapsedMsec = DWORD(::GetTickCount64() - start);
+	}
+	return S_OK;
+}
+
+void InstanceExport::AppendHeader(Utf8Buffer& out, InstanceStore const& store, std::vector<int> const& columns, ExportFormat format) {
+	if (format != ExportFormat::Csv)
+		return;
+
+	//
+	// the byte order mark tells spreadsheets the file is UTF-8
+	//
+	out.Append("\xef\xbb\xbf");
+	for (size_t i = 0; i < columns.size(); i++) {
+		if (i)
+			out.Append(',');
+		Utf8Text::AppendCsv(out, store.GetColumn(columns[i]).Name);
+	}
+	out.Append("\r\n");
+}
+
+void InstanceExport::AppendRows(Utf8Buffer& out, InstanceStore const& store, std::vector<int> const& columns, ExportFormat format,
+	size_t first, size_t count) {
+	auto json = format == ExportFormat::Json;
+
+	//
+	// JSON member names are the same on every row; converted once
+	//
+	Utf8Buffer names;
+	std::vector<size_t> ends;
+	if (json) {
+		for (size_t i = 0; i < columns.size(); i++) {
+			names.Append(i ? ',' : '{');
+			Utf8Text::AppendJson(names, store.GetColumn(columns[i]).Name);
+			names.Append(':');
+			ends.push_back(names.GetSize());
+		}
+	}
+	auto prefixes = names.GetView();
+
+	std::wstring scratch;
+	for (auto row = first; row < first + count; row++) {
+		for (size_t i = 0; i < columns.size(); i++) {
+			if (json)
+				out.Append(prefixes.substr(i ? ends[i - 1] : 0, ends[i] - (i ? ends[i - 1] : 0)));
+			else if (i)
+				out.Append(',');
+			AppendValue(out, store, row, columns[i], json, scratch);
+		}
+		if (json)
+			out.Append(columns.empty() ? "{}\n" : "}\n");
+		else
+			out.Append("\r\n");
+	}
+}
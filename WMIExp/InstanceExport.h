@@ -0,0 +1,62 @@
+#pragma once
+
+#include "Utf8Text.h"
+
+class InstanceStore;
+
+enum class ExportFormat {
+	Csv,
+	Json		// one object per line (NDJSON)
+};
+
+//
+// writes through a large buffer; writes larger than the buffer go straight to the file
+//
+class BufferedFileWriter {
+public:
+	explicit BufferedFileWriter(size_t bufferSize = 1 << 22);
+
+	HRESULT Open(PCWSTR path);
+	HRESULT Write(std::string_view data);
+	//
+	// flushes; data not flushed is lost if the writer goes away without it
+	//
+	HRESULT Close();
+
+	ULONGLONG GetBytesWritten() const;
+
+private:
+	HRESULT Flush();
+	HRESULT WriteThrough(char const* data, size_t size);
+
+	wil::unique_hfile m_hFile;
+	std::unique_ptr<char[]> m_Buffer;
+	size_t m_BufferSize;
+	size_t m_Used{ 0 };
+	ULONGLONG m_Written{ 0 };
+};
+
+struct ExportStats {
+	size_t Rows;
+	ULONGLONG Bytes;
+	DWORD ElapsedMsec;
+};
+
+//
+// streams the rows of an instance store to a file, values taken from the typed columns
+// rather than from list text. Rows are formatted in chunks on all cores and written in order;
+// chunks in flight are bounded, so memory does not grow with the row count.
+// The store must not change until Save returns
+//
+struct InstanceExport abstract final {
+	static const size_t ChunkRows = 4096;
+
+	//
+	// columns are store column indices, in output order
+	//
+	static HRESULT Save(PCWSTR path, InstanceStore const& store, std::vector<int> const& columns, ExportFormat format, ExportStats* stats = nullptr);
+
+	static void AppendHeader(Utf8Buffer& out, InstanceStore const& store, std::vector<int> const& columns, ExportFormat format);
+	static void AppendRows(Utf8Buffer& out, InstanceStore const& store, std::vector<int> const& columns, ExportFormat format,
+		size_t first, size_t count);
+};
@@ -0,0 +1,536 @@
+#include "pch.h"
+#include "InstanceStore.h"
+#include "SchemaCache.h"
+#include "CimDateTime.h"
+
+DWORD StringPool::Add(std::wstring_view text) {
+	if (auto it = m_Index.find(text); it != m_Index.end())
+		return it->second;
+
+	auto id = (DWORD)m_Strings.size();
+	auto& s = m_Strings.emplace_back(text);
+	m_Index.emplace(s, id);
+	m_Chars += s.capacity() + 1;
+	return id;
+}
+
+std::wstring const& StringPool::Get(DWORD id) const {
+	return m_Strings[id];
+}
+
+size_t StringPool::GetCount() const {
+	return m_Strings.size();
+}
+
+size_t StringPool::GetMemorySize() const {
+	//
+	// the characters, the string objects and roughly one hash node per string
+	//
+	return m_Chars * sizeof(WCHAR) + m_Strings.size() * (sizeof(std::wstring) + sizeof(std::pair<std::wstring_view, DWORD>) + 2 * sizeof(void*))
+		+ m_Index.bucket_count() * sizeof(void*);
+}
+
+void StringPool::Clear() {
+	m_Index.clear();
+	m_Strings.clear();
+	m_Chars = 0;
+}
+
+bool InstanceColumn::IsNull(size_t row) const {
+	return (Nulls[row / 64] >> (row % 64)) & 1;
+}
+
+bool InstanceColumn::IsRaw(size_t row) const {
+	return Kind == ColumnKind::DateTime && Offsets[row] == RawOffset;
+}
+
+size_t InstanceColumn::GetMemorySize() const {
+	return sizeof(*this) + Name.capacity() * sizeof(WCHAR) + Ints.capacity() * sizeof(LONGLONG) + Reals.capacity() * sizeof(double)
+		+ Bools.capacity() + Strings.capacity() * sizeof(DWORD) + Offsets.capacity() * sizeof(SHORT) + Nulls.capacity() * sizeof(ULONGLONG);
+}
+
+size_t InstanceStoreMemory::Total() const {
+	return Columns + Strings;
+}
+
+void InstanceStore::Reset(ClassSchema const& schema) {
+	Clear();
+	m_Columns.reserve(schema.Properties.size());
+	for (auto& prop : schema.Properties) {
+		InstanceColumn column;
+		column.Name = prop.Name;
+		column.CimType = prop.Type;
+		column.Kind = GetKind(prop.Type);
+		m_ColumnIndex.emplace(MakeKey(prop.Name.c_str()), (int)m_Columns.size());
+		if (prop.IsKey)
+			m_KeyColumns.push_back((int)m_Columns.size());
+		m_Columns.push_back(std::move(column));
+	}
+	m_ClassName = schema.Name;
+	m_ClassColumn = FindColumn(L"__CLASS");
+	//
+	// WMI lists the keys of a path in alphabetical order
+	//
+	std::sort(m_KeyColumns.begin(), m_KeyColumns.end(), [&](auto c1, auto c2) {
+		return ::_wcsicmp(m_Columns[c1].Name.c_str(), m_Columns[c2].Name.c_str()) < 0;
+		});
+}
+
+void InstanceStore::Clear() {
+	m_Columns.clear();
+	m_KeyColumns.clear();
+	m_ClassColumn = -1;
+	m_ClassName.clear();
+	m_ColumnIndex.clear();
+	m_Strings.Clear();
+	m_Layouts.clear();
+	m_LastLayout = nullptr;
+	m_Rows = 0;
+}
+
+void InstanceStore::Append(IWbemClassObject* pObj) {
+	//
+	// scalar properties are read through handles straight into the columns;
+	// the rest (system properties, arrays, objects) go through a VARIANT
+	//
+	CComVariant cls;
+	AccessLayout const* layout = nullptr;
+	wil::com_ptr<IWbemObjectAccess> spAccess;
+	if (SUCCEEDED(pObj->QueryInterface(spAccess.addressof()))
+		&& SUCCEEDED(pObj->Get(L"__CLASS", 0, &cls, nullptr, nullptr)) && cls.vt == VT_BSTR)
+		layout = &GetLayout(spAccess.get(), cls.bstrVal);
+
+	for (int i = 0; i < (int)m_Columns.size(); i++) {
+		auto& column = m_Columns[i];
+		if (m_Rows % 64 == 0)
+			column.Nulls.push_back(0);
+		if (layout && layout->Handles[i] >= 0 && ReadValue(spAccess.get(), layout->Handles[i], column))
+			continue;
+
+		CComVariant value;
+		if (i == m_ClassColumn && cls.vt == VT_BSTR)
+			value = cls;
+		else if (FAILED(pObj->Get(column.Name.c_str(), 0, &value, nullptr, nullptr)))
+			value.Clear();
+		AppendValue(column, value);
+	}
+	m_Rows++;
+}
+
+size_t InstanceStore::GetRowCount() const {
+	return m_Rows;
+}
+
+int InstanceStore::GetColumnCount() const {
+	return (int)m_Columns.size();
+}
+
+InstanceColumn const& InstanceStore::GetColumn(int col) const {
+	return m_Columns[col];
+}
+
+int InstanceStore::FindColumn(std::wstring_view name) const {
+	auto it = m_ColumnIndex.find(MakeKey(name));
+	return it == m_ColumnIndex.end() ? -1 : it->second;
+}
+
+WqlColumnKind InstanceStore::GetColumnKind(int col) const {
+	static_assert((int)ColumnKind::DateTime == (int)WqlColumnKind::DateTime);
+	auto kind = m_Columns[col].Kind;
+	return kind == ColumnKind::Text ? WqlColumnKind::String : (WqlColumnKind)kind;
+}
+
+StringPool const& InstanceStore::GetStrings() const {
+	return m_Strings;
+}
+
+bool InstanceStore::IsNull(size_t row, int col) const {
+	return m_Columns[col].IsNull(row);
+}
+
+LONGLONG InstanceStore::GetInt64(size_t row, int col) const {
+	return m_Columns[col].Ints[row];
+}
+
+double InstanceStore::GetDouble(size_t row, int col) const {
+	return m_Columns[col].Reals[row];
+}
+
+bool InstanceStore::GetBool(size_t row, int col) const {
+	return m_Columns[col].Bools[row] != 0;
+}
+
+bool InstanceStore::HasTicks(size_t row, int col) const {
+	return !m_Columns[col].IsRaw(row);
+}
+
+std::wstring const& InstanceStore::GetString(size_t row, int col) const {
+	return m_Strings.Get(m_Columns[col].Strings[row]);
+}
+
+uint32_t InstanceStore::GetStringId(size_t row, int col) const {
+	return m_Columns[col].Strings[row];
+}
+
+size_t InstanceStore::GetStringCount() const {
+	return m_Strings.GetCount();
+}
+
+std::wstring const& InstanceStore::GetPooledString(uint32_t id) const {
+	return m_Strings.Get(id);
+}
+
+std::wstring InstanceStore::GetText(size_t row, int col) const {
+	std::wstring text;
+	AppendText(row, col, text);
+	return text;
+}
+
+void InstanceStore::AppendText(size_t row, int col, std::wstring& text) const {
+	auto& column = m_Columns[col];
+	if (column.IsNull(row))
+		return;
+
+	switch (column.Kind) {
+		case ColumnKind::Int64: std::format_to(std::back_inserter(text), L"{}", column.Ints[row]); break;
+		case ColumnKind::UInt64: std::format_to(std::back_inserter(text), L"{}", (ULONGLONG)column.Ints[row]); break;
+		case ColumnKind::Char: text += (WCHAR)column.Ints[row]; break;
+		case ColumnKind::Double: std::format_to(std::back_inserter(text), L"{}", column.Reals[row]); break;
+		case ColumnKind::Bool: text += column.Bools[row] ? L"True" : L"False"; break;
+		case ColumnKind::DateTime:
+			if (column.IsRaw(row))
+				text += m_Strings.Get((DWORD)column.Ints[row]);
+			else
+				CimDateTime::Append(text, column.Ints[row], column.Offsets[row]);
+			break;
+		case ColumnKind::String:
+		case ColumnKind::Text:
+			text += m_Strings.Get(column.Strings[row]);
+			break;
+	}
+}
+
+std::wstring InstanceStore::GetRelPath(size_t row) const {
+	std::wstring path;
+	AppendRelPath(row, path);
+	return path;
+}
+
+void InstanceStore::AppendRelPath(size_t row, std::wstring& path) const {
+	path += m_ClassColumn >= 0 && !IsNull(row, m_ClassColumn) ? GetString(row, m_ClassColumn) : m_ClassName;
+	if (m_KeyColumns.empty()) {
+		path += L"=@";	// singleton
+		return;
+	}
+
+	auto quote = [&](std::wstring_view text) {
+		path += L'"';
+		for (auto ch : text) {
+			if (ch == L'"' || ch == L'\\')
+				path += L'\\';
+			path += ch;
+		}
+		path += L'"';
+	};
+
+	auto separator = L'.';
+	for (auto col : m_KeyColumns) {
+		auto& column = m_Columns[col];
+		path += separator;
+		path += column.Name;
+		path += L'=';
+		separator = L',';
+		if (column.IsNull(row)) {
+			path += L"\"\"";
+			continue;
+		}
+		switch (column.Kind) {
+			case ColumnKind::Int64:
+			case ColumnKind::UInt64:
+			case ColumnKind::Double:
+			case ColumnKind::Bool:
+				AppendText(row, col, path);
+				break;
+
+			case ColumnKind::Char:
+			{
+				auto ch = (WCHAR)column.Ints[row];
+				quote(std::wstring_view(&ch, 1));
+				break;
+			}
+
+			case ColumnKind::DateTime:
+				path += L'"';
+				AppendText(row, col, path);
+				path += L'"';
+				break;
+
+			default:
+				quote(m_Strings.Get(column.Strings[row]));
+				break;
+		}
+	}
+}
+
+InstanceStoreMemory InstanceStore::GetMemory() const {
+	InstanceStoreMemory memory{};
+	for (auto& column : m_Columns)
+		memory.Columns += column.GetMemorySize();
+	memory.Strings = m_Strings.GetMemorySize();
+	return memory;
+}
+
+ColumnKind InstanceStore::GetKind(CIMTYPE type) {
+	if (type & CIM_FLAG_ARRAY)
+		return ColumnKind::Text;
+
+	switch (type) {
+		case CIM_SINT8:
+		case CIM_UINT8:
+		case CIM_SINT16:
+		case CIM_UINT16:
+		case CIM_SINT32:
+		case CIM_UINT32:
+		case CIM_SINT64:
+			return ColumnKind::Int64;
+
+		case CIM_UINT64: return ColumnKind::UInt64;
+		case CIM_CHAR16: return ColumnKind::Char;
+		case CIM_REAL32:
+		case CIM_REAL64:
+			return ColumnKind::Double;
+
+		case CIM_BOOLEAN: return ColumnKind::Bool;
+		case CIM_DATETIME: return ColumnKind::DateTime;
+		case CIM_STRING:
+		case CIM_REFERENCE:
+			return ColumnKind::String;
+	}
+	return ColumnKind::Text;
+}
+
+void InstanceStore::AppendValue(InstanceColumn& column, VARIANT& value) {
+	auto null = value.vt == VT_NULL || value.vt == VT_EMPTY;
+	CComVariant converted;
+	switch (column.Kind) {
+		case ColumnKind::Int64:
+		case ColumnKind::UInt64:
+		case ColumnKind::Char:
+			//
+			// 64 bit integers arrive as strings
+			//
+			null = null || FAILED(converted.ChangeType(column.Kind == ColumnKind::UInt64 ? VT_UI8 : VT_I8, &value));
+			if (null)
+				column.Ints.push_back(0);
+			//
+			// uint32 arrives as VT_I4 and char16 as VT_I2; widen them the way handle reads do
+			//
+			else if (column.CimType == CIM_UINT32)
+				column.Ints.push_back((DWORD)converted.llVal);
+			else if (column.CimType == CIM_UINT16 || column.CimType == CIM_CHAR16)
+				column.Ints.push_back((WORD)converted.llVal);
+			else
+				column.Ints.push_back(converted.llVal);
+			break;
+
+		case ColumnKind::Double:
+			null = null || FAILED(converted.ChangeType(VT_R8, &value));
+			column.Reals.push_back(null ? 0 : converted.dblVal);
+			break;
+
+		case ColumnKind::Bool:
+			null = null || value.vt != VT_BOOL;
+			column.Bools.push_back(!null && value.boolVal != VARIANT_FALSE);
+			break;
+
+		case ColumnKind::DateTime:
+			null = null || value.vt != VT_BSTR;
+			if (null) {
+				column.Ints.push_back(0);
+				column.Offsets.push_back(0);
+			}
+			else
+				AppendDateTime(column, value.bstrVal);
+			break;
+
+		case ColumnKind::String:
+			null = null || value.vt != VT_BSTR;
+			column.Strings.push_back(null ? 0 : m_Strings.Add(value.bstrVal));
+			break;
+
+		case ColumnKind::Text:
+			column.Strings.push_back(null ? 0 : m_Strings.Add(VariantToText(value)));
+			break;
+	}
+	if (null)
+		column.Nulls.back() |= 1ULL << (m_Rows % 64);
+}
+
+void InstanceStore::AppendDateTime(InstanceColumn& column, PCWSTR text) {
+	int64_t ticks = 0;
+	int16_t offset = 0;
+	if (!CimDateTime::Parse(text, ticks, offset)) {
+		//
+		// wildcards and the like: show what WMI returned rather than nothing
+		//
+		ticks = m_Strings.Add(text);
+		offset = InstanceColumn::RawOffset;
+	}
+	column.Ints.push_back(ticks);
+	column.Offsets.push_back(offset);
+}
+
+InstanceStore::AccessLayout const& InstanceStore::GetLayout(IWbemObjectAccess* pAccess, PCWSTR className) {
+	//
+	// instances of a class arrive together; looking each one up by name would build a key string per instance
+	//
+	if (m_LastLayout && m_LastLayout->first == className)
+		return m_LastLayout->second;
+
+	auto [it, inserted] = m_Layouts.try_emplace(className);
+	m_LastLayout = &*it;
+	auto& layout = it->second;
+	if (!inserted)
+		return layout;
+
+	layout.Handles.reserve(m_Columns.size());
+	for (auto& column : m_Columns) {
+		CIMTYPE type;
+		long handle;
+		if (column.Kind == ColumnKind::Text || column.Name.starts_with(L"__")
+			|| FAILED(pAccess->GetPropertyHandle(column.Name.c_str(), &type, &handle)) || type != column.CimType)
+			handle = -1;
+		layout.Handles.push_back(handle);
+	}
+	return layout;
+}
+
+bool InstanceStore::ReadValue(IWbemObjectAccess* pAccess, long handle, InstanceColumn& column) {
+	long size = 0;
+	auto read = [&] {
+		if (m_ReadBuffer.size() < sizeof(ULONGLONG))
+			m_ReadBuffer.resize(256);
+		auto hr = pAccess->ReadPropertyValue(handle, (long)m_ReadBuffer.size(), &size, m_ReadBuffer.data());
+		if (hr == WBEM_E_BUFFER_TOO_SMALL) {
+			m_ReadBuffer.resize(size);
+			hr = pAccess->ReadPropertyValue(handle, (long)m_ReadBuffer.size(), &size, m_ReadBuffer.data());
+		}
+		return hr;
+	};
+	auto hr = read();
+	if (FAILED(hr))
+		return false;
+
+	if (hr == WBEM_S_FALSE || size == 0) {
+		CComVariant null;
+		null.vt = VT_NULL;
+		AppendValue(column, null);
+		return true;
+	}
+
+	auto data = m_ReadBuffer.data();
+	switch (column.CimType) {
+		case CIM_SINT8: column.Ints.push_back(*(signed char*)data); break;
+		case CIM_UINT8: column.Ints.push_back(*data); break;
+		case CIM_SINT16: column.Ints.push_back(*(SHORT*)data); break;
+		case CIM_UINT16:
+		case CIM_CHAR16:
+			column.Ints.push_back(*(WORD*)data);
+			break;
+		case CIM_SINT32: column.Ints.push_back(*(LONG*)data); break;
+		case CIM_UINT32: column.Ints.push_back(*(DWORD*)data); break;
+		case CIM_SINT64:
+		case CIM_UINT64:
+			column.Ints.push_back(*(LONGLONG*)data);
+			break;
+		case CIM_REAL32: column.Reals.push_back(*(float*)data); break;
+		case CIM_REAL64: column.Reals.push_back(*(double*)data); break;
+		case CIM_BOOLEAN: column.Bools.push_back(*(WORD*)data != 0); break;
+		case CIM_STRING:
+		case CIM_REFERENCE:
+			column.Strings.push_back(m_Strings.Add((PCWSTR)data));
+			break;
+
+		case CIM_DATETIME:
+			AppendDateTime(column, (PCWSTR)data);
+			break;
+
+		default:
+			return false;
+	}
+	return true;
+}
+
+std::wstring InstanceStore::VariantToText(VARIANT const& value) {
+	if ((value.vt & VT_ARRAY) == 0)
+		return ScalarToText(value);
+
+	std::wstring text;
+	auto sa = value.parray;
+	LONG lower, upper;
+	VARTYPE vt;
+	if (sa == nullptr || FAILED(::SafeArrayGetLBound(sa, 1, &lower)) || FAILED(::SafeArrayGetUBound(sa, 1, &upper))
+		|| FAILED(::SafeArrayGetVartype(sa, &vt)))
+		return text;
+
+	if (vt == VT_UI1 || vt == VT_I1) {
+		//
+		// binary data, as a hex dump of its beginning
+		//
+		for (LONG i = lower; i <= upper && i - lower < 64; i++) {
+			BYTE b;
+			if (SUCCEEDED(::SafeArrayGetElement(sa, &i, &b)))
+				text += std::format(L"{:02X} ", b);
+		}
+		return text;
+	}
+
+	for (LONG i = lower; i <= upper; i++) {
+		CComVariant element;
+		if (vt == VT_VARIANT) {
+			if (FAILED(::SafeArrayGetElement(sa, &i, &element)))
+				continue;
+		}
+		else {
+			if (FAILED(::SafeArrayGetElement(sa, &i, &element.llVal)))
+				continue;
+			element.vt = vt;
+		}
+		if (!text.empty())
+			text += L", ";
+		text += ScalarToText(element);
+	}
+	return text;
+}
+
+std::wstring InstanceStore::ScalarToText(VARIANT const& value) {
+	switch (value.vt) {
+		case VT_NULL:
+		case VT_EMPTY:
+			return L"";
+
+		case VT_BOOL: return value.boolVal ? L"True" : L"False";
+		case VT_BSTR: return value.bstrVal ? value.bstrVal : L"";
+		case VT_UNKNOWN:
+		{
+			//
+			// embedded object
+			//
+			CComQIPtr<IWbemClassObject> spObj(value.punkVal);
+			CComBSTR text;
+			if (spObj && SUCCEEDED(spObj->GetObjectText(0, &text)) && text)
+				return text.m_str;
+			return L"";
+		}
+	}
+	CComVariant text;
+	if (FAILED(text.ChangeType(VT_BSTR, &value)))
+		return L"";
+	return text.bstrVal;
+}
+
+std::wstring InstanceStore::MakeKey(std::wstring_view name) {
+	std::wstring key(name);
+	::CharLowerBuff(key.data(), (DWORD)key.length());
+	return key;
+}
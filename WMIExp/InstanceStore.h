@@ -0,0 +1,135 @@
+#pragma once
+
+#include <deque>
+#include <unordered_map>
+#include "WqlQuery.h"
+
+struct ClassSchema;
+
+enum class ColumnKind : BYTE {
+	Int64, UInt64, Char, Double, Bool, String, DateTime, Text
+};
+
+//
+// interned strings; ids are dense and a string never moves once added
+//
+class StringPool {
+public:
+	DWORD Add(std::wstring_view text);
+	std::wstring const& Get(DWORD id) const;
+	size_t GetCount() const;
+	size_t GetMemorySize() const;
+	void Clear();
+
+private:
+	std::deque<std::wstring> m_Strings;
+	std::unordered_map<std::wstring_view, DWORD> m_Index;
+	size_t m_Chars{ 0 };
+};
+
+//
+// one property across all rows; only the array matching the kind is used
+//
+struct InstanceColumn {
+	std::wstring Name;
+	CIMTYPE CimType;
+	ColumnKind Kind;
+	//
+	// a DateTime that does not parse (e.g. wildcard fields) is kept as WMI returned it:
+	// the offset is RawOffset and Ints holds the pool id of the text
+	//
+	static constexpr SHORT RawOffset = INT16_MIN + 1;
+
+	std::vector<LONGLONG> Ints;		// Int64, UInt64 (as bits), Char, DateTime (UTC, 100 nsec since 1601)
+	std::vector<double> Reals;
+	std::vector<BYTE> Bools;
+	std::vector<DWORD> Strings;		// String, Text (pool ids)
+	std::vector<SHORT> Offsets;		// DateTime: UTC offset in minutes, CimDateTime::IntervalOffset or RawOffset
+	std::vector<ULONGLONG> Nulls;	// one bit per row, set for NULL
+
+	bool IsNull(size_t row) const;
+	bool IsRaw(size_t row) const;
+	size_t GetMemorySize() const;
+};
+
+struct InstanceStoreMemory {
+	size_t Columns;		// typed arrays and null bitmaps
+	size_t Strings;		// the string pool
+	size_t Total() const;
+};
+
+//
+// instances of a class decoded once into typed columns, so reading a value
+// later is an array access rather than a trip through COM and VARIANT.
+// Arrays and embedded objects are kept as their display text
+//
+class InstanceStore final : public WqlTable {
+public:
+	//
+	// column i holds schema property i
+	//
+	void Reset(ClassSchema const& schema);
+	void Clear();
+	void Append(IWbemClassObject* pObj);
+
+	size_t GetRowCount() const override;
+	int GetColumnCount() const;
+	InstanceColumn const& GetColumn(int col) const;
+	int FindColumn(std::wstring_view name) const override;
+	WqlColumnKind GetColumnKind(int col) const override;
+	StringPool const& GetStrings() const;
+
+	bool IsNull(size_t row, int col) const override;
+	LONGLONG GetInt64(size_t row, int col) const override;
+	double GetDouble(size_t row, int col) const override;
+	bool GetBool(size_t row, int col) const override;
+	bool HasTicks(size_t row, int col) const override;
+	std::wstring const& GetString(size_t row, int col) const;
+	uint32_t GetStringId(size_t row, int col) const override;
+	size_t GetStringCount() const override;
+	std::wstring const& GetPooledString(uint32_t id) const override;
+	//
+	// any column, formatted the way WMI presents it
+	//
+	std::wstring GetText(size_t row, int col) const;
+	void AppendText(size_t row, int col, std::wstring& text) const;
+	//
+	// __RELPATH style name built from the key properties, e.g. Win32_Service.Name="Spooler"
+	//
+	std::wstring GetRelPath(size_t row) const;
+	void AppendRelPath(size_t row, std::wstring& path) const;
+
+	InstanceStoreMemory GetMemory() const;
+
+private:
+	static ColumnKind GetKind(CIMTYPE type);
+	static std::wstring VariantToText(VARIANT const& value);
+	static std::wstring ScalarToText(VARIANT const& value);
+	static std::wstring MakeKey(std::wstring_view name);
+	void AppendValue(InstanceColumn& column, VARIANT& value);
+	void AppendDateTime(InstanceColumn& column, PCWSTR text);
+
+	//
+	// IWbemObjectAccess handles of a class, one per column (-1 when read through Get)
+	//
+	struct AccessLayout {
+		std::vector<long> Handles;
+	};
+	AccessLayout const& GetLayout(IWbemObjectAccess* pAccess, PCWSTR className);
+	bool ReadValue(IWbemObjectAccess* pAccess, long handle, InstanceColumn& column);
+
+	std::vector<InstanceColumn> m_Columns;
+	std::vector<int> m_KeyColumns;
+	int m_ClassColumn{ -1 };
+	std::wstring m_ClassName;
+	std::unordered_map<std::wstring, int> m_ColumnIndex;
+	StringPool m_Strings;
+	//
+	// instances of derived classes may lay out their properties differently,
+	// so handles are resolved per concrete class
+	//
+	std::unordered_map<std::wstring, AccessLayout> m_Layouts;
+	decltype(m_Layouts)::value_type* m_LastLayout{ nullptr };
+	std::vector<BYTE> m_ReadBuffer;
+	size_t m_Rows{ 0 };
+};
@@ -10,8 +10,25 @@
 #include "AppSettings.h"
 #include "IconHelper.h"
 #include <SortHelper.h>
+#include "SchemaCache.h"
+#include "ConnectionPool.h"
+#include "InstanceExport.h"
+#include <ClipboardHelper.h>
 
 BOOL CMainFrame::PreTranslateMessage(MSG* pMsg) {
+	if (m_SearchDlg.IsWindow() && m_SearchDlg.IsDialogMessage(pMsg))
+		return TRUE;
+	if (m_QueryDlg.IsWindow() && m_QueryDlg.IsDialogMessage(pMsg))
+		return TRUE;
+	if (m_PerfMonitorDlg.IsWindow() && m_PerfMonitorDlg.IsDialogMessage(pMsg))
+		return TRUE;
+	if (m_EventsDlg.IsWindow() && m_EventsDlg.IsDialogMessage(pMsg))
+		return TRUE;
+	if (m_DiagnosticsDlg.IsWindow() && m_DiagnosticsDlg.IsDialogMessage(pMsg))
+		return TRUE;
+	if (m_FanOutDlg.IsWindow() && m_FanOutDlg.IsDialogMessage(pMsg))
+		return TRUE;
+
 	return CFrameWindowImpl<CMainFrame>::PreTranslateMessage(pMsg);
 }
 
@@ -21,31 +38,61 @@ BOOL CMainFrame::OnIdle() {
 }
 
 CString CMainFrame::GetColumnText(HWND h, int row, int col) const {
-	auto column = GetColumnManager(h)->GetColumnTag<ColumnType>(col);
-	if (h == m_List) {
-		auto& item = m_Items[row];
-		switch (column) {
-			case ColumnType::Name: return item.Name.c_str();
-			case ColumnType::Type: return NodeTypeToText(item.Type);
-			case ColumnType::CimType:
-				if (item.Type == NodeType::Property) {
-					auto text = CimTypeToString(item.CimType);
-					return text;
-				}
-				break;
+	return GetExistingColumnText(h, row, col);
+}
 
-			case ColumnType::Value: return GetObjectValue(item);
-			case ColumnType::Details: return GetObjectDetails(item);
-		}
+PCWSTR CMainFrame::GetExistingColumnText(HWND h, int row, int col) const {
+	//
+	// text is either owned by the item or formatted once into a cell cache,
+	// so repainting a cell allocates nothing
+	//
+	auto column = GetColumnManager(h)->GetColumnTag<ColumnType>(col);
+	if (h == m_InstanceList) {
+		if (column != ColumnType::Name)
+			return L"";
+
+		//
+		// built from the keys, and only for rows being painted
+		//
+		if (auto text = m_InstanceCells.Find(row, 0))
+			return text;
+		auto& text = m_InstanceCells.GetBuffer();
+		m_Store.AppendRelPath(row, text);
+		return m_InstanceCells.Add(row, 0, text);
 	}
-	else {
-		ATLASSERT(h == m_InstanceList);
-		auto& item = m_Objects[row];
-		switch (column) {
-			case ColumnType::Name: return item.Name.c_str();
-		}
+
+	ATLASSERT(h == m_List);
+	auto& item = m_Items[row];
+	switch (column) {
+		case ColumnType::Name: return item.Name.c_str();
+		case ColumnType::Type: return NodeTypeToText(item.Type);
+		case ColumnType::CimType: return item.Type == NodeType::Property ? CellText::CimTypeToText(item.CimType) : L"";
+		case ColumnType::Value:
+			if (item.Type == NodeType::Class)	// superclass of a derived class
+				return item.Value.vt == VT_BSTR && item.Value.bstrVal ? item.Value.bstrVal : L"";
+			if (item.Type != NodeType::Property)
+				return L"";
+			break;
+
+		case ColumnType::Details:
+			//
+			// signatures are rendered when the class is parsed
+			//
+			if (item.Type == NodeType::Method)
+				return m_spCurrentSchema ? m_spCurrentSchema->Methods[item.Column].Signature.c_str() : L"";
+			break;
+
+		default: return L"";
 	}
-	return L"";
+
+	if (auto text = m_ListCells.Find(row, (int)column))
+		return text;
+	auto& text = m_ListCells.GetBuffer();
+	if (column == ColumnType::Value)
+		CellText::AppendValue(text, item.Value, item.CimType);
+	else
+		AppendObjectDetails(item, text);
+	return m_ListCells.Add(row, (int)column, text);
 }
 
 int CMainFrame::GetRowImage(HWND h, int row, int) const {
@@ -70,11 +117,12 @@ void CMainFrame::OnStateChanged(HWND h, int from, int to, UINT oldState, UINT ne
 	if (h != m_InstanceList)
 		return;
 
-	int index = m_InstanceList.GetSelectedIndex();
-	if (index >= 0) {
-		m_ObjPropValues = WMIHelper::EnumProperties(m_Objects[index].Object.get());
-		m_List.RedrawItems(m_List.GetTopIndex(), m_List.GetTopIndex() + m_List.GetCountPerPage());
-	}
+	//
+	// property values of the selected instance come from the store
+	//
+	m_SelectedInstance = m_InstanceList.GetSelectedIndex();
+	m_ListCells.Invalidate((int)ColumnType::Details);
+	m_List.RedrawItems(m_List.GetTopIndex(), m_List.GetTopIndex() + m_List.GetCountPerPage());
 }
 
 LRESULT CMainFrame::OnCreate(UINT /*uMsg*/, WPARAM /*wParam*/, LPARAM /*lParam*/, BOOL& /*bHandled*/) {
@@ -187,20 +235,32 @@ LRESULT CMainFrame::OnCreate(UINT /*uMsg*/, WPARAM /*wParam*/, LPARAM /*lParam*/
 	UISetCheck(ID_VIEW_SYSTEMPROPERTIES, settings.ViewSystemProperties());
 	UISetCheck(ID_VIEW_SYSTEMCLASSES, settings.ViewSystemClasses());
 	UISetCheck(ID_VIEW_NAMESPACESINLIST, settings.ShowNamespacesInList());
+	UISetCheck(ID_VIEW_CLASSHIERARCHY, settings.ClassHierarchy());
 
 	if (settings.AlwaysOnTop())
 		SetWindowPos(HWND_TOPMOST, 0, 0, 0, 0, SWP_NOMOVE | SWP_NOSIZE);
 
 	UpdateLayout();
 
-	WMIHelper::Init(nullptr, m_RootName, &m_spWmi);
+	ConnectionPool::Get().SetCapacity(AppSettings::Get().ConnectionPoolSize());
+	WMIHelper::SetEnumBatchSize(std::max(0, AppSettings::Get().EnumBatchSize()));
+	ConnectionPool::Get().GetService(m_RootName, &m_spWmi);
+	m_Snapshot.Open(SchemaSnapshot::GetDefaultPath().c_str());
 	InitTree();
+	SetTimer(SchemaTimerId, SchemaPollMsec, nullptr);
 
 	return 0;
 }
 
 LRESULT CMainFrame::OnDestroy(UINT /*uMsg*/, WPARAM /*wParam*/, LPARAM /*lParam*/, BOOL& bHandled) {
 	AppSettings::Get().Save();
+	StopInstanceEnum();
+	KillTimer(SchemaTimerId);
+	m_SchemaWatcher.Stop();
+	if (m_Crawler)
+		m_Crawler->Cancel();
+	SaveSnapshot();
+	ConnectionPool::Get().Clear();
 
 	// unregister message filtering and idle updates
 	CMessageLoop* pLoop = _Module.GetMessageLoop();
@@ -213,45 +273,197 @@ LRESULT CMainFrame::OnDestroy(UINT /*uMsg*/, WPARAM /*wParam*/, LPARAM /*lParam*
 }
 
 LRESULT CMainFrame::OnTimer(UINT, WPARAM id, LPARAM, BOOL&) {
-	if (id == 2) {
-		KillTimer(id);
-		TreeItemSelected(nullptr);
+	switch (id) {
+		case SelectionTimerId:
+			KillTimer(id);
+			TreeItemSelected(nullptr);
+			break;
+
+		case InstancesTimerId:
+			DrainInstances();
+			break;
+
+		case SchemaTimerId:
+			for (auto& changes : m_SchemaWatcher.Drain())
+				ApplyClassChanges(changes);
+			break;
 	}
 	return 0;
 }
 
-LRESULT CMainFrame::OnAddInstances(UINT, WPARAM, LPARAM lp, BOOL& bHandled) {
-	if (m_spCurrentEnumClass == m_spCurrentClass) {
-		m_EnumInstancesInProgress = false;
-		auto cb = reinterpret_cast<IObjectsCallback*>(lp);
-		ATLASSERT(cb);
+LRESULT CMainFrame::OnAddInstances(UINT, WPARAM cookie, LPARAM, BOOL& bHandled) {
+	if (cookie == m_EnumCookie)
+		DrainInstances();
 
-		auto count = cb->GetObjectCount();
-		m_Objects.clear();
-		m_Objects.reserve(count);
-		for (auto i = 0; i < count; i++) {
-			WmiItem item;
-			item.Type = NodeType::Instance;
-			item.Object = cb->GetItem(i);
-			CComBSTR text;
-			item.Object->GetObjectText(0, &text);
-			item.Name = text;
-			m_Objects.push_back(std::move(item));
+	return 0;
+}
+
+LRESULT CMainFrame::OnNamespaceContents(UINT, WPARAM revalidate, LPARAM lp, BOOL&) {
+	std::unique_ptr<LoadedNamespace> contents(reinterpret_cast<LoadedNamespace*>(lp));
+	auto hItem = FindNamespaceItem(contents->Path.c_str());
+	if (FAILED(contents->Error)) {
+		//
+		// a snapshot being checked stays as drawn; a node being loaded loses its placeholder
+		// and is not cached, so expanding the namespace again retries
+		//
+		if (!revalidate && hItem) {
+			while (auto hChild = m_Tree.GetChildItem(hItem))
+				m_Tree.DeleteItem(hChild);
+			m_StatusBar.SetText(0, std::format(L"Failed to open {} (0x{:08X})", contents->Path, (DWORD)contents->Error).c_str());
 		}
-		cb->Release();
+		return 0;
+	}
+	if (revalidate) {
+		auto drawn = m_Snapshot.Find(contents->Path.c_str());
+		if (drawn && *drawn == *contents)
+			hItem = nullptr;
+		else
+			ATLTRACE(L"Snapshot of %s is stale\n", contents->Path.c_str());
+	}
+	if (hItem) {
+		//
+		// replace the placeholder (or the stale snapshot contents)
+		//
+		auto expanded = (m_Tree.GetItemState(hItem, TVIS_EXPANDED) & TVIS_EXPANDED) != 0;
+		m_Tree.SetRedraw(FALSE);
+		while (auto hChild = m_Tree.GetChildItem(hItem))
+			m_Tree.DeleteItem(hChild);
+		PopulateTree(hItem, *contents);
+		if (expanded)
+			m_Tree.Expand(hItem, TVE_EXPAND);
+		m_Tree.SetRedraw(TRUE);
+		if (!revalidate)
+			ProbeNamespaces(hItem, *contents);
+	}
+	//
+	// the class list shown for the namespace comes from the same enumeration
+	//
+	if (!contents->ClassObjects.empty())
+		SchemaCache::Get().SetNamespace(contents->Path.c_str(), contents->ClassObjects);
+	//
+	// from now on the namespace is kept current by its class events
+	//
+	m_SchemaWatcher.Watch(contents->Path.c_str());
+	m_TreeContents[PathKey(contents->Path.c_str())] = std::move(static_cast<NamespaceContents&>(*contents));
+	return 0;
+}
+
+LRESULT CMainFrame::OnNamespaceProbed(UINT, WPARAM, LPARAM lp, BOOL&) {
+	std::unique_ptr<ProbeResult> result(reinterpret_cast<ProbeResult*>(lp));
+	auto slash = result->Path.rfind(L'\\');
+	if (auto it = m_TreeContents.find(PathKey(result->Path.substr(0, slash).c_str())); it != m_TreeContents.end()) {
+		auto name = result->Path.substr(slash + 1);
+		for (auto& ns : it->second.Namespaces)
+			if (::_wcsicmp(ns.Name.c_str(), name.c_str()) == 0)
+				ns.Flag = result->HasChildren;
+	}
+
+	//
+	// an expand button from the snapshot goes away once the namespace turns out to be empty
+	//
+	auto hItem = FindNamespaceItem(result->Path.c_str());
+	if (hItem == nullptr)
+		return 0;
+	auto hChild = m_Tree.GetChildItem(hItem);
+	if (result->HasChildren && hChild == nullptr)
+		InsertTreeItem(L"\\\\", 0, hItem, NodeType::HasChildren);
+	else if (!result->HasChildren && hChild && GetTreeNodeType(hChild) == NodeType::HasChildren
+		&& (m_Tree.GetItemState(hItem, TVIS_EXPANDED) & TVIS_EXPANDED) == 0)
+		m_Tree.DeleteItem(hChild);
+	return 0;
+}
 
-		m_InstanceList.SetItemCount((int)m_Objects.size());
-		m_StatusBar.SetText(2, std::format(L"{} Objects", m_Objects.size()).c_str());
+LRESULT CMainFrame::OnObjectText(UINT, WPARAM, LPARAM lp, BOOL&) {
+	std::unique_ptr<std::wstring> text(reinterpret_cast<std::wstring*>(lp));
+	if (text->empty())
+		m_StatusBar.SetText(0, L"The instance is no longer available");
+	else
+		ClipboardHelper::CopyText(m_hWnd, text->c_str());
+	return 0;
+}
+
+LRESULT CMainFrame::OnClassesFetched(UINT, WPARAM, LPARAM lp, BOOL&) {
+	std::unique_ptr<FetchedClasses> result(reinterpret_cast<FetchedClasses*>(lp));
+	if (result->Names.empty()) {
+		//
+		// the namespace could not be opened, so nothing is known about the changed classes
+		//
+		SchemaCache::Get().InvalidateNamespace(result->Path.c_str());
+		return 0;
 	}
+	SchemaCache::Get().UpdateClasses(result->Path.c_str(), result->Names, result->Classes);
+	return 0;
+}
 
+LRESULT CMainFrame::OnCatalogReady(UINT, WPARAM, LPARAM lp, BOOL&) {
+	m_Catalog.reset(reinterpret_cast<RepositoryCatalog*>(lp));
+	m_Crawler.reset();
+	m_StatusBar.SetText(0, std::format(L"Indexed {} namespaces, {} classes in {} msec",
+		m_Catalog->Namespaces.size(), m_Catalog->GetClassCount(), m_Catalog->ElapsedMsec).c_str());
+	if (m_SearchDlg.IsWindow())
+		m_SearchDlg.Refresh();
 	return 0;
 }
 
+void CMainFrame::SaveSnapshot() {
+	auto namespaces = m_Snapshot.GetAll();
+	std::erase_if(namespaces, [&](auto& ns) { return m_TreeContents.contains(PathKey(ns.Path.c_str())); });
+	for (auto& [key, contents] : m_TreeContents)
+		namespaces.push_back(contents);
+
+	m_Snapshot.Close();
+	auto path = SchemaSnapshot::GetDefaultPath();
+	if (!path.empty())
+		SchemaSnapshot::Save(path.c_str(), namespaces);
+}
+
+std::wstring CMainFrame::PathKey(PCWSTR path) {
+	std::wstring key(path);
+	::CharLowerBuff(key.data(), (DWORD)key.length());
+	return key;
+}
+
 LRESULT CMainFrame::OnFileExit(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/) {
 	PostMessage(WM_CLOSE);
 	return 0;
 }
 
+LRESULT CMainFrame::OnFileSave(WORD, WORD, HWND, BOOL&) {
+	if (m_spCurrentSchema == nullptr || m_Store.GetColumnCount() == 0) {
+		AtlMessageBox(m_hWnd, L"Select a class to save its instances.", IDR_MAINFRAME, MB_ICONINFORMATION);
+		return 0;
+	}
+
+	CFileDialog dlg(FALSE, L"csv", m_spCurrentSchema->Name.c_str(), OFN_OVERWRITEPROMPT | OFN_EXPLORER | OFN_ENABLESIZING,
+		L"CSV Files (*.csv)\0*.csv\0JSON Lines (*.ndjson)\0*.ndjson;*.jsonl\0All Files\0*.*\0", m_hWnd);
+	if (dlg.DoModal() != IDOK)
+		return 0;
+
+	CString ext(dlg.m_szFileName);
+	ext = ext.Mid(ext.ReverseFind(L'.') + 1);
+	auto format = ext.CompareNoCase(L"ndjson") == 0 || ext.CompareNoCase(L"jsonl") == 0 || ext.CompareNoCase(L"json") == 0
+		|| (ext.CompareNoCase(L"csv") != 0 && dlg.m_ofn.nFilterIndex == 2) ? ExportFormat::Json : ExportFormat::Csv;
+
+	//
+	// the properties the list shows, straight from the store; rows still being enumerated are not included
+	//
+	std::vector<int> columns;
+	auto showSystem = AppSettings::Get().ViewSystemProperties();
+	for (int i = 0; i < m_Store.GetColumnCount(); i++)
+		if (showSystem || !m_Store.GetColumn(i).Name.starts_with(L"__"))
+			columns.push_back(i);
+
+	CWaitCursor wait;
+	ExportStats stats;
+	auto hr = InstanceExport::Save(dlg.m_szFileName, m_Store, columns, format, &stats);
+	if (FAILED(hr)) {
+		AtlMessageBox(m_hWnd, std::format(L"Failed to save instances (0x{:08X})", (DWORD)hr).c_str(), IDR_MAINFRAME, MB_ICONERROR);
+		return 0;
+	}
+	m_StatusBar.SetText(0, std::format(L"Saved {} instances ({} KB) in {} msec", stats.Rows, stats.Bytes >> 10, stats.ElapsedMsec).c_str());
+	return 0;
+}
+
 LRESULT CMainFrame::OnViewToolBar(WORD /*wNotifyCode*/, WORD wID, HWND /*hWndCtl*/, BOOL& /*bHandled*/) {
 	static BOOL bVisible = TRUE;	// initially visible
 	bVisible = !bVisible;
@@ -284,23 +496,38 @@ LRESULT CMainFrame::OnTreeItemExpanding(int, LPNMHDR hdr, BOOL&) {
 	if (m_Tree.GetItemText(m_Tree.GetChildItem(hItem), text) && text != L"\\\\")
 		return 0;
 
-	auto path = GetFullItemPath(m_Tree, hItem);
-	path = path.Mid(path.Find(L'\\') + 1);
-	CComPtr<IWbemServices> spNamespace;
-	CWaitCursor wait;
-	auto hr = m_spWmi->OpenNamespace(CComBSTR(path), 0, nullptr, &spNamespace, nullptr);
-	if (SUCCEEDED(hr)) {
-		m_NamespacePath = m_RootName + L"\\" + path;
-		m_Tree.DeleteItem(m_Tree.GetChildItem(hItem));
-		m_spCurrentNamespace = spNamespace;
-		BuildTree(spNamespace, hItem);
-	}
+	m_Tree.SetRedraw(FALSE);
+	m_Tree.DeleteItem(m_Tree.GetChildItem(hItem));
+	if (GetTreeNodeType(hItem) == NodeType::Class)
+		ExpandClass(hItem);
+	else
+		BuildTree(hItem);
+	m_Tree.SetRedraw(TRUE);
 	return 0;
 }
 
-LRESULT CMainFrame::OnTreeSelChanged(int, LPNMHDR, BOOL&) {
+LRESULT CMainFrame::OnTreeSelChanged(int, LPNMHDR hdr, BOOL&) {
+	//
+	// the previous enumeration is stale at this point, cancel it right away
+	// rather than when the new selection is processed
+	//
+	StopInstanceEnum();
 	m_InstanceList.SetItemCount(0);
-	SetTimer(2, 200, nullptr);
+	m_Store.Clear();
+	m_InstanceCells.Reset(1);
+	m_SelectedInstance = -1;
+
+	//
+	// keyboard navigation tends to pass through many items, so wait for it to settle;
+	// a click is final and is handled immediately. Programmatic selection is deferred
+	// until the current message is done
+	//
+	KillTimer(SelectionTimerId);
+	auto tv = reinterpret_cast<NMTREEVIEW*>(hdr);
+	if (tv->action == TVC_BYMOUSE)
+		TreeItemSelected(tv->itemNew.hItem);
+	else
+		SetTimer(SelectionTimerId, tv->action == TVC_BYKEYBOARD ? SelectionDebounceMsec : USER_TIMER_MINIMUM, nullptr);
 	return 0;
 }
 
@@ -308,24 +535,227 @@ LRESULT CMainFrame::OnViewSystemClasses(WORD, WORD id, HWND, BOOL&) {
 	bool view;
 	AppSettings::Get().ViewSystemClasses(view = !AppSettings::Get().ViewSystemClasses());
 	UISetCheck(id, view);
-	// recreate tree
+	ShowSystemClasses(view);
+	return 0;
+}
+
+LRESULT CMainFrame::OnViewClassHierarchy(WORD, WORD id, HWND, BOOL&) {
+	bool view;
+	AppSettings::Get().ClassHierarchy(view = !AppSettings::Get().ClassHierarchy());
+	UISetCheck(id, view);
+	ResetTree();
+	return 0;
+}
+
+void CMainFrame::ResetTree() {
+	// recreate tree, keeping the selection
 	auto node = m_Tree.GetSelectedItem();
-	CString path;
+	CString path, className;
 	if (node) {
-		path = GetFullItemPath(m_Tree, node);
+		//
+		// a class may sit at a different depth in the new tree, so remember it by name
+		//
+		path = GetFullItemPath(m_Tree, GetNamespaceItem(node));
+		if (GetTreeNodeType(node) == NodeType::Class)
+			m_Tree.GetItemText(node, className);
 	}
 	m_List.SetItemCount(0);
 	m_InstanceList.SetItemCount(0);
 	InitTree();
 	if (!path.IsEmpty()) {
 		node = FindItem(m_Tree, TVI_ROOT, path);
+		if (node && !className.IsEmpty())
+			node = FindClassItem(node, className);
 		if (node)
 			m_Tree.SelectItem(node);
 	}
+}
+
+HTREEITEM CMainFrame::FindClassItem(HTREEITEM hNamespace, PCWSTR name) {
+	auto graph = GetClassGraph(GetFullItemPath(m_Tree, hNamespace));
+	if (graph == nullptr || !AppSettings::Get().ClassHierarchy())
+		return FindChild(m_Tree, hNamespace, name);
+
+	//
+	// walk down from the root class, expanding on the way
+	//
+	auto index = graph->Find(name);
+	auto chain = graph->GetAncestors(index);
+	auto hItem = hNamespace;
+	for (auto it = chain.rbegin(); it != chain.rend() && hItem; ++it) {
+		hItem = FindChild(m_Tree, hItem, graph->GetName(*it).c_str());
+		if (hItem)
+			m_Tree.Expand(hItem, TVE_EXPAND);
+	}
+	return hItem ? FindChild(m_Tree, hItem, name) : nullptr;
+}
+
+LRESULT CMainFrame::OnViewRefresh(WORD, WORD, HWND, BOOL&) {
+	//
+	// drop what is cached for the current namespace and load it again
+	//
+	SchemaCache::Get().InvalidateNamespace(m_NamespacePath);
+	ConnectionPool::Get().Discard(m_NamespacePath);
+	TreeItemSelected(nullptr);
+	return 0;
+}
+
+InstanceStore const* CMainFrame::GetLoadedInstances(PCWSTR className) const {
+	if (m_spCurrentSchema == nullptr || m_Store.GetColumnCount() == 0 || ::_wcsicmp(m_spCurrentSchema->Name.c_str(), className) != 0)
+		return nullptr;
+	return &m_Store;
+}
+
+LRESULT CMainFrame::OnViewLiveCounters(WORD, WORD, HWND, BOOL&) {
+	if (m_spCurrentSchema == nullptr) {
+		AtlMessageBox(m_hWnd, L"Select a performance class (e.g. Win32_PerfRawData_PerfOS_Processor) first.", IDR_MAINFRAME, MB_ICONINFORMATION);
+		return 0;
+	}
+
+	if (!m_PerfMonitorDlg.IsWindow())
+		m_PerfMonitorDlg.Create(m_hWnd);
+	m_PerfMonitorDlg.ShowWindow(SW_SHOW);
+	if (FAILED(m_PerfMonitorDlg.Monitor(m_spCurrentNamespace, m_spCurrentSchema)))
+		AtlMessageBox(m_hWnd, L"The class cannot be refreshed; only performance classes backed by a high performance provider can.", IDR_MAINFRAME, MB_ICONERROR);
+	return 0;
+}
+
+LRESULT CMainFrame::OnViewEvents(WORD, WORD, HWND, BOOL&) {
+	if (!m_EventsDlg.IsWindow())
+		m_EventsDlg.Create(m_hWnd);
+	if (!m_NamespacePath.IsEmpty())
+		m_EventsDlg.SetNamespace(m_NamespacePath);
+	m_EventsDlg.ShowWindow(SW_SHOW);
+	m_EventsDlg.GotoDlgCtrl(m_EventsDlg.GetDlgItem(IDC_QUERY));
+	return 0;
+}
+
+LRESULT CMainFrame::OnViewDiagnostics(WORD, WORD, HWND, BOOL&) {
+	if (!m_DiagnosticsDlg.IsWindow())
+		m_DiagnosticsDlg.Create(m_hWnd);
+	m_DiagnosticsDlg.ShowWindow(SW_SHOW);
+	return 0;
+}
+
+LRESULT CMainFrame::OnViewFanOut(WORD, WORD, HWND, BOOL&) {
+	if (!m_FanOutDlg.IsWindow())
+		m_FanOutDlg.Create(m_hWnd);
+	if (!m_NamespacePath.IsEmpty())
+		m_FanOutDlg.SetNamespace(m_NamespacePath);
+	m_FanOutDlg.ShowWindow(SW_SHOW);
+	m_FanOutDlg.GotoDlgCtrl(m_FanOutDlg.GetDlgItem(IDC_HOSTS));
+	return 0;
+}
+
+LRESULT CMainFrame::OnViewQuery(WORD, WORD, HWND, BOOL&) {
+	if (!m_QueryDlg.IsWindow()) {
+		m_QueryDlg.Create(m_hWnd);
+		if (!m_NamespacePath.IsEmpty())
+			m_QueryDlg.SetNamespace(m_NamespacePath);
+	}
+	m_QueryDlg.ShowWindow(SW_SHOW);
+	m_QueryDlg.GotoDlgCtrl(m_QueryDlg.GetDlgItem(IDC_QUERY));
+	return 0;
+}
+
+LRESULT CMainFrame::OnIndexRepository(WORD, WORD, HWND, BOOL&) {
+	IndexRepository();
+	return 0;
+}
+
+LRESULT CMainFrame::OnEditCopy(WORD, WORD, HWND, BOOL&) {
+	CString text;
+	auto hFocus = ::GetFocus();
+	if (hFocus == m_InstanceList) {
+		//
+		// only the decoded values are kept; the object is fetched again by its own __RELPATH
+		// on a worker for the MOF text, which lands on the clipboard when it arrives
+		//
+		auto index = m_InstanceList.GetSelectedIndex();
+		if (index >= 0 && index < (int)m_Store.GetRowCount()) {
+			auto col = m_Store.FindColumn(L"__RELPATH");
+			auto relpath = col >= 0 && !m_Store.IsNull(index, col) ? m_Store.GetString(index, col) : m_Store.GetRelPath(index);
+			m_Workers.Submit([hWnd = m_hWnd, msg = WM_OBJECT_TEXT, path = std::wstring(m_NamespacePath), relpath] {
+				CComPtr<IWbemServices> spSvc;
+				CComPtr<IWbemClassObject> spObj;
+				CComBSTR mof;
+				auto text = std::make_unique<std::wstring>();
+				if (SUCCEEDED(ConnectionPool::Get().GetService(path.c_str(), &spSvc))
+					&& SUCCEEDED(spSvc->GetObject(CComBSTR(relpath.c_str()), 0, nullptr, &spObj, nullptr))
+					&& SUCCEEDED(spObj->GetObjectText(0, &mof)))
+					text->assign(mof.m_str, mof.Length());
+				if (::PostMessage(hWnd, msg, 0, reinterpret_cast<LPARAM>(text.get())))
+					text.release();
+				}, CopyPriority);
+		}
+	}
+	else if (hFocus == m_List) {
+		auto index = m_List.GetSelectedIndex();
+		if (index >= 0) {
+			auto& item = m_Items[index];
+			std::wstring value;
+			if (item.Type == NodeType::Property)
+				CellText::AppendValue(value, item.Value, item.CimType);
+			text = (item.Name + L"\t" + value).c_str();
+		}
+	}
+	else if (hFocus == m_Tree) {
+		if (auto hItem = m_Tree.GetSelectedItem())
+			text = GetFullItemPath(m_Tree, hItem);
+	}
+	if (!text.IsEmpty())
+		ClipboardHelper::CopyText(m_hWnd, text);
+	return 0;
+}
+
+LRESULT CMainFrame::OnEditFind(WORD, WORD, HWND, BOOL&) {
+	if (!m_SearchDlg.IsWindow())
+		m_SearchDlg.Create(m_hWnd);
+	m_SearchDlg.ShowWindow(SW_SHOW);
+	m_SearchDlg.GotoDlgCtrl(m_SearchDlg.GetDlgItem(IDC_SEARCHTEXT));
 
+	//
+	// searching needs the index; its results come in as the crawl goes
+	//
+	if (m_Catalog == nullptr)
+		IndexRepository();
 	return 0;
 }
 
+void CMainFrame::IndexRepository() {
+	if (m_Crawler)
+		return;
+
+	auto& settings = AppSettings::Get();
+	CrawlOptions options;
+	options.Concurrency = settings.CrawlerConcurrency();
+	m_SearchIndex->Clear();
+	options.OnNamespace = [index = m_SearchIndex](auto& ns) {
+		index->Add(ns);
+	};
+	m_Crawler = NamespaceCrawler::Create(std::make_shared<WmiCrawlerSource>(true, settings.IndexDescriptions()), options);
+	m_Crawler->Start(m_RootName, [hWnd = m_hWnd, msg = WM_CATALOG_READY](RepositoryCatalog catalog) {
+		auto result = std::make_unique<RepositoryCatalog>(std::move(catalog));
+		if (::PostMessage(hWnd, msg, 0, reinterpret_cast<LPARAM>(result.get())))
+			result.release();
+		});
+	m_StatusBar.SetText(0, L"Indexing repository...");
+}
+
+void CMainFrame::GoToClass(PCWSTR nsPath, PCWSTR className) {
+	auto hNamespace = FindItem(m_Tree, TVI_ROOT, nsPath);
+	if (hNamespace == nullptr)
+		return;
+
+	m_Tree.Expand(hNamespace, TVE_EXPAND);
+	auto hItem = FindClassItem(hNamespace, className);
+	//
+	// the namespace may still be loading, or the class hidden (system classes)
+	//
+	m_Tree.SelectItem(hItem ? hItem : hNamespace);
+	m_Tree.EnsureVisible(m_Tree.GetSelectedItem());
+}
+
 LRESULT CMainFrame::OnViewSystemProperties(WORD, WORD id, HWND, BOOL&) {
 	bool view;
 	AppSettings::Get().ViewSystemProperties(view = !AppSettings::Get().ViewSystemProperties());
@@ -353,78 +783,6 @@ PCWSTR CMainFrame::NodeTypeToText(NodeType type) {
 	return L"";
 }
 
-CString CMainFrame::CimTypeToString(CIMTYPE type) {
-	CString text;
-	switch (type & 0xff) {
-		case CIM_EMPTY: text = L"Empty"; break;
-		case CIM_SINT8: text = L"Signed Byte (8 bit)"; break;
-		case CIM_UINT8: text = L"Byte (8 bit)"; break;
-		case CIM_SINT16: text = L"Signed Word (16 bit)"; break;
-		case CIM_UINT16: text = L"Word (16 bit)"; break;
-		case CIM_SINT32: text = L"Signed Int (32 bit)"; break;
-		case CIM_UINT32: text = L"Int (32 bit)"; break;
-		case CIM_SINT64: text = L"Signed QWord (64 bit)"; break;
-		case CIM_UINT64: text = L"QWord (64 bit)"; break;
-		case CIM_REAL32: text = L"Real (32 bit)"; break;
-		case CIM_REAL64: text = L"Real (64 bit)"; break;
-		case CIM_BOOLEAN: text = L"Boolean"; break;
-		case CIM_STRING: text = L"String"; break;
-		case CIM_DATETIME: text = L"Date Time"; break;
-		case CIM_REFERENCE: text = L"Reference"; break;
-		case CIM_CHAR16: text = L"Character"; break;
-		case CIM_OBJECT: text = L"Object"; break;
-	}
-	if (type & CIM_FLAG_ARRAY)
-		text += L" [Array]";
-	return text;
-}
-
-CString CMainFrame::GetArrayValue(CComVariant& value, CIMTYPE type) {
-	CString text;
-	switch (type & 0xff) {
-		case CIM_STRING:
-		{
-			// string array
-			CComSafeArray<BSTR> arr(value.parray);
-			auto count = arr.GetCount();
-			for (ULONG i = 0; i < count; i++)
-				text += CString(arr.GetAt(i).m_str) + L", ";
-			if (!text.IsEmpty())
-				text = text.Left(text.GetLength() - 2);
-			break;
-		}
-
-		case CIM_SINT8:
-		case CIM_UINT8:
-		{
-			BYTE* data;
-			CComSafeArray<BYTE> arr(value.parray);
-			auto count = std::min(arr.GetCount(), (ULONG)64);
-			if (SUCCEEDED(::SafeArrayAccessData(value.parray, reinterpret_cast<void**>(&data)))) {
-				for (ULONG i = 0; i < count; i++) {
-					CString str;
-					str.Format(L"%02X ", data[i]);
-					text += str;
-				}
-				::SafeArrayUnaccessData(value.parray);
-			}
-			break;
-		}
-	}
-	return text;
-}
-
-CString CMainFrame::VariantToString(CComVariant value) {
-	if (value.vt == VT_NULL)
-		return L"";
-
-	if (value.vt == VT_BOOL)
-		return value.boolVal ? L"True" : L"False";
-	if (SUCCEEDED(value.ChangeType(VT_BSTR)))
-		return CString(value.bstrVal);
-	return L"";
-}
-
 void CMainFrame::InitCommandBar() {
 	struct {
 		UINT id, icon;
@@ -473,47 +831,378 @@ void CMainFrame::InitToolBar(CToolBarCtrl& tb, int size) {
 }
 
 void CMainFrame::InitTree() {
+	auto start = ::GetTickCount64();
 	m_spCurrentNamespace = m_spWmi;
 	m_Tree.LockWindowUpdate();
 	m_Tree.DeleteAllItems();
 	m_hRoot = InsertTreeItem(m_RootName, 0, TVI_ROOT, NodeType::Namespace);
 	if (m_spWmi) {
-		BuildTree(m_spWmi, m_hRoot);
+		BuildTree(m_hRoot);
 		m_Tree.Expand(m_hRoot, TVE_EXPAND);
 	}
 	m_Tree.LockWindowUpdate(FALSE);
 	m_Tree.SelectItem(m_hRoot);
 	m_Tree.SetFocus();
+	ATLTRACE(L"Tree ready in %u msec (%s)\n", (DWORD)(::GetTickCount64() - start), m_Snapshot.IsOpen() ? L"snapshot" : L"live");
 }
 
-void CMainFrame::BuildTree(IWbemServices* pWmi, HTREEITEM hParent) {
-	auto classes = WMIHelper::EnumClasses(pWmi, true, AppSettings::Get().ViewSystemClasses());
-	for (auto& spObj : classes) {
-		auto name = WMIHelper::GetStringProperty(spObj, L"__CLASS");
-		auto hItem = InsertTreeItem(name, 1, hParent, NodeType::Class);
+void CMainFrame::BuildTree(HTREEITEM hParent) {
+	if (BuildTreeFromCache(hParent))
+		return;
+
+	//
+	// load in the background; the placeholder keeps the node expandable until the results arrive
+	//
+	InsertTreeItem(L"Loading...", 0, hParent, NodeType::HasChildren);
+	LoadNamespace(GetFullItemPath(m_Tree, hParent), false);
+}
+
+bool CMainFrame::BuildTreeFromCache(HTREEITEM hParent) {
+	auto path = GetFullItemPath(m_Tree, hParent);
+	if (auto it = m_TreeContents.find(PathKey(path)); it != m_TreeContents.end()) {
+		PopulateTree(hParent, it->second);
+		return true;
 	}
 
-	auto ns = WMIHelper::EnumNamespaces(pWmi);
-	for (auto& spObj : ns) {
-		auto name = WMIHelper::GetStringProperty(spObj, L"NAME");
-		ATLTRACE(L"Namespace: %s\n", (PCWSTR)name);
-		auto hItem = InsertTreeItem(name, 0, hParent, NodeType::Namespace);
-		CComPtr<IWbemServices> spNamespace;
-		auto hr = pWmi->OpenNamespace(CComBSTR(name), 0, nullptr, &spNamespace, nullptr);
-		if (FAILED(hr))
-			continue;
+	//
+	// draw from the snapshot right away and check it against the live repository in the background
+	//
+	auto contents = m_Snapshot.Find(path);
+	if (!contents)
+		return false;
 
-		if (IsChildNamespaceOrClass(spNamespace)) {
+	PopulateTree(hParent, *contents);
+	RevalidateNamespace(path);
+	return true;
+}
+
+void CMainFrame::PopulateTree(HTREEITEM hParent, NamespaceContents const& contents) {
+	//
+	// graph indices follow the order of contents.Classes
+	//
+	auto& graph = BuildClassGraph(contents);
+	auto& settings = AppSettings::Get();
+	auto viewSystem = settings.ViewSystemClasses();
+	if (settings.ClassHierarchy()) {
+		//
+		// a system class derives from system classes only, so filtering the roots is enough
+		//
+		for (auto root : graph.GetRoots()) {
+			if (!viewSystem && contents.Classes[root].Flag)
+				continue;
+			InsertClassItem(hParent, graph, root);
+		}
+	}
+	else {
+		for (auto& cls : contents.Classes) {
+			if (!viewSystem && cls.Flag)
+				continue;
+			InsertTreeItem(cls.Name.c_str(), 1, hParent, NodeType::Class);
+		}
+	}
+	for (auto& ns : contents.Namespaces) {
+		auto hItem = InsertTreeItem(ns.Name.c_str(), 0, hParent, NodeType::Namespace);
+		if (ns.Flag)
 			InsertTreeItem(L"\\\\", 0, hItem, NodeType::HasChildren);
+	}
+}
+
+ClassGraph& CMainFrame::BuildClassGraph(NamespaceContents const& contents) {
+	auto& graph = m_ClassGraphs[PathKey(contents.Path.c_str())];
+	graph.Clear();
+	for (auto& cls : contents.Classes)
+		graph.Add(cls.Name, cls.SuperClass);
+	graph.Build();
+	return graph;
+}
+
+HTREEITEM CMainFrame::InsertClassItem(HTREEITEM hParent, ClassGraph const& graph, int index) {
+	auto hItem = InsertTreeItem(graph.GetName(index).c_str(), 1, hParent, NodeType::Class);
+	if (!graph.GetChildren(index).empty())
+		InsertTreeItem(L"\\\\", 1, hItem, NodeType::HasChildren);
+	return hItem;
+}
+
+void CMainFrame::ExpandClass(HTREEITEM hItem) {
+	auto graph = GetClassGraph(GetFullItemPath(m_Tree, GetNamespaceItem(hItem)));
+	if (graph == nullptr)
+		return;
+
+	CString name;
+	m_Tree.GetItemText(hItem, name);
+	for (auto child : graph->GetChildren(graph->Find(name)))
+		InsertClassItem(hItem, *graph, child);
+}
+
+bool CMainFrame::IsTreeItemLoaded(HTREEITEM hItem) const {
+	HTREEITEM hChild = m_Tree.GetChildItem(hItem);
+	return hChild == nullptr || GetTreeNodeType(hChild) != NodeType::HasChildren;
+}
+
+HTREEITEM CMainFrame::FindLoadedParentItem(HTREEITEM hNamespace, ClassGraph const& graph, int index) {
+	//
+	// like FindClassItem, but nothing is expanded; a parent not loaded yet picks up the change when it is
+	//
+	auto hItem = hNamespace;
+	if (AppSettings::Get().ClassHierarchy()) {
+		auto chain = graph.GetAncestors(index);
+		for (auto it = chain.rbegin(); it != chain.rend() && hItem; ++it)
+			hItem = FindChild(m_Tree, hItem, graph.GetName(*it).c_str());
+	}
+	return hItem && IsTreeItemLoaded(hItem) ? hItem : nullptr;
+}
+
+void CMainFrame::ApplyClassChanges(NamespaceChanges const& changes) {
+	auto path = changes.Path.c_str();
+	auto it = m_TreeContents.find(PathKey(path));
+	if (it == m_TreeContents.end())
+		return;
+
+	if (changes.Overflowed) {
+		//
+		// some changes are not known, so read the whole namespace again
+		//
+		SchemaCache::Get().InvalidateNamespace(path);
+		LoadNamespace(path, false);
+		return;
+	}
+
+	//
+	// contents may have been replaced without the tree being drawn from them, so start from a graph that matches
+	//
+	auto& contents = it->second;
+	ClassGraph const* graph = &BuildClassGraph(contents);
+	auto hNamespace = FindNamespaceItem(path);
+	if (hNamespace && !IsTreeItemLoaded(hNamespace))
+		hNamespace = nullptr;
+
+	//
+	// take out the items of classes that go away or move, while the old graph can still find them
+	//
+	std::vector<std::wstring> stale;
+	std::vector<std::wstring> moved;
+	bool removed = true;
+	for (auto& change : changes.Changes) {
+		auto index = graph->Find(change.Name.c_str());
+		stale.push_back(change.Name);
+		if (change.Type != ClassChangeType::Deleted)
+			removed = false;
+		if (index == ClassGraph::None) {
+			moved.push_back(change.Name);
+			continue;
+		}
+		//
+		// subclasses inherit whatever changed
+		//
+		for (auto derived : graph->GetDerived(index))
+			stale.push_back(graph->GetName(derived));
+		if (change.Type == ClassChangeType::Modified && ::_wcsicmp(contents.Classes[index].SuperClass.c_str(), change.SuperClass.c_str()) == 0)
+			continue;
+		moved.push_back(change.Name);
+		if (!hNamespace)
+			continue;
+		if (auto hParent = FindLoadedParentItem(hNamespace, *graph, index))
+			if (auto hItem = FindChild(m_Tree, hParent, change.Name.c_str()))
+				m_Tree.DeleteItem(hItem);
+	}
+
+	//
+	// patch the contents (which the snapshot is saved from) and rebuild the graph once for the batch
+	//
+	for (auto& change : changes.Changes) {
+		auto byName = [&](auto& cls) { return ::_wcsicmp(cls.Name.c_str(), change.Name.c_str()) == 0; };
+		auto cls = std::find_if(contents.Classes.begin(), contents.Classes.end(), byName);
+		if (change.Type == ClassChangeType::Deleted) {
+			//
+			// deleting a class deletes its subclasses, whether or not each gets an event
+			//
+			std::vector<std::wstring> gone{ PathKey(change.Name.c_str()) };
+			if (auto index = graph->Find(change.Name.c_str()); index != ClassGraph::None)
+				for (auto derived : graph->GetDerived(index))
+					gone.push_back(PathKey(graph->GetName(derived).c_str()));
+			std::sort(gone.begin(), gone.end());
+			std::erase_if(contents.Classes, [&](auto& c) { return std::binary_search(gone.begin(), gone.end(), PathKey(c.Name.c_str())); });
+		}
+		else if (cls == contents.Classes.end()) {
+			contents.Classes.push_back({ change.Name, change.IsSystem, change.SuperClass });
+		}
+		else {
+			cls->SuperClass = change.SuperClass;
+		}
+	}
+	graph = &BuildClassGraph(contents);
+	SchemaCache::Get().InvalidateClasses(path, stale, removed);
+	if (!removed) {
+		//
+		// only the changed classes are read again, on a worker; the rest of the cached list stays
+		//
+		m_Workers.Submit([hWnd = m_hWnd, msg = WM_CLASSES_FETCHED, path = changes.Path, stale] {
+			auto result = std::make_unique<FetchedClasses>();
+			result->Path = path;
+			result->Names = stale;
+			result->Classes.resize(stale.size());
+			CComPtr<IWbemServices> spSvc;
+			if (SUCCEEDED(ConnectionPool::Get().GetService(path.c_str(), &spSvc))) {
+				for (size_t i = 0; i < stale.size(); i++) {
+					auto hr = spSvc->GetObject(CComBSTR(stale[i].c_str()), 0, nullptr, &result->Classes[i], nullptr);
+					//
+					// a class that failed to read for another reason stays listed and is read when next needed
+					//
+					if (FAILED(hr) && hr != WBEM_E_NOT_FOUND)
+						result->Names[i].clear();
+				}
+			}
+			else {
+				result->Names.clear();
+			}
+			if (::PostMessage(hWnd, msg, 0, reinterpret_cast<LPARAM>(result.get())))
+				result.release();
+			}, LoadPriority);
+	}
+
+	if (hNamespace) {
+		auto viewSystem = AppSettings::Get().ViewSystemClasses();
+		m_Tree.SetRedraw(FALSE);
+		for (auto& name : moved) {
+			auto index = graph->Find(name.c_str());
+			if (index == ClassGraph::None || (!viewSystem && contents.Classes[index].Flag))
+				continue;
+			if (auto hParent = FindLoadedParentItem(hNamespace, *graph, index); hParent && !FindChild(m_Tree, hParent, name.c_str())) {
+				if (AppSettings::Get().ClassHierarchy())
+					InsertClassItem(hParent, *graph, index);
+				else
+					InsertTreeItem(name.c_str(), 1, hParent, NodeType::Class);
+			}
+		}
+		m_Tree.SetRedraw(TRUE);
+	}
+	ATLTRACE(L"%u class changes in %s, %u classes invalidated\n", (UINT)changes.Changes.size(), path, (UINT)stale.size());
+
+	//
+	// the class being shown is read again if it changed
+	//
+	if (m_spCurrentSchema && m_NamespacePath.CompareNoCase(path) == 0) {
+		auto& current = m_spCurrentSchema->Name;
+		if (std::any_of(stale.begin(), stale.end(), [&](auto& name) { return ::_wcsicmp(name.c_str(), current.c_str()) == 0; }))
+			TreeItemSelected(nullptr);
+	}
+}
+
+void CMainFrame::ShowSystemClasses(bool show) {
+	//
+	// system classes are added to or taken out of each loaded namespace in place.
+	// A system class derives from system classes only, so in the hierarchy only roots are involved
+	//
+	auto hierarchy = AppSettings::Get().ClassHierarchy();
+	m_Tree.SetRedraw(FALSE);
+	for (auto& [key, contents] : m_TreeContents) {
+		auto hNamespace = FindNamespaceItem(contents.Path.c_str());
+		auto graph = GetClassGraph(contents.Path.c_str());
+		if (hNamespace == nullptr || graph == nullptr || !IsTreeItemLoaded(hNamespace))
+			continue;
+
+		if (show) {
+			auto insert = [&](int index) {
+				if (contents.Classes[index].Flag && !FindChild(m_Tree, hNamespace, graph->GetName(index).c_str())) {
+					if (hierarchy)
+						InsertClassItem(hNamespace, *graph, index);
+					else
+						InsertTreeItem(graph->GetName(index).c_str(), 1, hNamespace, NodeType::Class);
+				}
+			};
+			if (hierarchy)
+				std::ranges::for_each(graph->GetRoots(), insert);
+			else
+				for (int i = 0; i < graph->GetCount(); i++)
+					insert(i);
+		}
+		else {
+			HTREEITEM hNext;
+			for (HTREEITEM hItem = m_Tree.GetChildItem(hNamespace); hItem; hItem = hNext) {
+				hNext = m_Tree.GetNextSiblingItem(hItem);
+				if (GetTreeNodeType(hItem) != NodeType::Class)
+					continue;
+				CString name;
+				m_Tree.GetItemText(hItem, name);
+				if (auto index = graph->Find(name); index != ClassGraph::None && contents.Classes[index].Flag)
+					m_Tree.DeleteItem(hItem);
+			}
 		}
 	}
-	//m_Tree.SortChildren(hParent);
+	m_Tree.SetRedraw(TRUE);
+}
+
+ClassGraph const* CMainFrame::GetClassGraph(PCWSTR path) const {
+	auto it = m_ClassGraphs.find(PathKey(path));
+	return it == m_ClassGraphs.end() ? nullptr : &it->second;
 }
 
-bool CMainFrame::IsChildNamespaceOrClass(IWbemServices* pWmi) const {
-	CComPtr<IEnumWbemClassObject> spEnum;
-	pWmi->CreateInstanceEnum(CComBSTR(L"__NAMESPACE"), 0, nullptr, &spEnum);
-	return spEnum != nullptr;
+HTREEITEM CMainFrame::GetNamespaceItem(HTREEITEM hItem) const {
+	while (hItem && GetTreeNodeType(hItem) != NodeType::Namespace)
+		hItem = m_Tree.GetParentItem(hItem);
+	return hItem;
+}
+
+void CMainFrame::LoadNamespace(PCWSTR path, bool revalidate) {
+	//
+	// a namespace the user is waiting for goes ahead of probes and snapshot checks.
+	// Revalidation probes children as part of the check, a fresh load probes them
+	// separately once its nodes are in the tree, visible nodes first
+	//
+	m_Workers.Submit([hWnd = m_hWnd, msg = WM_NAMESPACE_CONTENTS, path = std::wstring(path), revalidate] {
+		//
+		// a failure is reported too, so the placeholder does not stay behind
+		//
+		CComPtr<IWbemServices> spSvc;
+		auto hr = ConnectionPool::Get().GetService(path.c_str(), &spSvc);
+		auto contents = std::make_unique<LoadedNamespace>();
+		if (SUCCEEDED(hr))
+			static_cast<NamespaceContents&>(*contents) = NamespaceContents::Collect(spSvc, path.c_str(), revalidate, &contents->ClassObjects);
+		else {
+			contents->Path = path;
+			contents->Error = hr;
+		}
+		if (::PostMessage(hWnd, msg, revalidate, reinterpret_cast<LPARAM>(contents.get())))
+			contents.release();
+		}, revalidate ? RevalidatePriority : LoadPriority);
+}
+
+void CMainFrame::RevalidateNamespace(PCWSTR path) {
+	LoadNamespace(path, true);
+}
+
+void CMainFrame::ProbeNamespaces(HTREEITEM hParent, NamespaceContents const& contents) {
+	CRect client;
+	m_Tree.GetClientRect(&client);
+	for (auto& ns : contents.Namespaces) {
+		auto hItem = FindChild(m_Tree, hParent, ns.Name.c_str());
+		CRect rc;
+		auto visible = hItem && m_Tree.GetItemRect(hItem, &rc, FALSE) && rc.IntersectRect(&rc, &client);
+		m_Workers.Submit([hWnd = m_hWnd, msg = WM_NAMESPACE_PROBED, path = contents.Path + L"\\" + ns.Name] {
+			CComPtr<IWbemServices> spSvc;
+			auto result = std::make_unique<ProbeResult>(path,
+				SUCCEEDED(ConnectionPool::Get().GetService(path.c_str(), &spSvc)) && WMIHelper::IsChildNamespaceOrClass(spSvc));
+			if (::PostMessage(hWnd, msg, 0, reinterpret_cast<LPARAM>(result.get())))
+				result.release();
+			}, visible ? VisibleProbePriority : ProbePriority);
+	}
+}
+
+HTREEITEM CMainFrame::FindNamespaceItem(PCWSTR path) {
+	CString spath(path);
+	int start = 0;
+	auto name = spath.Tokenize(L"\\", start);
+	if (name.CompareNoCase(m_RootName) != 0)
+		return nullptr;
+
+	auto hItem = m_hRoot;
+	while (hItem) {
+		name = spath.Tokenize(L"\\", start);
+		if (name.IsEmpty())
+			break;
+		hItem = FindChild(m_Tree, hItem, name);
+	}
+	return hItem;
 }
 
 void CMainFrame::UpdateList() {
@@ -521,28 +1210,44 @@ void CMainFrame::UpdateList() {
 	m_Items.clear();
 
 	auto& settings = AppSettings::Get();
-	if (m_spCurrentClass) {
-		CString name;
-		m_Tree.GetItemText(m_Tree.GetSelectedItem(), name);
-		for (auto& prop : WMIHelper::EnumProperties(m_spCurrentClass)) {
-			if (!settings.ViewSystemProperties() && CString(prop.Name).Left(2) == L"__")
+	if (m_spCurrentSchema) {
+		auto& props = m_spCurrentSchema->Properties;
+		for (int i = 0; i < (int)props.size(); i++) {
+			auto& prop = props[i];
+			if (!settings.ViewSystemProperties() && prop.Name.starts_with(L"__"))
 				continue;
 			WmiItem item;
 			item.Name = prop.Name;
 			item.Type = NodeType::Property;
 			item.CimType = prop.Type;
 			item.Value = prop.Value;
+			item.Column = i;	// the store has a column per schema property, in order
 			m_Items.push_back(std::move(item));
 		}
-		for (auto& method : WMIHelper::EnumMethods(m_spCurrentClass)) {
+		auto& methods = m_spCurrentSchema->Methods;
+		for (int i = 0; i < (int)methods.size(); i++) {
+			auto& method = methods[i];
 			WmiItem item;
 			item.Name = method.Name;
+			item.Column = i;
 			item.Type = NodeType::Method;
 			item.Object = method.spInParams;
 			item.Object2 = method.spOutParams;
-			item.Value = method.ClassName.c_str();
+			item.Value = method.Origin.c_str();
 			m_Items.push_back(std::move(item));
 		}
+		//
+		// derived classes come from the inheritance graph, with no trip to WMI
+		//
+		if (auto graph = GetClassGraph(m_NamespacePath)) {
+			for (auto index : graph->GetDerived(graph->Find(m_spCurrentSchema->Name.c_str()))) {
+				WmiItem item;
+				item.Name = graph->GetName(index);
+				item.Type = NodeType::Class;
+				item.Value = graph->GetName(graph->GetParent(index)).c_str();
+				m_Items.push_back(std::move(item));
+			}
+		}
 	}
 	else {
 		if (m_spCurrentNamespace == nullptr)
@@ -558,11 +1263,16 @@ void CMainFrame::UpdateList() {
 				m_Items.push_back(std::move(item));
 			}
 		}
-		for (auto& cls : WMIHelper::EnumClasses(m_spCurrentNamespace, true)) {
+		HRESULT hr;
+		auto schema = SchemaCache::Get().GetNamespace(m_NamespacePath, m_spCurrentNamespace, &hr);
+		if (FAILED(hr))
+			m_StatusBar.SetText(0, std::format(L"Failed to enumerate classes of {} (0x{:08X})", (PCWSTR)m_NamespacePath, (DWORD)hr).c_str());
+		for (auto& cls : schema->Classes) {
+			if (cls->IsSystem)
+				continue;
 			WmiItem item;
-			CComBSTR name;
-			item.Name = WMIHelper::GetStringProperty(cls, L"__CLASS");
-			item.Object = cls;
+			item.Name = cls->Name;
+			item.Object = cls->Class.p;
 			item.Type = NodeType::Class;
 			m_Items.push_back(std::move(item));
 		}
@@ -583,56 +1293,21 @@ void CMainFrame::DoSort(const SortInfo* si) {
 		return false;
 		};
 	std::sort(m_Items.begin(), m_Items.end(), sort);
+	m_ListCells.Reset(ColumnTypeCount);
 }
 
-CString CMainFrame::GetObjectDetails(WmiItem const& item) const {
+void CMainFrame::AppendObjectDetails(WmiItem const& item, std::wstring& text) const {
 	switch (item.Type) {
 		case NodeType::Property:
 		{
-			if (m_ObjPropValues.empty())
-				return L"";
-
-			auto it = std::find_if(m_ObjPropValues.begin(), m_ObjPropValues.end(), [&](auto p) { return p.Name == item.Name.c_str(); });
-			if (it == m_ObjPropValues.end())
-				return L"";
-
-			auto value = it->Value;
-			return VariantToString(value);
-		}
-
-		case NodeType::Method:
-			if (item.Object) {	// in params
-				auto props = WMIHelper::EnumProperties(item.Object.get());
-				CString text;
-				for (auto& p : props) {
-					text += CimTypeToString(p.Type) + L" " + p.Name + L", ";
-				}
-				if (!text.IsEmpty())
-					text = text.Left(text.GetLength() - 2);
-				return L"(" + text + L")";
-			}
-			break;
-	}
-	return L"";
-}
-
-CString CMainFrame::GetObjectValue(WmiItem const& item) const {
-	switch (item.Type) {
-		case NodeType::Property:
-			CComVariant value(item.Value);
-			if (value.vt == VT_NULL)
-				return L"";
+			if (m_SelectedInstance < 0 || m_SelectedInstance >= (int)m_Store.GetRowCount() || item.Column >= m_Store.GetColumnCount())
+				return;
 
-			if ((item.CimType & CIM_FLAG_ARRAY) && value.parray) {
-				return GetArrayValue(value, item.CimType);
-			}
-			if (value.vt == VT_BOOL)
-				return value.boolVal ? L"True" : L"False";
-			if (SUCCEEDED(value.ChangeType(VT_BSTR)))
-				return CString(value.bstrVal);
+			ATLASSERT(m_Store.GetColumn(item.Column).Name == item.Name);
+			m_Store.AppendText(m_SelectedInstance, item.Column, text);
 			break;
+		}
 	}
-	return L"";
 }
 
 void CMainFrame::TreeItemSelected(HTREEITEM hItem) {
@@ -640,9 +1315,11 @@ void CMainFrame::TreeItemSelected(HTREEITEM hItem) {
 		hItem = m_Tree.GetSelectedItem();
 	if (hItem == nullptr) {
 		m_spCurrentClass = nullptr;
+		m_spCurrentSchema.reset();
 		m_spCurrentNamespace = nullptr;
 		return;
 	}
+	StopInstanceEnum();
 	auto path = GetFullItemPath(m_Tree, hItem);
 	auto type = GetTreeNodeType(hItem);
 	CString name;
@@ -657,37 +1334,55 @@ void CMainFrame::TreeItemSelected(HTREEITEM hItem) {
 			else {
 				CComPtr<IWbemServices> spNamespace;
 				path = path.Mid(path.Find(L'\\') + 1);
-				m_spWmi->OpenNamespace(CComBSTR(path), 0, nullptr, &spNamespace, nullptr);
+				ConnectionPool::Get().GetService(m_RootName + L"\\" + path, &spNamespace);
 				if (spNamespace) {
 					m_spCurrentNamespace = spNamespace;
 					m_NamespacePath = m_RootName + L"\\" + path;
 				}
 			}
 			m_spCurrentClass = nullptr;
+			m_spCurrentSchema.reset();
+			m_QueryDlg.SetNamespace(m_NamespacePath);
 			break;
 		}
 		case NodeType::Class:
-			if(m_NamespacePath != GetFullItemPath(m_Tree, m_Tree.GetParentItem(hItem)))
-				TreeItemSelected(m_Tree.GetParentItem(hItem));
-			m_spCurrentClass = nullptr;
-			m_spCurrentNamespace->GetObject(CComBSTR(name), 0, nullptr, &m_spCurrentClass, nullptr);
+			if (auto hNamespace = GetNamespaceItem(hItem); m_NamespacePath != GetFullItemPath(m_Tree, hNamespace))
+				TreeItemSelected(hNamespace);
+			m_spCurrentSchema = SchemaCache::Get().GetClass(m_NamespacePath, m_spCurrentNamespace, name);
+			m_spCurrentClass = m_spCurrentSchema ? m_spCurrentSchema->Class : nullptr;
 			if (m_spCurrentClass) {
-				m_spCurrentEnumClass = m_spCurrentClass;
 				m_InstanceList.SetItemCount(0);
+				m_Store.Reset(*m_spCurrentSchema);
+				m_SampleBytes = 0;
+				m_SampleCount = 0;
+				m_InstanceCells.Reset(1);
+				m_SelectedInstance = -1;
 				m_EnumInstancesInProgress = true;
 				m_StatusBar.SetText(2, L"Enumerating Objects...");
-				WMIHelper::EnumInstancesAsync(m_hWnd, WM_INSTANCES, name, m_spCurrentNamespace, false);
+				m_InstanceSink = WMIHelper::EnumInstancesAsync(m_hWnd, WM_INSTANCES, ++m_EnumCookie, name, m_spCurrentNamespace, false);
+				if (m_InstanceSink == nullptr) {
+					m_EnumInstancesInProgress = false;
+					m_StatusBar.SetText(2, L"");
+				}
 			}
 			else {
 				m_List.SetItemCount(0);
 				m_InstanceList.SetItemCount(0);
-				m_Objects.clear();
-				m_ObjPropValues.clear();
+				m_Store.Clear();
+				m_InstanceCells.Reset(1);
+				m_SelectedInstance = -1;
 				m_Items.clear();
+				m_ListCells.Reset(ColumnTypeCount);
 				return;
 			}
 			break;
 
+		case NodeType::HasChildren:
+			//
+			// a placeholder, while the namespace loads
+			//
+			return;
+
 		default:
 			ATLASSERT(false);
 			return;
@@ -696,7 +1391,87 @@ void CMainFrame::TreeItemSelected(HTREEITEM hItem) {
 	UpdateList();
 }
 
+void CMainFrame::DrainInstances() {
+	if (m_InstanceSink == nullptr)
+		return;
+
+	//
+	// append queued objects in chunks for a bounded time slice, so the list
+	// gets a chance to paint between slices while the enumeration continues
+	//
+	auto done = m_InstanceSink->IsDone();
+	auto start = ::GetTickCount64();
+	std::vector<CComPtr<IWbemClassObject>> objects;
+	while (::GetTickCount64() - start < InstancesSliceMsec) {
+		objects.clear();
+		if (m_InstanceSink->TakeObjects(objects, InstancesChunkSize) == 0)
+			break;
+
+		//
+		// the objects are decoded into the store and released with the chunk
+		//
+		for (auto& obj : objects) {
+			if (m_SampleCount < ObjectSizeSamples) {
+				m_SampleBytes += WMIHelper::GetObjectSize(obj);
+				m_SampleCount++;
+			}
+			m_Store.Append(obj);
+		}
+	}
+	auto rows = m_Store.GetRowCount();
+	m_InstanceList.SetItemCountEx((int)rows, LVSICF_NOSCROLL | LVSICF_NOINVALIDATEALL);
+
+	if (m_InstanceSink->HasObjects()) {
+		SetTimer(InstancesTimerId, InstancesSliceMsec, nullptr);
+		m_StatusBar.SetText(2, std::format(L"{} Objects...", rows).c_str());
+		return;
+	}
+
+	KillTimer(InstancesTimerId);
+	if (!done) {
+		m_StatusBar.SetText(2, std::format(L"{} Objects...", rows).c_str());
+		return;
+	}
+
+	auto status = m_InstanceSink->GetStatus();
+	m_InstanceSink->Release();
+	m_InstanceSink = nullptr;
+	m_EnumInstancesInProgress = false;
+	if (ConnectionPool::IsBroken(status)) {
+		//
+		// the next selection in this namespace opens it again
+		//
+		ConnectionPool::Get().Discard(m_NamespacePath);
+		m_NamespacePath.Empty();
+		m_StatusBar.SetText(2, std::format(L"{} Objects (connection lost: 0x{:08X})", rows, (DWORD)status).c_str());
+		return;
+	}
+	auto memory = m_Store.GetMemory();
+	auto asObjects = m_SampleCount ? m_SampleBytes * rows / m_SampleCount : 0;
+	ATLTRACE(L"Instance store: %u rows, %u columns, %u KB (%u KB strings); as objects about %u KB\n",
+		(ULONG)rows, m_Store.GetColumnCount(), ULONG(memory.Total() >> 10), ULONG(memory.Strings >> 10), ULONG(asObjects >> 10));
+	auto text = std::format(L"{} Objects ({} KB: {} KB values, {} KB strings", rows, memory.Total() >> 10, memory.Columns >> 10, memory.Strings >> 10);
+	if (asObjects > memory.Total())
+		text += std::format(L"; about {} KB saved over objects", (asObjects - memory.Total()) >> 10);
+	m_StatusBar.SetText(2, (text + L")").c_str());
+}
+
+void CMainFrame::StopInstanceEnum() {
+	KillTimer(InstancesTimerId);
+	//
+	// bump the cookie so notifications already posted by the old sink are ignored
+	//
+	m_EnumCookie++;
+	if (m_InstanceSink) {
+		m_InstanceSink->Cancel();
+		m_InstanceSink->Release();
+		m_InstanceSink = nullptr;
+	}
+	m_EnumInstancesInProgress = false;
+}
+
 void CMainFrame::RefreshList() {
+	m_ListCells.Reset(ColumnTypeCount);
 	m_List.SetItemCountEx(static_cast<int>(m_Items.size()), LVSICF_NOSCROLL | LVSICF_NOINVALIDATEALL);
 	m_List.RedrawItems(m_List.GetTopIndex(), m_List.GetTopIndex() + m_List.GetCountPerPage());
 	m_StatusBar.SetText(1, std::format(L"{} Items", m_Items.size()).c_str());
@@ -6,6 +6,21 @@
 
 #include <VirtualListView.h>
 #include "WMIHelper.h"
+#include "SchemaCache.h"
+#include "SchemaSnapshot.h"
+#include "WorkerPool.h"
+#include "NamespaceCrawler.h"
+#include "ClassGraph.h"
+#include "SearchIndex.h"
+#include "SearchDlg.h"
+#include "QueryDlg.h"
+#include "PerfMonitorDlg.h"
+#include "EventsDlg.h"
+#include "DiagnosticsDlg.h"
+#include "FanOutDlg.h"
+#include "SchemaWatcher.h"
+#include "InstanceStore.h"
+#include "CellCache.h"
 #include <OwnerDrawnMenu.h>
 #include <CustomSplitterWindow.h>
 #include <TreeViewHelper.h>
@@ -22,13 +37,25 @@ public:
 	DECLARE_FRAME_WND_CLASS(L"WMIEXPWNDCLASS", IDR_MAINFRAME)
 
 	const UINT WM_INSTANCES = WM_APP + 6;
+	const UINT WM_NAMESPACE_CONTENTS = WM_APP + 7;
+	const UINT WM_NAMESPACE_PROBED = WM_APP + 8;
+	const UINT WM_CATALOG_READY = WM_APP + 9;
+	const UINT WM_OBJECT_TEXT = WM_APP + 10;
+	const UINT WM_CLASSES_FETCHED = WM_APP + 11;
 
 	enum { TreeId = 123, ListId };
+	enum { SelectionTimerId = 2, InstancesTimerId, SchemaTimerId };
+	static const UINT SelectionDebounceMsec = 200;
+	static const UINT SchemaPollMsec = 1000;
+	static const int InstancesChunkSize = 256;
+	static const UINT InstancesSliceMsec = 30;
+	static const int ObjectSizeSamples = 32;
 
 	virtual BOOL PreTranslateMessage(MSG* pMsg);
 	virtual BOOL OnIdle();
 
 	CString GetColumnText(HWND, int row, int col) const;
+	PCWSTR GetExistingColumnText(HWND, int row, int col) const;
 	int GetRowImage(HWND, int row, int) const;
 
 	void OnStateChanged(HWND h, int from, int to, UINT oldState, UINT newState);
@@ -39,10 +66,26 @@ public:
 		NOTIFY_CODE_HANDLER(TVN_ITEMEXPANDING, OnTreeItemExpanding)
 		NOTIFY_CODE_HANDLER(TVN_SELCHANGED, OnTreeSelChanged)
 		MESSAGE_HANDLER(WM_INSTANCES, OnAddInstances)
+		MESSAGE_HANDLER(WM_NAMESPACE_CONTENTS, OnNamespaceContents)
+		MESSAGE_HANDLER(WM_NAMESPACE_PROBED, OnNamespaceProbed)
+		MESSAGE_HANDLER(WM_CATALOG_READY, OnCatalogReady)
+		MESSAGE_HANDLER(WM_OBJECT_TEXT, OnObjectText)
+		MESSAGE_HANDLER(WM_CLASSES_FETCHED, OnClassesFetched)
 		COMMAND_ID_HANDLER(ID_VIEW_SYSTEMCLASSES, OnViewSystemClasses)
+		COMMAND_ID_HANDLER(ID_VIEW_CLASSHIERARCHY, OnViewClassHierarchy)
 		COMMAND_ID_HANDLER(ID_VIEW_SYSTEMPROPERTIES, OnViewSystemProperties)
+		COMMAND_ID_HANDLER(ID_VIEW_REFRESH, OnViewRefresh)
+		COMMAND_ID_HANDLER(ID_VIEW_INDEXREPOSITORY, OnIndexRepository)
+		COMMAND_ID_HANDLER(ID_VIEW_QUERY, OnViewQuery)
+		COMMAND_ID_HANDLER(ID_VIEW_LIVECOUNTERS, OnViewLiveCounters)
+		COMMAND_ID_HANDLER(ID_VIEW_EVENTS, OnViewEvents)
+		COMMAND_ID_HANDLER(ID_VIEW_DIAGNOSTICS, OnViewDiagnostics)
+		COMMAND_ID_HANDLER(ID_VIEW_FANOUT, OnViewFanOut)
+		COMMAND_ID_HANDLER(ID_EDIT_FIND, OnEditFind)
+		COMMAND_ID_HANDLER(ID_EDIT_COPY, OnEditCopy)
 		COMMAND_ID_HANDLER(ID_VIEW_NAMESPACESINLIST, OnViewNamespacesInList)
 		COMMAND_ID_HANDLER(ID_APP_EXIT, OnFileExit)
+		COMMAND_ID_HANDLER(ID_FILE_SAVE, OnFileSave)
 		COMMAND_ID_HANDLER(ID_VIEW_TOOLBAR, OnViewToolBar)
 		COMMAND_ID_HANDLER(ID_OPTIONS_ALWAYSONTOP, OnAlwaysOnTop)
 		COMMAND_ID_HANDLER(ID_VIEW_STATUS_BAR, OnViewStatusBar)
@@ -66,6 +109,7 @@ private:
 	enum class ColumnType {
 		Name, Value, Type, Size, CimType, Details
 	};
+	static const int ColumnTypeCount = (int)ColumnType::Details + 1;
 	enum class NodeType {
 		Computer, Namespace, Class, Property, Method, Instance, HasChildren = 0x80
 	};
@@ -75,27 +119,71 @@ private:
 		CIMTYPE CimType;
 		NodeType Type;
 		CComVariant Value;
+		int Column{ -1 };	// property: instance store column; method: index in the schema
 	};
 
 	struct WmiObject {
 		wil::com_ptr<IWbemClassObject> Object;
 	};
 
-	static PCWSTR NodeTypeToText(NodeType type);
-	static CString CimTypeToString(CIMTYPE type);
-	static CString GetArrayValue(CComVariant& value, CIMTYPE type);
+	//
+	// a namespace read for the tree, with the class objects that go to the schema cache
+	//
+	struct LoadedNamespace : NamespaceContents {
+		std::vector<CComPtr<IWbemClassObject>> ClassObjects;
+	};
 
-	static CString VariantToString(CComVariant value);
+	//
+	// changed classes read again for the schema cache; null for a class that is gone
+	//
+	struct FetchedClasses {
+		std::wstring Path;
+		std::vector<std::wstring> Names;
+		std::vector<CComPtr<IWbemClassObject>> Classes;
+	};
+
+	struct ProbeResult {
+		std::wstring Path;
+		bool HasChildren;
+	};
+
+	enum {
+		ProbePriority, VisibleProbePriority, RevalidatePriority, LoadPriority, CopyPriority
+	};
+
+	static PCWSTR NodeTypeToText(NodeType type);
 
 	void InitCommandBar();
 	void InitToolBar(CToolBarCtrl& tb, int size = 24);
 	void InitTree();
-	void BuildTree(IWbemServices* pWmi, HTREEITEM hParent);
-	bool IsChildNamespaceOrClass(IWbemServices* pWmi) const;
+	void ResetTree();
+	void BuildTree(HTREEITEM hParent);
+	bool BuildTreeFromCache(HTREEITEM hParent);
+	void PopulateTree(HTREEITEM hParent, NamespaceContents const& contents);
+	ClassGraph& BuildClassGraph(NamespaceContents const& contents);
+	HTREEITEM InsertClassItem(HTREEITEM hParent, ClassGraph const& graph, int index);
+	void ExpandClass(HTREEITEM hItem);
+	bool IsTreeItemLoaded(HTREEITEM hItem) const;
+	HTREEITEM FindLoadedParentItem(HTREEITEM hNamespace, ClassGraph const& graph, int index);
+	void ApplyClassChanges(NamespaceChanges const& changes);
+	void ShowSystemClasses(bool show);
+	ClassGraph const* GetClassGraph(PCWSTR path) const;
+	HTREEITEM GetNamespaceItem(HTREEITEM hItem) const;
+	HTREEITEM FindClassItem(HTREEITEM hNamespace, PCWSTR name);
+	void LoadNamespace(PCWSTR path, bool revalidate);
+	void RevalidateNamespace(PCWSTR path);
+	void ProbeNamespaces(HTREEITEM hParent, NamespaceContents const& contents);
+	HTREEITEM FindNamespaceItem(PCWSTR path);
+	void SaveSnapshot();
+	void IndexRepository();
+	void GoToClass(PCWSTR nsPath, PCWSTR className);
+	InstanceStore const* GetLoadedInstances(PCWSTR className) const;
+	static std::wstring PathKey(PCWSTR path);
 	void UpdateList();
-	CString GetObjectDetails(WmiItem const& item) const;
-	CString GetObjectValue(WmiItem const& item) const;
+	void AppendObjectDetails(WmiItem const& item, std::wstring& text) const;
 	void TreeItemSelected(HTREEITEM hItem);
+	void DrainInstances();
+	void StopInstanceEnum();
 	void RefreshList();
 
 	HTREEITEM InsertTreeItem(PCWSTR text, int image, HTREEITEM hParent, NodeType type);
@@ -105,15 +193,31 @@ private:
 	LRESULT OnCreate(UINT /*uMsg*/, WPARAM /*wParam*/, LPARAM /*lParam*/, BOOL& /*bHandled*/);
 	LRESULT OnDestroy(UINT /*uMsg*/, WPARAM /*wParam*/, LPARAM /*lParam*/, BOOL& bHandled);
 	LRESULT OnTimer(UINT /*uMsg*/, WPARAM /*wParam*/, LPARAM /*lParam*/, BOOL& /*bHandled*/);
-	LRESULT OnAddInstances(UINT /*uMsg*/, WPARAM /*wParam*/, LPARAM /*lParam*/, BOOL& bHandled);
+	LRESULT OnAddInstances(UINT /*uMsg*/, WPARAM cookie, LPARAM /*lParam*/, BOOL& bHandled);
+	LRESULT OnNamespaceContents(UINT /*uMsg*/, WPARAM revalidate, LPARAM lParam, BOOL& /*bHandled*/);
+	LRESULT OnNamespaceProbed(UINT /*uMsg*/, WPARAM /*wParam*/, LPARAM lParam, BOOL& /*bHandled*/);
+	LRESULT OnCatalogReady(UINT /*uMsg*/, WPARAM /*wParam*/, LPARAM lParam, BOOL& /*bHandled*/);
+	LRESULT OnObjectText(UINT /*uMsg*/, WPARAM /*wParam*/, LPARAM lParam, BOOL& /*bHandled*/);
+	LRESULT OnClassesFetched(UINT /*uMsg*/, WPARAM /*wParam*/, LPARAM lParam, BOOL& /*bHandled*/);
 	LRESULT OnFileExit(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/);
+	LRESULT OnFileSave(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/);
 	LRESULT OnViewToolBar(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/);
 	LRESULT OnViewStatusBar(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/);
 	LRESULT OnAppAbout(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/);
 	LRESULT OnTreeItemExpanding(int /*idCtrl*/, LPNMHDR /*pnmh*/, BOOL& /*bHandled*/);
-	LRESULT OnTreeSelChanged(int /*idCtrl*/, LPNMHDR /*pnmh*/, BOOL& /*bHandled*/);
+	LRESULT OnTreeSelChanged(int /*idCtrl*/, LPNMHDR hdr, BOOL& /*bHandled*/);
 	LRESULT OnViewSystemClasses(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/);
+	LRESULT OnViewClassHierarchy(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/);
 	LRESULT OnViewSystemProperties(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/);
+	LRESULT OnViewRefresh(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/);
+	LRESULT OnIndexRepository(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/);
+	LRESULT OnViewQuery(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/);
+	LRESULT OnViewLiveCounters(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/);
+	LRESULT OnViewEvents(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/);
+	LRESULT OnViewDiagnostics(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/);
+	LRESULT OnViewFanOut(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/);
+	LRESULT OnEditFind(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/);
+	LRESULT OnEditCopy(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/);
 	LRESULT OnViewNamespacesInList(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/);
 	LRESULT OnShowWindow(UINT, WPARAM, LPARAM, BOOL&);
 	LRESULT OnRunAsAdmin(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/);
@@ -127,14 +231,41 @@ private:
 	CListViewCtrl m_InstanceList;
 	CMultiPaneStatusBarCtrl m_StatusBar;
 	std::vector<WmiItem> m_Items;
-	std::vector<WmiItem> m_Objects;
-	std::vector<WMIProperty> m_ObjPropValues;
+	InstanceStore m_Store;
+	//
+	// marshal size of the first instances, to estimate what holding them as objects would take
+	//
+	size_t m_SampleBytes{ 0 };
+	int m_SampleCount{ 0 };
+	int m_SelectedInstance{ -1 };
+	//
+	// formatted text of cells painted so far, by row (list) and column type
+	//
+	mutable CellCache m_ListCells;
+	mutable CellCache m_InstanceCells;
+	SchemaSnapshot m_Snapshot;
+	std::map<std::wstring, NamespaceContents> m_TreeContents;
+	std::map<std::wstring, ClassGraph> m_ClassGraphs;
+	SchemaWatcher m_SchemaWatcher;
+	WorkerPool m_Workers{ 4 };
+	std::shared_ptr<NamespaceCrawler> m_Crawler;
+	std::shared_ptr<RepositoryCatalog const> m_Catalog;
+	std::shared_ptr<SearchIndex> m_SearchIndex{ std::make_shared<SearchIndex>() };
+	CQueryDlg m_QueryDlg{ [this](auto className) { return GetLoadedInstances(className); } };
+	CPerfMonitorDlg m_PerfMonitorDlg;
+	CEventsDlg m_EventsDlg;
+	CDiagnosticsDlg m_DiagnosticsDlg;
+	CFanOutDlg m_FanOutDlg;
+	CSearchDlg m_SearchDlg{ *m_SearchIndex, [this](auto& hit) { GoToClass(hit.Namespace.c_str(), hit.Class.c_str()); } };
 	HANDLE m_hSingleInstMutex;
 	HTREEITEM m_hRoot;
 	CString m_NamespacePath;
 	CComPtr<IWbemServices> m_spWmi;
 	CComPtr<IWbemServices> m_spCurrentNamespace;
-	CComPtr<IWbemClassObject> m_spCurrentClass, m_spCurrentEnumClass;
+	CComPtr<IWbemClassObject> m_spCurrentClass;
+	std::shared_ptr<ClassSchema const> m_spCurrentSchema;
+	IObjectsCallback* m_InstanceSink{ nullptr };
+	WPARAM m_EnumCookie{ 0 };
 	const CString m_RootName{ L"ROOT" };
 	bool m_EnumInstancesInProgress{ false };
 };
@@ -0,0 +1,142 @@
+#include "pch.h"
+#include "NamespaceCrawler.h"
+#include "WMIHelper.h"
+#include "BatchEnumerator.h"
+
+size_t RepositoryCatalog::GetClassCount() const {
+	size_t count = 0;
+	for (auto& ns : Namespaces)
+		count += ns.Classes.size();
+	return count;
+}
+
+CatalogNamespace const* RepositoryCatalog::Find(PCWSTR path) const {
+	for (auto& ns : Namespaces)
+		if (::_wcsicmp(ns.Path.c_str(), path) == 0)
+			return &ns;
+	return nullptr;
+}
+
+WmiCrawlerSource::WmiCrawlerSource(bool includeMembers, bool includeDescriptions) :
+	m_IncludeMembers(includeMembers), m_IncludeDescriptions(includeDescriptions) {
+}
+
+HRESULT WmiCrawlerSource::ReadNamespace(CatalogNamespace& ns) {
+	auto start = ::GetTickCount64();
+	CComPtr<IWbemServices> spSvc;
+	auto hr = WMIHelper::Init(nullptr, ns.Path.c_str(), &spSvc);
+	ns.OpenMsec = DWORD(::GetTickCount64() - start);
+	if (FAILED(hr))
+		return hr;
+
+	//
+	// forward only, no amended qualifiers: the smallest class payload WMI offers.
+	// Descriptions are amended (localized) qualifiers and cost considerably more
+	//
+	CComPtr<IEnumWbemClassObject> spEnum;
+	hr = spSvc->CreateClassEnum(nullptr, WBEM_FLAG_DEEP | WBEM_FLAG_FORWARD_ONLY | WBEM_FLAG_RETURN_IMMEDIATELY
+		| (m_IncludeDescriptions ? WBEM_FLAG_USE_AMENDED_QUALIFIERS : 0), nullptr, &spEnum);
+	if (FAILED(hr))
+		return hr;
+
+	BatchEnumerator enumerator(spEnum);
+	enumerator.ForEach([&](auto pClass) {
+		CatalogClass cls;
+		cls.Name = WMIHelper::GetStringProperty(pClass, L"__CLASS");
+		cls.SuperClass = WMIHelper::GetStringProperty(pClass, L"__SUPERCLASS");
+		cls.IsSystem = WMIHelper::GetStringProperty(pClass, L"__DYNASTY").CompareNoCase(L"__SystemClass") == 0;
+		if (m_IncludeMembers) {
+			for (auto& name : WMIHelper::GetNames(pClass, WBEM_FLAG_NONSYSTEM_ONLY))
+				cls.Properties.push_back(name.m_str);
+			for (auto& method : WMIHelper::EnumMethods(pClass, true))
+				cls.Methods.push_back(std::move(method.Name));
+		}
+		if (m_IncludeDescriptions) {
+			CComPtr<IWbemQualifierSet> spQualifiers;
+			CComVariant value;
+			if (SUCCEEDED(pClass->GetQualifierSet(&spQualifiers)) &&
+				SUCCEEDED(spQualifiers->Get(L"Description", 0, &value, nullptr)) && value.vt == VT_BSTR)
+				cls.Description = value.bstrVal;
+		}
+		ns.Classes.push_back(std::move(cls));
+		});
+
+	for (auto& spNs : WMIHelper::EnumNamespaces(spSvc))
+		ns.Namespaces.push_back((PCWSTR)WMIHelper::GetStringProperty(spNs, L"NAME"));
+	return S_OK;
+}
+
+std::shared_ptr<NamespaceCrawler> NamespaceCrawler::Create(std::shared_ptr<ICrawlerSource> source, CrawlOptions const& options) {
+	return std::shared_ptr<NamespaceCrawler>(new NamespaceCrawler(std::move(source), options));
+}
+
+NamespaceCrawler::NamespaceCrawler(std::shared_ptr<ICrawlerSource> source, CrawlOptions const& options) :
+	m_Source(std::move(source)), m_OnNamespace(options.OnNamespace), m_Pool(std::max(1, options.Concurrency)) {
+}
+
+void NamespaceCrawler::Start(PCWSTR root, CompletionCallback callback) {
+	m_Callback = std::move(callback);
+	m_Start = ::GetTickCount64();
+	Submit(root);
+}
+
+RepositoryCatalog NamespaceCrawler::Crawl(PCWSTR root) {
+	wil::unique_event done(wil::EventOptions::ManualReset);
+	RepositoryCatalog result;
+	Start(root, [&](RepositoryCatalog catalog) {
+		result = std::move(catalog);
+		done.SetEvent();
+		});
+	done.wait();
+	return result;
+}
+
+void NamespaceCrawler::Cancel() {
+	m_Cancelled = true;
+}
+
+bool NamespaceCrawler::IsCancelled() const {
+	return m_Cancelled;
+}
+
+void NamespaceCrawler::Submit(std::wstring path) {
+	m_Pending++;
+	m_Pool.Submit([self = shared_from_this(), path = std::move(path)]() mutable {
+		if (!self->m_Cancelled) {
+			CatalogNamespace ns;
+			ns.Path = std::move(path);
+			auto start = ::GetTickCount64();
+			ns.Status = self->m_Source->ReadNamespace(ns);
+			ns.ElapsedMsec = DWORD(::GetTickCount64() - start);
+			ATLTRACE(L"Crawled %s: %u classes, open %u msec, total %u msec\n",
+				ns.Path.c_str(), (ULONG)ns.Classes.size(), ns.OpenMsec, ns.ElapsedMsec);
+
+			for (auto& child : ns.Namespaces)
+				self->Submit(ns.Path + L"\\" + child);
+			if (self->m_OnNamespace)
+				self->m_OnNamespace(ns);
+
+			std::lock_guard lock(self->m_Lock);
+			self->m_Catalog.Namespaces.push_back(std::move(ns));
+		}
+		//
+		// children were submitted before this one is counted as done, so zero means the walk is over
+		//
+		if (--self->m_Pending == 0)
+			self->Complete();
+		});
+}
+
+void NamespaceCrawler::Complete() {
+	RepositoryCatalog catalog;
+	{
+		std::lock_guard lock(m_Lock);
+		catalog = std::move(m_Catalog);
+	}
+	std::sort(catalog.Namespaces.begin(), catalog.Namespaces.end(), [](auto& ns1, auto& ns2) {
+		return ::_wcsicmp(ns1.Path.c_str(), ns2.Path.c_str()) < 0;
+		});
+	catalog.ElapsedMsec = DWORD(::GetTickCount64() - m_Start);
+	if (m_Callback)
+		m_Callback(std::move(catalog));
+}
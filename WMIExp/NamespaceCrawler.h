@@ -0,0 +1,86 @@
+#pragma once
+
+#include "WorkerPool.h"
+#include <functional>
+
+struct CatalogClass {
+	std::wstring Name;
+	std::wstring SuperClass;
+	std::vector<std::wstring> Properties;
+	std::vector<std::wstring> Methods;
+	std::wstring Description;
+	bool IsSystem;
+};
+
+struct CatalogNamespace {
+	std::wstring Path;
+	std::vector<CatalogClass> Classes;
+	std::vector<std::wstring> Namespaces;
+	HRESULT Status{ S_OK };
+	DWORD OpenMsec{ 0 };
+	DWORD ElapsedMsec{ 0 };
+};
+
+struct RepositoryCatalog {
+	std::vector<CatalogNamespace> Namespaces;
+	DWORD ElapsedMsec{ 0 };
+
+	size_t GetClassCount() const;
+	CatalogNamespace const* Find(PCWSTR path) const;
+};
+
+//
+// where the crawler gets its data from; the WMI implementation is the real thing,
+// other implementations can stand in for a repository (e.g. a synthetic one)
+//
+struct ICrawlerSource {
+	virtual ~ICrawlerSource() = default;
+	// fills the classes and child namespace names of the namespace
+	virtual HRESULT ReadNamespace(CatalogNamespace& ns) = 0;
+};
+
+class WmiCrawlerSource : public ICrawlerSource {
+public:
+	explicit WmiCrawlerSource(bool includeMembers = false, bool includeDescriptions = false);
+	HRESULT ReadNamespace(CatalogNamespace& ns) override;
+
+private:
+	bool m_IncludeMembers;
+	bool m_IncludeDescriptions;
+};
+
+struct CrawlOptions {
+	int Concurrency{ 8 };
+	// called on a pool thread as each namespace is read, before the catalog is complete
+	std::function<void(CatalogNamespace const&)> OnNamespace;
+};
+
+//
+// walks a namespace tree concurrently, reading each namespace on a pool thread
+//
+class NamespaceCrawler : public std::enable_shared_from_this<NamespaceCrawler> {
+public:
+	using CompletionCallback = std::function<void(RepositoryCatalog)>;
+
+	static std::shared_ptr<NamespaceCrawler> Create(std::shared_ptr<ICrawlerSource> source, CrawlOptions const& options = {});
+
+	void Start(PCWSTR root, CompletionCallback callback);
+	RepositoryCatalog Crawl(PCWSTR root);
+	void Cancel();
+	bool IsCancelled() const;
+
+private:
+	NamespaceCrawler(std::shared_ptr<ICrawlerSource> source, CrawlOptions const& options);
+	void Submit(std::wstring path);
+	void Complete();
+
+	std::shared_ptr<ICrawlerSource> m_Source;
+	std::function<void(CatalogNamespace const&)> m_OnNamespace;
+	WorkerPool m_Pool;
+	std::mutex m_Lock;
+	RepositoryCatalog m_Catalog;
+	CompletionCallback m_Callback;
+	std::atomic<int> m_Pending{ 0 };
+	std::atomic<bool> m_Cancelled{ false };
+	ULONGLONG m_Start{ 0 };
+};
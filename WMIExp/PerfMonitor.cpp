@@ -0,0 +1,278 @@
+#include "pch.h"
+#include "PerfMonitor.h"
+#include "SchemaCache.h"
+
+PerfMonitor::~PerfMonitor() {
+	Stop();
+}
+
+HRESULT PerfMonitor::Start(IWbemServices* pSvc, ClassSchema const& schema, UINT history) {
+	Stop();
+
+	CComPtr<IWbemConfigureRefresher> spConfig;
+	long id;
+	auto hr = m_spRefresher.CoCreateInstance(__uuidof(WbemRefresher));
+	if (SUCCEEDED(hr))
+		hr = m_spRefresher.QueryInterface(&spConfig);
+	if (SUCCEEDED(hr))
+		hr = spConfig->AddEnum(pSvc, schema.Name.c_str(), 0, nullptr, &m_spEnum, &id);
+	if (FAILED(hr)) {
+		Stop();
+		return hr;
+	}
+
+	//
+	// counters are the integer properties; their handles are resolved from the first instance
+	//
+	for (auto& prop : schema.Properties) {
+		switch (prop.Type) {
+			case CIM_SINT32:
+			case CIM_UINT32:
+			case CIM_SINT64:
+			case CIM_UINT64:
+				if (!prop.Name.starts_with(L"__"))
+					m_Counters.push_back({ prop.Name, prop.Type, -1 });
+				break;
+		}
+	}
+	m_History = std::max(history, 2U);
+	return S_OK;
+}
+
+void PerfMonitor::Stop() {
+	m_spEnum.Release();
+	m_spRefresher.Release();
+	m_Counters.clear();
+	m_NameHandle = -1;
+	m_Values.clear();
+	m_Slots.clear();
+	m_Free.clear();
+	m_Live.clear();
+	m_LastOrder.clear();
+	m_Index.clear();
+	m_Objects.clear();
+	m_Refreshes = 0;
+	m_HandlesResolved = false;
+	m_InstancesChanged = false;
+}
+
+bool PerfMonitor::IsRunning() const {
+	return m_spRefresher != nullptr;
+}
+
+HRESULT PerfMonitor::Refresh() {
+	if (m_spRefresher == nullptr)
+		return E_UNEXPECTED;
+
+	LARGE_INTEGER start, end, freq;
+	::QueryPerformanceCounter(&start);
+	auto hr = m_spRefresher->Refresh(0);
+	if (FAILED(hr))
+		return hr;
+
+	ULONG count = 0;
+	hr = m_spEnum->GetObjects(0, (ULONG)m_Objects.size(), m_Objects.data(), &count);
+	if (hr == WBEM_E_BUFFER_TOO_SMALL) {
+		m_Objects.resize(count + count / 4);
+		hr = m_spEnum->GetObjects(0, (ULONG)m_Objects.size(), m_Objects.data(), &count);
+	}
+	if (FAILED(hr))
+		return hr;
+
+	//
+	// handles come from the first object seen, which may be refreshes after the first
+	// when the class starts out with no instances
+	//
+	m_Refreshes++;
+	if (!m_HandlesResolved && count > 0) {
+		m_HandlesResolved = true;
+		CIMTYPE type;
+		if (FAILED(m_Objects[0]->GetPropertyHandle(L"Name", &type, &m_NameHandle)) || type != CIM_STRING)
+			m_NameHandle = -1;
+		std::erase_if(m_Counters, [&](auto& counter) {
+			return FAILED(m_Objects[0]->GetPropertyHandle(counter.Name.c_str(), &type, &counter.Handle));
+			});
+		m_Slots.reserve(count + count / 4);
+		m_Values.reserve(m_Slots.capacity() * m_Counters.size() * m_History);
+	}
+
+	m_InstancesChanged = false;
+	m_LastOrder.resize(count, -1);
+	for (ULONG i = 0; i < count; i++) {
+		auto pAccess = m_Objects[i];
+		auto instance = -1;
+		if (ReadName(pAccess)) {
+			//
+			// the provider tends to return instances in the same order every time,
+			// which saves the lookup by name
+			//
+			auto last = m_LastOrder[i];
+			instance = last >= 0 && m_Slots[last].Alive && m_Slots[last].Name == m_Name.data() ? last : Acquire(m_Name.data());
+			if (m_Slots[instance].LastSeen != m_Refreshes)
+				ReadSample(pAccess, instance);
+		}
+		m_LastOrder[i] = instance;
+		pAccess->Release();
+		m_Objects[i] = nullptr;
+	}
+
+	for (auto instance : m_Live) {
+		auto& slot = m_Slots[instance];
+		if (slot.LastSeen != m_Refreshes) {
+			slot.Alive = false;
+			m_Index.erase(slot.Name);
+			m_Free.push_back(instance);
+			m_InstancesChanged = true;
+		}
+	}
+	if (m_InstancesChanged)
+		std::erase_if(m_Live, [&](auto instance) { return !m_Slots[instance].Alive; });
+
+	::QueryPerformanceCounter(&end);
+	::QueryPerformanceFrequency(&freq);
+	m_LastRefreshUsec = DWORD((end.QuadPart - start.QuadPart) * 1000000 / freq.QuadPart);
+	return S_OK;
+}
+
+int PerfMonitor::GetCounterCount() const {
+	return (int)m_Counters.size();
+}
+
+PerfCounter const& PerfMonitor::GetCounter(int counter) const {
+	return m_Counters[counter];
+}
+
+int PerfMonitor::FindCounter(PCWSTR name) const {
+	for (int i = 0; i < (int)m_Counters.size(); i++)
+		if (::_wcsicmp(m_Counters[i].Name.c_str(), name) == 0)
+			return i;
+	return -1;
+}
+
+UINT PerfMonitor::GetHistoryLength() const {
+	return m_History;
+}
+
+std::vector<int> const& PerfMonitor::GetInstances() const {
+	return m_Live;
+}
+
+std::wstring const& PerfMonitor::GetInstanceName(int instance) const {
+	return m_Slots[instance].Name;
+}
+
+ULONGLONG PerfMonitor::GetValue(int instance, int counter, UINT back) const {
+	auto& slot = m_Slots[instance];
+	if (back >= slot.Samples)
+		return 0;
+	return GetRing(instance, counter)[(slot.Head + m_History - back) % m_History];
+}
+
+UINT PerfMonitor::GetSampleCount(int instance) const {
+	return m_Slots[instance].Samples;
+}
+
+bool PerfMonitor::IsChanged(int instance) const {
+	return m_Slots[instance].Changed;
+}
+
+bool PerfMonitor::InstancesChanged() const {
+	return m_InstancesChanged;
+}
+
+bool PerfMonitor::AreCountersResolved() const {
+	return m_HandlesResolved;
+}
+
+DWORD PerfMonitor::GetLastRefreshUsec() const {
+	return m_LastRefreshUsec;
+}
+
+size_t PerfMonitor::GetMemorySize() const {
+	size_t size = m_Values.capacity() * sizeof(ULONGLONG) + m_Slots.capacity() * sizeof(Instance);
+	for (auto& slot : m_Slots)
+		size += slot.Name.capacity() * sizeof(WCHAR);
+	return size;
+}
+
+int PerfMonitor::Acquire(PCWSTR name) {
+	if (auto it = m_Index.find(name); it != m_Index.end())
+		return it->second;
+
+	int instance;
+	if (m_Free.empty()) {
+		instance = (int)m_Slots.size();
+		m_Slots.emplace_back();
+		m_Values.resize(m_Values.size() + m_Counters.size() * m_History);
+	}
+	else {
+		instance = m_Free.back();
+		m_Free.pop_back();
+	}
+	auto& slot = m_Slots[instance];
+	slot = Instance();
+	slot.Name = name;
+	slot.Alive = true;
+	m_Index.emplace(slot.Name, instance);
+	m_Live.push_back(instance);
+	m_InstancesChanged = true;
+	return instance;
+}
+
+bool PerfMonitor::ReadName(IWbemObjectAccess* pAccess) {
+	if (m_Name.empty())
+		m_Name.resize(128);
+	if (m_NameHandle < 0) {
+		//
+		// a singleton, e.g. Win32_PerfRawData_PerfOS_Memory
+		//
+		m_Name[0] = 0;
+		return true;
+	}
+
+	long size = 0;
+	auto hr = pAccess->ReadPropertyValue(m_NameHandle, long(m_Name.size() * sizeof(WCHAR)), &size, (BYTE*)m_Name.data());
+	if (hr == WBEM_E_BUFFER_TOO_SMALL) {
+		m_Name.resize(size / sizeof(WCHAR) + 1);
+		hr = pAccess->ReadPropertyValue(m_NameHandle, long(m_Name.size() * sizeof(WCHAR)), &size, (BYTE*)m_Name.data());
+	}
+	if (FAILED(hr))
+		return false;
+	if (hr == WBEM_S_FALSE || size == 0)
+		m_Name[0] = 0;
+	return true;
+}
+
+void PerfMonitor::ReadSample(IWbemObjectAccess* pAccess, int instance) {
+	auto& slot = m_Slots[instance];
+	auto head = slot.Samples == 0 ? 0 : (slot.Head + 1) % m_History;
+	auto changed = slot.Samples == 0;
+	for (int c = 0; c < (int)m_Counters.size(); c++) {
+		auto& counter = m_Counters[c];
+		ULONGLONG value = 0;
+		if (counter.Type == CIM_SINT32 || counter.Type == CIM_UINT32) {
+			DWORD dw;
+			if (SUCCEEDED(pAccess->ReadDWORD(counter.Handle, &dw)))
+				value = counter.Type == CIM_SINT32 ? (ULONGLONG)(LONGLONG)(LONG)dw : dw;
+		}
+		else if (FAILED(pAccess->ReadQWORD(counter.Handle, &value))) {
+			value = 0;
+		}
+		auto ring = GetRing(instance, c);
+		if (!changed && ring[slot.Head] != value)
+			changed = true;
+		ring[head] = value;
+	}
+	slot.Head = head;
+	slot.Samples = std::min(slot.Samples + 1, m_History);
+	slot.Changed = changed;
+	slot.LastSeen = m_Refreshes;
+}
+
+ULONGLONG* PerfMonitor::GetRing(int instance, int counter) {
+	return m_Values.data() + ((size_t)instance * m_Counters.size() + counter) * m_History;
+}
+
+ULONGLONG const* PerfMonitor::GetRing(int instance, int counter) const {
+	return m_Values.data() + ((size_t)instance * m_Counters.size() + counter) * m_History;
+}
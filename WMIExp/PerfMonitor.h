@@ -0,0 +1,100 @@
+#pragma once
+
+#include <unordered_map>
+
+struct ClassSchema;
+
+struct PerfCounter {
+	std::wstring Name;
+	CIMTYPE Type;
+	long Handle;
+};
+
+//
+// instances of a performance class kept live through a high performance refresher
+// (IWbemConfigureRefresher::AddEnum). Each refresh reads the counters through property
+// handles straight into per instance ring buffers, which are allocated once, when an
+// instance first shows up, and reused after it goes away. Nothing on the refresh path
+// goes through a VARIANT or allocates, unless instances come and go
+//
+class PerfMonitor {
+public:
+	~PerfMonitor();
+
+	HRESULT Start(IWbemServices* pSvc, ClassSchema const& schema, UINT history);
+	void Stop();
+	bool IsRunning() const;
+
+	//
+	// takes one sample of all instances
+	//
+	HRESULT Refresh();
+
+	int GetCounterCount() const;
+	PerfCounter const& GetCounter(int counter) const;
+	int FindCounter(PCWSTR name) const;
+	UINT GetHistoryLength() const;
+	//
+	// live instances, in the order they first appeared
+	//
+	std::vector<int> const& GetInstances() const;
+	std::wstring const& GetInstanceName(int instance) const;
+	//
+	// a value from "back" samples ago; signed counters come back sign extended
+	//
+	ULONGLONG GetValue(int instance, int counter, UINT back = 0) const;
+	UINT GetSampleCount(int instance) const;
+	//
+	// whether any counter of the instance changed in the last refresh
+	//
+	bool IsChanged(int instance) const;
+	//
+	// whether instances appeared or went away in the last refresh
+	//
+	bool InstancesChanged() const;
+	//
+	// whether the counters are settled: property handles are resolved from the first
+	// instance seen, and counters without one are dropped then
+	//
+	bool AreCountersResolved() const;
+
+	DWORD GetLastRefreshUsec() const;
+	size_t GetMemorySize() const;
+
+private:
+	struct Instance {
+		std::wstring Name;
+		ULONGLONG LastSeen{ 0 };	// refresh number
+		UINT Head{ 0 };				// ring slot of the latest sample
+		UINT Samples{ 0 };
+		bool Changed{ false };
+		bool Alive{ false };
+	};
+
+	int Acquire(PCWSTR name);
+	bool ReadName(IWbemObjectAccess* pAccess);
+	void ReadSample(IWbemObjectAccess* pAccess, int instance);
+	ULONGLONG* GetRing(int instance, int counter);
+	ULONGLONG const* GetRing(int instance, int counter) const;
+
+	CComPtr<IWbemRefresher> m_spRefresher;
+	CComPtr<IWbemHiPerfEnum> m_spEnum;
+	std::vector<PerfCounter> m_Counters;
+	long m_NameHandle{ -1 };
+	UINT m_History{ 0 };
+	//
+	// ring of instance i, counter c: m_Values[(i * counters + c) * history ...]
+	//
+	std::vector<ULONGLONG> m_Values;
+	std::vector<Instance> m_Slots;
+	std::vector<int> m_Free;
+	std::vector<int> m_Live;
+	std::vector<int> m_LastOrder;		// slot of each object in the previous refresh
+	std::unordered_map<std::wstring, int> m_Index;
+	std::vector<IWbemObjectAccess*> m_Objects;
+	std::vector<WCHAR> m_Name;
+	ULONGLONG m_Refreshes{ 0 };
+	bool m_HandlesResolved{ false };
+	DWORD m_LastRefreshUsec{ 0 };
+	bool m_InstancesChanged{ false };
+};
@@ -0,0 +1,212 @@
+#include "pch.h"
+#include "PerfMonitorDlg.h"
+#include "SchemaCache.h"
+#include "AppSettings.h"
+
+HRESULT CPerfMonitorDlg::Monitor(IWbemServices* pSvc, std::shared_ptr<ClassSchema const> schema) {
+	KillTimer(RefreshTimerId);
+	m_List.SetItemCount(0);
+	auto cm = GetColumnManager(m_List);
+	cm->Clear();
+	m_spSchema = std::move(schema);
+	SetWindowText((L"Live Counters - " + m_spSchema->Name).c_str());
+
+	auto hr = m_Monitor.Start(pSvc, *m_spSchema, AppSettings::Get().PerfHistoryLength());
+	if (FAILED(hr)) {
+		UpdateStatus(hr);
+		return hr;
+	}
+
+	//
+	// the first sample with an instance settles which counters can be read through handles
+	//
+	hr = m_Monitor.Refresh();
+	BindCounters();
+	UpdateStatus(hr);
+	StartTimer();
+	return hr;
+}
+
+void CPerfMonitorDlg::BindCounters() {
+	auto cm = GetColumnManager(m_List);
+	m_List.SetItemCount(0);
+	cm->Clear();
+	m_Cooker.Bind(m_Monitor, *m_spSchema);
+	m_Cooker.Cook(m_Monitor);
+	cm->AddColumn(L"Instance", LVCFMT_LEFT, 200);
+	for (int i = 0; i < m_Monitor.GetCounterCount(); i++)
+		cm->AddColumn(m_Monitor.GetCounter(i).Name.c_str(), LVCFMT_RIGHT, 110);
+	m_List.SetItemCountEx((int)m_Monitor.GetInstances().size(), LVSICF_NOSCROLL);
+}
+
+CString CPerfMonitorDlg::GetColumnText(HWND h, int row, int col) const {
+	return GetExistingColumnText(h, row, col);
+}
+
+PCWSTR CPerfMonitorDlg::GetExistingColumnText(HWND, int row, int col) const {
+	auto& instances = m_Monitor.GetInstances();
+	if (row >= (int)instances.size())
+		return L"";
+
+	auto instance = instances[row];
+	if (col == 0) {
+		auto& name = m_Monitor.GetInstanceName(instance);
+		return name.empty() ? L"(singleton)" : name.c_str();
+	}
+	m_Text.clear();
+	if (m_Cooked && m_Cooker.IsBound()) {
+		auto formula = m_Cooker.GetFormula(col - 1);
+		if (formula != CookFormula::Raw && formula != CookFormula::Hidden) {
+			m_Cooker.AppendValue(row, col - 1, m_Text);
+			return m_Text.c_str();
+		}
+	}
+	auto& counter = m_Monitor.GetCounter(col - 1);
+	auto value = m_Monitor.GetValue(instance, col - 1);
+	if (counter.Type == CIM_SINT32 || counter.Type == CIM_SINT64)
+		std::format_to(std::back_inserter(m_Text), L"{}", (LONGLONG)value);
+	else
+		std::format_to(std::back_inserter(m_Text), L"{}", value);
+	return m_Text.c_str();
+}
+
+void CPerfMonitorDlg::Refresh() {
+	auto resolved = m_Monitor.AreCountersResolved();
+	auto hr = m_Monitor.Refresh();
+	if (SUCCEEDED(hr) && !resolved && m_Monitor.AreCountersResolved()) {
+		//
+		// the class had no instances so far; its counters just changed
+		//
+		BindCounters();
+		UpdateStatus(hr);
+		return;
+	}
+	if (SUCCEEDED(hr)) {
+		if (m_Cooked)
+			m_Cooker.Cook(m_Monitor);
+		UpdateList();
+	}
+	UpdateStatus(hr);
+}
+
+void CPerfMonitorDlg::UpdateList() {
+	auto& instances = m_Monitor.GetInstances();
+	if (m_Monitor.InstancesChanged()) {
+		m_List.SetItemCountEx((int)instances.size(), LVSICF_NOSCROLL);
+		return;
+	}
+
+	//
+	// only the visible cells whose value moved are repainted
+	//
+	auto top = m_List.GetTopIndex();
+	auto end = std::min(top + m_List.GetCountPerPage() + 1, (int)instances.size());
+	auto counters = m_Monitor.GetCounterCount();
+	for (int row = top; row < end; row++) {
+		auto instance = instances[row];
+		if (!m_Monitor.IsChanged(instance))
+			continue;
+
+		//
+		// cooked values move with the time stamps, so the whole row goes
+		//
+		if (m_Cooked || m_Monitor.GetSampleCount(instance) < 2) {
+			m_List.RedrawItems(row, row);
+			continue;
+		}
+		for (int c = 0; c < counters; c++) {
+			CRect rc;
+			if (m_Monitor.GetValue(instance, c) != m_Monitor.GetValue(instance, c, 1) && m_List.GetSubItemRect(row, c + 1, LVIR_BOUNDS, &rc))
+				m_List.InvalidateRect(&rc, FALSE);
+		}
+	}
+}
+
+void CPerfMonitorDlg::UpdateStatus(HRESULT hr) {
+	FILETIME created, exited, kernel, user;
+	::GetProcessTimes(::GetCurrentProcess(), &created, &exited, &kernel, &user);
+	auto cpu = *(ULONGLONG*)&kernel + *(ULONGLONG*)&user;
+	auto tick = ::GetTickCount64();
+	if (m_LastTick && tick > m_LastTick)
+		m_CpuPercent = (cpu - m_LastCpu) / 100.0 / (tick - m_LastTick);	// 100 nsec units over msec
+	m_LastCpu = cpu;
+	m_LastTick = tick;
+
+	std::wstring text;
+	if (FAILED(hr))
+		text = std::format(L"Error 0x{:08X}. ", (DWORD)hr);
+	if (m_Monitor.IsRunning())
+		text += std::format(L"{} instances, {} counters; refresh took {} usec; explorer CPU {:.2f}% of one core; {} KB of history{}",
+			m_Monitor.GetInstances().size(), m_Monitor.GetCounterCount(), m_Monitor.GetLastRefreshUsec(),
+			m_CpuPercent, m_Monitor.GetMemorySize() >> 10, m_Paused ? L" (paused)" : L"");
+	SetDlgItemText(IDC_STATUS, text.c_str());
+}
+
+void CPerfMonitorDlg::StartTimer() {
+	if (!m_Paused && m_Monitor.IsRunning() && IsWindowVisible())
+		SetTimer(RefreshTimerId, std::max(100, AppSettings::Get().PerfRefreshMsec()), nullptr);
+}
+
+LRESULT CPerfMonitorDlg::OnInitDialog(UINT, WPARAM, LPARAM, BOOL&) {
+	SetDialogIcon(IDR_MAINFRAME);
+	DlgResize_Init(true, false);
+
+	m_List.Attach(GetDlgItem(IDC_RESULTS));
+	m_List.SetExtendedListViewStyle(LVS_EX_FULLROWSELECT | LVS_EX_DOUBLEBUFFER);
+	CheckDlgButton(IDC_COOKED, m_Cooked ? BST_CHECKED : BST_UNCHECKED);
+	return TRUE;
+}
+
+LRESULT CPerfMonitorDlg::OnTimer(UINT, WPARAM id, LPARAM, BOOL&) {
+	if (id == RefreshTimerId)
+		Refresh();
+	return 0;
+}
+
+LRESULT CPerfMonitorDlg::OnShowWindow(UINT, WPARAM show, LPARAM, BOOL& bHandled) {
+	//
+	// nothing is sampled while no one is looking
+	//
+	if (show)
+		StartTimer();
+	else
+		KillTimer(RefreshTimerId);
+	bHandled = FALSE;
+	return 0;
+}
+
+LRESULT CPerfMonitorDlg::OnDestroy(UINT, WPARAM, LPARAM, BOOL&) {
+	KillTimer(RefreshTimerId);
+	m_Monitor.Stop();
+	return 0;
+}
+
+LRESULT CPerfMonitorDlg::OnPause(WORD, WORD, HWND, BOOL&) {
+	m_Paused = !m_Paused;
+	SetDlgItemText(IDC_PAUSE, m_Paused ? L"&Resume" : L"&Pause");
+	if (m_Paused)
+		KillTimer(RefreshTimerId);
+	else
+		StartTimer();
+	UpdateStatus(S_OK);
+	return 0;
+}
+
+LRESULT CPerfMonitorDlg::OnCooked(WORD, WORD, HWND, BOOL&) {
+	m_Cooked = IsDlgButtonChecked(IDC_COOKED) == BST_CHECKED;
+	if (m_Cooked && m_Monitor.IsRunning())
+		m_Cooker.Cook(m_Monitor);
+	m_List.Invalidate();
+	return 0;
+}
+
+LRESULT CPerfMonitorDlg::OnCloseCmd(WORD, WORD, HWND, BOOL&) {
+	//
+	// the refresher holds the provider's instances; closing lets them go
+	//
+	KillTimer(RefreshTimerId);
+	m_Monitor.Stop();
+	m_List.SetItemCount(0);
+	ShowWindow(SW_HIDE);
+	return 0;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "resource.h"
+#include "DialogHelper.h"
+#include <VirtualListView.h>
+#include "PerfMonitor.h"
+#include "CounterCooker.h"
+
+struct ClassSchema;
+
+class CPerfMonitorDlg :
+	public CDialogImpl<CPerfMonitorDlg>,
+	public CDialogResize<CPerfMonitorDlg>,
+	public CVirtualListView<CPerfMonitorDlg>,
+	public CDialogHelper<CPerfMonitorDlg> {
+public:
+	enum { IDD = IDD_PERFMON };
+	enum { RefreshTimerId = 1 };
+
+	//
+	// starts refreshing the class, replacing whatever was monitored
+	//
+	HRESULT Monitor(IWbemServices* pSvc, std::shared_ptr<ClassSchema const> schema);
+
+	CString GetColumnText(HWND, int row, int col) const;
+	PCWSTR GetExistingColumnText(HWND, int row, int col) const;
+
+	BEGIN_MSG_MAP(CPerfMonitorDlg)
+		MESSAGE_HANDLER(WM_INITDIALOG, OnInitDialog)
+		MESSAGE_HANDLER(WM_TIMER, OnTimer)
+		MESSAGE_HANDLER(WM_SHOWWINDOW, OnShowWindow)
+		MESSAGE_HANDLER(WM_DESTROY, OnDestroy)
+		COMMAND_ID_HANDLER(IDC_PAUSE, OnPause)
+		COMMAND_ID_HANDLER(IDC_COOKED, OnCooked)
+		COMMAND_ID_HANDLER(IDCANCEL, OnCloseCmd)
+		CHAIN_MSG_MAP(CVirtualListView<CPerfMonitorDlg>)
+		CHAIN_MSG_MAP(CDialogResize<CPerfMonitorDlg>)
+	END_MSG_MAP()
+
+	BEGIN_DLGRESIZE_MAP(CPerfMonitorDlg)
+		DLGRESIZE_CONTROL(IDC_PAUSE, DLSZ_MOVE_X)
+		DLGRESIZE_CONTROL(IDC_RESULTS, DLSZ_SIZE_X | DLSZ_SIZE_Y)
+		DLGRESIZE_CONTROL(IDC_STATUS, DLSZ_SIZE_X | DLSZ_MOVE_Y)
+	END_DLGRESIZE_MAP()
+
+private:
+	void Refresh();
+	void BindCounters();
+	void UpdateList();
+	void UpdateStatus(HRESULT hr);
+	void StartTimer();
+
+	LRESULT OnInitDialog(UINT /*uMsg*/, WPARAM /*wParam*/, LPARAM /*lParam*/, BOOL& /*bHandled*/);
+	LRESULT OnTimer(UINT /*uMsg*/, WPARAM id, LPARAM /*lParam*/, BOOL& /*bHandled*/);
+	LRESULT OnShowWindow(UINT /*uMsg*/, WPARAM show, LPARAM /*lParam*/, BOOL& /*bHandled*/);
+	LRESULT OnDestroy(UINT /*uMsg*/, WPARAM /*wParam*/, LPARAM /*lParam*/, BOOL& /*bHandled*/);
+	LRESULT OnPause(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/);
+	LRESULT OnCooked(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/);
+	LRESULT OnCloseCmd(WORD /*wNotifyCode*/, WORD wID, HWND /*hWndCtl*/, BOOL& /*bHandled*/);
+
+	PerfMonitor m_Monitor;
+	CounterCooker m_Cooker;
+	std::shared_ptr<ClassSchema const> m_spSchema;
+	CListViewCtrl m_List;
+	mutable std::wstring m_Text;
+	//
+	// the explorer's own CPU time, to show what monitoring costs
+	//
+	ULONGLONG m_LastCpu{ 0 };
+	ULONGLONG m_LastTick{ 0 };
+	double m_CpuPercent{ 0 };
+	bool m_Paused{ false };
+	bool m_Cooked{ true };
+};
@@ -0,0 +1,322 @@
+#include "pch.h"
+#include "QueryDlg.h"
+#include "WMIHelper.h"
+#include "ConnectionPool.h"
+#include "CellCache.h"
+#include "AppSettings.h"
+#include "SchemaCache.h"
+
+CQueryDlg::CQueryDlg(LocalSource source) : m_LocalSource(std::move(source)) {
+}
+
+void CQueryDlg::SetNamespace(PCWSTR path) {
+	if (::_wcsicmp(m_Namespace.c_str(), path) != 0)
+		m_spSvc.Release();
+	m_Namespace = path;
+	if (IsWindow())
+		SetWindowText((L"WQL Query - " + m_Namespace).c_str());
+}
+
+CString CQueryDlg::GetColumnText(HWND h, int row, int col) const {
+	return GetExistingColumnText(h, row, col);
+}
+
+PCWSTR CQueryDlg::GetExistingColumnText(HWND, int row, int col) const {
+	return m_Strings.Get(m_Cells[row * m_Columns.size() + col]).c_str();
+}
+
+void CQueryDlg::Stop() {
+	if (m_Runner) {
+		m_Runner->Cancel();
+		m_Runner.reset();
+	}
+	GetDlgItem(IDC_STOP).EnableWindow(FALSE);
+}
+
+void CQueryDlg::Clear() {
+	m_List.SetItemCount(0);
+	GetColumnManager(m_List)->Clear();
+	m_Columns.clear();
+	m_Cells.clear();
+	m_Strings.Clear();
+	m_Rows = 0;
+}
+
+bool CQueryDlg::RunLocal(PCWSTR text) {
+	WqlQuery query;
+	std::wstring error;
+	if (!WqlQuery::Parse(text, query, &error)) {
+		SetDlgItemText(IDC_STATUS, (L"Syntax error: " + error).c_str());
+		return false;
+	}
+	auto store = m_LocalSource ? m_LocalSource(query.ClassName.c_str()) : nullptr;
+	if (store == nullptr) {
+		SetDlgItemText(IDC_STATUS, (L"No instances of " + query.ClassName + L" are loaded; select the class in the tree first").c_str());
+		return false;
+	}
+
+	WqlFilter filter;
+	if (!filter.Bind(query, *store, &error)) {
+		SetDlgItemText(IDC_STATUS, error.c_str());
+		return false;
+	}
+	LARGE_INTEGER start, end, freq;
+	::QueryPerformanceCounter(&start);
+	auto rows = filter.Run();
+	::QueryPerformanceCounter(&end);
+	::QueryPerformanceFrequency(&freq);
+
+	std::vector<int> columns;
+	for (auto& name : query.Properties) {
+		auto col = store->FindColumn(name.c_str());
+		if (col < 0) {
+			SetDlgItemText(IDC_STATUS, (L"unknown property " + name).c_str());
+			return false;
+		}
+		columns.push_back(col);
+	}
+	if (columns.empty())
+		for (int col = 0; col < store->GetColumnCount(); col++)
+			if (!store->GetColumn(col).Name.starts_with(L"__"))
+				columns.push_back(col);
+
+	Clear();
+	auto cm = GetColumnManager(m_List);
+	for (auto col : columns) {
+		auto& name = store->GetColumn(col).Name;
+		cm->AddColumn(name.c_str(), LVCFMT_LEFT, 140, (int)m_Columns.size());
+		m_Columns.push_back(name);
+	}
+	m_Cells.reserve(rows.size() * columns.size());
+	for (auto row : rows) {
+		for (auto col : columns) {
+			m_Buffer.clear();
+			store->AppendText(row, col, m_Buffer);
+			m_Cells.push_back(m_Strings.Add(m_Buffer));
+		}
+	}
+	m_Rows = rows.size();
+	m_List.SetItemCountEx((int)m_Rows, LVSICF_NOSCROLL);
+	SetDlgItemText(IDC_STATUS, std::format(L"{} of {} loaded instances matched in {} usec (local)",
+		rows.size(), store->GetRowCount(), (end.QuadPart - start.QuadPart) * 1000000 / freq.QuadPart).c_str());
+	return true;
+}
+
+void CQueryDlg::StartQuery(std::wstring const& text) {
+	m_Query = text;
+	m_Planned = m_Filtering = false;
+	m_Select.clear();
+
+	//
+	// queries the local parser does not understand go to WMI as they are
+	//
+	auto server = text;
+	WqlQuery query;
+	if (WqlQuery::Parse(text, query)) {
+		m_Plan = m_Planner.Plan(m_Namespace.c_str(), query);
+		m_Planned = true;
+		if (m_Plan.HasResidual()) {
+			m_Filtering = BindResidual(query);
+			if (m_Filtering) {
+				server = m_Plan.ServerQuery;
+				m_Select = query.Properties;
+			}
+			else {
+				m_Planned = false;
+			}
+		}
+	}
+
+	m_Runner = QueryRunner::Create(m_hWnd, WM_QUERY_RESULTS, ++m_Cookie);
+	m_Runner->Start(m_Namespace.c_str(), server.c_str(), AppSettings::Get().QueryMaxRows());
+	GetDlgItem(IDC_STOP).EnableWindow();
+	SetDlgItemText(IDC_STATUS, L"Running...");
+}
+
+bool CQueryDlg::BindResidual(WqlQuery const& query) {
+	if (m_spSvc == nullptr && FAILED(ConnectionPool::Get().GetService(m_Namespace.c_str(), &m_spSvc)))
+		return false;
+
+	m_spSchema = SchemaCache::Get().GetClass(m_Namespace.c_str(), m_spSvc, query.ClassName.c_str());
+	if (m_spSchema == nullptr)
+		return false;
+
+	//
+	// a condition that cannot be evaluated here is left to the server as a whole
+	//
+	m_Page.Reset(*m_spSchema);
+	return m_Residual.Bind(m_Plan.Residual, m_Page);
+}
+
+void CQueryDlg::SetColumns(IWbemClassObject* pObj) {
+	std::vector<std::wstring> names;
+	if (m_Select.empty()) {
+		auto all = WMIHelper::GetNames(pObj, WBEM_FLAG_NONSYSTEM_ONLY);
+		if (all.empty())	// only system properties selected
+			all = WMIHelper::GetNames(pObj);
+		for (auto& name : all)
+			names.push_back(name.m_str);
+	}
+	else {
+		//
+		// the server was asked for more than was selected, for the local filter
+		//
+		names = m_Select;
+	}
+
+	auto cm = GetColumnManager(m_List);
+	cm->Clear();
+	m_PageColumns.clear();
+	for (auto& name : names) {
+		cm->AddColumn(name.c_str(), LVCFMT_LEFT, 140, (int)m_Columns.size());
+		m_PageColumns.push_back(m_Filtering ? m_Page.FindColumn(name.c_str()) : -1);
+		m_Columns.push_back(std::move(name));
+	}
+}
+
+void CQueryDlg::AddPage(std::vector<CComPtr<IWbemClassObject>> const& objects) {
+	if (objects.empty())
+		return;
+
+	if (m_Columns.empty())
+		SetColumns(objects[0]);
+
+	if (m_Filtering) {
+		m_Page.Reset(*m_spSchema);
+		for (auto& obj : objects)
+			m_Page.Append(obj);
+		m_Residual.Bind(m_Plan.Residual, m_Page);
+		auto rows = m_Residual.Run();
+		m_Cells.reserve(m_Cells.size() + rows.size() * m_Columns.size());
+		for (auto row : rows) {
+			for (auto col : m_PageColumns) {
+				m_Buffer.clear();
+				if (col >= 0)
+					m_Page.AppendText(row, col, m_Buffer);
+				m_Cells.push_back(m_Strings.Add(m_Buffer));
+			}
+		}
+		m_Rows += rows.size();
+		return;
+	}
+
+	//
+	// rows of derived classes may lack some of the columns; those stay empty
+	//
+	m_Cells.reserve(m_Cells.size() + objects.size() * m_Columns.size());
+	for (auto& obj : objects) {
+		for (auto& name : m_Columns) {
+			CComVariant value;
+			CIMTYPE type;
+			m_Buffer.clear();
+			if (SUCCEEDED(obj->Get(name.c_str(), 0, &value, &type, nullptr)))
+				CellText::AppendValue(m_Buffer, value, type);
+			m_Cells.push_back(m_Strings.Add(m_Buffer));
+		}
+	}
+	m_Rows += objects.size();
+}
+
+void CQueryDlg::UpdateStatus() {
+	if (m_Runner == nullptr)
+		return;
+
+	auto stats = m_Runner->GetStats();
+	std::wstring text;
+	if (FAILED(stats.Status))
+		text = std::format(L"Error 0x{:08X} after {} msec. ", (DWORD)stats.Status, stats.ElapsedMsec);
+	text += std::format(L"{} rows in {} msec", m_Rows, stats.ElapsedMsec);
+	if (stats.FirstRowMsec)
+		text += std::format(L", first row after {} msec, {:.0f} rows/sec", stats.FirstRowMsec,
+			stats.ElapsedMsec ? m_Rows * 1000.0 / stats.ElapsedMsec : 0.0);
+	if (stats.LimitReached)
+		text += L" (stopped at the row limit)";
+	if (m_Filtering)
+		text += std::format(L"; {} of {} rows passed the local filter ({})", m_Rows, stats.Rows,
+			QueryPlanner::FormatOperators(m_Plan.Kept));
+	if (m_Retries)
+		text += L"; the provider rejected the condition, now filtered locally";
+	text += std::format(L"; {} KB of text", (m_Strings.GetMemorySize() + m_Cells.capacity() * sizeof(DWORD)) >> 10);
+	SetDlgItemText(IDC_STATUS, text.c_str());
+}
+
+LRESULT CQueryDlg::OnInitDialog(UINT, WPARAM, LPARAM, BOOL&) {
+	SetDialogIcon(IDR_MAINFRAME);
+	DlgResize_Init(true, false);
+	SetNamespace(m_Namespace.c_str());
+
+	m_List.Attach(GetDlgItem(IDC_RESULTS));
+	m_List.SetExtendedListViewStyle(LVS_EX_FULLROWSELECT | LVS_EX_DOUBLEBUFFER);
+	SetDlgItemText(IDC_QUERY, L"SELECT * FROM Win32_Process");
+	GetDlgItem(IDC_STOP).EnableWindow(FALSE);
+	return TRUE;
+}
+
+LRESULT CQueryDlg::OnDestroy(UINT, WPARAM, LPARAM, BOOL&) {
+	Stop();
+	return 0;
+}
+
+LRESULT CQueryDlg::OnQueryResults(UINT, WPARAM cookie, LPARAM, BOOL&) {
+	if (cookie != m_Cookie || m_Runner == nullptr)
+		return 0;
+
+	std::vector<CComPtr<IWbemClassObject>> page;
+	while (m_Runner->TakePage(page))
+		AddPage(page);
+	m_List.SetItemCountEx((int)m_Rows, LVSICF_NOSCROLL | LVSICF_NOINVALIDATEALL);
+	UpdateStatus();
+	if (m_Runner->IsDone()) {
+		auto stats = m_Runner->GetStats();
+		//
+		// the runner dropped a broken connection from the pool; this copy goes too
+		//
+		if (ConnectionPool::IsBroken(stats.Status))
+			m_spSvc.Release();
+		if (m_Planned && m_Planner.Record(m_Plan, stats)) {
+			//
+			// nothing was returned, so running again with less pushed down loses nothing
+			//
+			m_Retries++;
+			Clear();
+			StartQuery(m_Query);
+			return 0;
+		}
+		m_Runner.reset();
+		GetDlgItem(IDC_STOP).EnableWindow(FALSE);
+	}
+	return 0;
+}
+
+LRESULT CQueryDlg::OnRun(WORD, WORD, HWND, BOOL&) {
+	CString query;
+	GetDlgItemText(IDC_QUERY, query);
+	query.Trim();
+	if (query.IsEmpty())
+		return 0;
+
+	Stop();
+	if (IsDlgButtonChecked(IDC_LOCAL)) {
+		RunLocal(query);
+		return 0;
+	}
+
+	Clear();
+	m_Retries = 0;
+	StartQuery((PCWSTR)query);
+	return 0;
+}
+
+LRESULT CQueryDlg::OnStop(WORD, WORD, HWND, BOOL&) {
+	UpdateStatus();
+	Stop();
+	return 0;
+}
+
+LRESULT CQueryDlg::OnCloseCmd(WORD, WORD, HWND, BOOL&) {
+	//
+	// modeless; hidden rather than destroyed so the results survive
+	//
+	ShowWindow(SW_HIDE);
+	return 0;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "resource.h"
+#include "DialogHelper.h"
+#include <VirtualListView.h>
+#include "QueryRunner.h"
+#include "InstanceStore.h"
+#include "WqlQuery.h"
+#include "QueryPlanner.h"
+#include <functional>
+
+class CQueryDlg :
+	public CDialogImpl<CQueryDlg>,
+	public CDialogResize<CQueryDlg>,
+	public CVirtualListView<CQueryDlg>,
+	public CDialogHelper<CQueryDlg> {
+public:
+	enum { IDD = IDD_QUERY };
+
+	const UINT WM_QUERY_RESULTS = WM_APP + 1;
+
+	//
+	// instances of the class already in memory, or null
+	//
+	using LocalSource = std::function<InstanceStore const*(PCWSTR className)>;
+
+	explicit CQueryDlg(LocalSource source);
+
+	//
+	// namespace the next query runs in
+	//
+	void SetNamespace(PCWSTR path);
+
+	CString GetColumnText(HWND, int row, int col) const;
+	PCWSTR GetExistingColumnText(HWND, int row, int col) const;
+
+	BEGIN_MSG_MAP(CQueryDlg)
+		MESSAGE_HANDLER(WM_INITDIALOG, OnInitDialog)
+		MESSAGE_HANDLER(WM_DESTROY, OnDestroy)
+		MESSAGE_HANDLER(WM_QUERY_RESULTS, OnQueryResults)
+		COMMAND_ID_HANDLER(IDOK, OnRun)
+		COMMAND_ID_HANDLER(IDC_STOP, OnStop)
+		COMMAND_ID_HANDLER(IDCANCEL, OnCloseCmd)
+		CHAIN_MSG_MAP(CVirtualListView<CQueryDlg>)
+		CHAIN_MSG_MAP(CDialogResize<CQueryDlg>)
+	END_MSG_MAP()
+
+	BEGIN_DLGRESIZE_MAP(CQueryDlg)
+		DLGRESIZE_CONTROL(IDC_QUERY, DLSZ_SIZE_X)
+		DLGRESIZE_CONTROL(IDC_LOCAL, DLSZ_SIZE_X)
+		DLGRESIZE_CONTROL(IDOK, DLSZ_MOVE_X)
+		DLGRESIZE_CONTROL(IDC_STOP, DLSZ_MOVE_X)
+		DLGRESIZE_CONTROL(IDC_RESULTS, DLSZ_SIZE_X | DLSZ_SIZE_Y)
+		DLGRESIZE_CONTROL(IDC_STATUS, DLSZ_SIZE_X | DLSZ_MOVE_Y)
+	END_DLGRESIZE_MAP()
+
+private:
+	void Stop();
+	void Clear();
+	bool RunLocal(PCWSTR text);
+	void StartQuery(std::wstring const& text);
+	bool BindResidual(WqlQuery const& query);
+	void AddPage(std::vector<CComPtr<IWbemClassObject>> const& objects);
+	void SetColumns(IWbemClassObject* pObj);
+	void UpdateStatus();
+
+	LRESULT OnInitDialog(UINT /*uMsg*/, WPARAM /*wParam*/, LPARAM /*lParam*/, BOOL& /*bHandled*/);
+	LRESULT OnDestroy(UINT /*uMsg*/, WPARAM /*wParam*/, LPARAM /*lParam*/, BOOL& /*bHandled*/);
+	LRESULT OnQueryResults(UINT /*uMsg*/, WPARAM cookie, LPARAM /*lParam*/, BOOL& /*bHandled*/);
+	LRESULT OnRun(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/);
+	LRESULT OnStop(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/);
+	LRESULT OnCloseCmd(WORD /*wNotifyCode*/, WORD wID, HWND /*hWndCtl*/, BOOL& /*bHandled*/);
+
+	LocalSource m_LocalSource;
+	CListViewCtrl m_List;
+	std::wstring m_Namespace{ L"ROOT\\CIMV2" };
+	std::shared_ptr<QueryRunner> m_Runner;
+	WPARAM m_Cookie{ 0 };
+	std::wstring m_Query;
+	//
+	// the part of the condition the provider is not trusted with is applied here,
+	// a page at a time, through a store laid out like the queried class
+	//
+	QueryPlanner m_Planner;
+	QueryPlan m_Plan;
+	bool m_Planned{ false };
+	bool m_Filtering{ false };
+	CComPtr<IWbemServices> m_spSvc;
+	std::shared_ptr<ClassSchema const> m_spSchema;
+	InstanceStore m_Page;
+	WqlFilter m_Residual;
+	std::vector<std::wstring> m_Select;	// columns asked for, empty for *
+	std::vector<int> m_PageColumns;		// store column of each result column, -1 if missing
+	ULONG m_Retries{ 0 };
+	//
+	// results are kept as interned text, row by row; the objects are released
+	// as soon as a page is decoded
+	//
+	std::vector<std::wstring> m_Columns;
+	std::vector<DWORD> m_Cells;
+	StringPool m_Strings;
+	std::wstring m_Buffer;
+	size_t m_Rows{ 0 };
+};
@@ -0,0 +1,231 @@
+#include "pch.h"
+#include "QueryPlanner.h"
+
+bool QueryPlan::HasResidual() const {
+	return Residual.Where >= 0;
+}
+
+QueryPlan QueryPlanner::Plan(PCWSTR nsPath, WqlQuery const& query) {
+	QueryPlan plan;
+	plan.Key = std::wstring(nsPath) + L'\\' + query.ClassName;
+	std::transform(plan.Key.begin(), plan.Key.end(), plan.Key.begin(), ::towlower);
+	plan.Residual = query;
+	plan.Residual.Where = -1;
+
+	auto& profile = m_Profiles[plan.Key];
+	auto avoid = GetRejected(profile) | profile.Withheld;
+	if (++profile.Plans % ReprobeInterval != 0)
+		avoid |= profile.Slow;
+
+	std::vector<int> terms, pushed, kept;
+	if (query.Where >= 0)
+		SplitAnd(query, query.Where, terms);
+	for (auto term : terms) {
+		auto ops = GetOperators(query, term);
+		if (ops & avoid) {
+			kept.push_back(term);
+			plan.Kept |= ops;
+		}
+		else {
+			pushed.push_back(term);
+			plan.Pushed |= ops;
+		}
+	}
+
+	//
+	// the residual reuses the parsed nodes, chained with new AND nodes
+	//
+	for (auto term : kept) {
+		if (plan.Residual.Where < 0) {
+			plan.Residual.Where = term;
+			continue;
+		}
+		plan.Residual.Nodes.push_back({ WqlOp::And, plan.Residual.Where, term });
+		plan.Residual.Where = (int)plan.Residual.Nodes.size() - 1;
+	}
+
+	WqlQuery server;
+	server.ClassName = query.ClassName;
+	server.Properties = query.Properties;
+	if (!server.Properties.empty())
+		for (auto term : kept)
+			AddProperties(query, term, server.Properties);
+	auto text = server.ToString();
+	for (auto term : pushed) {
+		text += term == pushed.front() ? L" WHERE " : L" AND ";
+		text += query.ToString(term);
+	}
+	plan.ServerQuery = std::move(text);
+	return plan;
+}
+
+bool QueryPlanner::Record(QueryPlan const& plan, QueryStats const& stats) {
+	auto& profile = m_Profiles[plan.Key];
+	if (plan.Pushed && stats.Rows == 0 && IsRejection(stats.Status)) {
+		//
+		// which operator was refused is not reported. The suspects are the operators pushed
+		// (while narrowing down, those still pushed: leaving the others out did not help);
+		// with one left it is to blame, otherwise the next try withholds another one
+		//
+		profile.Suspects = profile.Withheld ? profile.Suspects & plan.Pushed : plan.Pushed;
+		profile.Withheld = 0;
+		if (profile.Suspects == 0)
+			profile.Suspects = plan.Pushed;
+		if ((profile.Suspects & (profile.Suspects - 1)) == 0) {
+			Reject(profile, profile.Suspects);
+			profile.Suspects = 0;
+		}
+		else {
+			//
+			// LIKE before =, as providers are less likely to support the later operators
+			//
+			profile.Withheld = GetLastOperator(profile.Suspects);
+		}
+		return true;
+	}
+	if (profile.Withheld) {
+		//
+		// accepted without the withheld operator: the suspects kept local are to blame,
+		// normally just that one (more only if they share a term). Their terms were
+		// evaluated locally, so the rows are complete
+		//
+		auto culprits = profile.Suspects & plan.Kept;
+		profile.Suspects = profile.Withheld = 0;
+		if (SUCCEEDED(stats.Status)) {
+			Reject(profile, culprits);
+			return false;
+		}
+	}
+	if (FAILED(stats.Status) || stats.LimitReached)
+		return false;
+
+	if (plan.Pushed == 0) {
+		//
+		// a plain enumeration: the baseline pushed queries are measured against
+		//
+		profile.ScanMsec = profile.ScanMsec ? (profile.ScanMsec * 3 + stats.ElapsedMsec) / 4 : std::max<DWORD>(1, stats.ElapsedMsec);
+		return false;
+	}
+	if (profile.ScanMsec == 0)
+		return false;
+
+	auto slow = stats.ElapsedMsec > profile.ScanMsec * SlowFactor + SlowSlackMsec;
+	if (!slow) {
+		for (int op = 0; op < OpCount; op++) {
+			if (plan.Pushed & (1 << op)) {
+				profile.Strikes[op] = 0;
+				profile.Slow &= ~(1 << op);
+			}
+		}
+		return false;
+	}
+
+	//
+	// the blame is shared, but only one operator is demoted at a time: the one slow most
+	// often, and on a tie the later one in WqlOp (LIKE rather than =), which providers
+	// are less likely to index. The others get to prove themselves without it
+	//
+	int worst = -1;
+	for (int op = 0; op < OpCount; op++) {
+		if (plan.Pushed & (1 << op)) {
+			auto& strikes = profile.Strikes[op];
+			strikes = std::min<BYTE>(strikes + 1, SlowStrikes);
+			if (worst < 0 || strikes >= profile.Strikes[worst])
+				worst = op;
+		}
+	}
+	if (profile.Strikes[worst] >= SlowStrikes)
+		profile.Slow |= 1 << worst;
+	return false;
+}
+
+std::wstring QueryPlanner::GetKeptOperators(QueryPlan const& plan) const {
+	return FormatOperators(plan.Kept);
+}
+
+std::wstring QueryPlanner::FormatOperators(DWORD ops) {
+	std::wstring text;
+	for (int op = 0; op < OpCount; op++) {
+		if (ops & (1 << op)) {
+			if (!text.empty())
+				text += L", ";
+			text += WqlQuery::OpToText((WqlOp)op);
+		}
+	}
+	return text;
+}
+
+bool QueryPlanner::IsRejection(HRESULT hr) {
+	//
+	// only a provider saying it cannot do the query; anything else (a bad property name,
+	// a type mismatch, access denied) would fail without pushing down too
+	//
+	switch (hr) {
+		case WBEM_E_NOT_SUPPORTED:
+		case WBEM_E_INVALID_QUERY_TYPE:
+		case WBEM_E_PROVIDER_NOT_CAPABLE:
+			return true;
+	}
+	return false;
+}
+
+DWORD QueryPlanner::GetRejected(ClassProfile const& profile) {
+	auto now = ::GetTickCount64();
+	DWORD ops = 0;
+	for (int op = 0; op < OpCount; op++)
+		if (now < profile.RejectedUntil[op])
+			ops |= 1 << op;
+	return ops;
+}
+
+void QueryPlanner::Reject(ClassProfile& profile, DWORD ops) {
+	auto until = ::GetTickCount64() + RejectionMsec;
+	for (int op = 0; op < OpCount; op++)
+		if (ops & (1 << op))
+			profile.RejectedUntil[op] = until;
+}
+
+DWORD QueryPlanner::GetLastOperator(DWORD ops) {
+	for (int op = OpCount - 1; op >= 0; op--)
+		if (ops & (1 << op))
+			return 1 << op;
+	return 0;
+}
+
+DWORD QueryPlanner::GetOperators(WqlQuery const& query, int node) {
+	auto& n = query.Nodes[node];
+	switch (n.Op) {
+		case WqlOp::And:
+		case WqlOp::Or:
+			return GetOperators(query, n.Left) | GetOperators(query, n.Right);
+		case WqlOp::Not:
+			return GetOperators(query, n.Left);
+	}
+	return 1 << (int)n.Op;
+}
+
+void QueryPlanner::SplitAnd(WqlQuery const& query, int node, std::vector<int>& terms) {
+	auto& n = query.Nodes[node];
+	if (n.Op == WqlOp::And) {
+		SplitAnd(query, n.Left, terms);
+		SplitAnd(query, n.Right, terms);
+	}
+	else {
+		terms.push_back(node);
+	}
+}
+
+void QueryPlanner::AddProperties(WqlQuery const& query, int node, std::vector<std::wstring>& names) {
+	auto& n = query.Nodes[node];
+	switch (n.Op) {
+		case WqlOp::And:
+		case WqlOp::Or:
+			AddProperties(query, n.Right, names);
+			[[fallthrough]];
+		case WqlOp::Not:
+			AddProperties(query, n.Left, names);
+			return;
+	}
+	if (std::none_of(names.begin(), names.end(), [&](auto& name) { return ::_wcsicmp(name.c_str(), n.Property.c_str()) == 0; }))
+		names.push_back(n.Property);
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "WqlQuery.h"
+#include "QueryRunner.h"
+#include <unordered_map>
+
+//
+// a query split in two: the part the provider is asked to filter and the rest,
+// which is applied to the returned instances
+//
+struct QueryPlan {
+	std::wstring Key;			// namespace\class
+	std::wstring ServerQuery;
+	WqlQuery Residual;			// Where is -1 when the server does all the filtering
+	DWORD Pushed{ 0 };			// operators sent to the server, one bit per WqlOp
+	DWORD Kept{ 0 };			// operators left to the client
+
+	bool HasResidual() const;
+};
+
+//
+// decides per class which comparison operators go into the WHERE clause sent to WMI.
+// Top level AND terms are pushed unless they use an operator the provider rejected
+// or that made it slower than a plain enumeration of the class; those are evaluated
+// locally, and the select list grows by the properties they need.
+// Everything is pushed until the planner has learned otherwise. A rejection is pinned
+// on one operator by retrying without each suspect in turn, and is forgotten after a while
+//
+class QueryPlanner {
+public:
+	QueryPlan Plan(PCWSTR nsPath, WqlQuery const& query);
+
+	//
+	// learns from a finished run of the plan; returns true if the provider rejected
+	// the pushed condition, or a rejection is still being narrowed down, and the query
+	// should be planned and run again
+	//
+	bool Record(QueryPlan const& plan, QueryStats const& stats);
+
+	//
+	// operators that are evaluated locally for the class, e.g. "LIKE, <>"
+	//
+	std::wstring GetKeptOperators(QueryPlan const& plan) const;
+
+	static std::wstring FormatOperators(DWORD ops);
+
+private:
+	//
+	// a pushed query this much slower than enumerating the class counts against its operators
+	//
+	static const DWORD SlowFactor = 2;
+	static const DWORD SlowSlackMsec = 100;
+	static const BYTE SlowStrikes = 2;
+	//
+	// operators demoted for being slow are tried on the server again every so often,
+	// in case the slowness was the machine rather than the provider
+	//
+	static const ULONG ReprobeInterval = 16;
+	//
+	// a rejected operator is tried on the server again after this long (e.g. a provider update)
+	//
+	static const DWORD RejectionMsec = 10 * 60 * 1000;
+	static const int OpCount = (int)WqlOp::IsNotNull + 1;
+
+	struct ClassProfile {
+		ULONGLONG RejectedUntil[OpCount]{};	// tick count
+		DWORD Suspects{ 0 };		// operators of a rejected run, one of them to blame
+		DWORD Withheld{ 0 };		// the suspect kept local in the current try
+		DWORD Slow{ 0 };
+		BYTE Strikes[OpCount]{};
+		DWORD ScanMsec{ 0 };		// enumeration with nothing pushed, 0 until seen
+		ULONG Plans{ 0 };
+	};
+
+	static bool IsRejection(HRESULT hr);
+	static DWORD GetRejected(ClassProfile const& profile);
+	static void Reject(ClassProfile& profile, DWORD ops);
+	static DWORD GetLastOperator(DWORD ops);
+	static DWORD GetOperators(WqlQuery const& query, int node);
+	static void SplitAnd(WqlQuery const& query, int node, std::vector<int>& terms);
+	static void AddProperties(WqlQuery const& query, int node, std::vector<std::wstring>& names);
+
+	std::unordered_map<std::wstring, ClassProfile> m_Profiles;
+};
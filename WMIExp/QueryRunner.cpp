@@ -0,0 +1,120 @@
+#include "pch.h"
+#include "QueryRunner.h"
+#include "WMIHelper.h"
+#include "ConnectionPool.h"
+#include "BatchEnumerator.h"
+#include <thread>
+
+std::shared_ptr<QueryRunner> QueryRunner::Create(HWND hWnd, UINT msg, WPARAM cookie) {
+	return std::shared_ptr<QueryRunner>(new QueryRunner(hWnd, msg, cookie));
+}
+
+QueryRunner::QueryRunner(HWND hWnd, UINT msg, WPARAM cookie) : m_hWnd(hWnd), m_Msg(msg), m_Cookie(cookie) {
+}
+
+void QueryRunner::Start(PCWSTR nsPath, PCWSTR query, ULONG maxRows) {
+	m_Start = ::GetTickCount64();
+	std::thread([self = shared_from_this(), nsPath = std::wstring(nsPath), query = std::wstring(query), maxRows] {
+		self->Run(std::move(nsPath), std::move(query), maxRows);
+		}).detach();
+}
+
+void QueryRunner::Cancel() {
+	{
+		std::lock_guard lock(m_Lock);
+		m_Cancelled = true;
+		m_Pages.clear();
+	}
+	m_PageTaken.notify_all();
+}
+
+bool QueryRunner::TakePage(std::vector<CComPtr<IWbemClassObject>>& objects) {
+	{
+		std::lock_guard lock(m_Lock);
+		if (m_Pages.empty())
+			return false;
+
+		objects = std::move(m_Pages.front());
+		m_Pages.pop_front();
+	}
+	m_PageTaken.notify_all();
+	return true;
+}
+
+bool QueryRunner::IsDone() const {
+	std::lock_guard lock(m_Lock);
+	return m_Done && m_Pages.empty();
+}
+
+QueryStats QueryRunner::GetStats() const {
+	std::lock_guard lock(m_Lock);
+	auto stats = m_Stats;
+	if (!m_Done)
+		stats.ElapsedMsec = DWORD(::GetTickCount64() - m_Start);
+	return stats;
+}
+
+void QueryRunner::Run(std::wstring nsPath, std::wstring query, ULONG maxRows) {
+	::CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+	HRESULT hr;
+	{
+		CComPtr<IWbemServices> spSvc;
+		CComPtr<IEnumWbemClassObject> spEnum;
+		hr = ConnectionPool::Get().GetService(nsPath.c_str(), &spSvc);
+		if (SUCCEEDED(hr))
+			hr = spSvc->ExecQuery(CComBSTR(L"WQL"), CComBSTR(query.c_str()),
+				WBEM_FLAG_RETURN_IMMEDIATELY | WBEM_FLAG_FORWARD_ONLY, nullptr, &spEnum);
+		if (SUCCEEDED(hr)) {
+			BatchEnumerator enumerator(spEnum);
+			enumerator.SetCancelFlag(&m_Cancelled);
+			ULONG rows = 0;
+			std::vector<CComPtr<IWbemClassObject>> page;
+			while (enumerator.Next(page) > 0) {
+				auto limit = rows + page.size() >= maxRows;
+				if (limit)
+					page.resize(maxRows - rows);
+				rows += (ULONG)page.size();
+				if (!AddPage(page) || limit) {
+					std::lock_guard lock(m_Lock);
+					m_Stats.LimitReached = limit;
+					break;
+				}
+				page.clear();
+			}
+			if (FAILED(enumerator.GetLastStatus()))
+				hr = enumerator.GetLastStatus();
+		}
+		ConnectionPool::Get().CheckCall(nsPath.c_str(), hr);
+	}
+	Complete(hr);
+	::CoUninitialize();
+}
+
+bool QueryRunner::AddPage(std::vector<CComPtr<IWbemClassObject>>& objects) {
+	{
+		std::unique_lock lock(m_Lock);
+		m_PageTaken.wait(lock, [&] { return m_Cancelled || m_Pages.size() < MaxPendingPages; });
+		if (m_Cancelled)
+			return false;
+
+		if (m_Stats.Rows == 0)
+			m_Stats.FirstRowMsec = (DWORD)std::max(1ULL, ::GetTickCount64() - m_Start);
+		m_Stats.Rows += (ULONG)objects.size();
+		m_Pages.push_back(std::move(objects));
+	}
+	if (!::PostMessage(m_hWnd, m_Msg, m_Cookie, 0)) {
+		Cancel();
+		return false;
+	}
+	return true;
+}
+
+void QueryRunner::Complete(HRESULT hr) {
+	{
+		std::lock_guard lock(m_Lock);
+		m_Done = true;
+		m_Stats.Status = hr;
+		m_Stats.ElapsedMsec = DWORD(::GetTickCount64() - m_Start);
+	}
+	::PostMessage(m_hWnd, m_Msg, m_Cookie, 0);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+struct QueryStats {
+	ULONG Rows;
+	DWORD FirstRowMsec;		// time to first row, 0 until one arrived
+	DWORD ElapsedMsec;
+	HRESULT Status;
+	bool LimitReached;
+};
+
+//
+// runs a WQL query semi-synchronously (return immediately, forward only) on its own MTA thread
+// and hands the results over in pages. The thread stays at most a few pages ahead of the
+// consumer and forward only enumerators do not keep what was returned, so memory stays bounded.
+// The window is posted its message (WPARAM = cookie) when a page is ready and once more when done.
+// Cancel() is noticed within BatchEnumerator::SliceMsec even while the provider has nothing to return
+//
+class QueryRunner : public std::enable_shared_from_this<QueryRunner> {
+public:
+	static const size_t MaxPendingPages = 4;
+
+	static std::shared_ptr<QueryRunner> Create(HWND hWnd, UINT msg, WPARAM cookie);
+
+	void Start(PCWSTR nsPath, PCWSTR query, ULONG maxRows);
+	void Cancel();
+
+	//
+	// moves the oldest page to the vector, returns false if none is pending
+	//
+	bool TakePage(std::vector<CComPtr<IWbemClassObject>>& objects);
+	bool IsDone() const;
+	QueryStats GetStats() const;
+
+private:
+	QueryRunner(HWND hWnd, UINT msg, WPARAM cookie);
+	void Run(std::wstring nsPath, std::wstring query, ULONG maxRows);
+	bool AddPage(std::vector<CComPtr<IWbemClassObject>>& objects);
+	void Complete(HRESULT hr);
+
+	mutable std::mutex m_Lock;
+	std::condition_variable m_PageTaken;
+	std::deque<std::vector<CComPtr<IWbemClassObject>>> m_Pages;
+	QueryStats m_Stats{};
+	ULONGLONG m_Start{ 0 };
+	HWND m_hWnd;
+	UINT m_Msg;
+	WPARAM m_Cookie;
+	bool m_Done{ false };
+	std::atomic<bool> m_Cancelled{ false };	// also read by the enumerator without the lock
+};
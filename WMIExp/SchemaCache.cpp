@@ -0,0 +1,293 @@
+#include "pch.h"
+#include "SchemaCache.h"
+#include "WMIHelper.h"
+#include "BatchEnumerator.h"
+
+size_t ClassSchema::GetDescriptorSize() const {
+	auto size = sizeof(*this) + Name.capacity() * sizeof(WCHAR);
+	size += Properties.capacity() * sizeof(PropertyDesc);
+	for (auto& p : Properties) {
+		size += (p.Name.capacity() + p.Origin.capacity()) * sizeof(WCHAR);
+		if (p.Value.vt == VT_BSTR && p.Value.bstrVal)
+			size += ::SysStringByteLen(p.Value.bstrVal);
+	}
+	size += Methods.capacity() * sizeof(MethodDesc);
+	for (auto& m : Methods) {
+		size += (m.Name.capacity() + m.Origin.capacity() + m.ReturnType.capacity() + m.Signature.capacity()) * sizeof(WCHAR);
+		size += m.Parameters.capacity() * sizeof(ParameterDesc);
+		for (auto& p : m.Parameters)
+			size += (p.Name.capacity() + p.TypeName.capacity()) * sizeof(WCHAR);
+	}
+	return size;
+}
+
+SchemaCache& SchemaCache::Get() {
+	static SchemaCache cache;
+	return cache;
+}
+
+NamespaceSchema const* SchemaCache::GetNamespace(PCWSTR nsPath, IWbemServices* pSvc, HRESULT* hr) {
+	if (hr)
+		*hr = S_OK;
+	auto& ns = m_Namespaces[MakeKey(nsPath)];
+	if (ns.Enumerated) {
+		m_Hits++;
+		return &ns;
+	}
+
+	m_Misses++;
+	EnumStats stats;
+	auto classes = WMIHelper::EnumClasses(pSvc, true, true, &stats);
+	ATLTRACE(L"Enumerated %u classes in %s in %u calls (%.0f objects/sec)\n",
+		stats.Objects, nsPath, stats.Calls, stats.ObjectsPerSecond());
+	if (FAILED(stats.Status)) {
+		//
+		// a partial list would be cached as complete
+		//
+		if (hr)
+			*hr = stats.Status;
+		return &ns;
+	}
+
+	AddClasses(ns, classes);
+	return &ns;
+}
+
+void SchemaCache::SetNamespace(PCWSTR nsPath, std::vector<CComPtr<IWbemClassObject>> const& classes) {
+	auto& ns = m_Namespaces[MakeKey(nsPath)];
+	if (!ns.Enumerated)
+		AddClasses(ns, classes);
+}
+
+void SchemaCache::AddClasses(NamespaceSchema& ns, std::vector<CComPtr<IWbemClassObject>> const& classes) {
+	ns.Classes.reserve(classes.size());
+	for (auto& spClass : classes) {
+		auto name = MakeKey(WMIHelper::GetStringProperty(spClass, L"__CLASS"));
+		//
+		// keep a class already parsed by an earlier GetClass
+		//
+		auto& cls = ns.ClassesByName[name];
+		if (cls == nullptr)
+			cls = CreateClass(spClass);
+		ns.Classes.push_back(cls);
+	}
+	ns.Enumerated = true;
+}
+
+std::shared_ptr<ClassSchema const> SchemaCache::GetClass(PCWSTR nsPath, IWbemServices* pSvc, PCWSTR className) {
+	auto& ns = m_Namespaces[MakeKey(nsPath)];
+	auto& cls = ns.ClassesByName[MakeKey(className)];
+	if (cls && cls->Parsed) {
+		m_Hits++;
+		return cls;
+	}
+
+	m_Misses++;
+	if (cls == nullptr) {
+		CComPtr<IWbemClassObject> spClass;
+		if (FAILED(pSvc->GetObject(CComBSTR(className), 0, nullptr, &spClass, nullptr))) {
+			ns.ClassesByName.erase(MakeKey(className));
+			return nullptr;
+		}
+		cls = CreateClass(spClass);
+	}
+	ParseClass(*cls);
+	return cls;
+}
+
+void SchemaCache::InvalidateNamespace(PCWSTR nsPath) {
+	m_Namespaces.erase(MakeKey(nsPath));
+}
+
+void SchemaCache::InvalidateClasses(PCWSTR nsPath, std::vector<std::wstring> const& names, bool removed) {
+	auto it = m_Namespaces.find(MakeKey(nsPath));
+	if (it == m_Namespaces.end())
+		return;
+
+	auto& ns = it->second;
+	for (auto& name : names)
+		ns.ClassesByName.erase(MakeKey(name.c_str()));
+	if (removed)
+		std::erase_if(ns.Classes, [&](auto& cls) { return !ns.ClassesByName.contains(MakeKey(cls->Name.c_str())); });
+}
+
+void SchemaCache::UpdateClasses(PCWSTR nsPath, std::vector<std::wstring> const& names, std::vector<CComPtr<IWbemClassObject>> const& classes) {
+	auto it = m_Namespaces.find(MakeKey(nsPath));
+	if (it == m_Namespaces.end())
+		return;
+
+	auto& ns = it->second;
+	for (size_t i = 0; i < names.size() && i < classes.size(); i++) {
+		if (names[i].empty())
+			continue;
+		auto key = MakeKey(names[i].c_str());
+		auto pos = std::find_if(ns.Classes.begin(), ns.Classes.end(), [&](auto& cls) { return MakeKey(cls->Name.c_str()) == key; });
+		if (classes[i] == nullptr) {
+			ns.ClassesByName.erase(key);
+			if (pos != ns.Classes.end())
+				ns.Classes.erase(pos);
+			continue;
+		}
+		//
+		// a GetClass since the invalidation may have read it already
+		//
+		auto& cls = ns.ClassesByName[key];
+		if (cls == nullptr)
+			cls = CreateClass(classes[i]);
+		if (pos != ns.Classes.end())
+			*pos = cls;
+		else if (ns.Enumerated)
+			ns.Classes.push_back(cls);
+	}
+}
+
+void SchemaCache::Clear() {
+	m_Namespaces.clear();
+}
+
+SchemaCacheStats SchemaCache::GetStats() const {
+	SchemaCacheStats stats{};
+	stats.Namespaces = m_Namespaces.size();
+	stats.Hits = m_Hits;
+	stats.Misses = m_Misses;
+	for (auto& [name, ns] : m_Namespaces) {
+		stats.DescriptorBytes += name.capacity() * sizeof(WCHAR) + ns.Classes.capacity() * sizeof(ns.Classes[0]);
+		for (auto& [cname, cls] : ns.ClassesByName) {
+			stats.Classes++;
+			stats.DescriptorBytes += cname.capacity() * sizeof(WCHAR) + cls->GetDescriptorSize();
+			stats.ObjectBytes += cls->ObjectSize;
+			if (cls->Parsed)
+				stats.ParsedClasses++;
+		}
+	}
+	return stats;
+}
+
+std::wstring SchemaCache::MakeKey(PCWSTR name) {
+	std::wstring key(name);
+	::CharLowerBuff(key.data(), (DWORD)key.length());
+	return key;
+}
+
+std::shared_ptr<ClassSchema> SchemaCache::CreateClass(IWbemClassObject* pClass) {
+	auto cls = std::make_shared<ClassSchema>();
+	cls->Class = pClass;
+	cls->Name = WMIHelper::GetStringProperty(pClass, L"__CLASS");
+	cls->IsSystem = WMIHelper::GetStringProperty(pClass, L"__DYNASTY").CompareNoCase(L"__SystemClass") == 0;
+	cls->ObjectSize = WMIHelper::GetObjectSize(pClass);
+	return cls;
+}
+
+void SchemaCache::ParseClass(ClassSchema& cls) {
+	for (auto& prop : WMIHelper::EnumProperties(cls.Class)) {
+		PropertyDesc desc;
+		desc.Name = prop.Name;
+		desc.Type = prop.Type;
+		desc.Flavor = prop.Flavor;
+		desc.Value = std::move(prop.Value);
+		CComBSTR origin;
+		if (SUCCEEDED(cls.Class->GetPropertyOrigin(prop.Name, &origin)) && origin)
+			desc.Origin = origin;
+		//
+		// system properties have no qualifier set
+		//
+		CComPtr<IWbemQualifierSet> spQualifiers;
+		desc.IsKey = false;
+		desc.CounterType = 0;
+		if (SUCCEEDED(cls.Class->GetPropertyQualifierSet(prop.Name, &spQualifiers))) {
+			desc.IsKey = SUCCEEDED(spQualifiers->Get(L"key", 0, nullptr, nullptr));
+			CComVariant type;
+			if (SUCCEEDED(spQualifiers->Get(L"CounterType", 0, &type, nullptr)) && SUCCEEDED(type.ChangeType(VT_I4)))
+				desc.CounterType = type.lVal;
+		}
+		cls.Properties.push_back(std::move(desc));
+	}
+	for (auto& method : WMIHelper::EnumMethods(cls.Class)) {
+		MethodDesc desc;
+		desc.Name = std::move(method.Name);
+		desc.Origin = std::move(method.ClassName);
+		desc.spInParams = std::move(method.spInParams);
+		desc.spOutParams = std::move(method.spOutParams);
+		ParseMethod(desc);
+		cls.Methods.push_back(std::move(desc));
+	}
+	cls.Parsed = true;
+}
+
+void SchemaCache::ParseMethod(MethodDesc& method) {
+	//
+	// a parameter that is both in and out shows up in both objects
+	//
+	auto parse = [&](IWbemClassObject* pParams, bool in) {
+		if (pParams == nullptr)
+			return;
+
+		pParams->BeginEnumeration(WBEM_FLAG_NONSYSTEM_ONLY);
+		CComBSTR name;
+		CIMTYPE type;
+		while (S_OK == pParams->Next(0, &name, nullptr, &type, nullptr)) {
+			std::wstring typeName;
+			int id = -1;
+			bool optional = false;
+			CComPtr<IWbemQualifierSet> spQualifiers;
+			if (SUCCEEDED(pParams->GetPropertyQualifierSet(name, &spQualifiers))) {
+				CComVariant value;
+				if (SUCCEEDED(spQualifiers->Get(L"CIMTYPE", 0, &value, nullptr)) && value.vt == VT_BSTR)
+					typeName = value.bstrVal;
+				value.Clear();
+				if (SUCCEEDED(spQualifiers->Get(L"ID", 0, &value, nullptr)) && value.vt == VT_I4)
+					id = value.lVal;
+				value.Clear();
+				optional = SUCCEEDED(spQualifiers->Get(L"Optional", 0, &value, nullptr)) && value.vt == VT_BOOL && value.boolVal;
+			}
+			if (!in && ::_wcsicmp(name, L"ReturnValue") == 0) {
+				method.ReturnType = std::move(typeName);
+				name.Empty();
+				continue;
+			}
+
+			auto it = std::find_if(method.Parameters.begin(), method.Parameters.end(),
+				[&](auto& p) { return ::_wcsicmp(p.Name.c_str(), name) == 0; });
+			if (it != method.Parameters.end()) {
+				it->Out = true;
+			}
+			else {
+				ParameterDesc param;
+				param.Name = name.m_str;
+				param.TypeName = std::move(typeName);
+				param.Type = type;
+				param.Id = id;
+				param.In = in;
+				param.Out = !in;
+				param.Optional = optional;
+				method.Parameters.push_back(std::move(param));
+			}
+			name.Empty();
+		}
+		pParams->EndEnumeration();
+	};
+	parse(method.spInParams.get(), true);
+	parse(method.spOutParams.get(), false);
+
+	std::stable_sort(method.Parameters.begin(), method.Parameters.end(), [](auto& p1, auto& p2) { return p1.Id < p2.Id; });
+
+	auto& text = method.Signature;
+	text = method.ReturnType.empty() ? L"void" : method.ReturnType;
+	text += L' ';
+	text += method.Name;
+	text += L'(';
+	for (auto& p : method.Parameters) {
+		if (&p != &method.Parameters.front())
+			text += L", ";
+		text += p.In && p.Out ? L"[in, out" : p.In ? L"[in" : L"[out";
+		if (p.Optional)
+			text += L", optional";
+		text += L"] ";
+		text += p.TypeName;
+		if (p.Type & CIM_FLAG_ARRAY)
+			text += L"[]";
+		text += L' ';
+		text += p.Name;
+	}
+	text += L')';
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <unordered_map>
+
+struct PropertyDesc {
+	std::wstring Name;
+	std::wstring Origin;
+	CComVariant Value;
+	CIMTYPE Type;
+	long Flavor;
+	DWORD CounterType;		// the CounterType qualifier of performance counters, 0 if none
+	bool IsKey;
+};
+
+struct ParameterDesc {
+	std::wstring Name;
+	std::wstring TypeName;	// the CIMTYPE qualifier, e.g. uint32 or ref:Win32_Process
+	CIMTYPE Type;
+	int Id;					// position, from the ID qualifier
+	bool In, Out, Optional;
+};
+
+struct MethodDesc {
+	std::wstring Name;
+	std::wstring Origin;
+	wil::com_ptr<IWbemClassObject> spInParams, spOutParams;
+	std::vector<ParameterDesc> Parameters;	// in ID order, without the return value
+	std::wstring ReturnType;
+	std::wstring Signature;		// rendered once, e.g. uint32 Terminate([in] uint32 Reason)
+};
+
+struct ClassSchema {
+	std::wstring Name;
+	CComPtr<IWbemClassObject> Class;
+	std::vector<PropertyDesc> Properties;
+	std::vector<MethodDesc> Methods;
+	size_t ObjectSize{ 0 };
+	bool IsSystem{ false };
+	bool Parsed{ false };
+
+	size_t GetDescriptorSize() const;
+};
+
+struct NamespaceSchema {
+	std::vector<std::shared_ptr<ClassSchema>> Classes;
+	std::unordered_map<std::wstring, std::shared_ptr<ClassSchema>> ClassesByName;
+	bool Enumerated{ false };
+};
+
+struct SchemaCacheStats {
+	size_t Namespaces;
+	size_t Classes;
+	size_t ParsedClasses;
+	size_t DescriptorBytes;
+	size_t ObjectBytes;
+	ULONG Hits;
+	ULONG Misses;
+};
+
+//
+// class objects and their parsed descriptors, keyed by namespace path and class name.
+// Lookups are case insensitive, like WMI itself
+//
+class SchemaCache {
+public:
+	static SchemaCache& Get();
+
+	//
+	// all classes of the namespace (deep), including system classes. If the enumeration fails
+	// the namespace is returned without classes, is tried again next time, and hr gets the error
+	//
+	NamespaceSchema const* GetNamespace(PCWSTR nsPath, IWbemServices* pSvc, HRESULT* hr = nullptr);
+	//
+	// the complete class list of a namespace enumerated elsewhere (loading the tree),
+	// so GetNamespace does not enumerate it again. Ignored if the namespace is already enumerated
+	//
+	void SetNamespace(PCWSTR nsPath, std::vector<CComPtr<IWbemClassObject>> const& classes);
+
+	//
+	// class with its properties and methods parsed
+	//
+	std::shared_ptr<ClassSchema const> GetClass(PCWSTR nsPath, IWbemServices* pSvc, PCWSTR className);
+
+	void InvalidateNamespace(PCWSTR nsPath);
+	//
+	// drops the descriptors of changed classes (a class and its subclasses); other classes stay.
+	// removed: the classes no longer exist and leave the class list, otherwise they stay in it
+	// until UpdateClasses brings their new objects
+	//
+	void InvalidateClasses(PCWSTR nsPath, std::vector<std::wstring> const& names, bool removed);
+	//
+	// the class objects fetched again after InvalidateClasses, by name; null for a class that is gone,
+	// an empty name for one that could not be read
+	//
+	void UpdateClasses(PCWSTR nsPath, std::vector<std::wstring> const& names, std::vector<CComPtr<IWbemClassObject>> const& classes);
+	void Clear();
+
+	SchemaCacheStats GetStats() const;
+
+private:
+	static std::wstring MakeKey(PCWSTR name);
+	static std::shared_ptr<ClassSchema> CreateClass(IWbemClassObject* pClass);
+	static void AddClasses(NamespaceSchema& ns, std::vector<CComPtr<IWbemClassObject>> const& classes);
+	static void ParseClass(ClassSchema& cls);
+	static void ParseMethod(MethodDesc& method);
+
+	std::unordered_map<std::wstring, NamespaceSchema> m_Namespaces;
+	ULONG m_Hits{ 0 }, m_Misses{ 0 };
+};
@@ -0,0 +1,207 @@
+#include "pch.h"
+#include "SchemaSnapshot.h"
+#include "WMIHelper.h"
+#include "ConnectionPool.h"
+#include "BatchEnumerator.h"
+#include <ShlObj.h>
+#include <unordered_map>
+
+NamespaceContents NamespaceContents::Collect(IWbemServices* pSvc, PCWSTR path, bool probeChildren,
+	std::vector<CComPtr<IWbemClassObject>>* classes) {
+	NamespaceContents contents;
+	contents.Path = path;
+	EnumStats stats;
+	auto objects = WMIHelper::EnumClasses(pSvc, true, true, &stats);
+	for (auto& spClass : objects) {
+		Entry entry;
+		entry.Name = WMIHelper::GetStringProperty(spClass, L"__CLASS");
+		entry.Flag = WMIHelper::GetStringProperty(spClass, L"__DYNASTY").CompareNoCase(L"__SystemClass") == 0;
+		entry.SuperClass = WMIHelper::GetStringProperty(spClass, L"__SUPERCLASS");
+		contents.Classes.push_back(std::move(entry));
+	}
+	for (auto& spNs : WMIHelper::EnumNamespaces(pSvc)) {
+		Entry entry;
+		entry.Name = WMIHelper::GetStringProperty(spNs, L"NAME");
+		CComPtr<IWbemServices> spNamespace;
+		entry.Flag = probeChildren && SUCCEEDED(ConnectionPool::Get().GetService((contents.Path + L"\\" + entry.Name).c_str(), &spNamespace))
+			&& WMIHelper::IsChildNamespaceOrClass(spNamespace);
+		contents.Namespaces.push_back(std::move(entry));
+	}
+	if (classes && SUCCEEDED(stats.Status))
+		*classes = std::move(objects);
+	return contents;
+}
+
+std::wstring SchemaSnapshot::GetDefaultPath() {
+	wil::unique_cotaskmem_string folder;
+	if (FAILED(::SHGetKnownFolderPath(FOLDERID_LocalAppData, KF_FLAG_CREATE, nullptr, &folder)))
+		return L"";
+
+	std::wstring path(folder.get());
+	path += L"\\ScorpioSoftware";
+	::CreateDirectory(path.c_str(), nullptr);
+	path += L"\\WmiExp";
+	::CreateDirectory(path.c_str(), nullptr);
+	return path + L"\\Schema.snapshot";
+}
+
+bool SchemaSnapshot::Open(PCWSTR path) {
+	Close();
+	m_hFile.reset(::CreateFile(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, 0, nullptr));
+	if (!m_hFile)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!::GetFileSizeEx(m_hFile.get(), &size) || size.QuadPart < (LONGLONG)sizeof(Header) || size.HighPart) {
+		Close();
+		return false;
+	}
+
+	m_hMap.reset(::CreateFileMapping(m_hFile.get(), nullptr, PAGE_READONLY, 0, 0, nullptr));
+	if (m_hMap)
+		m_View.reset(static_cast<BYTE*>(::MapViewOfFile(m_hMap.get(), FILE_MAP_READ, 0, 0, 0)));
+	if (!m_View) {
+		Close();
+		return false;
+	}
+
+	auto header = reinterpret_cast<Header const*>(m_View.get());
+	auto expected = sizeof(Header) + (ULONGLONG)header->NamespaceCount * sizeof(NamespaceRecord)
+		+ (ULONGLONG)header->EntryCount * sizeof(EntryRecord) + (ULONGLONG)header->StringsSize * sizeof(WCHAR);
+	if (header->Magic != Magic || header->Version != Version || expected != (ULONGLONG)size.QuadPart) {
+		Close();
+		return false;
+	}
+
+	m_Namespaces = reinterpret_cast<NamespaceRecord const*>(header + 1);
+	m_Entries = reinterpret_cast<EntryRecord const*>(m_Namespaces + header->NamespaceCount);
+	m_Strings = reinterpret_cast<PCWSTR>(m_Entries + header->EntryCount);
+	//
+	// strings are read in place up to their terminator, so the table must end with one
+	//
+	if (header->StringsSize && m_Strings[header->StringsSize - 1] != L'\0') {
+		Close();
+		return false;
+	}
+	m_Header = header;
+	return true;
+}
+
+void SchemaSnapshot::Close() {
+	m_Header = nullptr;
+	m_Namespaces = nullptr;
+	m_Entries = nullptr;
+	m_Strings = nullptr;
+	m_View.reset();
+	m_hMap.reset();
+	m_hFile.reset();
+}
+
+bool SchemaSnapshot::IsOpen() const {
+	return m_Header != nullptr;
+}
+
+std::optional<NamespaceContents> SchemaSnapshot::Find(PCWSTR path) const {
+	if (!IsOpen())
+		return {};
+
+	for (DWORD i = 0; i < m_Header->NamespaceCount; i++) {
+		auto& rec = m_Namespaces[i];
+		if (rec.Path < m_Header->StringsSize && ::_wcsicmp(m_Strings + rec.Path, path) == 0)
+			return Decode(rec);
+	}
+	return {};
+}
+
+std::vector<NamespaceContents> SchemaSnapshot::GetAll() const {
+	std::vector<NamespaceContents> all;
+	if (IsOpen()) {
+		all.reserve(m_Header->NamespaceCount);
+		for (DWORD i = 0; i < m_Header->NamespaceCount; i++)
+			all.push_back(Decode(m_Namespaces[i]));
+	}
+	return all;
+}
+
+NamespaceContents SchemaSnapshot::Decode(NamespaceRecord const& rec) const {
+	NamespaceContents contents;
+	auto string = [&](DWORD offset) {
+		return offset < m_Header->StringsSize ? m_Strings + offset : L"";
+	};
+	contents.Path = string(rec.Path);
+	auto count = rec.ClassCount + rec.NamespaceCount;
+	if ((ULONGLONG)rec.FirstEntry + count > m_Header->EntryCount)
+		return contents;
+
+	contents.Classes.reserve(rec.ClassCount);
+	contents.Namespaces.reserve(rec.NamespaceCount);
+	for (DWORD i = 0; i < count; i++) {
+		auto& entry = m_Entries[rec.FirstEntry + i];
+		(i < rec.ClassCount ? contents.Classes : contents.Namespaces).push_back({ string(entry.Name), entry.Flags != 0, string(entry.SuperClass) });
+	}
+	return contents;
+}
+
+bool SchemaSnapshot::Save(PCWSTR path, std::vector<NamespaceContents> const& namespaces) {
+	std::vector<NamespaceRecord> records;
+	std::vector<EntryRecord> entries;
+	std::wstring strings;
+	records.reserve(namespaces.size());
+
+	//
+	// each distinct string is stored once: superclasses are classes listed in the same namespace,
+	// and class names like the __ system classes repeat in every namespace
+	//
+	std::unordered_map<std::wstring, DWORD> offsets;
+	auto addString = [&](std::wstring const& s) {
+		auto [it, inserted] = offsets.try_emplace(s, (DWORD)strings.size());
+		if (inserted)
+			strings.append(s.c_str(), s.size() + 1);
+		return it->second;
+	};
+
+	for (auto& ns : namespaces) {
+		NamespaceRecord rec;
+		rec.Path = addString(ns.Path);
+		rec.FirstEntry = (DWORD)entries.size();
+		rec.ClassCount = (DWORD)ns.Classes.size();
+		rec.NamespaceCount = (DWORD)ns.Namespaces.size();
+		for (auto& e : ns.Classes)
+			entries.push_back({ addString(e.Name), e.Flag ? 1UL : 0UL, addString(e.SuperClass) });
+		for (auto& e : ns.Namespaces)
+			entries.push_back({ addString(e.Name), e.Flag ? 1UL : 0UL, addString(e.SuperClass) });
+		records.push_back(rec);
+	}
+
+	Header header{};
+	header.Magic = Magic;
+	header.Version = Version;
+	header.NamespaceCount = (DWORD)records.size();
+	header.EntryCount = (DWORD)entries.size();
+	header.StringsSize = (DWORD)strings.size();
+
+	//
+	// write to a temporary file and swap it in, so a failed write never leaves a corrupt snapshot
+	//
+	std::wstring temp(path);
+	temp += L".tmp";
+	{
+		wil::unique_hfile hFile(::CreateFile(temp.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, 0, nullptr));
+		if (!hFile)
+			return false;
+
+		auto write = [&](void const* data, size_t size) {
+			DWORD bytes;
+			return size == 0 || (::WriteFile(hFile.get(), data, (DWORD)size, &bytes, nullptr) && bytes == size);
+		};
+		if (!write(&header, sizeof(header)) ||
+			!write(records.data(), records.size() * sizeof(NamespaceRecord)) ||
+			!write(entries.data(), entries.size() * sizeof(EntryRecord)) ||
+			!write(strings.data(), strings.size() * sizeof(WCHAR))) {
+			hFile.reset();
+			::DeleteFile(temp.c_str());
+			return false;
+		}
+	}
+	return ::MoveFileEx(temp.c_str(), path, MOVEFILE_REPLACE_EXISTING);
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <optional>
+
+//
+// the tree level of a namespace: its classes and child namespaces
+//
+struct NamespaceContents {
+	struct Entry {
+		std::wstring Name;
+		bool Flag;		// class: system class, namespace: has children
+		std::wstring SuperClass;		// classes only
+
+		bool operator==(Entry const&) const = default;
+	};
+	std::wstring Path;
+	std::vector<Entry> Classes;
+	std::vector<Entry> Namespaces;
+	HRESULT Error{ S_OK };		// the namespace could not be opened; Classes and Namespaces are empty
+
+	bool operator==(NamespaceContents const&) const = default;
+
+	//
+	// classes: receives the class objects when the enumeration completes, so the caller can cache them
+	//
+	static NamespaceContents Collect(IWbemServices* pSvc, PCWSTR path, bool probeChildren = true,
+		std::vector<CComPtr<IWbemClassObject>>* classes = nullptr);
+};
+
+//
+// compact on-disk copy of the namespace/class tree, memory mapped when loaded.
+// Layout: header, namespace records, entry records, string blob (UTF-16, NUL terminated,
+// each distinct string once; records refer to strings by offset)
+//
+class SchemaSnapshot {
+public:
+	SchemaSnapshot() = default;
+	SchemaSnapshot(SchemaSnapshot const&) = delete;
+	SchemaSnapshot& operator=(SchemaSnapshot const&) = delete;
+
+	static std::wstring GetDefaultPath();
+
+	bool Open(PCWSTR path);
+	void Close();
+	bool IsOpen() const;
+
+	std::optional<NamespaceContents> Find(PCWSTR path) const;
+	std::vector<NamespaceContents> GetAll() const;
+
+	static bool Save(PCWSTR path, std::vector<NamespaceContents> const& namespaces);
+
+private:
+	struct Header {
+		DWORD Magic;
+		DWORD Version;
+		DWORD NamespaceCount;
+		DWORD EntryCount;
+		DWORD StringsSize;		// in characters
+		DWORD Reserved;
+	};
+	struct NamespaceRecord {
+		DWORD Path;
+		DWORD FirstEntry;
+		DWORD ClassCount;
+		DWORD NamespaceCount;
+	};
+	struct EntryRecord {
+		DWORD Name;
+		DWORD Flags;
+		DWORD SuperClass;
+	};
+	static const DWORD Magic = 'SSXW';
+	static const DWORD Version = 2;
+
+	NamespaceContents Decode(NamespaceRecord const& rec) const;
+
+	wil::unique_hfile m_hFile;
+	wil::unique_handle m_hMap;
+	wil::unique_mapview_ptr<BYTE> m_View;
+	Header const* m_Header{ nullptr };
+	NamespaceRecord const* m_Namespaces{ nullptr };
+	EntryRecord const* m_Entries{ nullptr };
+	PCWSTR m_Strings{ nullptr };
+};
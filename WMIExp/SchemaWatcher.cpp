@@ -0,0 +1,88 @@
+#include "pch.h"
+#include "SchemaWatcher.h"
+#include "WMIHelper.h"
+
+HRESULT SchemaWatcher::Watch(PCWSTR nsPath) {
+	auto& watched = m_Namespaces[MakeKey(nsPath)];
+	if (watched)
+		return watched->Watcher.GetStatus();
+
+	watched = std::make_unique<Watched>();
+	watched->Path = nsPath;
+	//
+	// class events are raised by the repository itself, so no polling (WITHIN) is needed
+	//
+	auto hr = watched->Watcher.Start(nsPath, L"SELECT * FROM __ClassOperationEvent", RingCapacity);
+	if (FAILED(hr))
+		ATLTRACE(L"Class events of %s not available (0x%X)\n", nsPath, hr);
+	return hr;
+}
+
+bool SchemaWatcher::IsWatching(PCWSTR nsPath) const {
+	auto it = m_Namespaces.find(MakeKey(nsPath));
+	return it != m_Namespaces.end() && it->second->Watcher.IsRunning();
+}
+
+void SchemaWatcher::Stop() {
+	m_Namespaces.clear();
+}
+
+std::vector<NamespaceChanges> SchemaWatcher::Drain() {
+	std::vector<NamespaceChanges> result;
+	for (auto& [key, watched] : m_Namespaces) {
+		auto ring = watched->Watcher.GetRing();
+		if (ring == nullptr || ring->GetCount() == 0)
+			continue;
+
+		NamespaceChanges changes;
+		changes.Path = watched->Path;
+		EventRecord record;
+		while (ring->Pop(record)) {
+			wil::com_ptr<IWbemClassObject> spEvent;
+			spEvent.attach(record.Object);
+			ClassChange change;
+			if (Decode(spEvent.get(), change))
+				changes.Changes.push_back(std::move(change));
+		}
+		if (auto dropped = ring->GetDropped(); dropped != watched->Dropped) {
+			watched->Dropped = dropped;
+			changes.Overflowed = true;
+		}
+		if (!changes.Changes.empty() || changes.Overflowed)
+			result.push_back(std::move(changes));
+	}
+	return result;
+}
+
+std::wstring SchemaWatcher::MakeKey(PCWSTR path) {
+	std::wstring key(path);
+	::CharLowerBuff(key.data(), (DWORD)key.length());
+	return key;
+}
+
+bool SchemaWatcher::Decode(IWbemClassObject* pEvent, ClassChange& change) {
+	auto type = WMIHelper::GetStringProperty(pEvent, L"__CLASS");
+	if (type.CompareNoCase(L"__ClassCreationEvent") == 0)
+		change.Type = ClassChangeType::Created;
+	else if (type.CompareNoCase(L"__ClassModificationEvent") == 0)
+		change.Type = ClassChangeType::Modified;
+	else if (type.CompareNoCase(L"__ClassDeletionEvent") == 0)
+		change.Type = ClassChangeType::Deleted;
+	else
+		return false;
+
+	//
+	// TargetClass is the class as it is now (as it was, for a deletion)
+	//
+	CComVariant target;
+	if (FAILED(pEvent->Get(L"TargetClass", 0, &target, nullptr, nullptr)) || target.vt != VT_UNKNOWN)
+		return false;
+	CComQIPtr<IWbemClassObject> spClass(target.punkVal);
+	if (spClass == nullptr)
+		return false;
+
+	change.Name = WMIHelper::GetStringProperty(spClass, L"__CLASS");
+	change.SuperClass = WMIHelper::GetStringProperty(spClass, L"__SUPERCLASS");
+	change.IsSystem = WMIHelper::GetStringProperty(spClass, L"__DYNASTY").CompareNoCase(L"__SystemClass") == 0;
+	return !change.Name.empty();
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "EventWatcher.h"
+#include <unordered_map>
+
+enum class ClassChangeType {
+	Created, Modified, Deleted
+};
+
+struct ClassChange {
+	ClassChangeType Type;
+	std::wstring Name;
+	std::wstring SuperClass;	// after the change; empty for a root class
+	bool IsSystem;
+};
+
+struct NamespaceChanges {
+	std::wstring Path;
+	std::vector<ClassChange> Changes;	// in the order they were made
+	bool Overflowed{ false };			// events were lost, the namespace has to be read again
+};
+
+//
+// class operation events (__ClassCreationEvent, __ClassModificationEvent, __ClassDeletionEvent)
+// of the namespaces being watched, one subscription each. Installing a provider or compiling
+// a MOF shows up here, so cached schema can be dropped class by class instead of wholesale
+//
+class SchemaWatcher {
+public:
+	static const size_t RingCapacity = 1024;
+
+	//
+	// a namespace is subscribed to once; a failed subscription is not retried
+	//
+	HRESULT Watch(PCWSTR nsPath);
+	bool IsWatching(PCWSTR nsPath) const;
+	void Stop();
+
+	//
+	// what changed since the last call, by namespace
+	//
+	std::vector<NamespaceChanges> Drain();
+
+private:
+	struct Watched {
+		std::wstring Path;
+		EventWatcher Watcher;
+		ULONGLONG Dropped{ 0 };
+	};
+
+	static std::wstring MakeKey(PCWSTR path);
+	static bool Decode(IWbemClassObject* pEvent, ClassChange& change);
+
+	std::unordered_map<std::wstring, std::unique_ptr<Watched>> m_Namespaces;
+};
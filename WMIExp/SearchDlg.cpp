@@ -0,0 +1,104 @@
+#include "pch.h"
+#include "SearchDlg.h"
+#include <SortHelper.h>
+
+CSearchDlg::CSearchDlg(SearchIndex const& index, NavigateCallback navigate) : m_Index(index), m_Navigate(std::move(navigate)) {
+}
+
+void CSearchDlg::Refresh() {
+	CString text;
+	GetDlgItemText(IDC_SEARCHTEXT, text);
+	m_Hits.clear();
+	LARGE_INTEGER start, end, freq;
+	::QueryPerformanceCounter(&start);
+	if (!text.IsEmpty())
+		m_Hits = m_Index.Search(text);
+	::QueryPerformanceCounter(&end);
+	::QueryPerformanceFrequency(&freq);
+
+	Sort(m_List);
+	m_List.SetItemCountEx((int)m_Hits.size(), LVSICF_NOSCROLL);
+	m_List.RedrawItems(m_List.GetTopIndex(), m_List.GetTopIndex() + m_List.GetCountPerPage());
+
+	SetDlgItemText(IDC_STATUS, std::format(L"{} matches in {:.2f} msec ({} names in {} namespaces indexed)",
+		m_Hits.size(), (end.QuadPart - start.QuadPart) * 1000.0 / freq.QuadPart,
+		m_Index.GetEntryCount(), m_Index.GetNamespaceCount()).c_str());
+}
+
+CString CSearchDlg::GetColumnText(HWND h, int row, int col) const {
+	auto& hit = m_Hits[row];
+	switch (GetColumnManager(h)->GetColumnTag<ColumnType>(col)) {
+		case ColumnType::Name: return hit.Name.c_str();
+		case ColumnType::Kind: return KindToText(hit.Kind);
+		case ColumnType::Class: return hit.Class.c_str();
+		case ColumnType::Namespace: return hit.Namespace.c_str();
+	}
+	return L"";
+}
+
+void CSearchDlg::DoSort(const SortInfo* si) {
+	auto column = GetColumnManager(si->hWnd)->GetColumnTag<ColumnType>(si->SortColumn);
+	auto sort = [&](auto const& h1, auto const& h2) {
+		switch (column) {
+			case ColumnType::Name: return SortHelper::Sort(h1.Name, h2.Name, si->SortAscending);
+			case ColumnType::Kind: return SortHelper::Sort(h1.Kind, h2.Kind, si->SortAscending);
+			case ColumnType::Class: return SortHelper::Sort(h1.Class, h2.Class, si->SortAscending);
+			case ColumnType::Namespace: return SortHelper::Sort(h1.Namespace, h2.Namespace, si->SortAscending);
+		}
+		return false;
+		};
+	std::stable_sort(m_Hits.begin(), m_Hits.end(), sort);
+}
+
+bool CSearchDlg::OnDoubleClickList(HWND, int row, int, POINT const&) {
+	if (row < 0)
+		return false;
+
+	m_Navigate(m_Hits[row]);
+	return true;
+}
+
+PCWSTR CSearchDlg::KindToText(SearchKind kind) {
+	switch (kind) {
+		case SearchKind::Class: return L"Class";
+		case SearchKind::Property: return L"Property";
+		case SearchKind::Method: return L"Method";
+		case SearchKind::Description: return L"Description";
+	}
+	return L"";
+}
+
+LRESULT CSearchDlg::OnInitDialog(UINT, WPARAM, LPARAM, BOOL&) {
+	SetDialogIcon(IDR_MAINFRAME);
+	DlgResize_Init(true, false);
+
+	m_List.Attach(GetDlgItem(IDC_RESULTS));
+	m_List.SetExtendedListViewStyle(LVS_EX_FULLROWSELECT | LVS_EX_DOUBLEBUFFER);
+	auto cm = GetColumnManager(m_List);
+	cm->AddColumn(L"Name", LVCFMT_LEFT, 200, ColumnType::Name);
+	cm->AddColumn(L"Kind", LVCFMT_LEFT, 80, ColumnType::Kind);
+	cm->AddColumn(L"Class", LVCFMT_LEFT, 220, ColumnType::Class);
+	cm->AddColumn(L"Namespace", LVCFMT_LEFT, 180, ColumnType::Namespace);
+
+	Refresh();
+	return TRUE;
+}
+
+LRESULT CSearchDlg::OnSearchTextChanged(WORD, WORD, HWND, BOOL&) {
+	Refresh();
+	return 0;
+}
+
+LRESULT CSearchDlg::OnGoTo(WORD, WORD, HWND, BOOL&) {
+	if (auto index = m_List.GetSelectedIndex(); index >= 0)
+		m_Navigate(m_Hits[index]);
+	return 0;
+}
+
+LRESULT CSearchDlg::OnCloseCmd(WORD, WORD, HWND, BOOL&) {
+	//
+	// modeless; hidden rather than destroyed so the query survives
+	//
+	ShowWindow(SW_HIDE);
+	return 0;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "resource.h"
+#include "DialogHelper.h"
+#include <VirtualListView.h>
+#include <functional>
+#include "SearchIndex.h"
+
+class CSearchDlg :
+	public CDialogImpl<CSearchDlg>,
+	public CDialogResize<CSearchDlg>,
+	public CVirtualListView<CSearchDlg>,
+	public CDialogHelper<CSearchDlg> {
+public:
+	enum { IDD = IDD_SEARCH };
+
+	using NavigateCallback = std::function<void(SearchHit const&)>;
+
+	CSearchDlg(SearchIndex const& index, NavigateCallback navigate);
+
+	//
+	// runs the current query again, e.g. after the index has grown
+	//
+	void Refresh();
+
+	CString GetColumnText(HWND, int row, int col) const;
+	void DoSort(const SortInfo* si);
+	bool OnDoubleClickList(HWND, int row, int col, POINT const& pt);
+
+	BEGIN_MSG_MAP(CSearchDlg)
+		MESSAGE_HANDLER(WM_INITDIALOG, OnInitDialog)
+		COMMAND_HANDLER(IDC_SEARCHTEXT, EN_CHANGE, OnSearchTextChanged)
+		COMMAND_ID_HANDLER(IDOK, OnGoTo)
+		COMMAND_ID_HANDLER(IDCANCEL, OnCloseCmd)
+		CHAIN_MSG_MAP(CVirtualListView<CSearchDlg>)
+		CHAIN_MSG_MAP(CDialogResize<CSearchDlg>)
+	END_MSG_MAP()
+
+	BEGIN_DLGRESIZE_MAP(CSearchDlg)
+		DLGRESIZE_CONTROL(IDC_SEARCHTEXT, DLSZ_SIZE_X)
+		DLGRESIZE_CONTROL(IDC_RESULTS, DLSZ_SIZE_X | DLSZ_SIZE_Y)
+		DLGRESIZE_CONTROL(IDC_STATUS, DLSZ_SIZE_X | DLSZ_MOVE_Y)
+	END_DLGRESIZE_MAP()
+
+private:
+	enum class ColumnType {
+		Name, Kind, Class, Namespace
+	};
+
+	static PCWSTR KindToText(SearchKind kind);
+
+	LRESULT OnInitDialog(UINT /*uMsg*/, WPARAM /*wParam*/, LPARAM /*lParam*/, BOOL& /*bHandled*/);
+	LRESULT OnSearchTextChanged(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/);
+	LRESULT OnGoTo(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/);
+	LRESULT OnCloseCmd(WORD /*wNotifyCode*/, WORD wID, HWND /*hWndCtl*/, BOOL& /*bHandled*/);
+
+	SearchIndex const& m_Index;
+	NavigateCallback m_Navigate;
+	CListViewCtrl m_List;
+	std::vector<SearchHit> m_Hits;
+};
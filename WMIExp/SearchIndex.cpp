@@ -0,0 +1,168 @@
+#include "pch.h"
+#include "SearchIndex.h"
+#include "NamespaceCrawler.h"
+
+void SearchIndex::Add(CatalogNamespace const& ns) {
+	auto lock = m_Lock.lock_exclusive();
+	auto nsIndex = (DWORD)m_Namespaces.size();
+	m_Namespaces.push_back(ns.Path);
+	for (auto& cls : ns.Classes) {
+		auto clsTerm = AddTerm(cls.Name);
+		AddEntry(SearchKind::Class, clsTerm, clsTerm, nsIndex);
+		for (auto& name : cls.Properties)
+			AddEntry(SearchKind::Property, AddTerm(name), clsTerm, nsIndex);
+		for (auto& name : cls.Methods)
+			AddEntry(SearchKind::Method, AddTerm(name), clsTerm, nsIndex);
+		if (!cls.Description.empty())
+			AddEntry(SearchKind::Description, AddTerm(cls.Description), clsTerm, nsIndex);
+	}
+}
+
+void SearchIndex::Clear() {
+	auto lock = m_Lock.lock_exclusive();
+	m_Terms.clear();
+	m_Keys.clear();
+	m_TermIndex.clear();
+	m_TermEntries.clear();
+	m_Trigrams.clear();
+	m_Bigrams.clear();
+	m_Entries.clear();
+	m_Namespaces.clear();
+}
+
+std::vector<SearchHit> SearchIndex::Search(PCWSTR text, size_t maxResults) const {
+	std::vector<SearchHit> hits;
+	auto key = MakeKey(text);
+	if (key.empty())
+		return hits;
+
+	auto lock = m_Lock.lock_shared();
+	auto terms = FindTerms(key);
+
+	//
+	// exact matches first, then prefixes, then the rest
+	//
+	auto prefixes = std::stable_partition(terms.begin(), terms.end(), [&](auto term) {
+		return m_Keys[term].length() == key.length();
+		});
+	std::stable_partition(prefixes, terms.end(), [&](auto term) {
+		return m_Keys[term].starts_with(key);
+		});
+
+	for (auto term : terms) {
+		for (auto index : m_TermEntries[term]) {
+			if (hits.size() >= maxResults)
+				return hits;
+			auto& entry = m_Entries[index];
+			hits.push_back({ entry.Kind, m_Namespaces[entry.Namespace], m_Terms[entry.Class], m_Terms[entry.Term] });
+		}
+	}
+	return hits;
+}
+
+size_t SearchIndex::GetEntryCount() const {
+	auto lock = m_Lock.lock_shared();
+	return m_Entries.size();
+}
+
+size_t SearchIndex::GetTermCount() const {
+	auto lock = m_Lock.lock_shared();
+	return m_Terms.size();
+}
+
+size_t SearchIndex::GetNamespaceCount() const {
+	auto lock = m_Lock.lock_shared();
+	return m_Namespaces.size();
+}
+
+DWORD SearchIndex::AddTerm(std::wstring const& name) {
+	auto [it, inserted] = m_TermIndex.try_emplace(MakeKey(name), (DWORD)m_Terms.size());
+	auto id = it->second;
+	if (!inserted)
+		return id;
+
+	auto& key = it->first;
+	m_Terms.push_back(name);
+	m_Keys.push_back(key);
+	m_TermEntries.emplace_back();
+	//
+	// terms only get added with increasing ids, so the posting lists stay sorted.
+	// Bigrams serve two letter queries, which have no trigram
+	//
+	auto post = [&](auto& lists, ULONGLONG gram) {
+		auto& terms = lists[gram];
+		if (terms.empty() || terms.back() != id)
+			terms.push_back(id);
+	};
+	for (size_t i = 0; i + 3 <= key.length(); i++)
+		post(m_Trigrams, MakeTrigram(key.c_str() + i));
+	for (size_t i = 0; i + 2 <= key.length(); i++)
+		post(m_Bigrams, MakeBigram(key.c_str() + i));
+	return id;
+}
+
+void SearchIndex::AddEntry(SearchKind kind, DWORD term, DWORD cls, DWORD ns) {
+	m_TermEntries[term].push_back((DWORD)m_Entries.size());
+	m_Entries.push_back({ term, cls, ns, kind });
+}
+
+std::vector<DWORD> SearchIndex::FindTerms(std::wstring const& key) const {
+	std::vector<DWORD> terms;
+	if (key.length() == 1) {
+		//
+		// too short for any gram, scan the (distinct) terms
+		//
+		for (DWORD i = 0; i < (DWORD)m_Keys.size(); i++)
+			if (m_Keys[i].find(key[0]) != std::wstring::npos)
+				terms.push_back(i);
+		return terms;
+	}
+	if (key.length() == 2) {
+		if (auto it = m_Bigrams.find(MakeBigram(key.c_str())); it != m_Bigrams.end())
+			terms = it->second;
+		return terms;
+	}
+
+	std::vector<std::vector<DWORD> const*> lists;
+	for (size_t i = 0; i + 3 <= key.length(); i++) {
+		auto it = m_Trigrams.find(MakeTrigram(key.c_str() + i));
+		if (it == m_Trigrams.end())
+			return terms;
+		lists.push_back(&it->second);
+	}
+
+	//
+	// intersect starting with the shortest list and probe the longer ones by binary search,
+	// so the work is bounded by the rarest trigram rather than the most common one
+	//
+	std::sort(lists.begin(), lists.end(), [](auto l1, auto l2) { return l1->size() < l2->size(); });
+	terms = *lists[0];
+	for (size_t i = 1; i < lists.size() && !terms.empty(); i++) {
+		auto& list = *lists[i];
+		auto pos = list.begin();
+		std::erase_if(terms, [&](auto term) {
+			pos = std::lower_bound(pos, list.end(), term);
+			return pos == list.end() || *pos != term;
+			});
+	}
+
+	//
+	// the trigrams being present does not mean they appear in sequence
+	//
+	std::erase_if(terms, [&](auto term) { return m_Keys[term].find(key) == std::wstring::npos; });
+	return terms;
+}
+
+std::wstring SearchIndex::MakeKey(std::wstring_view text) {
+	std::wstring key(text);
+	::CharLowerBuff(key.data(), (DWORD)key.length());
+	return key;
+}
+
+ULONGLONG SearchIndex::MakeBigram(PCWSTR p) {
+	return ((ULONGLONG)p[0] << 16) | p[1];
+}
+
+ULONGLONG SearchIndex::MakeTrigram(PCWSTR p) {
+	return ((ULONGLONG)p[0] << 32) | ((ULONGLONG)p[1] << 16) | p[2];
+}
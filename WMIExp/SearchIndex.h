@@ -0,0 +1,59 @@
+#pragma once
+
+#include <unordered_map>
+
+struct CatalogNamespace;
+
+enum class SearchKind : BYTE {
+	Class, Property, Method, Description
+};
+
+struct SearchHit {
+	SearchKind Kind;
+	std::wstring Namespace;
+	std::wstring Class;
+	std::wstring Name;		// the text that matched
+};
+
+//
+// case insensitive substring search over the names in the repository catalog.
+// Distinct names (terms) are indexed by their trigrams (and bigrams); a query intersects the posting
+// lists of its own trigrams and verifies the few remaining candidates.
+// Namespaces can be added while searches run on other threads
+//
+class SearchIndex {
+public:
+	void Add(CatalogNamespace const& ns);
+	void Clear();
+
+	std::vector<SearchHit> Search(PCWSTR text, size_t maxResults = 1000) const;
+
+	size_t GetEntryCount() const;
+	size_t GetTermCount() const;
+	size_t GetNamespaceCount() const;
+
+private:
+	struct Entry {
+		DWORD Term;
+		DWORD Class;		// term of the class name
+		DWORD Namespace;
+		SearchKind Kind;
+	};
+
+	DWORD AddTerm(std::wstring const& name);
+	void AddEntry(SearchKind kind, DWORD term, DWORD cls, DWORD ns);
+	std::vector<DWORD> FindTerms(std::wstring const& key) const;
+	static std::wstring MakeKey(std::wstring_view text);
+	static ULONGLONG MakeBigram(PCWSTR p);
+	static ULONGLONG MakeTrigram(PCWSTR p);
+
+	mutable wil::srwlock m_Lock;
+	std::vector<std::wstring> m_Terms;		// as first seen
+	std::vector<std::wstring> m_Keys;		// lower case
+	std::unordered_map<std::wstring, DWORD> m_TermIndex;
+	std::vector<std::vector<DWORD>> m_TermEntries;
+	std::unordered_map<ULONGLONG, std::vector<DWORD>> m_Trigrams;	// trigram to sorted term list
+	std::unordered_map<ULONGLONG, std::vector<DWORD>> m_Bigrams;
+	std::vector<Entry> m_Entries;
+	std::vector<std::wstring> m_Namespaces;
+};
@@ -0,0 +1,231 @@
+#include "Utf8Text.h"
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstring>
+#include <cwchar>
+
+//
+// the vector path reads 8 UTF-16 units at a time, so it needs a 16-bit wchar_t
+//
+#if (defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)) && WCHAR_MAX == 0xffff
+#include <emmintrin.h>
+#define UTF8_SSE2
+#endif
+
+namespace {
+	enum class Escape {
+		None,
+		Csv,		// inside quotes: quotes doubled
+		Json		// quotes, backslashes and control characters
+	};
+
+	bool IsHighSurrogate(wchar_t ch) {
+		return ch >= 0xd800 && ch <= 0xdbff;
+	}
+
+	bool IsLowSurrogate(wchar_t ch) {
+		return ch >= 0xdc00 && ch <= 0xdfff;
+	}
+
+	//
+	// one character (or surrogate pair); the worst case is a control character in JSON, 6 bytes
+	//
+	template<Escape escape>
+	char* ConvertChar(char* dst, wchar_t const*& p, wchar_t const* end) {
+		auto ch = *p++;
+		if (ch < 0x80) {
+			if constexpr (escape == Escape::Csv) {
+				if (ch == L'"')
+					*dst++ = '"';
+			}
+			else if constexpr (escape == Escape::Json) {
+				if (ch == L'"' || ch == L'\\') {
+					*dst++ = '\\';
+				}
+				else if (ch < 0x20) {
+					static const char hex[] = "0123456789abcdef";
+					*dst++ = '\\';
+					switch (ch) {
+						case L'\b': *dst++ = 'b'; break;
+						case L'\f': *dst++ = 'f'; break;
+						case L'\n': *dst++ = 'n'; break;
+						case L'\r': *dst++ = 'r'; break;
+						case L'\t': *dst++ = 't'; break;
+						default:
+							*dst++ = 'u';
+							*dst++ = '0';
+							*dst++ = '0';
+							*dst++ = hex[ch >> 4];
+							*dst++ = hex[ch & 15];
+							break;
+					}
+					return dst;
+				}
+			}
+			*dst++ = (char)ch;
+			return dst;
+		}
+		if (ch < 0x800) {
+			*dst++ = char(0xc0 | (ch >> 6));
+			*dst++ = char(0x80 | (ch & 0x3f));
+			return dst;
+		}
+		if (IsHighSurrogate(ch) && p < end && IsLowSurrogate(*p)) {
+			auto cp = 0x10000 + ((ch - 0xd800) << 10) + (*p++ - 0xdc00);
+			*dst++ = char(0xf0 | (cp >> 18));
+			*dst++ = char(0x80 | ((cp >> 12) & 0x3f));
+			*dst++ = char(0x80 | ((cp >> 6) & 0x3f));
+			*dst++ = char(0x80 | (cp & 0x3f));
+			return dst;
+		}
+		if constexpr (sizeof(wchar_t) > 2) {
+			//
+			// a 32-bit wchar_t holds a whole code point
+			//
+			if (ch > 0x10ffff)
+				ch = 0xfffd;
+			else if (ch > 0xffff) {
+				*dst++ = char(0xf0 | (ch >> 18));
+				*dst++ = char(0x80 | ((ch >> 12) & 0x3f));
+				*dst++ = char(0x80 | ((ch >> 6) & 0x3f));
+				*dst++ = char(0x80 | (ch & 0x3f));
+				return dst;
+			}
+		}
+		if (IsHighSurrogate(ch) || IsLowSurrogate(ch))
+			ch = 0xfffd;
+		*dst++ = char(0xe0 | (ch >> 12));
+		*dst++ = char(0x80 | ((ch >> 6) & 0x3f));
+		*dst++ = char(0x80 | (ch & 0x3f));
+		return dst;
+	}
+
+	//
+	// the destination must have room for 6 bytes per character plus 8
+	//
+	template<Escape escape>
+	char* Convert(char* dst, wchar_t const* p, wchar_t const* end) {
+#ifdef UTF8_SSE2
+		auto const high = _mm_set1_epi16((short)0xff80);
+		auto const quote = _mm_set1_epi16(L'"');
+		auto const backslash = _mm_set1_epi16(L'\\');
+		auto const control = _mm_set1_epi16(0x1f);
+		auto const zero = _mm_setzero_si128();
+		while (end - p >= 8) {
+			auto chars = _mm_loadu_si128((__m128i const*)p);
+			auto plain = _mm_cmpeq_epi16(_mm_and_si128(chars, high), zero);
+			if constexpr (escape != Escape::None)
+				plain = _mm_andnot_si128(_mm_cmpeq_epi16(chars, quote), plain);
+			if constexpr (escape == Escape::Json)
+				plain = _mm_and_si128(_mm_andnot_si128(_mm_cmpeq_epi16(chars, backslash), plain), _mm_cmpgt_epi16(chars, control));
+
+			//
+			// all 8 narrowed bytes are stored; only the plain ones before the first special
+			// character are kept, the rest is overwritten
+			//
+			_mm_storel_epi64((__m128i*)dst, _mm_packus_epi16(chars, chars));
+			auto mask = (unsigned)_mm_movemask_epi8(plain);
+			if (mask == 0xffff) {
+				dst += 8;
+				p += 8;
+				continue;
+			}
+			auto index = std::countr_zero(~mask);
+			dst += index / 2;
+			p += index / 2;
+			dst = ConvertChar<escape>(dst, p, end);
+		}
+#endif
+		while (p < end)
+			dst = ConvertChar<escape>(dst, p, end);
+		return dst;
+	}
+
+	template<Escape escape>
+	void AppendConverted(Utf8Buffer& out, std::wstring_view text) {
+		auto dst = out.Reserve(text.size() * 6 + 8);
+		out.Commit(Convert<escape>(dst, text.data(), text.data() + text.size()));
+	}
+
+	bool NeedsQuotes(std::wstring_view text) {
+		auto p = text.data(), end = p + text.size();
+#ifdef UTF8_SSE2
+		auto const comma = _mm_set1_epi16(L',');
+		auto const quote = _mm_set1_epi16(L'"');
+		auto const cr = _mm_set1_epi16(L'\r');
+		auto const lf = _mm_set1_epi16(L'\n');
+		for (; end - p >= 8; p += 8) {
+			auto chars = _mm_loadu_si128((__m128i const*)p);
+			auto hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi16(chars, comma), _mm_cmpeq_epi16(chars, quote)),
+				_mm_or_si128(_mm_cmpeq_epi16(chars, cr), _mm_cmpeq_epi16(chars, lf)));
+			if (_mm_movemask_epi8(hits))
+				return true;
+		}
+#endif
+		for (; p < end; p++)
+			if (*p == L',' || *p == L'"' || *p == L'\r' || *p == L'\n')
+				return true;
+		return false;
+	}
+}
+
+char* Utf8Buffer::Reserve(size_t count) {
+	if (m_Capacity - m_Size < count) {
+		auto capacity = std::max({ m_Capacity * 2, m_Size + count, size_t(1) << 16 });
+		auto data = std::make_unique_for_overwrite<char[]>(capacity);
+		if (m_Size)
+			memcpy(data.get(), m_Data.get(), m_Size);
+		m_Data = std::move(data);
+		m_Capacity = capacity;
+	}
+	return m_Data.get() + m_Size;
+}
+
+void Utf8Buffer::Commit(char* end) {
+	m_Size = end - m_Data.get();
+	assert(m_Size <= m_Capacity);
+}
+
+void Utf8Buffer::Append(std::string_view text) {
+	auto dst = Reserve(text.size());
+	memcpy(dst, text.data(), text.size());
+	m_Size += text.size();
+}
+
+void Utf8Buffer::Append(char ch) {
+	*Reserve(1) = ch;
+	m_Size++;
+}
+
+void Utf8Buffer::Clear() {
+	m_Size = 0;
+}
+
+std::string_view Utf8Buffer::GetView() const {
+	return std::string_view(m_Data.get(), m_Size);
+}
+
+size_t Utf8Buffer::GetSize() const {
+	return m_Size;
+}
+
+void Utf8Text::Append(Utf8Buffer& out, std::wstring_view text) {
+	AppendConverted<Escape::None>(out, text);
+}
+
+void Utf8Text::AppendCsv(Utf8Buffer& out, std::wstring_view text) {
+	if (!NeedsQuotes(text)) {
+		AppendConverted<Escape::None>(out, text);
+		return;
+	}
+	out.Append('"');
+	AppendConverted<Escape::Csv>(out, text);
+	out.Append('"');
+}
+
+void Utf8Text::AppendJson(Utf8Buffer& out, std::wstring_view text) {
+	out.Append('"');
+	AppendConverted<Escape::Json>(out, text);
+	out.Append('"');
+}
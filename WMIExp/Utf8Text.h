@@ -0,0 +1,46 @@
+#pragma once
+
+//
+// UTF-16 to UTF-8 conversion for export. Plain C++ with no Windows or WMI dependency,
+// so it builds on its own (see WMIExp.Tests)
+//
+#include <cstddef>
+#include <memory>
+#include <string_view>
+
+//
+// growing byte buffer written through raw pointers: Reserve room, write, Commit the end
+//
+class Utf8Buffer {
+public:
+	char* Reserve(size_t count);
+	void Commit(char* end);
+
+	void Append(std::string_view text);
+	void Append(char ch);
+	void Clear();
+
+	std::string_view GetView() const;
+	size_t GetSize() const;
+
+private:
+	std::unique_ptr<char[]> m_Data;
+	size_t m_Size{ 0 };
+	size_t m_Capacity{ 0 };
+};
+
+//
+// UTF-16 to UTF-8, with the escaping each format needs. Where wchar_t is 16 bits and SSE2 is there,
+// runs of plain ASCII are converted 8 characters at a time; unpaired surrogates become U+FFFD
+//
+struct Utf8Text {
+	static void Append(Utf8Buffer& out, std::wstring_view text);
+	//
+	// quoted only when it contains a separator, quote or line break
+	//
+	static void AppendCsv(Utf8Buffer& out, std::wstring_view text);
+	//
+	// always quoted
+	//
+	static void AppendJson(Utf8Buffer& out, std::wstring_view text);
+};
@@ -1,5 +1,6 @@
 #include "pch.h"
 #include "WMIHelper.h"
+#include "BatchEnumerator.h"
 
 class CObjectSink : 
 	public IObjectsCallback,
@@ -10,113 +11,202 @@ public:
 		COM_INTERFACE_ENTRY(IWbemObjectSink)
 	END_COM_MAP()
 
-	void Init(HWND hWnd, UINT msg) {
+	void Init(HWND hWnd, UINT msg, WPARAM cookie, IWbemServices* pSvc) {
 		m_hWnd = hWnd;
 		m_Msg = msg;
+		m_Cookie = cookie;
+		m_spSvc = pSvc;
 		AddRef();
 	}
 
-	int GetObjectCount() const override {
-		return (int)m_Objects.size();
+	void Cancel() override {
+		if (m_Cancelled.exchange(true) || m_Done)
+			return;
+
+		if (auto spSvc = m_spSvc)
+			spSvc->CancelAsyncCall(this);
+
+		//
+		// release whatever was delivered but not consumed yet
+		//
+		std::vector<CComPtr<IWbemClassObject>> pending;
+		{
+			auto lock = m_Lock.lock_exclusive();
+			pending.swap(m_Pending);
+			m_Next = 0;
+		}
+	}
+
+	int TakeObjects(std::vector<CComPtr<IWbemClassObject>>& objects, int maxCount) override {
+		auto lock = m_Lock.lock_exclusive();
+		auto count = std::min(maxCount, (int)(m_Pending.size() - m_Next));
+		objects.reserve(objects.size() + count);
+		for (int i = 0; i < count; i++)
+			objects.push_back(std::move(m_Pending[m_Next++]));
+		if (m_Next == m_Pending.size()) {
+			m_Pending.clear();
+			m_Next = 0;
+			//
+			// queue drained, the next Indicate should notify again
+			//
+			m_NotifyPending = false;
+		}
+		return count;
 	}
-	CComPtr<IWbemClassObject> GetItem(int i) const override {
-		return m_Objects[i];
+
+	bool HasObjects() const override {
+		auto lock = m_Lock.lock_shared();
+		return m_Next < m_Pending.size();
+	}
+
+	bool IsDone() const override {
+		return m_Done;
+	}
+
+	HRESULT GetStatus() const override {
+		return m_Status;
 	}
 
 private:
 	// Inherited via IWbemObjectSink
 	HRESULT __stdcall Indicate(long lObjectCount, IWbemClassObject** apObjArray) override {
-		for (int i = 0; i < lObjectCount; i++)
-			m_Objects.push_back(apObjArray[i]);
+		if (m_Cancelled)
+			return WBEM_E_CALL_CANCELLED;
+
+		bool notify = false;
+		{
+			auto lock = m_Lock.lock_exclusive();
+			for (int i = 0; i < lObjectCount; i++)
+				m_Pending.push_back(apObjArray[i]);
+			if (!m_NotifyPending)
+				notify = m_NotifyPending = true;
+		}
+		if (notify)
+			::PostMessage(m_hWnd, m_Msg, m_Cookie, 0);
 		return S_OK;
 	}
 	HRESULT __stdcall SetStatus(long lFlags, HRESULT hr, BSTR strParam, IWbemClassObject* pObjParam) override {
 		if (lFlags == WBEM_STATUS_COMPLETE) {
-			::PostMessage(m_hWnd, m_Msg, 0, reinterpret_cast<LPARAM>(static_cast<IObjectsCallback*>(this)));
+			m_Status = hr;
+			m_Done = true;
+			m_spSvc.Release();
+			if (!m_Cancelled)
+				::PostMessage(m_hWnd, m_Msg, m_Cookie, 0);
 		}
 		return S_OK;
 	}
 
 	HWND m_hWnd;
 	UINT m_Msg;
-	std::vector<CComPtr<IWbemClassObject>> m_Objects;
+	WPARAM m_Cookie;
+	CComPtr<IWbemServices> m_spSvc;
+	mutable wil::srwlock m_Lock;
+	std::vector<CComPtr<IWbemClassObject>> m_Pending;
+	size_t m_Next{ 0 };
+	bool m_NotifyPending{ false };
+	std::atomic<bool> m_Done{ false };
+	std::atomic<bool> m_Cancelled{ false };
+	std::atomic<HRESULT> m_Status{ S_OK };
 };
 
+ULONG WMIHelper::s_BatchSize = 0;
+
+void WMIHelper::SetEnumBatchSize(ULONG size) {
+	s_BatchSize = size;
+}
+
+ULONG WMIHelper::GetEnumBatchSize() {
+	return s_BatchSize;
+}
+
 HRESULT WMIHelper::Init(PCWSTR computerName, PCWSTR ns, IWbemServices** ppWmi) {
 	CComPtr<IWbemLocator> spLocator;
 	auto hr = spLocator.CoCreateInstance(__uuidof(WbemLocator));
 	if (FAILED(hr))
 		return hr;
 
-	return spLocator->ConnectServer(CComBSTR(ns),
+	return spLocator->ConnectServer(CComBSTR(GetNamespacePath(computerName, ns).c_str()),
 		nullptr, nullptr, nullptr, WBEM_FLAG_CONNECT_USE_MAX_WAIT, nullptr, nullptr, ppWmi);
 }
 
-std::vector<CComPtr<IWbemClassObject>> WMIHelper::EnumNamespaces(IWbemServices* pWmi) {
+std::wstring WMIHelper::GetNamespacePath(PCWSTR computerName, PCWSTR ns) {
+	if (computerName == nullptr || *computerName == 0 || ::wcscmp(computerName, L".") == 0)
+		return ns;
+	return std::format(L"\\\\{}\\{}", computerName, ns);
+}
+
+std::vector<CComPtr<IWbemClassObject>> WMIHelper::EnumNamespaces(IWbemServices* pWmi, EnumStats* stats) {
 	std::vector<CComPtr<IWbemClassObject>> ns;
 	CComPtr<IEnumWbemClassObject> spEnum;
 	//auto hr = pWmi->ExecQuery(CComBSTR(L"WQL"), CComBSTR(L"SELECT * FROM __NAMESPACE"), 0, nullptr, &spEnum);
 	auto hr = pWmi->CreateInstanceEnum(CComBSTR(L"__NAMESPACE"), 0, nullptr, &spEnum);
-	if (FAILED(hr))
+	if (FAILED(hr)) {
+		if (stats)
+			stats->Status = hr;
 		return ns;
-
-	CComPtr<IWbemClassObject> spObj;
-	ULONG count;
-	while (S_OK == spEnum->Next(WBEM_INFINITE, 1, &spObj, &count)) {
-		ns.push_back(spObj);
-		spObj.Release();
 	}
+
+	BatchEnumerator enumerator(spEnum, s_BatchSize);
+	while (enumerator.Next(ns))
+		;
+	if (stats)
+		*stats = enumerator.GetStats();
 	return ns;
 }
 
-std::vector<CComPtr<IWbemClassObject>> WMIHelper::EnumClasses(IWbemServices* pSvc, bool deep, bool includeSystemClasses) {
+std::vector<CComPtr<IWbemClassObject>> WMIHelper::EnumClasses(IWbemServices* pSvc, bool deep, bool includeSystemClasses, EnumStats* stats) {
 	std::vector<CComPtr<IWbemClassObject>> classes;
 	CComPtr<IEnumWbemClassObject> spEnum;
 	auto hr = pSvc->CreateClassEnum(nullptr, (deep ? WBEM_FLAG_DEEP : WBEM_FLAG_SHALLOW) | WBEM_FLAG_FORWARD_ONLY, nullptr, &spEnum);
-	if (FAILED(hr))
+	if (FAILED(hr)) {
+		if (stats)
+			stats->Status = hr;
 		return classes;
+	}
 
-	CComPtr<IWbemClassObject> spObj;
-	ULONG count;
-	while (S_OK == spEnum->Next(WBEM_INFINITE, 1, &spObj, &count)) {
+	BatchEnumerator enumerator(spEnum, s_BatchSize);
+	enumerator.ForEach([&](auto pObj) {
 		if (!includeSystemClasses) {
-			auto dynasty = GetStringProperty(spObj, L"__DYNASTY");
-			if (dynasty.CompareNoCase(L"__SystemClass") == 0) {
-				spObj.Release();
-				continue;
-			}
+			auto dynasty = GetStringProperty(pObj, L"__DYNASTY");
+			if (dynasty.CompareNoCase(L"__SystemClass") == 0)
+				return;
 		}
-		classes.push_back(spObj);
-		spObj.Release();
-	}
+		classes.push_back(pObj);
+		});
+	if (stats)
+		*stats = enumerator.GetStats();
 	return classes;
 }
 
-std::vector<CComPtr<IWbemClassObject>> WMIHelper::EnumInstances(PCWSTR name, IWbemServices* pSvc, bool deep) {
+std::vector<CComPtr<IWbemClassObject>> WMIHelper::EnumInstances(PCWSTR name, IWbemServices* pSvc, bool deep, EnumStats* stats) {
 	std::vector<CComPtr<IWbemClassObject>> instances;
 	CComPtr<IEnumWbemClassObject> spEnum;
 	auto hr = pSvc->CreateInstanceEnum(CComBSTR(name), (deep ? WBEM_FLAG_DEEP : 0) | WBEM_FLAG_FORWARD_ONLY | WBEM_FLAG_RETURN_IMMEDIATELY, nullptr, &spEnum);
-	if (FAILED(hr))
+	if (FAILED(hr)) {
+		if (stats)
+			stats->Status = hr;
 		return instances;
-
-	CComPtr<IWbemClassObject> spObj;
-	ULONG count;
-	while (S_OK == spEnum->Next(WBEM_INFINITE, 1, &spObj, &count)) {
-		instances.push_back(spObj);
-		spObj.Release();
 	}
+
+	BatchEnumerator enumerator(spEnum, s_BatchSize);
+	while (enumerator.Next(instances))
+		;
+	if (stats)
+		*stats = enumerator.GetStats();
 	return instances;
 }
 
-bool WMIHelper::EnumInstancesAsync(HWND hWnd, UINT msg, PCWSTR name, IWbemServices* pSvc, bool deep) {
+IObjectsCallback* WMIHelper::EnumInstancesAsync(HWND hWnd, UINT msg, WPARAM cookie, PCWSTR name, IWbemServices* pSvc, bool deep) {
 	CComObject<CObjectSink>* pSink;
 	pSink->CreateInstance(&pSink);
-	pSink->Init(hWnd, msg);
+	pSink->Init(hWnd, msg, cookie, pSvc);
 	auto hr = pSvc->CreateInstanceEnumAsync(CComBSTR(name), (deep ? WBEM_FLAG_DEEP : WBEM_FLAG_SHALLOW), nullptr, pSink);
-	if (hr != S_OK)
-		return false;
+	if (hr != S_OK) {
+		pSink->Release();
+		return nullptr;
+	}
 
-	return true;
+	return pSink;
 }
 
 std::vector<WMIProperty> WMIHelper::EnumProperties(IWbemClassObject* pObj) {
@@ -146,12 +236,17 @@ std::vector<WMIMethod> WMIHelper::EnumMethods(IWbemClassObject* pObj, bool local
 	return methods;
 }
 
-std::vector<CComBSTR> WMIHelper::GetNames(IWbemClassObject* pObj) {
+std::vector<CComBSTR> WMIHelper::GetNames(IWbemClassObject* pObj, long flags) {
 	std::vector<CComBSTR> names;
 	SAFEARRAY* sa;
-	pObj->GetNames(nullptr, 0, nullptr, &sa);
-	auto count = sa->cbElements;
-	for (ULONG i = 0; i < count; i++) {
+	if (FAILED(pObj->GetNames(nullptr, flags, nullptr, &sa)))
+		return names;
+
+	LONG upper = -1;
+	::SafeArrayGetUBound(sa, 1, &upper);
+	auto count = upper + 1;
+	names.reserve(count);
+	for (LONG i = 0; i < count; i++) {
 		LONG index = i;
 		BSTR name;
 		::SafeArrayGetElement(sa, &index, &name);
@@ -163,6 +258,30 @@ std::vector<CComBSTR> WMIHelper::GetNames(IWbemClassObject* pObj) {
 	return names;
 }
 
+bool WMIHelper::IsChildNamespaceOrClass(IWbemServices* pWmi) {
+	//
+	// the enumerations open fine on an empty namespace too; only an object coming back counts.
+	// Every namespace has system classes, so only a class of its own does
+	//
+	CComPtr<IEnumWbemClassObject> spEnum;
+	CComPtr<IWbemClassObject> spObj;
+	ULONG returned = 0;
+	if (SUCCEEDED(pWmi->CreateInstanceEnum(CComBSTR(L"__NAMESPACE"), WBEM_FLAG_FORWARD_ONLY | WBEM_FLAG_RETURN_IMMEDIATELY, nullptr, &spEnum))
+		&& spEnum->Next(WBEM_INFINITE, 1, &spObj, &returned) == WBEM_S_NO_ERROR && returned == 1)
+		return true;
+
+	spEnum.Release();
+	if (FAILED(pWmi->CreateClassEnum(nullptr, WBEM_FLAG_DEEP | WBEM_FLAG_FORWARD_ONLY | WBEM_FLAG_RETURN_IMMEDIATELY, nullptr, &spEnum)))
+		return false;
+
+	BatchEnumerator enumerator(spEnum);
+	for (auto batch = enumerator.Next(); !batch.empty(); batch = enumerator.Next())
+		for (auto pClass : batch)
+			if (GetStringProperty(pClass, L"__DYNASTY").CompareNoCase(L"__SystemClass") != 0)
+				return true;
+	return false;
+}
+
 CString WMIHelper::GetStringProperty(IWbemClassObject* pObj, PCWSTR name) {
 	CComVariant value;
 	if (FAILED(pObj->Get(name, 0, &value, nullptr, nullptr)))
@@ -172,3 +291,16 @@ CString WMIHelper::GetStringProperty(IWbemClassObject* pObj, PCWSTR name) {
 		return L"";
 	return value.bstrVal;
 }
+
+size_t WMIHelper::GetObjectSize(IWbemClassObject* pObj) {
+	//
+	// WMI objects marshal by value, so the marshal size is a fair estimate of their footprint
+	//
+	CComQIPtr<IMarshal> spMarshal(pObj);
+	if (!spMarshal)
+		return 0;
+
+	DWORD size = 0;
+	spMarshal->GetMarshalSizeMax(__uuidof(IWbemClassObject), pObj, MSHCTX_INPROC, nullptr, MSHLFLAGS_NORMAL, &size);
+	return size;
+}
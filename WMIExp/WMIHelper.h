@@ -15,20 +15,49 @@ struct WMIMethod {
 	std::wstring ClassName;
 };
 
+struct EnumStats;
+
+//
+// objects delivered by an asynchronous enumeration. The sink posts its message (WPARAM = cookie)
+// when objects become available and once more when the enumeration completes
+//
 struct IObjectsCallback {
-	virtual int GetObjectCount() const = 0;
-	virtual CComPtr<IWbemClassObject> GetItem(int i) const = 0;
+	// moves up to maxCount queued objects to the vector, returns the number moved
+	virtual int TakeObjects(std::vector<CComPtr<IWbemClassObject>>& objects, int maxCount) = 0;
+	virtual bool HasObjects() const = 0;
+	virtual bool IsDone() const = 0;
+	virtual HRESULT GetStatus() const = 0;
+	// cancels the call with the provider and drops queued objects
+	virtual void Cancel() = 0;
 	virtual ULONG Release() = 0;
 };
 
 struct WMIHelper abstract final {
 	static HRESULT Init(PCWSTR computerName, PCWSTR ns, IWbemServices** ppWmi);
+	//
+	// \\computer\namespace, or the namespace as is for the local machine (null, empty or ".")
+	//
+	static std::wstring GetNamespacePath(PCWSTR computerName, PCWSTR ns);
 	static CString GetStringProperty(IWbemClassObject* pObj, PCWSTR name);
-	static std::vector<CComPtr<IWbemClassObject>> EnumNamespaces(IWbemServices* pWmi);
-	static std::vector<CComPtr<IWbemClassObject>> EnumClasses(IWbemServices* pSvc, bool deep, bool includeSystemClasses = false);
-	static std::vector<CComPtr<IWbemClassObject>> EnumInstances(PCWSTR name, IWbemServices* pSvc, bool deep);
-	static bool EnumInstancesAsync(HWND hWnd, UINT msg, PCWSTR name, IWbemServices* pSvc, bool deep);
+	static std::vector<CComPtr<IWbemClassObject>> EnumNamespaces(IWbemServices* pWmi, EnumStats* stats = nullptr);
+	static std::vector<CComPtr<IWbemClassObject>> EnumClasses(IWbemServices* pSvc, bool deep, bool includeSystemClasses = false, EnumStats* stats = nullptr);
+	static std::vector<CComPtr<IWbemClassObject>> EnumInstances(PCWSTR name, IWbemServices* pSvc, bool deep, EnumStats* stats = nullptr);
+	static IObjectsCallback* EnumInstancesAsync(HWND hWnd, UINT msg, WPARAM cookie, PCWSTR name, IWbemServices* pSvc, bool deep);
 	static std::vector<WMIProperty> EnumProperties(IWbemClassObject* pObj);
 	static std::vector<WMIMethod> EnumMethods(IWbemClassObject* pObj, bool localOnly = false, bool inheritedOnly = false);
-	static std::vector<CComBSTR> GetNames(IWbemClassObject* pObj);
+	static std::vector<CComBSTR> GetNames(IWbemClassObject* pObj, long flags = 0);
+	static bool IsChildNamespaceOrClass(IWbemServices* pWmi);
+	//
+	// estimated memory footprint of a class or instance object
+	//
+	static size_t GetObjectSize(IWbemClassObject* pObj);
+
+	//
+	// batch size used by the synchronous enumerations (0 = adaptive)
+	//
+	static void SetEnumBatchSize(ULONG size);
+	static ULONG GetEnumBatchSize();
+
+private:
+	static ULONG s_BatchSize;
 };
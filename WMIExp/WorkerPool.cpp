@@ -0,0 +1,87 @@
+#include "pch.h"
+#include "WorkerPool.h"
+#include <thread>
+
+namespace {
+	thread_local void const* t_CurrentPool;
+}
+
+WorkerPool::WorkerPool(int threads) : m_State(std::make_shared<State>()) {
+	m_Threads = threads > 0 ? threads : (int)std::max(1u, std::thread::hardware_concurrency());
+	m_State->Running = m_Threads;
+	for (int i = 0; i < m_Threads; i++)
+		std::thread(WorkerThread, m_State).detach();
+}
+
+WorkerPool::~WorkerPool() {
+	std::unique_lock lock(m_State->Lock);
+	m_State->Stop = true;
+	m_State->Tasks = {};
+	m_State->TaskReady.notify_all();
+	//
+	// the last reference may go away inside one of our own tasks, nothing to wait for then
+	//
+	if (t_CurrentPool == m_State.get())
+		return;
+
+	//
+	// a task may be stuck in a long WMI call; don't hold up shutdown for it,
+	// the threads own the shared state and exit on their own
+	//
+	m_State->Idle.wait_for(lock, std::chrono::seconds(2), [&] { return m_State->Running == 0; });
+}
+
+void WorkerPool::Submit(std::function<void()> task, int priority) {
+	std::lock_guard lock(m_State->Lock);
+	m_State->Tasks.push({ priority, m_State->NextSequence++, std::move(task) });
+	m_State->TaskReady.notify_one();
+}
+
+void WorkerPool::CancelPending() {
+	std::lock_guard lock(m_State->Lock);
+	m_State->Tasks = {};
+	m_State->Idle.notify_all();
+}
+
+void WorkerPool::Wait() {
+	std::unique_lock lock(m_State->Lock);
+	m_State->Idle.wait(lock, [&] { return m_State->Tasks.empty() && m_State->Busy == 0; });
+}
+
+int WorkerPool::GetThreadCount() const {
+	return m_Threads;
+}
+
+size_t WorkerPool::GetPendingCount() const {
+	std::lock_guard lock(m_State->Lock);
+	return m_State->Tasks.size();
+}
+
+void WorkerPool::WorkerThread(std::shared_ptr<State> state) {
+	auto hr = ::CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+	t_CurrentPool = state.get();
+	for (;;) {
+		std::function<void()> run;
+		{
+			std::unique_lock lock(state->Lock);
+			state->TaskReady.wait(lock, [&] { return state->Stop || !state->Tasks.empty(); });
+			if (state->Stop)
+				break;
+			run = std::move(const_cast<Task&>(state->Tasks.top()).Run);
+			state->Tasks.pop();
+			state->Busy++;
+		}
+		run();
+		run = nullptr;
+
+		std::lock_guard lock(state->Lock);
+		if (--state->Busy == 0 && state->Tasks.empty())
+			state->Idle.notify_all();
+	}
+	if (SUCCEEDED(hr))
+		::CoUninitialize();
+
+	std::lock_guard lock(state->Lock);
+	state->Running--;
+	state->Idle.notify_all();
+}
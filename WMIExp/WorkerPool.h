@@ -0,0 +1,60 @@
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+
+//
+// fixed set of worker threads, each initialized into the MTA, running queued tasks
+// highest priority first (FIFO within a priority)
+//
+class WorkerPool {
+public:
+	explicit WorkerPool(int threads = 0);
+	~WorkerPool();
+
+	WorkerPool(WorkerPool const&) = delete;
+	WorkerPool& operator=(WorkerPool const&) = delete;
+
+	void Submit(std::function<void()> task, int priority = 0);
+
+	//
+	// drops tasks that have not started yet
+	//
+	void CancelPending();
+
+	//
+	// blocks until the queue is empty and no task is running
+	//
+	void Wait();
+
+	int GetThreadCount() const;
+	size_t GetPendingCount() const;
+
+private:
+	struct Task {
+		int Priority;
+		ULONGLONG Sequence;
+		std::function<void()> Run;
+
+		bool operator<(Task const& other) const {
+			return Priority == other.Priority ? Sequence > other.Sequence : Priority < other.Priority;
+		}
+	};
+
+	struct State {
+		std::mutex Lock;
+		std::condition_variable TaskReady, Idle;
+		std::priority_queue<Task> Tasks;
+		ULONGLONG NextSequence{ 0 };
+		int Busy{ 0 };
+		int Running{ 0 };
+		bool Stop{ false };
+	};
+
+	static void WorkerThread(std::shared_ptr<State> state);
+
+	std::shared_ptr<State> m_State;
+	int m_Threads;
+};
@@ -0,0 +1,782 @@
+#include "WqlQuery.h"
+#include "CimDateTime.h"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cwctype>
+
+namespace {
+	enum class TokenType {
+		End, Identifier, Number, String, Symbol, Error
+	};
+
+	struct Token {
+		TokenType Type;
+		std::wstring Text;
+		WqlNumber Number;
+	};
+
+	wchar_t Fold(wchar_t ch) {
+		return (wchar_t)std::towlower(ch);
+	}
+
+	bool EqualNoCase(std::wstring_view s1, std::wstring_view s2) {
+		return s1.length() == s2.length() && std::equal(s1.begin(), s1.end(), s2.begin(), [](auto c1, auto c2) { return Fold(c1) == Fold(c2); });
+	}
+
+	class Lexer {
+	public:
+		explicit Lexer(std::wstring_view text) : m_Text(text) {}
+
+		Token Next() {
+			while (m_Pos < m_Text.length() && std::iswspace(m_Text[m_Pos]))
+				m_Pos++;
+			if (m_Pos == m_Text.length())
+				return { TokenType::End, {}, {} };
+
+			auto start = m_Pos;
+			auto ch = m_Text[m_Pos];
+			if (std::iswalpha(ch) || ch == L'_') {
+				while (m_Pos < m_Text.length() && (std::iswalnum(m_Text[m_Pos]) || m_Text[m_Pos] == L'_'))
+					m_Pos++;
+				return { TokenType::Identifier, std::wstring(m_Text.substr(start, m_Pos - start)), {} };
+			}
+			if (std::iswdigit(ch) || (ch == L'.' && m_Pos + 1 < m_Text.length() && std::iswdigit(m_Text[m_Pos + 1]))) {
+				auto hex = ch == L'0' && m_Pos + 1 < m_Text.length() && (m_Text[m_Pos + 1] == L'x' || m_Text[m_Pos + 1] == L'X');
+				if (hex)
+					m_Pos += 2;
+				while (m_Pos < m_Text.length() && (hex ? std::iswxdigit(m_Text[m_Pos]) : std::iswdigit(m_Text[m_Pos]) || m_Text[m_Pos] == L'.'))
+					m_Pos++;
+				//
+				// a number runs into a name (12ab) only by mistake
+				//
+				while (m_Pos < m_Text.length() && (std::iswalnum(m_Text[m_Pos]) || m_Text[m_Pos] == L'_'))
+					m_Pos++;
+				Token token{ TokenType::Number, std::wstring(m_Text.substr(start, m_Pos - start)), {} };
+				if (!WqlNumber::Parse(token.Text, token.Number))
+					token.Type = TokenType::Error;
+				return token;
+			}
+			if (ch == L'\'' || ch == L'"') {
+				std::wstring text;
+				for (m_Pos++; m_Pos < m_Text.length() && m_Text[m_Pos] != ch; m_Pos++) {
+					if (m_Text[m_Pos] == L'\\' && m_Pos + 1 < m_Text.length())
+						m_Pos++;
+					text += m_Text[m_Pos];
+				}
+				if (m_Pos == m_Text.length())
+					return { TokenType::Error, L"unterminated string", {} };
+				m_Pos++;
+				return { TokenType::String, std::move(text), {} };
+			}
+			for (auto symbol : { L"<=", L">=", L"<>", L"!=" }) {
+				if (m_Text.substr(m_Pos).starts_with(symbol)) {
+					m_Pos += 2;
+					return { TokenType::Symbol, symbol, {} };
+				}
+			}
+			if (std::wstring_view(L"=<>(),*-").find(ch) != std::wstring_view::npos) {
+				m_Pos++;
+				return { TokenType::Symbol, std::wstring(1, ch), {} };
+			}
+			m_Pos++;
+			return { TokenType::Error, std::wstring(1, ch), {} };
+		}
+
+	private:
+		std::wstring_view m_Text;
+		size_t m_Pos{ 0 };
+	};
+
+	class Parser {
+	public:
+		Parser(std::wstring_view text, WqlQuery& query) : m_Lexer(text), m_Query(query) {
+			Advance();
+		}
+
+		bool Parse() {
+			if (!Keyword(L"SELECT"))
+				return Fail(L"SELECT expected");
+			if (Symbol(L"*")) {
+				Advance();
+			}
+			else {
+				for (;;) {
+					if (m_Token.Type != TokenType::Identifier)
+						return Fail(L"property name expected");
+					m_Query.Properties.push_back(m_Token.Text);
+					Advance();
+					if (!Symbol(L","))
+						break;
+					Advance();
+				}
+			}
+			if (!Keyword(L"FROM"))
+				return Fail(L"FROM expected");
+			if (m_Token.Type != TokenType::Identifier)
+				return Fail(L"class name expected");
+			m_Query.ClassName = m_Token.Text;
+			Advance();
+			if (Keyword(L"WHERE")) {
+				m_Query.Where = ParseOr();
+				if (m_Query.Where < 0)
+					return false;
+			}
+			if (m_Token.Type == TokenType::Error)
+				return Fail(L"invalid '" + m_Token.Text + L"'");
+			if (m_Token.Type != TokenType::End)
+				return Fail(L"unexpected '" + m_Token.Text + L"'");
+			return true;
+		}
+
+		std::wstring const& GetError() const {
+			return m_Error;
+		}
+
+	private:
+		void Advance() {
+			m_Token = m_Lexer.Next();
+		}
+
+		bool Fail(std::wstring error) {
+			if (m_Error.empty())
+				m_Error = std::move(error);
+			return false;
+		}
+
+		int FailNode(std::wstring error) {
+			Fail(std::move(error));
+			return -1;
+		}
+
+		bool IsKeyword(wchar_t const* keyword) const {
+			return m_Token.Type == TokenType::Identifier && EqualNoCase(m_Token.Text, keyword);
+		}
+
+		bool Keyword(wchar_t const* keyword) {
+			if (!IsKeyword(keyword))
+				return false;
+			Advance();
+			return true;
+		}
+
+		bool Symbol(wchar_t const* symbol) const {
+			return m_Token.Type == TokenType::Symbol && m_Token.Text == symbol;
+		}
+
+		int AddNode(WqlNode node) {
+			m_Query.Nodes.push_back(std::move(node));
+			return (int)m_Query.Nodes.size() - 1;
+		}
+
+		int ParseOr() {
+			auto left = ParseAnd();
+			while (left >= 0 && Keyword(L"OR")) {
+				auto right = ParseAnd();
+				if (right < 0)
+					return -1;
+				left = AddNode({ WqlOp::Or, left, right, {}, {} });
+			}
+			return left;
+		}
+
+		int ParseAnd() {
+			auto left = ParseUnary();
+			while (left >= 0 && Keyword(L"AND")) {
+				auto right = ParseUnary();
+				if (right < 0)
+					return -1;
+				left = AddNode({ WqlOp::And, left, right, {}, {} });
+			}
+			return left;
+		}
+
+		int ParseUnary() {
+			if (Keyword(L"NOT")) {
+				auto operand = ParseUnary();
+				return operand < 0 ? -1 : AddNode({ WqlOp::Not, operand, -1, {}, {} });
+			}
+			if (Symbol(L"(")) {
+				Advance();
+				auto node = ParseOr();
+				if (node < 0)
+					return -1;
+				if (!Symbol(L")"))
+					return FailNode(L"')' expected");
+				Advance();
+				return node;
+			}
+			return ParseComparison();
+		}
+
+		bool IsLiteral() const {
+			return m_Token.Type == TokenType::Number || m_Token.Type == TokenType::String || Symbol(L"-")
+				|| IsKeyword(L"TRUE") || IsKeyword(L"FALSE") || IsKeyword(L"NULL");
+		}
+
+		bool ParseLiteral(WqlLiteral& value) {
+			auto negative = Symbol(L"-");
+			if (negative)
+				Advance();
+			if (m_Token.Type == TokenType::Number) {
+				value.Type = WqlLiteralType::Number;
+				value.Number = negative ? m_Token.Number.Negated() : m_Token.Number;
+			}
+			else if (m_Token.Type == TokenType::Error) {
+				return Fail(L"invalid '" + m_Token.Text + L"'");
+			}
+			else if (negative) {
+				return Fail(L"number expected");
+			}
+			else if (m_Token.Type == TokenType::String) {
+				value.Type = WqlLiteralType::String;
+				value.String = m_Token.Text;
+			}
+			else if (IsKeyword(L"TRUE") || IsKeyword(L"FALSE")) {
+				value.Type = WqlLiteralType::Bool;
+				value.Bool = IsKeyword(L"TRUE");
+			}
+			else if (IsKeyword(L"NULL")) {
+				value.Type = WqlLiteralType::Null;
+			}
+			else {
+				return Fail(L"value expected");
+			}
+			Advance();
+			return true;
+		}
+
+		bool ParseOperator(WqlOp& op) {
+			static const struct {
+				wchar_t const* Symbol;
+				WqlOp Op;
+			} ops[] = {
+				{ L"=", WqlOp::Equal }, { L"<>", WqlOp::NotEqual }, { L"!=", WqlOp::NotEqual },
+				{ L"<", WqlOp::Less }, { L"<=", WqlOp::LessEqual }, { L">", WqlOp::Greater }, { L">=", WqlOp::GreaterEqual },
+			};
+			for (auto& o : ops) {
+				if (Symbol(o.Symbol)) {
+					op = o.Op;
+					Advance();
+					return true;
+				}
+			}
+			return Fail(L"comparison operator expected");
+		}
+
+		int ParseComparison() {
+			WqlNode node{};
+			if (IsLiteral()) {
+				//
+				// literal on the left: flip the comparison around
+				//
+				if (!ParseLiteral(node.Value) || !ParseOperator(node.Op))
+					return -1;
+				if (m_Token.Type != TokenType::Identifier)
+					return FailNode(L"property name expected");
+				node.Property = m_Token.Text;
+				Advance();
+				switch (node.Op) {
+					case WqlOp::Less: node.Op = WqlOp::Greater; break;
+					case WqlOp::LessEqual: node.Op = WqlOp::GreaterEqual; break;
+					case WqlOp::Greater: node.Op = WqlOp::Less; break;
+					case WqlOp::GreaterEqual: node.Op = WqlOp::LessEqual; break;
+					default: break;
+				}
+			}
+			else {
+				if (m_Token.Type != TokenType::Identifier)
+					return FailNode(L"property name expected");
+				node.Property = m_Token.Text;
+				Advance();
+				if (Keyword(L"IS")) {
+					auto negate = Keyword(L"NOT");
+					if (!Keyword(L"NULL"))
+						return FailNode(L"NULL expected");
+					node.Op = negate ? WqlOp::IsNotNull : WqlOp::IsNull;
+					return AddNode(std::move(node));
+				}
+				if (IsKeyword(L"ISA"))
+					return FailNode(L"ISA is not supported");
+
+				auto negate = Keyword(L"NOT");
+				if (Keyword(L"LIKE")) {
+					if (m_Token.Type != TokenType::String)
+						return FailNode(L"pattern expected");
+					node.Op = WqlOp::Like;
+					node.Value.Type = WqlLiteralType::String;
+					node.Value.String = m_Token.Text;
+					Advance();
+					auto like = AddNode(std::move(node));
+					return negate ? AddNode({ WqlOp::Not, like, -1, {}, {} }) : like;
+				}
+				if (negate)
+					return FailNode(L"LIKE expected");
+				if (!ParseOperator(node.Op) || !ParseLiteral(node.Value))
+					return -1;
+			}
+			if (node.Value.Type == WqlLiteralType::Null) {
+				if (node.Op == WqlOp::Equal)
+					node.Op = WqlOp::IsNull;
+				else if (node.Op == WqlOp::NotEqual)
+					node.Op = WqlOp::IsNotNull;
+			}
+			return AddNode(std::move(node));
+		}
+
+		Lexer m_Lexer;
+		Token m_Token;
+		WqlQuery& m_Query;
+		std::wstring m_Error;
+	};
+
+	std::wstring ToLower(std::wstring_view text) {
+		std::wstring lower(text);
+		for (auto& ch : lower)
+			ch = Fold(ch);
+		return lower;
+	}
+
+	//
+	// case insensitive; the second string is already lowercase
+	//
+	int CompareNoCase(std::wstring_view text, std::wstring_view lower) {
+		auto count = std::min(text.length(), lower.length());
+		for (size_t i = 0; i < count; i++) {
+			auto ch = Fold(text[i]);
+			if (ch != lower[i])
+				return ch < lower[i] ? -1 : 1;
+		}
+		return text.length() == lower.length() ? 0 : text.length() < lower.length() ? -1 : 1;
+	}
+
+	bool Apply(WqlOp op, int compare) {
+		switch (op) {
+			case WqlOp::Equal: return compare == 0;
+			case WqlOp::NotEqual: return compare != 0;
+			case WqlOp::Less: return compare < 0;
+			case WqlOp::LessEqual: return compare <= 0;
+			case WqlOp::Greater: return compare > 0;
+			case WqlOp::GreaterEqual: return compare >= 0;
+			default: break;
+		}
+		return false;
+	}
+}
+
+bool WqlNumber::Parse(std::wstring_view text, WqlNumber& number) {
+	number = WqlNumber();
+	auto negative = !text.empty() && text[0] == L'-';
+	if (negative)
+		text.remove_prefix(1);
+	if (text.empty())
+		return false;
+
+	auto overflow = false;
+	auto digit = [&](unsigned base, unsigned value) {
+		if (number.Magnitude > (UINT64_MAX - value) / base)
+			overflow = true;
+		else
+			number.Magnitude = number.Magnitude * base + value;
+	};
+	if (text.length() > 2 && text[0] == L'0' && (text[1] == L'x' || text[1] == L'X')) {
+		for (auto ch : text.substr(2)) {
+			if (ch >= L'0' && ch <= L'9')
+				digit(16, ch - L'0');
+			else if (Fold(ch) >= L'a' && Fold(ch) <= L'f')
+				digit(16, Fold(ch) - L'a' + 10);
+			else
+				return false;
+		}
+		if (overflow)
+			return false;
+		number.Integral = true;
+		number.Value = (double)number.Magnitude;
+	}
+	else {
+		size_t digits = 0, dots = 0;
+		for (auto ch : text) {
+			if (ch == L'.')
+				dots++;
+			else if (ch >= L'0' && ch <= L'9')
+				digits++;
+			else
+				return false;
+			if (dots == 0)
+				digit(10, ch - L'0');
+		}
+		if (digits == 0 || dots > 1)
+			return false;
+
+		//
+		// the double is parsed from the text, so it is as close as a double gets
+		//
+		std::string narrow(text.begin(), text.end());
+		std::from_chars(narrow.data(), narrow.data() + narrow.size(), number.Value);
+		number.Integral = dots == 0 && !overflow;
+		if (!number.Integral)
+			number.Magnitude = 0;
+	}
+	if (negative) {
+		number.Value = -number.Value;
+		number.Negative = number.Magnitude != 0;
+	}
+	return true;
+}
+
+WqlNumber WqlNumber::FromInteger(int64_t value) {
+	WqlNumber number;
+	number.Value = (double)value;
+	number.Integral = true;
+	number.Negative = value < 0;
+	number.Magnitude = value < 0 ? uint64_t(-(value + 1)) + 1 : (uint64_t)value;
+	return number;
+}
+
+WqlNumber WqlNumber::Negated() const {
+	auto number = *this;
+	number.Value = -Value;
+	number.Negative = Integral && Magnitude && !Negative;
+	return number;
+}
+
+std::wstring WqlNumber::ToString() const {
+	//
+	// integers are written out in full; WMI does not take exponents for them
+	//
+	char text[32];
+	auto end = Integral ? std::to_chars(text, text + sizeof(text), Magnitude).ptr : std::to_chars(text, text + sizeof(text), Value).ptr;
+	std::wstring result = Integral && Negative ? L"-" : L"";
+	result.append(text, end);
+	return result;
+}
+
+bool WqlQuery::Parse(std::wstring_view text, WqlQuery& query, std::wstring* error) {
+	query = WqlQuery();
+	Parser parser(text, query);
+	if (parser.Parse())
+		return true;
+
+	if (error)
+		*error = parser.GetError();
+	return false;
+}
+
+std::wstring WqlQuery::ToString() const {
+	std::wstring text = L"SELECT ";
+	if (Properties.empty())
+		text += L'*';
+	for (auto& name : Properties) {
+		if (&name != &Properties.front())
+			text += L", ";
+		text += name;
+	}
+	text += L" FROM " + ClassName;
+	if (Where >= 0)
+		text += L" WHERE " + ToString(Where);
+	return text;
+}
+
+std::wstring WqlQuery::ToString(int index) const {
+	auto& node = Nodes[index];
+	switch (node.Op) {
+		case WqlOp::And:
+		case WqlOp::Or:
+			return L"(" + ToString(node.Left) + L" " + OpToText(node.Op) + L" " + ToString(node.Right) + L")";
+		case WqlOp::Not: return L"NOT (" + ToString(node.Left) + L")";
+		case WqlOp::IsNull:
+		case WqlOp::IsNotNull:
+			return node.Property + L" " + OpToText(node.Op);
+		default: break;
+	}
+
+	auto text = node.Property + L" " + OpToText(node.Op) + L" ";
+	switch (node.Value.Type) {
+		case WqlLiteralType::Number: text += node.Value.Number.ToString(); break;
+		case WqlLiteralType::Bool: text += node.Value.Bool ? L"TRUE" : L"FALSE"; break;
+		case WqlLiteralType::Null: text += L"NULL"; break;
+		case WqlLiteralType::String:
+			text += L'"';
+			for (auto ch : node.Value.String) {
+				if (ch == L'"' || ch == L'\\')
+					text += L'\\';
+				text += ch;
+			}
+			text += L'"';
+			break;
+		default: break;
+	}
+	return text;
+}
+
+wchar_t const* WqlQuery::OpToText(WqlOp op) {
+	switch (op) {
+		case WqlOp::Equal: return L"=";
+		case WqlOp::NotEqual: return L"<>";
+		case WqlOp::Less: return L"<";
+		case WqlOp::LessEqual: return L"<=";
+		case WqlOp::Greater: return L">";
+		case WqlOp::GreaterEqual: return L">=";
+		case WqlOp::Like: return L"LIKE";
+		case WqlOp::IsNull: return L"IS NULL";
+		case WqlOp::IsNotNull: return L"IS NOT NULL";
+		case WqlOp::And: return L"AND";
+		case WqlOp::Or: return L"OR";
+		case WqlOp::Not: return L"NOT";
+		default: break;
+	}
+	return L"";
+}
+
+bool WqlFilter::Bind(WqlQuery const& query, WqlTable const& table, std::wstring* error) {
+	m_Table = &table;
+	m_Root = query.Where;
+	m_Nodes.clear();
+	m_Nodes.reserve(query.Nodes.size());
+	for (auto& node : query.Nodes) {
+		Bound b{ node.Op, node.Left, node.Right, -1, {}, {}, 0, {}, {} };
+		m_Nodes.push_back(std::move(b));
+		if (node.Op == WqlOp::And || node.Op == WqlOp::Or || node.Op == WqlOp::Not)
+			continue;
+
+		auto col = table.FindColumn(node.Property);
+		if (col < 0) {
+			if (error)
+				*error = L"unknown property " + node.Property;
+			return false;
+		}
+		auto& bound = m_Nodes.back();
+		bound.Kind = table.GetColumnKind(col);
+		if (node.Op == WqlOp::IsNull || node.Op == WqlOp::IsNotNull) {
+			bound.Column = col;
+			continue;
+		}
+
+		//
+		// the literal is converted once to what the column holds; a comparison
+		// that can never hold (NULL, or a value the column cannot have) keeps Column -1
+		//
+		auto& value = node.Value;
+		auto kind = bound.Kind;
+		auto mismatch = false;
+		switch (kind) {
+			case WqlColumnKind::Int64:
+			case WqlColumnKind::UInt64:
+			case WqlColumnKind::Double:
+			case WqlColumnKind::Bool:
+			case WqlColumnKind::Char:
+				if (node.Op == WqlOp::Like || value.Type == WqlLiteralType::Null) {
+					mismatch = node.Op == WqlOp::Like;
+					break;
+				}
+				if (value.Type == WqlLiteralType::Number)
+					bound.Number = value.Number;
+				else if (value.Type == WqlLiteralType::Bool)
+					bound.Number = WqlNumber::FromInteger(value.Bool);
+				else if (kind == WqlColumnKind::Char && value.String.length() == 1)
+					bound.Number = WqlNumber::FromInteger(value.String[0]);
+				else if (kind == WqlColumnKind::Bool && (EqualNoCase(value.String, L"true") || EqualNoCase(value.String, L"false")))
+					bound.Number = WqlNumber::FromInteger(EqualNoCase(value.String, L"true"));
+				else
+					mismatch = !WqlNumber::Parse(value.String, bound.Number);
+				bound.Column = mismatch ? -1 : col;
+				break;
+
+			case WqlColumnKind::DateTime:
+			{
+				int16_t offset;
+				if (value.Type == WqlLiteralType::Null)
+					break;
+				if (node.Op == WqlOp::Like || value.Type != WqlLiteralType::String || !CimDateTime::Parse(value.String, bound.Ticks, offset))
+					mismatch = true;
+				else
+					bound.Column = col;
+				break;
+			}
+
+			default:
+				if (value.Type == WqlLiteralType::Null)
+					break;
+				bound.String = value.Type == WqlLiteralType::String ? ToLower(value.String)
+					: value.Type == WqlLiteralType::Bool ? (value.Bool ? L"true" : L"false") : value.Number.ToString();
+				bound.Column = col;
+				break;
+		}
+		if (mismatch) {
+			if (error)
+				*error = L"cannot compare " + node.Property + L" with the given value";
+			return false;
+		}
+	}
+	return true;
+}
+
+bool WqlFilter::Matches(size_t row) {
+	return m_Root < 0 || Evaluate(m_Root, row);
+}
+
+std::vector<size_t> WqlFilter::Run() {
+	std::vector<size_t> rows;
+	auto count = m_Table ? m_Table->GetRowCount() : 0;
+	for (size_t row = 0; row < count; row++)
+		if (Matches(row))
+			rows.push_back(row);
+	return rows;
+}
+
+bool WqlFilter::Evaluate(int index, size_t row) {
+	auto& b = m_Nodes[index];
+	auto& table = *m_Table;
+	switch (b.Op) {
+		case WqlOp::And: return Evaluate(b.Left, row) && Evaluate(b.Right, row);
+		case WqlOp::Or: return Evaluate(b.Left, row) || Evaluate(b.Right, row);
+		case WqlOp::Not: return !Evaluate(b.Left, row);
+		case WqlOp::IsNull: return table.IsNull(row, b.Column);
+		case WqlOp::IsNotNull: return !table.IsNull(row, b.Column);
+		default: break;
+	}
+	if (b.Column < 0 || table.IsNull(row, b.Column))
+		return false;
+
+	switch (b.Kind) {
+		case WqlColumnKind::Int64:
+		case WqlColumnKind::Char:
+			return Apply(b.Op, Compare(table.GetInt64(row, b.Column), b.Number));
+		case WqlColumnKind::UInt64: return Apply(b.Op, Compare((uint64_t)table.GetInt64(row, b.Column), b.Number));
+		case WqlColumnKind::Double: return Apply(b.Op, Compare(table.GetDouble(row, b.Column), b.Number));
+		case WqlColumnKind::Bool: return Apply(b.Op, Compare((int64_t)table.GetBool(row, b.Column), b.Number));
+		case WqlColumnKind::DateTime:
+		{
+			if (!table.HasTicks(row, b.Column))
+				return false;
+			auto ticks = table.GetInt64(row, b.Column);
+			return Apply(b.Op, ticks < b.Ticks ? -1 : ticks > b.Ticks ? 1 : 0);
+		}
+		default: break;
+	}
+
+	//
+	// interned strings: each distinct value is compared once
+	//
+	auto id = table.GetStringId(row, b.Column);
+	if (id >= b.Decided.size())
+		b.Decided.resize(std::max<size_t>(id + 1, table.GetStringCount()), -1);
+	auto& decided = b.Decided[id];
+	if (decided < 0)
+		decided = CompareString(b, table.GetPooledString(id));
+	return decided != 0;
+}
+
+bool WqlFilter::CompareString(Bound& b, std::wstring const& value) {
+	if (b.Op == WqlOp::Like)
+		return Like(value, b.String);
+	return Apply(b.Op, CompareNoCase(value, b.String));
+}
+
+int WqlFilter::Compare(int64_t value, WqlNumber const& literal) {
+	if (literal.Integral) {
+		if (!literal.Negative)
+			return value < 0 ? -1 : Compare((uint64_t)value, literal);
+		if (value >= 0)
+			return 1;
+		//
+		// both negative: the larger magnitude is the smaller value
+		//
+		auto magnitude = uint64_t(-(value + 1)) + 1;
+		return magnitude > literal.Magnitude ? -1 : magnitude < literal.Magnitude ? 1 : 0;
+	}
+
+	auto d = literal.Value;
+	if (d >= 9223372036854775808.0)
+		return -1;
+	if (d < -9223372036854775808.0)
+		return 1;
+	auto whole = std::floor(d);
+	auto n = (int64_t)whole;
+	if (whole == d)
+		return value < n ? -1 : value > n ? 1 : 0;
+	//
+	// n < d < n + 1
+	//
+	return value <= n ? -1 : 1;
+}
+
+int WqlFilter::Compare(uint64_t value, WqlNumber const& literal) {
+	if (literal.Integral) {
+		if (literal.Negative)
+			return 1;
+		return value < literal.Magnitude ? -1 : value > literal.Magnitude ? 1 : 0;
+	}
+
+	auto d = literal.Value;
+	if (d >= 18446744073709551616.0)
+		return -1;
+	if (d < 0)
+		return 1;
+	auto whole = std::floor(d);
+	auto n = (uint64_t)whole;
+	if (whole == d)
+		return value < n ? -1 : value > n ? 1 : 0;
+	return value <= n ? -1 : 1;
+}
+
+int WqlFilter::Compare(double value, WqlNumber const& literal) {
+	return value < literal.Value ? -1 : value > literal.Value ? 1 : 0;
+}
+
+bool WqlFilter::Like(std::wstring_view text, std::wstring_view pattern) {
+	//
+	// backtracks only to the last %, which is enough for these wildcards
+	//
+	auto matchOne = [&](size_t& p, wchar_t ch) {
+		if (pattern[p] == L'_') {
+			p++;
+			return true;
+		}
+		if (pattern[p] == L'[') {
+			auto close = pattern.find(L']', p + 1);
+			if (close != std::wstring_view::npos) {
+				auto set = pattern.substr(p + 1, close - p - 1);
+				p = close + 1;
+				auto negate = !set.empty() && set[0] == L'^';
+				if (negate)
+					set.remove_prefix(1);
+				auto found = false;
+				for (size_t i = 0; i < set.length() && !found; i++) {
+					if (i + 2 < set.length() && set[i + 1] == L'-') {
+						found = ch >= set[i] && ch <= set[i + 2];
+						i += 2;
+					}
+					else {
+						found = ch == set[i];
+					}
+				}
+				return found != negate;
+			}
+		}
+		return pattern[p++] == ch;
+	};
+
+	size_t t = 0, p = 0;
+	size_t starPattern = std::wstring_view::npos, starText = 0;
+	while (t < text.length()) {
+		if (p < pattern.length() && pattern[p] == L'%') {
+			starPattern = ++p;
+			starText = t;
+			continue;
+		}
+		auto next = p;
+		if (p < pattern.length() && matchOne(next, Fold(text[t]))) {
+			p = next;
+			t++;
+			continue;
+		}
+		if (starPattern == std::wstring_view::npos)
+			return false;
+		p = starPattern;
+		t = ++starText;
+	}
+	while (p < pattern.length() && pattern[p] == L'%')
+		p++;
+	return p == pattern.length();
+}
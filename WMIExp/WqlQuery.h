@@ -0,0 +1,153 @@
+#pragma once
+
+//
+// WQL parsing and client side evaluation. Plain C++ with no Windows or WMI dependency:
+// the filter reads values through WqlTable, which the instance store implements in the
+// application and plain vectors implement in WMIExp.Tests
+//
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class WqlOp : uint8_t {
+	Equal, NotEqual, Less, LessEqual, Greater, GreaterEqual, Like, IsNull, IsNotNull,
+	And, Or, Not
+};
+
+enum class WqlLiteralType : uint8_t {
+	Null, Number, String, Bool
+};
+
+//
+// integers are kept exactly as well, since 64 bit values do not fit a double
+//
+struct WqlNumber {
+	double Value{ 0 };
+	bool Integral{ false };		// the value is exactly Magnitude, negated if Negative
+	bool Negative{ false };
+	uint64_t Magnitude{ 0 };
+
+	//
+	// decimal (with an optional fraction) or 0x hex, with an optional leading minus
+	//
+	static bool Parse(std::wstring_view text, WqlNumber& number);
+	static WqlNumber FromInteger(int64_t value);
+	WqlNumber Negated() const;
+	std::wstring ToString() const;
+};
+
+struct WqlLiteral {
+	WqlLiteralType Type{ WqlLiteralType::Null };
+	WqlNumber Number;
+	bool Bool{ false };
+	std::wstring String;
+};
+
+//
+// expression nodes live in one vector and refer to each other by index.
+// And/Or use Left and Right, Not uses Left, everything else compares Property to Value
+//
+struct WqlNode {
+	WqlOp Op;
+	int Left{ -1 }, Right{ -1 };
+	std::wstring Property;
+	WqlLiteral Value;
+};
+
+//
+// SELECT <properties | *> FROM <class> [WHERE <condition>], parsed without WMI.
+// ISA, ASSOCIATORS OF and REFERENCES OF are not supported
+//
+struct WqlQuery {
+	std::vector<std::wstring> Properties;	// empty for *
+	std::wstring ClassName;
+	std::vector<WqlNode> Nodes;
+	int Where{ -1 };						// root node, -1 if there is no condition
+
+	static bool Parse(std::wstring_view text, WqlQuery& query, std::wstring* error = nullptr);
+
+	std::wstring ToString() const;
+	std::wstring ToString(int node) const;
+	static wchar_t const* OpToText(WqlOp op);
+};
+
+enum class WqlColumnKind : uint8_t {
+	Int64, UInt64, Char, Double, Bool, String, DateTime
+};
+
+//
+// rows of typed columns, as the filter reads them
+//
+class WqlTable {
+public:
+	virtual ~WqlTable() = default;
+
+	virtual size_t GetRowCount() const = 0;
+	//
+	// case insensitive; -1 if there is no such column
+	//
+	virtual int FindColumn(std::wstring_view name) const = 0;
+	virtual WqlColumnKind GetColumnKind(int col) const = 0;
+
+	virtual bool IsNull(size_t row, int col) const = 0;
+	//
+	// Int64, UInt64 (as bits), Char, and DateTime as UTC ticks (see CimDateTime)
+	//
+	virtual int64_t GetInt64(size_t row, int col) const = 0;
+	virtual double GetDouble(size_t row, int col) const = 0;
+	virtual bool GetBool(size_t row, int col) const = 0;
+	//
+	// false for a DateTime value kept as text because it has no ticks (e.g. with wildcard fields):
+	// such a value is not NULL, but compares false with any datetime literal
+	//
+	virtual bool HasTicks(size_t row, int col) const = 0;
+	//
+	// strings are interned: equal strings share an id, and ids are below GetStringCount
+	//
+	virtual uint32_t GetStringId(size_t row, int col) const = 0;
+	virtual size_t GetStringCount() const = 0;
+	virtual std::wstring const& GetPooledString(uint32_t id) const = 0;
+};
+
+//
+// a condition bound to the columns of a table, evaluated on the client.
+// String conditions are decided once per distinct (interned) string
+//
+class WqlFilter {
+public:
+	bool Bind(WqlQuery const& query, WqlTable const& table, std::wstring* error = nullptr);
+
+	bool Matches(size_t row);
+	std::vector<size_t> Run();
+
+	//
+	// -1, 0 or 1 as the value is less than, equal to or greater than the literal; exact for any 64 bit value
+	//
+	static int Compare(int64_t value, WqlNumber const& literal);
+	static int Compare(uint64_t value, WqlNumber const& literal);
+	static int Compare(double value, WqlNumber const& literal);
+	//
+	// % any run, _ any character, [abc] [a-z] [^abc] a set; the pattern is lowercase
+	//
+	static bool Like(std::wstring_view text, std::wstring_view pattern);
+
+private:
+	struct Bound {
+		WqlOp Op;
+		int Left, Right;
+		int Column;				// -1 for a comparison that is never true (e.g. with NULL)
+		WqlColumnKind Kind;
+		WqlNumber Number;		// numeric and boolean literals
+		int64_t Ticks;			// datetime literals
+		std::wstring String;	// lowercase
+		std::vector<int8_t> Decided;	// by string id: -1 unknown, 0 false, 1 true
+	};
+
+	bool Evaluate(int node, size_t row);
+	bool CompareString(Bound& b, std::wstring const& value);
+
+	std::vector<Bound> m_Nodes;
+	WqlTable const* m_Table{ nullptr };
+	int m_Root{ -1 };
+};
@@ -31,6 +31,8 @@ extern CAppModule _Module;
 #include <map>
 #include <utility>
 #include <wil\com.h>
+#include <wil\resource.h>
+#include <atomic>
 #include <format>
 
 #if defined _M_IX86
@@ -18,9 +18,25 @@
 #define IDI_CHECK                       210
 #define IDI_ICON3                       211
 #define IDI_RADIO                       211
+#define IDD_SEARCH                      212
+#define IDD_QUERY                       213
+#define IDD_PERFMON                     214
+#define IDD_EVENTS                      215
+#define IDD_DIAGNOSTICS                 216
+#define IDD_FANOUT                      217
 #define IDC_COPYRIGHT                   1000
 #define IDC_VERSION                     1001
 #define IDC_LINK                        1002
+#define IDC_SEARCHTEXT                  1003
+#define IDC_RESULTS                     1004
+#define IDC_STATUS                      1005
+#define IDC_QUERY                       1006
+#define IDC_STOP                        1007
+#define IDC_LOCAL                       1008
+#define IDC_PAUSE                       1009
+#define IDC_COOKED                      1010
+#define IDC_CLEAR                       1011
+#define IDC_HOSTS                       1012
 #define ID_OPTIONS_ALWAYSONTOP          32775
 #define ID_OPTIONS_FONT                 32776
 #define ID_OPTIONS_SINGLEINSTANCE       32777
@@ -28,14 +44,21 @@
 #define ID_VIEW_SYSTEMCLASSES           32780
 #define ID_VIEW_SYSTEMPROPERTIES        32781
 #define ID_VIEW_NAMESPACESINLIST        32782
+#define ID_VIEW_INDEXREPOSITORY         32783
+#define ID_VIEW_CLASSHIERARCHY          32784
+#define ID_VIEW_QUERY                   32785
+#define ID_VIEW_LIVECOUNTERS            32786
+#define ID_VIEW_EVENTS                  32787
+#define ID_VIEW_DIAGNOSTICS             32788
+#define ID_VIEW_FANOUT                  32789
 
 // Next default values for new objects
 // 
 #ifdef APSTUDIO_INVOKED
 #ifndef APSTUDIO_READONLY_SYMBOLS
-#define _APS_NEXT_RESOURCE_VALUE        212
-#define _APS_NEXT_COMMAND_VALUE         32783
-#define _APS_NEXT_CONTROL_VALUE         1003
+#define _APS_NEXT_RESOURCE_VALUE        218
+#define _APS_NEXT_COMMAND_VALUE         32790
+#define _APS_NEXT_CONTROL_VALUE         1013
 #define _APS_NEXT_SYMED_VALUE           101
 #endif
 #endif